@@ -0,0 +1,418 @@
+// EndToEndBench.cxx : times ImportExport on a generated or given FBX pair.
+//
+// Every run is split into the import of input 1, the import of input 2, the
+// merge and the export (MergeTimings). The best and the average of the runs
+// are reported, the best being the least disturbed by the rest of the machine.
+// With -smooth, input 2 is not read and the smooth normals are generated.
+// With -output uv or color, the tangent basis is built and the smooth normals
+// are written in tangent space, or packed in octahedral components with -pack.
+// With -reader2 native, input 2 is read by the native binary reader (BinaryFbx.h)
+// instead of the SDK, which is the import input 2 phase. With -writer patch, the
+// export phase copies the lighting file with the new tangent layers (BinaryFbxPatch.h);
+// with -writer glb, it writes the meshes to a GLB file (GltfWriter.h). With
+// -compact, the merge phase includes the compaction of the tangent elements
+// (ElementCompaction.h). With -channels, input 2 (or the generated normals) is
+// merged in every channel of the list in one ImportExport call, the sources
+// being imported at the same time. With -mesh-cache, the merged arrays of every
+// mesh are kept in a directory (MeshCache.h): the first run stores them, the
+// next ones read them back, so the merge of the best run is the reuse. With
+// -sidecar, the normals of input 2 are first written to a sidecar (NormalSidecar.h),
+// untimed, which is then mapped instead of importing input 2.
+// With -compare-profiles, every input is first imported with every import
+// profile, to compare their time, the growth of the resident memory (Linux
+// only, approximate: the allocator keeps some of the memory it gets back) and
+// what the scene holds.
+
+#include "SceneGenerator.h"
+#include "../Common/ImportExport.h"
+#include "../Common/MeshCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+    #include <unistd.h>
+#endif
+#if defined(__GLIBC__)
+    #include <malloc.h>
+#endif
+
+static bool gVerbose = false;
+
+// used to show messages from the ImportExport.cxx file
+void UI_Printf(
+               const char* pMsg,
+               ...
+               )
+{
+    if( !gVerbose ) return;
+
+    va_list Arguments;
+    va_start( Arguments, pMsg );
+    vprintf( pMsg, Arguments );
+    va_end( Arguments );
+    printf("\n");
+}
+
+static void PrintUsage()
+{
+    printf("usage: NormalMergerE2E [options]\n"
+           "  -i <file> -s <file>   existing lighting and smooth files, otherwise a pair is generated\n"
+           "  -dir <path>           directory of the generated and merged files (.)\n"
+           "  -repeat <n>           timed runs (3)\n"
+           "  -mesh-threads <n>     threads merging the meshes of a scene (1)\n"
+           "  -smooth <w>           generates the smooth normals, area or angle weighted, instead of reading -s\n"
+           "  -output <c>           tangent, uv or color: where the smooth normals are written (tangent)\n"
+           "  -pack <p>             tangent, oct8 or oct16: encoding of -output uv and color (tangent)\n"
+           "  -import1 <p>          full, static or geometry: import profile of the lighting file (full),\n"
+           "                        static and geometry need -writer patch, tangent outputs and binary FBX\n"
+           "  -import2 <p>          same for the smooth file (geometry)\n"
+           "  -reader2 <r>          sdk or native: reader of the smooth file (sdk)\n"
+           "  -writer <w>           sdk, patch or glb: writer of the merged file (sdk)\n"
+           "  -quantize <q>         float, int16 or int8: attributes of -writer glb (float)\n"
+           "  -compact <d>          indexes the distinct tangents and binormals within <d> (off)\n"
+           "  -channels <c,...>     merges input 2 once per channel in one pass, instead of -output and -pack\n"
+           "  -mesh-cache <dir>     keeps the merged arrays of every mesh in <dir>, emptied first\n"
+           "  -sidecar              writes the normals of input 2 to a sidecar and merges the sidecar\n"
+           "  -compare-profiles     first imports every input with every profile\n"
+           "  -ascii                writes ASCII FBX\n"
+           "  -json <file>          writes the results as JSON, - for stdout\n"
+           "  -v                    prints the messages of the merge\n"
+           "scene generation:\n%s", GetSceneOptionsUsage());
+}
+
+// one line of the report: best and average seconds of a phase
+static void PrintPhase(FILE* pFile, const char* pName, const std::vector<double>& pSeconds)
+{
+    double lBest = pSeconds[0], lSum = 0.0;
+    for( size_t i = 0; i < pSeconds.size(); i++ )
+    {
+        if( pSeconds[i] < lBest ) lBest = pSeconds[i];
+        lSum += pSeconds[i];
+    }
+    fprintf(pFile, "%-16s %10.4f %10.4f\n", pName, lBest, lSum / pSeconds.size());
+}
+
+// resident memory of the process, 0 where it is not known
+static double GetResidentBytes()
+{
+#if defined(__linux__)
+    long lPages = 0, lResident = 0;
+    FILE* lFile = fopen("/proc/self/statm", "r");
+    if( lFile == NULL ) return 0.0;
+    if( fscanf(lFile, "%ld %ld", &lPages, &lResident) != 2 ) lResident = 0;
+    fclose(lFile);
+    return double(lResident) * double(sysconf(_SC_PAGESIZE));
+#else
+    return 0.0;
+#endif
+}
+
+// one import of -compare-profiles
+struct ProfileResult
+{
+    std::string    mFile;
+    EImportProfile mProfile;
+    bool           mLoaded;
+    double         mSeconds;        // best of the runs
+    double         mBytes;          // smallest growth of the resident memory
+    int            mObjects;
+    int            mCurves;
+    int            mMaterials;
+    int            mTextures;
+};
+
+// imports pFile pRepeat times with every profile
+static void CompareProfiles(FbxManager* pSdkManager, const std::string& pFile, int pRepeat, std::vector<ProfileResult>& pResults)
+{
+    const EImportProfile kProfiles[3] = { eImportFull, eImportStatic, eImportGeometry };
+    for( int p = 0; p < 3; p++ )
+    {
+        ProfileResult lResult;
+        lResult.mFile = pFile;
+        lResult.mProfile = kProfiles[p];
+        lResult.mLoaded = true;
+
+        for( int r = 0; r < pRepeat && lResult.mLoaded; r++ )
+        {
+            FbxScene* lScene = FbxScene::Create(pSdkManager, "");
+            double lBefore = GetResidentBytes();
+            std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+            lResult.mLoaded = LoadScene(pSdkManager, lScene, pFile.c_str(), kProfiles[p]);
+            double lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+            double lBytes = GetResidentBytes() - lBefore;
+
+            lResult.mSeconds   = r == 0 ? lSeconds : std::min(lResult.mSeconds, lSeconds);
+            lResult.mBytes     = r == 0 ? lBytes : std::min(lResult.mBytes, lBytes);
+            lResult.mObjects   = lScene->GetSrcObjectCount();
+            lResult.mCurves    = lScene->GetSrcObjectCount<FbxAnimCurve>();
+            lResult.mMaterials = lScene->GetMaterialCount();
+            lResult.mTextures  = lScene->GetTextureCount();
+            lScene->Destroy();
+
+            // gives the freed pages back, so that the next import grows again
+#if defined(__GLIBC__)
+            malloc_trim(0);
+#endif
+        }
+        pResults.push_back(lResult);
+    }
+}
+
+static EImportProfile ParseImportProfile(const char* pName, bool& pValid)
+{
+    if( strcmp(pName, "full") == 0 )     return eImportFull;
+    if( strcmp(pName, "static") == 0 )   return eImportStatic;
+    if( strcmp(pName, "geometry") == 0 ) return eImportGeometry;
+    pValid = false;
+    return eImportFull;
+}
+
+static void WriteJsonPhase(FILE* pFile, const char* pName, const std::vector<double>& pSeconds, bool pLast)
+{
+    fprintf(pFile, "    \"%s\": [", pName);
+    for( size_t i = 0; i < pSeconds.size(); i++ )
+        fprintf(pFile, "%s%.6f", i ? ", " : "", pSeconds[i]);
+    fprintf(pFile, "]%s\n", pLast ? "" : ",");
+}
+
+int main(int argc, char** argv)
+{
+    SceneDesc lDesc;
+    MergeOptions lMergeOptions;
+    std::string lInput, lInput2, lDir = ".";
+    const char* lJsonPath = NULL;
+    int lRepeat = 3;
+    bool lAscii = false;
+    const char* lSmooth = NULL;
+    const char* lOutputChannel = "tangent";
+    const char* lPacking = "tangent";
+    const char* lReader2 = "sdk";
+    const char* lWriter = "sdk";
+    const char* lQuantization = "float";
+    const char* lChannels = NULL;
+    bool lSidecar = false;
+    double lSidecarSeconds = 0.0;
+    bool lCompare = false;
+    bool lValidProfiles = true;
+
+    for( int i = 1; i < argc; i++ )
+    {
+        bool lKnown = false;
+        bool lHasValue = i + 1 < argc;
+
+        if( strcmp(argv[i], "-i") == 0 && lHasValue )                 lInput = argv[++i];
+        else if( strcmp(argv[i], "-s") == 0 && lHasValue )            lInput2 = argv[++i];
+        else if( strcmp(argv[i], "-dir") == 0 && lHasValue )          lDir = argv[++i];
+        else if( strcmp(argv[i], "-repeat") == 0 && lHasValue )       lRepeat = atoi(argv[++i]);
+        else if( strcmp(argv[i], "-mesh-threads") == 0 && lHasValue ) lMergeOptions.mMeshThreads = atoi(argv[++i]);
+        else if( strcmp(argv[i], "-json") == 0 && lHasValue )         lJsonPath = argv[++i];
+        else if( strcmp(argv[i], "-smooth") == 0 && lHasValue )       lSmooth = argv[++i];
+        else if( strcmp(argv[i], "-output") == 0 && lHasValue )       lOutputChannel = argv[++i];
+        else if( strcmp(argv[i], "-pack") == 0 && lHasValue )         lPacking = argv[++i];
+        else if( strcmp(argv[i], "-import1") == 0 && lHasValue )      lMergeOptions.mImportProfile = ParseImportProfile(argv[++i], lValidProfiles);
+        else if( strcmp(argv[i], "-import2") == 0 && lHasValue )      lMergeOptions.mImportProfile2 = ParseImportProfile(argv[++i], lValidProfiles);
+        else if( strcmp(argv[i], "-reader2") == 0 && lHasValue )      lReader2 = argv[++i];
+        else if( strcmp(argv[i], "-writer") == 0 && lHasValue )       lWriter = argv[++i];
+        else if( strcmp(argv[i], "-quantize") == 0 && lHasValue )     lQuantization = argv[++i];
+        else if( strcmp(argv[i], "-compact") == 0 && lHasValue )      lMergeOptions.mCompactTolerance = atof(argv[++i]);
+        else if( strcmp(argv[i], "-channels") == 0 && lHasValue )     lChannels = argv[++i];
+        else if( strcmp(argv[i], "-mesh-cache") == 0 && lHasValue )   lMergeOptions.mMeshCacheDirectory = argv[++i];
+        else if( strcmp(argv[i], "-sidecar") == 0 )                   lSidecar = true;
+        else if( strcmp(argv[i], "-compare-profiles") == 0 )          lCompare = true;
+        else if( strcmp(argv[i], "-ascii") == 0 )                     lAscii = true;
+        else if( strcmp(argv[i], "-v") == 0 )                         gVerbose = true;
+        else if( !ParseSceneOption(argc, argv, i, lDesc, lKnown) )
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if( lSmooth ) lMergeOptions.mSmoothWeighting = strcmp(lSmooth, "angle") == 0 ? eWeightAngle : eWeightArea;
+    lMergeOptions.mPackBits = strcmp(lPacking, "oct8") == 0 ? 8 : strcmp(lPacking, "oct16") == 0 ? 16 : 0;
+    lMergeOptions.mOutput = strcmp(lOutputChannel, "uv") == 0 ? eOutputUV : strcmp(lOutputChannel, "color") == 0 ? eOutputColor : eOutputTangent;
+    lMergeOptions.mNativeReader2 = strcmp(lReader2, "native") == 0;
+    lMergeOptions.mWriter = strcmp(lWriter, "patch") == 0 ? eWriterPatch : strcmp(lWriter, "glb") == 0 ? eWriterGltf : eWriterSdk;
+    lMergeOptions.mQuantization = strcmp(lQuantization, "int16") == 0 ? eGltfInt16 : strcmp(lQuantization, "int8") == 0 ? eGltfInt8 : eGltfFloat;
+    std::vector<MergeSource> lSources;
+    std::string lError;
+    if( lChannels && (!ParseMergeChannels(lChannels, lSources) || !AreMergeSourcesValid(lSources, lError)) )
+    {
+        if( !lError.empty() ) printf("-channels: %s\n", lError.c_str());
+        PrintUsage();
+        return 1;
+    }
+    std::vector<MergeSource> lWritten = lSources;
+    if( lWritten.empty() )
+    {
+        lWritten.resize(1);
+        lWritten[0].mOutput = lMergeOptions.mOutput;
+    }
+    if( !IsImportProfileWritable(lMergeOptions, lWritten, !lAscii, lError) )
+    {
+        printf("-import1: %s\n", lError.c_str());
+        PrintUsage();
+        return 1;
+    }
+
+    if( lRepeat < 1 || lMergeOptions.mMeshThreads < 0 || !lValidProfiles || (!lSmooth && lInput.empty() != lInput2.empty()) ||
+        (lSidecar && lSmooth) ||
+        (lSmooth && strcmp(lSmooth, "area") != 0 && strcmp(lSmooth, "angle") != 0) ||
+        (lMergeOptions.mOutput == eOutputTangent && strcmp(lOutputChannel, "tangent") != 0) ||
+        (lMergeOptions.mPackBits == 0 && strcmp(lPacking, "tangent") != 0) ||
+        (!lMergeOptions.mNativeReader2 && strcmp(lReader2, "sdk") != 0) ||
+        strcmp(lWriter, GetOutputWriterName(lMergeOptions.mWriter)) != 0 ||
+        (lMergeOptions.mQuantization == eGltfFloat && strcmp(lQuantization, "float") != 0) ||
+        (lMergeOptions.mPackBits > 0 && lMergeOptions.mOutput == eOutputTangent) )
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    // the first run stores every mesh
+    if( !lMergeOptions.mMeshCacheDirectory.empty() )
+    {
+        if( !OpenMeshCache(lMergeOptions.mMeshCacheDirectory.c_str()) )
+        {
+            printf("-mesh-cache: cannot write in %s\n", lMergeOptions.mMeshCacheDirectory.c_str());
+            return 1;
+        }
+        ClearMeshCache(lMergeOptions.mMeshCacheDirectory.c_str());
+    }
+
+    MergeContext lContext;
+    InitializeMergeContext(lContext);
+
+    FbxIOPluginRegistry* lRegistry = lContext.mSdkManager->GetIOPluginRegistry();
+    int lFileFormat = lAscii ? lRegistry->FindWriterIDByDescription("FBX ascii (*.fbx)") : lRegistry->GetNativeWriterFormat();
+
+    bool lGenerated = lInput.empty();
+    if( lGenerated )
+    {
+        lInput  = lDir + "/e2e_lighting.fbx";
+        lInput2 = lDir + "/e2e_smooth.fbx";
+
+        std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+        if( !GenerateScenePair(lContext.mSdkManager, lDesc, lInput.c_str(), lInput2.c_str(), lFileFormat) )
+        {
+            DestroyMergeContext(lContext);
+            return 1;
+        }
+        printf("generated %d nodes of %d vertices in %.3f s\n", lDesc.mNodeCount, lDesc.mVertexCount,
+               std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count());
+    }
+    if( lSidecar )
+    {
+        std::string lSidecarPath = lDir + "/e2e_smooth.nms";
+        std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+        if( !WriteSmoothSidecar(lContext, lMergeOptions, lInput2.c_str(), lSidecarPath.c_str()) )
+        {
+            DestroyMergeContext(lContext);
+            return 1;
+        }
+        lSidecarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+        printf("sidecar of %s written in %.3f s\n", lInput2.c_str(), lSidecarSeconds);
+        lInput2 = lSidecarPath;
+    }
+    std::string lOutput = lDir + (lMergeOptions.mWriter == eWriterGltf ? "/e2e_merged.glb" : "/e2e_merged.fbx");
+    for( size_t i = 0; i < lSources.size(); i++ ) lSources[i].mFileName = lSmooth ? "" : lInput2;
+
+    std::vector<ProfileResult> lProfiles;
+    if( lCompare )
+    {
+        CompareProfiles(lContext.mSdkManager, lInput, lRepeat, lProfiles);
+        if( !lSmooth ) CompareProfiles(lContext.mSdkManager, lInput2, lRepeat, lProfiles);
+    }
+
+    std::vector<double> lImport, lImport2, lMerge, lExport, lTotal;
+    bool lStatus = true;
+    for( int r = 0; r < lRepeat && lStatus; r++ )
+    {
+        MergeTimings lTimings;
+        std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+        if( lSources.empty() )
+            lStatus = ImportExport(lContext, lMergeOptions, lInput.c_str(), lSmooth ? NULL : lInput2.c_str(), lOutput.c_str(), lFileFormat, &lTimings);
+        else
+            lStatus = ImportExport(lContext, lMergeOptions, lInput.c_str(), lSources, lOutput.c_str(), lFileFormat, &lTimings);
+        lTotal.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count());
+
+        lImport.push_back(lTimings.mImport);
+        lImport2.push_back(lTimings.mImport2);
+        lMerge.push_back(lTimings.mMerge);
+        lExport.push_back(lTimings.mExport);
+    }
+    DestroyMergeContext(lContext);
+
+    if( !lStatus )
+    {
+        printf("ImportExport failed on %s %s\n", lInput.c_str(), lInput2.c_str());
+        return 2;
+    }
+
+    // the smooth file of a generated pair is not read with -smooth
+    if( lSmooth ) lInput2 = std::string("generated ") + lSmooth;
+    double lInputBytes = double(FbxFileUtils::Size(lInput.c_str())) + (lSmooth ? 0.0 : double(FbxFileUtils::Size(lInput2.c_str())));
+
+    // the table goes to stderr when the JSON is written on stdout
+    FILE* lLog = lJsonPath && strcmp(lJsonPath, "-") == 0 ? stderr : stdout;
+    fprintf(lLog, "%s + %s, %.1f MB, %d runs\n", lInput.c_str(), lInput2.c_str(), lInputBytes / (1024.0 * 1024.0), lRepeat);
+    fprintf(lLog, "%-16s %10s %10s\n", "phase", "best s", "average s");
+    PrintPhase(lLog, "import input 1", lImport);
+    PrintPhase(lLog, "import input 2", lImport2);
+    PrintPhase(lLog, "merge", lMerge);
+    PrintPhase(lLog, "export", lExport);
+    PrintPhase(lLog, "total", lTotal);
+
+    if( !lProfiles.empty() )
+    {
+        fprintf(lLog, "\n%-9s %10s %10s %9s %8s %9s %8s  %s\n", "profile", "best s", "memory MB", "objects", "curves", "materials", "textures", "file");
+        for( size_t i = 0; i < lProfiles.size(); i++ )
+        {
+            const ProfileResult& r = lProfiles[i];
+            fprintf(lLog, "%-9s %10.4f %10.1f %9d %8d %9d %8d  %s%s\n", GetImportProfileName(r.mProfile), r.mSeconds,
+                    r.mBytes / (1024.0 * 1024.0), r.mObjects, r.mCurves, r.mMaterials, r.mTextures, r.mFile.c_str(),
+                    r.mLoaded ? "" : " (failed)");
+        }
+    }
+
+    if( lJsonPath )
+    {
+        FILE* lFile = strcmp(lJsonPath, "-") == 0 ? stdout : fopen(lJsonPath, "w");
+        if( lFile == NULL )
+        {
+            printf("cannot write %s\n", lJsonPath);
+            return 1;
+        }
+        fprintf(lFile, "{\n  \"benchmark\": \"end_to_end\",\n  \"input\": \"%s\",\n  \"input2\": \"%s\",\n"
+                       "  \"input_bytes\": %.0f,\n  \"generated\": %s,\n  \"nodes\": %d,\n  \"depth\": %d,\n  \"vertices\": %d,\n"
+                       "  \"layers\": %d,\n  \"anim_stacks\": %d,\n  \"mesh_threads\": %d,\n  \"output\": \"%s\",\n  \"pack\": \"%s\",\n  \"import1\": \"%s\",\n  \"import2\": \"%s\",\n  \"reader2\": \"%s\",\n  \"writer\": \"%s\",\n  \"quantize\": \"%s\",\n  \"compact\": %g,\n  \"channels\": \"%s\",\n  \"mesh_cache\": %s,\n  \"sidecar\": %s,\n  \"sidecar_seconds\": %.6f,\n  \"seconds\": {\n",
+                lInput.c_str(), lInput2.c_str(), lInputBytes, lGenerated ? "true" : "false", lDesc.mNodeCount, lDesc.mDepth, lDesc.mVertexCount,
+                lDesc.mLayerCount, lDesc.mAnimStackCount, lMergeOptions.mMeshThreads, lOutputChannel, lPacking,
+                GetImportProfileName(lMergeOptions.mImportProfile), GetImportProfileName(lMergeOptions.mImportProfile2), lReader2, lWriter, lQuantization, lMergeOptions.mCompactTolerance, lChannels ? lChannels : "",
+                lMergeOptions.mMeshCacheDirectory.empty() ? "false" : "true", lSidecar ? "true" : "false", lSidecarSeconds);
+        WriteJsonPhase(lFile, "import", lImport, false);
+        WriteJsonPhase(lFile, "import2", lImport2, false);
+        WriteJsonPhase(lFile, "merge", lMerge, false);
+        WriteJsonPhase(lFile, "export", lExport, false);
+        WriteJsonPhase(lFile, "total", lTotal, true);
+        fprintf(lFile, "  },\n  \"profiles\": [\n");
+        for( size_t i = 0; i < lProfiles.size(); i++ )
+        {
+            const ProfileResult& r = lProfiles[i];
+            fprintf(lFile, "    {\"file\": \"%s\", \"profile\": \"%s\", \"loaded\": %s, \"seconds\": %.6f, \"resident_bytes\": %.0f, "
+                           "\"objects\": %d, \"curves\": %d, \"materials\": %d, \"textures\": %d}%s\n",
+                    r.mFile.c_str(), GetImportProfileName(r.mProfile), r.mLoaded ? "true" : "false", r.mSeconds, r.mBytes,
+                    r.mObjects, r.mCurves, r.mMaterials, r.mTextures, i + 1 < lProfiles.size() ? "," : "");
+        }
+        fprintf(lFile, "  ]\n}\n");
+        if( lFile != stdout ) fclose(lFile);
+    }
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+// GenerateScenes.cxx : command line tool writing a synthetic FBX pair.
+
+#include "SceneGenerator.h"
+
+#include <cstdio>
+#include <cstring>
+
+static void PrintUsage()
+{
+    printf("usage: NormalMergerGen [options] <lighting.fbx> <smooth.fbx>\n"
+           "  -ascii                writes ASCII FBX\n%s", GetSceneOptionsUsage());
+}
+
+int main(int argc, char** argv)
+{
+    SceneDesc lDesc;
+    bool lAscii = false;
+    const char* lFiles[2] = { NULL, NULL };
+    int lFileCount = 0;
+
+    for( int i = 1; i < argc; i++ )
+    {
+        bool lKnown = false;
+        if( strcmp(argv[i], "-ascii") == 0 )
+        {
+            lAscii = true;
+        }
+        else if( argv[i][0] == '-' )
+        {
+            if( !ParseSceneOption(argc, argv, i, lDesc, lKnown) )
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if( lFileCount < 2 )
+        {
+            lFiles[lFileCount++] = argv[i];
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if( lFileCount != 2 )
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    FbxManager* lSdkManager = FbxManager::Create();
+    lSdkManager->SetIOSettings(FbxIOSettings::Create(lSdkManager, IOSROOT));
+
+    int lFileFormat = lAscii ? lSdkManager->GetIOPluginRegistry()->FindWriterIDByDescription("FBX ascii (*.fbx)") : -1;
+    bool lStatus = GenerateScenePair(lSdkManager, lDesc, lFiles[0], lFiles[1], lFileFormat);
+    if( lStatus )
+    {
+        printf("%s: %lld bytes\n", lFiles[0], (long long)FbxFileUtils::Size(lFiles[0]));
+        printf("%s: %lld bytes\n", lFiles[1], (long long)FbxFileUtils::Size(lFiles[1]));
+    }
+
+    lSdkManager->Destroy();
+    return lStatus ? 0 : 1;
+}
@@ -0,0 +1,1891 @@
+// MergeBench.cxx : microbenchmark of the normal merge of the core.
+//
+// Runs without the FBX SDK. Every combination of topology, normal mapping,
+// reference mode, size and instruction set is generated and timed. A vertex is
+// one element of the normal layer (a control point or a polygon-vertex, depending
+// on the mapping). The results are checked by NormalMergerTests, not here.
+//
+// With -match, the position matching of the control points (Correspondence.h)
+// is also timed on a copy of every mesh with shuffled control points.
+//
+// With -closest, the closest point sampling (TriangulateMesh, TriangleBvh,
+// SampleSurface) is timed on every mesh: the BVH build, then one query at every
+// used control point and at the center of every well shaped triangle, in mesh order.
+//
+// With -smooth, the smooth normal generation (SmoothNormals.h) is timed on a copy
+// of every mesh with one control point per polygon-vertex, which the welding
+// joins back, for both weightings.
+//
+// With -tangent, the tangent basis (TangentSpace.h) and the XY encoding of the
+// smooth normals are timed on every mesh, with UVs mirrored at the middle column.
+//
+// With -pack, the octahedral packing (PackNormals) is timed on every mesh and
+// instruction set with 8 and 16 bits per component, with the largest angle it
+// returns.
+//
+// With -read, every mesh is written three times in a binary FBX file (SyntheticFbx.h)
+// of version 7.4 and 7.5, raw and compressed, in the -dir directory, which is read
+// back by BinaryFbxFile, which inflates on -threads.
+//
+// With -patch, the same files get new tangent and binormal layers on two of their
+// three meshes (BinaryFbxPatch.h), one with indexed binormals.
+//
+// With -gltf, every mesh is written to a GLB file (GltfWriter.h) under two nodes,
+// with UVs, its smooth normals and three materials, one of them missing, in float,
+// 16 and 8 bit.
+//
+// With -compact, the tangents and binormals merged on every mesh are compacted
+// (ElementCompaction.h) with a 0 and a 1e-3 tolerance.
+//
+// With -cache, the binary FBX file of every mesh is hashed, stored in a result
+// cache (ResultCache.h) of the -dir directory and copied out of it.
+//
+// With -meshcache, the tangents and binormals merged on every mesh are stored in a
+// mesh cache (MeshCache.h) of the -dir directory, then read back, and compared with
+// the time of the merge.
+//
+// With -sidecar, the smooth normals of every mesh are written to a sidecar
+// (NormalSidecar.h) under three node paths, two of them sharing their arrays, and
+// its opening is timed against the native reader on the same meshes in a binary
+// FBX file.
+
+#include "BinaryFbx.h"
+#include "BinaryFbxPatch.h"
+#include "Bvh.h"
+#include "GltfWriter.h"
+#include "Correspondence.h"
+#include "ElementCompaction.h"
+#include "MergeCore.h"
+#include "MergeKernel.h"
+#include "MeshCache.h"
+#include "NormalSidecar.h"
+#include "ResultCache.h"
+#include "SmoothNormals.h"
+#include "SyntheticFbx.h"
+#include "SyntheticMesh.h"
+#include "TangentSpace.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+struct BenchResult
+{
+    SyntheticMeshDesc mDesc;
+    EKernelIsa        mIsa;
+    int               mControlPointCount;
+    int               mPolygonCount;
+    int               mVertexCount;
+    int               mIterations;
+    double            mNsPerVertex;
+    double            mVerticesPerSecond;
+    double            mBytesPerVertex;
+    double            mGigaBytesPerSecond;
+};
+
+struct BenchOptions
+{
+    std::vector<int>                mSizes;
+    std::vector<ESyntheticTopology> mTopologies;
+    std::vector<EElementMapping>    mMappings;
+    std::vector<EElementReference>  mReferences;
+    std::vector<EKernelIsa>         mIsas;
+    double                          mMinSeconds;
+    const char*                     mJsonPath;
+    bool                            mMatch;
+    bool                            mClosest;
+    bool                            mSmooth;
+    bool                            mTangent;
+    bool                            mPack;
+    bool                            mRead;
+    bool                            mPatch;
+    bool                            mGltf;
+    bool                            mCompact;
+    bool                            mCache;
+    bool                            mMeshCache;
+    bool                            mSidecar;
+    const char*                     mDirectory;
+    int                             mThreadCount;
+};
+
+// timing of MatchControlPoints on one mesh
+struct MatchResult
+{
+    SyntheticMeshDesc mDesc;
+    int               mControlPointCount;
+    int               mThreadCount;
+    int               mIterations;
+    double            mNsPerPoint;
+    double            mPointsPerSecond;
+};
+
+// timing of the closest point sampling on one mesh
+struct ClosestResult
+{
+    SyntheticMeshDesc mDesc;
+    int               mTriangleCount;
+    int               mNodeCount;
+    int               mQueryCount;
+    int               mThreadCount;
+    int               mIterations;
+    double            mBuildMs;
+    double            mNsPerQuery;
+    double            mQueriesPerSecond;
+};
+
+// timing of ComputeSmoothNormals on one split mesh
+struct SmoothResult
+{
+    SyntheticMeshDesc mDesc;
+    ESmoothWeighting  mWeighting;
+    int               mControlPointCount;     // of the split mesh
+    int               mWeldedCount;           // of the original mesh
+    int               mThreadCount;
+    int               mIterations;
+    double            mNsPerVertex;
+    double            mVerticesPerSecond;
+};
+
+// timing of ComputeTangentFrames and EncodeTangentSpace on one mesh
+struct TangentResult
+{
+    SyntheticMeshDesc mDesc;
+    int               mVertexCount;           // polygon-vertices
+    int               mThreadCount;
+    int               mIterations;
+    double            mNsPerVertex;
+    double            mVerticesPerSecond;
+};
+
+// timing of PackNormals on one mesh
+struct PackResult
+{
+    SyntheticMeshDesc mDesc;
+    EKernelIsa        mIsa;
+    int               mBits;
+    int               mVertexCount;
+    int               mIterations;
+    double            mNsPerVertex;
+    double            mVerticesPerSecond;
+    double            mMaxAngle;              // degrees, returned by PackNormals
+};
+
+// timing of BinaryFbxFile::Open on one file
+struct ReadResult
+{
+    SyntheticMeshDesc mDesc;
+    int               mVersion;
+    bool              mCompressed;
+    int               mMeshCount;
+    int               mVertexCount;           // polygon-vertices of all the meshes
+    double            mFileBytes;
+    double            mCopiedBytes;           // arrays read outside of the mapping
+    int               mThreadCount;
+    int               mIterations;
+    double            mMsPerOpen;
+    double            mMegaBytesPerSecond;
+};
+
+// timing of WriteGlb on one mesh
+struct GltfResult
+{
+    SyntheticMeshDesc mDesc;
+    EGltfQuantization mQuantization;
+    int               mPolygonVertexCount;
+    int               mVertexCount;           // glTF vertices
+    double            mFileBytes;
+    int               mThreadCount;
+    int               mIterations;
+    double            mMsPerWrite;
+    double            mMegaBytesPerSecond;    // of the file
+};
+
+// timing of CompactElement on the tangents and binormals of one mesh
+struct CompactResult
+{
+    SyntheticMeshDesc mDesc;
+    double            mTolerance;
+    int               mVertexCount;           // tangents and binormals
+    int               mDistinctCount;         // distinct vectors of both
+    double            mSavedBytes;            // of the indexed arrays, as FbxVector4 and int
+    int               mThreadCount;
+    int               mIterations;
+    double            mNsPerVertex;
+    double            mVerticesPerSecond;
+};
+
+// timing of HashFile and ResultCache::Fetch on one file
+struct CacheResult
+{
+    SyntheticMeshDesc mDesc;
+    double            mFileBytes;
+    int               mIterations;
+    double            mMsPerHash;
+    double            mHashMegaBytesPerSecond;
+    double            mFetchMegaBytesPerSecond;
+};
+
+// timing of LoadMeshOutputs against MergeNormals on one mesh
+struct MeshCacheResult
+{
+    SyntheticMeshDesc mDesc;
+    int               mVertexCount;           // tangents and binormals
+    double            mEntryBytes;
+    double            mArrayBytes;            // of the merged arrays
+    int               mIterations;
+    double            mMsPerMerge;
+    double            mMsPerLoad;
+};
+
+// timing of NormalSidecarFile::Open against BinaryFbxFile::Open on the same meshes
+struct SidecarResult
+{
+    SyntheticMeshDesc mDesc;
+    int               mMeshCount;
+    int               mVertexCount;           // smooth normal elements of all the meshes
+    double            mFileBytes;
+    double            mFbxBytes;
+    int               mIterations;
+    double            mMsPerOpen;
+    double            mMsPerFbxOpen;
+};
+
+// timing of WritePatchedFbx on one file
+struct PatchResult
+{
+    SyntheticMeshDesc mDesc;
+    int               mVersion;
+    bool              mCompressed;
+    int               mPatchedCount;          // meshes of the file which get new layers
+    int               mVertexCount;           // polygon-vertices of the patched meshes
+    double            mFileBytes;
+    double            mPatchedBytes;          // size of the patched file
+    int               mThreadCount;
+    int               mIterations;
+    double            mMsPerPatch;
+    double            mMegaBytesPerSecond;    // of the patched file
+};
+
+static void PrintUsage()
+{
+    printf("usage: NormalMergerBench [options]\n"
+           "  -sizes <n,...>        vertex counts, k and m suffixes allowed (1k,10k,100k,1m,10m)\n"
+           "  -topology <t>         tri, quad, mixed or all (all)\n"
+           "  -mapping <m>          cp (by control point), pv (by polygon-vertex) or all (all)\n"
+           "  -reference <r>        direct, index or all (all)\n"
+           "  -isa <i>              best, all, scalar, avx2 or avx512 (best)\n"
+           "  -min-time <seconds>   minimum timed duration of a case (0.2)\n"
+           "  -json <file>          writes the results as JSON, - for stdout\n"
+           "  -match                also times the position matching of the control points\n"
+           "  -closest              also times the closest point sampling\n"
+           "  -smooth               also times the smooth normal generation\n"
+           "  -tangent              also times the tangent basis and the tangent space encoding\n"
+           "  -pack                 also times the octahedral packing, 8 and 16 bits\n"
+           "  -read                 also times the native binary FBX reader\n"
+           "  -patch                also times the binary FBX patch writer\n"
+           "  -gltf                 also times the GLB writer\n"
+           "  -compact              also times the index to direct compaction of the tangents\n"
+           "  -cache                also times the hashing and the copies of the result cache\n"
+           "  -meshcache            also times the mesh cache against the merge\n"
+           "  -sidecar              also times the mapping of the smooth normal sidecar against the native reader\n"
+           "  -dir <path>           directory of the files of -read, -patch, -gltf, -cache, -meshcache and -sidecar (.)\n"
+           "  -threads <n>          threads of the matching, the sampling, the generation, the reader and\n"
+           "                        the compaction, 0 for all cores (0)\n");
+}
+
+// "10k" -> 10000, "1m" -> 1000000, 0 on error
+static int ParseSize(const std::string& pText)
+{
+    char* lEnd = NULL;
+    double lValue = strtod(pText.c_str(), &lEnd);
+    if( lEnd == pText.c_str() ) return 0;
+    if( *lEnd == 'k' || *lEnd == 'K' ) { lValue *= 1e3; lEnd++; }
+    else if( *lEnd == 'm' || *lEnd == 'M' ) { lValue *= 1e6; lEnd++; }
+    if( *lEnd != '\0' || lValue < 1.0 || lValue > 1e9 ) return 0;
+    return int(lValue);
+}
+
+static bool ParseSizes(const char* pText, std::vector<int>& pSizes)
+{
+    pSizes.clear();
+    std::string lText(pText);
+    size_t lStart = 0;
+    while( lStart <= lText.size() )
+    {
+        size_t lEnd = lText.find(',', lStart);
+        if( lEnd == std::string::npos ) lEnd = lText.size();
+
+        int lSize = ParseSize(lText.substr(lStart, lEnd - lStart));
+        if( lSize == 0 ) return false;
+        pSizes.push_back(lSize);
+        lStart = lEnd + 1;
+    }
+    return !pSizes.empty();
+}
+
+static bool ParseOptions(int argc, char** argv, BenchOptions& pOptions)
+{
+    const char* lTopology = "all";
+    const char* lMapping = "all";
+    const char* lReference = "all";
+    const char* lIsa = "best";
+
+    ParseSizes("1k,10k,100k,1m,10m", pOptions.mSizes);
+    pOptions.mMinSeconds = 0.2;
+    pOptions.mJsonPath = NULL;
+    pOptions.mMatch = false;
+    pOptions.mClosest = false;
+    pOptions.mSmooth = false;
+    pOptions.mTangent = false;
+    pOptions.mPack = false;
+    pOptions.mRead = false;
+    pOptions.mPatch = false;
+    pOptions.mGltf = false;
+    pOptions.mCompact = false;
+    pOptions.mCache = false;
+    pOptions.mMeshCache = false;
+    pOptions.mSidecar = false;
+    pOptions.mDirectory = ".";
+    pOptions.mThreadCount = 0;
+
+    for( int i = 1; i < argc; i++ )
+    {
+        if( strcmp(argv[i], "-match") == 0 )
+        {
+            pOptions.mMatch = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-closest") == 0 )
+        {
+            pOptions.mClosest = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-smooth") == 0 )
+        {
+            pOptions.mSmooth = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-tangent") == 0 )
+        {
+            pOptions.mTangent = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-pack") == 0 )
+        {
+            pOptions.mPack = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-read") == 0 )
+        {
+            pOptions.mRead = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-patch") == 0 )
+        {
+            pOptions.mPatch = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-gltf") == 0 )
+        {
+            pOptions.mGltf = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-compact") == 0 )
+        {
+            pOptions.mCompact = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-cache") == 0 )
+        {
+            pOptions.mCache = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-meshcache") == 0 )
+        {
+            pOptions.mMeshCache = true;
+            continue;
+        }
+        if( strcmp(argv[i], "-sidecar") == 0 )
+        {
+            pOptions.mSidecar = true;
+            continue;
+        }
+        if( i + 1 >= argc )
+            return false;
+
+        if( strcmp(argv[i], "-sizes") == 0 )
+        {
+            if( !ParseSizes(argv[++i], pOptions.mSizes) ) return false;
+        }
+        else if( strcmp(argv[i], "-topology") == 0 )  lTopology = argv[++i];
+        else if( strcmp(argv[i], "-mapping") == 0 )   lMapping = argv[++i];
+        else if( strcmp(argv[i], "-reference") == 0 ) lReference = argv[++i];
+        else if( strcmp(argv[i], "-isa") == 0 )       lIsa = argv[++i];
+        else if( strcmp(argv[i], "-min-time") == 0 )  pOptions.mMinSeconds = atof(argv[++i]);
+        else if( strcmp(argv[i], "-json") == 0 )      pOptions.mJsonPath = argv[++i];
+        else if( strcmp(argv[i], "-dir") == 0 )       pOptions.mDirectory = argv[++i];
+        else if( strcmp(argv[i], "-threads") == 0 )   pOptions.mThreadCount = atoi(argv[++i]);
+        else
+            return false;
+    }
+
+    bool lAll = strcmp(lTopology, "all") == 0;
+    if( lAll || strcmp(lTopology, "tri") == 0 )   pOptions.mTopologies.push_back(eTopologyTriangles);
+    if( lAll || strcmp(lTopology, "quad") == 0 )  pOptions.mTopologies.push_back(eTopologyQuads);
+    if( lAll || strcmp(lTopology, "mixed") == 0 ) pOptions.mTopologies.push_back(eTopologyMixed);
+
+    lAll = strcmp(lMapping, "all") == 0;
+    if( lAll || strcmp(lMapping, "cp") == 0 ) pOptions.mMappings.push_back(eMapByControlPoint);
+    if( lAll || strcmp(lMapping, "pv") == 0 ) pOptions.mMappings.push_back(eMapByPolygonVertex);
+
+    lAll = strcmp(lReference, "all") == 0;
+    if( lAll || strcmp(lReference, "direct") == 0 ) pOptions.mReferences.push_back(eRefDirect);
+    if( lAll || strcmp(lReference, "index") == 0 )  pOptions.mReferences.push_back(eRefIndexToDirect);
+
+    EKernelIsa lSupported = GetSupportedKernelIsa();
+    if( strcmp(lIsa, "best") == 0 )
+        pOptions.mIsas.push_back(lSupported);
+    for( int i = eKernelScalar; i <= lSupported; i++ )
+    {
+        if( strcmp(lIsa, "all") == 0 || strcmp(lIsa, GetKernelIsaName(EKernelIsa(i))) == 0 )
+            pOptions.mIsas.push_back(EKernelIsa(i));
+    }
+
+    return !pOptions.mTopologies.empty() && !pOptions.mMappings.empty() && !pOptions.mReferences.empty() &&
+           !pOptions.mIsas.empty() && pOptions.mMinSeconds >= 0.0 && pOptions.mThreadCount >= 0;
+}
+
+// vector reads and writes of one element, FbxVector4 arrays and int indices
+static double GetBytesPerVertex(EElementReference pReference)
+{
+    double lIndexBytes = pReference == eRefIndexToDirect ? 2 * sizeof(int) : 0;
+    return 4 * 4 * sizeof(double) + lIndexBytes;
+}
+
+static void RunCase(const SyntheticMesh& pMesh, EKernelIsa pIsa, double pMinSeconds, BenchResult& pResult)
+{
+    int lCount = GetElementCount(pMesh.mView, pMesh.mSource.mMapping);
+    std::vector<double> lTangents(size_t(lCount) * 4), lBinormals(size_t(lCount) * 4);
+    ElementOutput lTangentOutput  = { &lTangents[0],  lCount, 4 };
+    ElementOutput lBinormalOutput = { &lBinormals[0], lCount, 4 };
+
+    SetKernelIsa(pIsa);
+
+    // first run touches the output pages and is not timed
+    MergeNormals(pMesh.mView, pMesh.mSource, lTangentOutput, lBinormalOutput, 0.0, 0, lCount);
+
+    int lIterations = 0;
+    double lSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        MergeNormals(pMesh.mView, pMesh.mSource, lTangentOutput, lBinormalOutput, 0.0, 0, lCount);
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+
+    double lVertices = double(lCount) * lIterations;
+
+    pResult.mIsa                = pIsa;
+    pResult.mControlPointCount  = pMesh.mView.mControlPointCount;
+    pResult.mPolygonCount       = pMesh.mView.mPolygonCount;
+    pResult.mVertexCount        = lCount;
+    pResult.mIterations         = lIterations;
+    pResult.mNsPerVertex        = lSeconds * 1e9 / lVertices;
+    pResult.mVerticesPerSecond  = lVertices / lSeconds;
+    pResult.mBytesPerVertex     = GetBytesPerVertex(pMesh.mSource.mReference);
+    pResult.mGigaBytesPerSecond = pResult.mBytesPerVertex * lVertices / lSeconds * 1e-9;
+}
+
+// matches pMesh against a copy with its control points shuffled
+static void RunMatchCase(const SyntheticMesh& pMesh, WorkStealingPool& pPool, double pMinSeconds, MatchResult& pResult)
+{
+    const MeshView& lView = pMesh.mView;
+    int lCount = lView.mControlPointCount;
+
+    // lShuffle[c] is the new place of the control point c
+    std::vector<int> lShuffle(lCount);
+    for( int i = 0; i < lCount; i++ ) lShuffle[i] = i;
+    unsigned lSeed = 12345u;
+    for( int i = lCount - 1; i > 0; i-- )
+    {
+        lSeed = lSeed * 1664525u + 1013904223u;
+        std::swap(lShuffle[i], lShuffle[lSeed % unsigned(i + 1)]);
+    }
+
+    std::vector<double> lPositions(size_t(lCount) * 4);
+    for( int i = 0; i < lCount; i++ )
+        memcpy(&lPositions[size_t(lShuffle[i]) * 4], lView.mPositions + size_t(i) * lView.mPositionStride, 4 * sizeof(double));
+
+    int lPolygonVertexCount = lView.mPolygonStarts[lView.mPolygonCount];
+    std::vector<int> lPolygonVertices(lPolygonVertexCount);
+    for( int i = 0; i < lPolygonVertexCount; i++ ) lPolygonVertices[i] = lShuffle[lView.mPolygonVertices[i]];
+
+    MeshView lShuffled = lView;
+    lShuffled.mPositions       = &lPositions[0];
+    lShuffled.mPositionStride  = 4;
+    lShuffled.mPolygonVertices = &lPolygonVertices[0];
+
+    std::vector<int> lMatches;
+    int lIterations = 0;
+    double lSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        MatchControlPoints(lView, lShuffled, 1e-4, &pPool, lMatches);
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+
+    pResult.mControlPointCount = lCount;
+    pResult.mThreadCount       = pPool.GetThreadCount();
+    pResult.mIterations        = lIterations;
+    pResult.mNsPerPoint        = lSeconds * 1e9 / (double(lCount) * lIterations);
+    pResult.mPointsPerSecond   = double(lCount) * lIterations / lSeconds;
+}
+
+// samples the smooth normals of pMesh at its used control points and its triangle centers
+static void RunClosestCase(const SyntheticMesh& pMesh, WorkStealingPool& pPool, double pMinSeconds, ClosestResult& pResult)
+{
+    const MeshView& lView = pMesh.mView;
+
+    std::vector<double> lCorners, lCornerValues;
+    TriangulateMesh(lView, pMesh.mSource, lCorners, lCornerValues);
+    int lTriangleCount = int(lCorners.size() / 9);
+
+    // the queries, control points and triangles in mesh order
+    std::vector<char> lUsed(lView.mControlPointCount, 0);
+    for( int i = 0; i < lView.mPolygonStarts[lView.mPolygonCount]; i++ ) lUsed[lView.mPolygonVertices[i]] = 1;
+
+    std::vector<double> lQueries;
+    for( int i = 0; i < lView.mControlPointCount; i++ )
+    {
+        if( !lUsed[i] ) continue;
+        lQueries.insert(lQueries.end(), lView.mPositions + size_t(i) * lView.mPositionStride, lView.mPositions + size_t(i) * lView.mPositionStride + 3);
+    }
+    for( int t = 0; t < lTriangleCount; t++ )
+    {
+        // the closest point of slivers (fans over collinear points of the mixed
+        // polygons) is ill conditioned, their centers are left out
+        const double* a = &lCorners[size_t(t) * 9];
+        double ab[3], ac[3], bc[3];
+        for( int c = 0; c < 3; c++ )
+        {
+            ab[c] = a[3 + c] - a[c];
+            ac[c] = a[6 + c] - a[c];
+            bc[c] = a[6 + c] - a[3 + c];
+        }
+        double n[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+        double lLongest2 = std::max(std::max(ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2], ac[0] * ac[0] + ac[1] * ac[1] + ac[2] * ac[2]),
+                                    bc[0] * bc[0] + bc[1] * bc[1] + bc[2] * bc[2]);
+        if( std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) < 0.1 * lLongest2 ) continue;
+
+        for( int c = 0; c < 3; c++ )
+            lQueries.push_back((lCorners[size_t(t) * 9 + c] + lCorners[size_t(t) * 9 + 3 + c] + lCorners[size_t(t) * 9 + 6 + c]) / 3.0);
+    }
+    int lQueryCount = int(lQueries.size() / 3);
+
+    // a mesh of points only, sampled by control point
+    int lNoPolygon = 0;
+    MeshView lTarget = lView;
+    lTarget.mPositions         = &lQueries[0];
+    lTarget.mPositionStride    = 3;
+    lTarget.mControlPointCount = lQueryCount;
+    lTarget.mPolygonVertices   = NULL;
+    lTarget.mPolygonStarts     = &lNoPolygon;
+    lTarget.mPolygonCount      = 0;
+
+    std::vector<double> lValues;
+    int lIterations = 0;
+    int lNodeCount = 0;
+    double lBuildSeconds = 0.0, lQuerySeconds = 0.0;
+    do
+    {
+        std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+        TriangleBvh lBvh(lCorners, &pPool);
+        std::chrono::steady_clock::time_point lBuilt = std::chrono::steady_clock::now();
+        SampleSurface(lBvh, lCornerValues, lTarget, eMapByControlPoint, &pPool, lValues);
+
+        lBuildSeconds += std::chrono::duration<double>(lBuilt - lStart).count();
+        lQuerySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - lBuilt).count();
+        lNodeCount = lBvh.GetNodeCount();
+        lIterations++;
+    }
+    while( lBuildSeconds + lQuerySeconds < pMinSeconds );
+
+    pResult.mTriangleCount    = lTriangleCount;
+    pResult.mNodeCount        = lNodeCount;
+    pResult.mQueryCount       = lQueryCount;
+    pResult.mThreadCount      = pPool.GetThreadCount();
+    pResult.mIterations       = lIterations;
+    pResult.mBuildMs          = lBuildSeconds * 1e3 / lIterations;
+    pResult.mNsPerQuery       = lQuerySeconds * 1e9 / (double(lQueryCount) * lIterations);
+    pResult.mQueriesPerSecond = double(lQueryCount) * lIterations / lQuerySeconds;
+}
+
+// generates the smooth normals of a copy of pMesh with one control point per polygon-vertex
+static void RunSmoothCase(const SyntheticMesh& pMesh, ESmoothWeighting pWeighting, WorkStealingPool& pPool, double pMinSeconds, SmoothResult& pResult)
+{
+    const MeshView& lView = pMesh.mView;
+    int lPolygonVertexCount = lView.mPolygonStarts[lView.mPolygonCount];
+
+    std::vector<double> lPositions(size_t(lPolygonVertexCount) * 4);
+    std::vector<int> lPolygonVertices(lPolygonVertexCount);
+    for( int i = 0; i < lPolygonVertexCount; i++ )
+    {
+        memcpy(&lPositions[size_t(i) * 4], lView.mPositions + size_t(lView.mPolygonVertices[i]) * lView.mPositionStride, 4 * sizeof(double));
+        lPolygonVertices[i] = i;
+    }
+
+    MeshView lSplit = lView;
+    lSplit.mPositions         = &lPositions[0];
+    lSplit.mPositionStride    = 4;
+    lSplit.mControlPointCount = lPolygonVertexCount;
+    lSplit.mPolygonVertices   = &lPolygonVertices[0];
+
+    std::vector<double> lNormals;
+    int lIterations = 0;
+    double lSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        ComputeSmoothNormals(lSplit, pWeighting, 1e-4, &pPool, lNormals);
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+
+    pResult.mWeighting         = pWeighting;
+    pResult.mControlPointCount = lPolygonVertexCount;
+    pResult.mWeldedCount       = lView.mControlPointCount;
+    pResult.mThreadCount       = pPool.GetThreadCount();
+    pResult.mIterations        = lIterations;
+    pResult.mNsPerVertex       = lSeconds * 1e9 / (double(lPolygonVertexCount) * lIterations);
+    pResult.mVerticesPerSecond = double(lPolygonVertexCount) * lIterations / lSeconds;
+}
+
+// builds the tangent basis of pMesh (by control point normals) and encodes its smooth normals
+static void RunTangentCase(const SyntheticMesh& pMesh, WorkStealingPool& pPool, double pMinSeconds, TangentResult& pResult)
+{
+    const MeshView& lView = pMesh.mView;
+    int lVertexCount = lView.mPolygonStarts[lView.mPolygonCount];
+
+    // U mirrored at a half column, so that no control point is on the mirror line
+    double lMirror = 0.0;
+    for( int i = 0; i < lView.mControlPointCount; i++ ) lMirror = std::max(lMirror, lView.mPositions[size_t(i) * 4]);
+    lMirror = std::floor(lMirror * 0.5) + 0.5;
+
+    std::vector<double> lUVValues(size_t(lView.mControlPointCount) * 2);
+    for( int i = 0; i < lView.mControlPointCount; i++ )
+    {
+        lUVValues[size_t(i) * 2]     = std::fabs(lView.mPositions[size_t(i) * 4] - lMirror);
+        lUVValues[size_t(i) * 2 + 1] = lView.mPositions[size_t(i) * 4 + 2];
+    }
+    ElementView lUVs = { eMapByControlPoint, eRefDirect, &lUVValues[0], lView.mControlPointCount, 2, NULL, 0 };
+
+    std::vector<double> lFrames, lTangents(size_t(lVertexCount) * 4), lBinormals(size_t(lVertexCount) * 4);
+    std::vector<double> lEncoded(size_t(lVertexCount) * 2);
+    ElementOutput lTangentOutput  = { &lTangents[0], lVertexCount, 4 };
+    ElementOutput lBinormalOutput = { &lBinormals[0], lVertexCount, 4 };
+    ElementOutput lEncodedOutput  = { &lEncoded[0], lVertexCount, 2 };
+
+    std::function<void(int, int)> lEncode = [&](int pBegin, int pEnd)
+    {
+        EncodeTangentSpace(lView, pMesh.mSource, lFrames, eEncodeXY, lTangentOutput, lBinormalOutput, 0.0, lEncodedOutput, pBegin, pEnd);
+    };
+
+    int lIterations = 0;
+    double lSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        ComputeTangentFrames(lView, lUVs, &pPool, lFrames);
+        pPool.ParallelFor(0, lView.mPolygonCount, 16 * 1024, lEncode);
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+
+    pResult.mVertexCount       = lVertexCount;
+    pResult.mThreadCount       = pPool.GetThreadCount();
+    pResult.mIterations        = lIterations;
+    pResult.mNsPerVertex       = lSeconds * 1e9 / (double(lVertexCount) * lIterations);
+    pResult.mVerticesPerSecond = double(lVertexCount) * lIterations / lSeconds;
+}
+
+// packs the smooth normals of pMesh with pBits bits per component
+static void RunPackCase(const SyntheticMesh& pMesh, EKernelIsa pIsa, int pBits, double pMinSeconds, PackResult& pResult)
+{
+    int lCount = GetElementCount(pMesh.mView, pMesh.mSource.mMapping);
+    std::vector<double> lPacked(size_t(lCount) * 2);
+    ElementOutput lPackedOutput = { &lPacked[0], lCount, 2 };
+
+    SetKernelIsa(pIsa);
+    PackNormals(pMesh.mView, pMesh.mSource, pBits, lPackedOutput, 0, lCount);
+
+    int lIterations = 0;
+    double lSeconds = 0.0, lMaxAngle = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        lMaxAngle = PackNormals(pMesh.mView, pMesh.mSource, pBits, lPackedOutput, 0, lCount);
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+
+    double lVertices = double(lCount) * lIterations;
+
+    pResult.mIsa               = pIsa;
+    pResult.mBits              = pBits;
+    pResult.mVertexCount       = lCount;
+    pResult.mIterations        = lIterations;
+    pResult.mNsPerVertex       = lSeconds * 1e9 / lVertices;
+    pResult.mVerticesPerSecond = lVertices / lSeconds;
+    pResult.mMaxAngle          = lMaxAngle;
+}
+
+// merges the normals of pMesh and compacts the tangents and the binormals
+static void RunCompactCase(const SyntheticMesh& pMesh, double pTolerance, WorkStealingPool& pPool, double pMinSeconds, CompactResult& pResult)
+{
+    int lCount = GetElementCount(pMesh.mView, pMesh.mSource.mMapping);
+    std::vector<double> lVectors[2];
+    lVectors[0].resize(size_t(lCount) * 4);
+    lVectors[1].resize(size_t(lCount) * 4);
+    ElementOutput lTangentOutput  = { &lVectors[0][0], lCount, 4 };
+    ElementOutput lBinormalOutput = { &lVectors[1][0], lCount, 4 };
+    MergeNormals(pMesh.mView, pMesh.mSource, lTangentOutput, lBinormalOutput, 0.0, 0, lCount);
+
+    std::vector<int> lIndex[2], lFirst[2];
+    int lIterations = 0;
+    double lSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        for( int v = 0; v < 2; v++ ) CompactElement(&lVectors[v][0], lCount, 4, 4, pTolerance, &pPool, lIndex[v], lFirst[v]);
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+
+    int lDistinct = 0;
+    double lSaved = 0.0;
+    for( int v = 0; v < 2; v++ )
+    {
+        lDistinct += int(lFirst[v].size());
+        lSaved += double(lCount - int(lFirst[v].size())) * 4 * sizeof(double) - double(lCount) * sizeof(int);
+    }
+
+    double lVertices = 2.0 * lCount * lIterations;
+
+    pResult.mTolerance         = pTolerance;
+    pResult.mVertexCount       = 2 * lCount;
+    pResult.mDistinctCount     = lDistinct;
+    pResult.mSavedBytes        = lSaved;
+    pResult.mThreadCount       = pPool.GetThreadCount();
+    pResult.mIterations        = lIterations;
+    pResult.mNsPerVertex       = lSeconds * 1e9 / lVertices;
+    pResult.mVerticesPerSecond = lVertices / lSeconds;
+}
+
+// writes pMesh three times in a binary FBX file and reads it back
+static void RunReadCase(
+                        const SyntheticMesh& pMesh,
+                        const char* pDirectory,
+                        int pVersion,
+                        bool pCompress,
+                        WorkStealingPool& pPool,
+                        double pMinSeconds,
+                        ReadResult& pResult
+                        )
+{
+    const int kMeshCount = 3;
+    std::vector<const SyntheticMesh*> lMeshes(kMeshCount, &pMesh);
+    std::vector<std::string> lNames;
+    for( int i = 0; i < kMeshCount; i++ ) lNames.push_back("Smooth" + std::to_string(i));
+
+    std::string lPath = std::string(pDirectory) + "/mergebench_read.fbx";
+    if( !WriteSyntheticFbx(lPath.c_str(), pVersion, pCompress, lMeshes, lNames) ) printf("cannot write %s\n", lPath.c_str());
+
+    BinaryFbxFile lFile;
+    lFile.Open(lPath.c_str(), &pPool);
+    double lFileBytes = double(lFile.GetFileSize());
+    double lCopiedBytes = double(lFile.GetCopiedBytes());
+    lFile.Close();
+
+    int lIterations = 0;
+    double lSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        lFile.Open(lPath.c_str(), &pPool);
+        lFile.Close();
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+    remove(lPath.c_str());
+
+    pResult.mVersion            = pVersion;
+    pResult.mCompressed         = pCompress;
+    pResult.mMeshCount          = kMeshCount;
+    pResult.mVertexCount        = kMeshCount * pMesh.mView.mPolygonStarts[pMesh.mView.mPolygonCount];
+    pResult.mFileBytes          = lFileBytes;
+    pResult.mCopiedBytes        = lCopiedBytes;
+    pResult.mThreadCount        = pPool.GetThreadCount();
+    pResult.mIterations         = lIterations;
+    pResult.mMsPerOpen          = lSeconds * 1e3 / lIterations;
+    pResult.mMegaBytesPerSecond = lFileBytes * lIterations / lSeconds / (1024.0 * 1024.0);
+}
+
+// new layer values of the mesh pMesh of a file: xyzw by element of the mapping of its
+// normals, indexed through pIndex if it is not empty
+static void BuildPatchValues(const MeshView& pMesh, int pSeed, bool pIndexed, std::vector<double>& pValues, std::vector<int>& pIndex)
+{
+    int lCount = GetElementCount(pMesh, pMesh.mNormals.mMapping);
+    int lDirectCount = pIndexed ? lCount / 2 + 1 : lCount;
+    pValues.resize(size_t(lDirectCount) * 4);
+    for( int i = 0; i < lDirectCount; i++ )
+    {
+        pValues[4 * size_t(i)]     = 0.25 * i + pSeed;
+        pValues[4 * size_t(i) + 1] = -0.5 * i;
+        pValues[4 * size_t(i) + 2] = 1.0 / (i + 1);
+        pValues[4 * size_t(i) + 3] = (i + pSeed) % 2 == 0 ? 1.0 : -1.0;
+    }
+    pIndex.clear();
+    for( int i = 0; i < lCount && pIndexed; i++ ) pIndex.push_back(i / 2);
+}
+
+static ElementView GetPatchView(EElementMapping pMapping, const std::vector<double>& pValues, const std::vector<int>& pIndex)
+{
+    ElementView lView;
+    lView.mMapping     = pMapping;
+    lView.mReference   = pIndex.empty() ? eRefDirect : eRefIndexToDirect;
+    lView.mDirect      = pValues.empty() ? NULL : &pValues[0];
+    lView.mDirectCount = int(pValues.size() / 4);
+    lView.mStride      = 4;
+    lView.mIndex       = pIndex.empty() ? NULL : &pIndex[0];
+    lView.mIndexCount  = int(pIndex.size());
+    return lView;
+}
+
+// the bytes of a file
+static bool ReadFileBytes(const std::string& pFile, std::vector<unsigned char>& pData)
+{
+    FILE* lFile = fopen(pFile.c_str(), "rb");
+    if( lFile == NULL ) return false;
+    fseek(lFile, 0, SEEK_END);
+    pData.resize(size_t(ftell(lFile)));
+    fseek(lFile, 0, SEEK_SET);
+    bool lRead = pData.empty() || fread(&pData[0], 1, pData.size(), lFile) == pData.size();
+    fclose(lFile);
+    return lRead;
+}
+
+// writes pMesh in a binary FBX file, hashes it and goes through the entries of a cache
+static void RunCacheCase(const SyntheticMesh& pMesh, const char* pDirectory, double pMinSeconds, CacheResult& pResult)
+{
+    std::vector<const SyntheticMesh*> lMeshes(1, &pMesh);
+    std::vector<std::string> lNames(1, "Lighting");
+    std::string lPath = std::string(pDirectory) + "/mergebench_cache.fbx";
+    std::string lCopy = std::string(pDirectory) + "/mergebench_cache_copy.fbx";
+    std::string lCacheDirectory = std::string(pDirectory) + "/mergebench_cache";
+
+    std::vector<unsigned char> lData;
+    if( !WriteSyntheticFbx(lPath.c_str(), 7500, false, lMeshes, lNames) ) printf("cannot write %s\n", lPath.c_str());
+    ReadFileBytes(lPath, lData);
+
+    std::string lDigest;
+    int lIterations = 0;
+    double lSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        HashFile(lPath.c_str(), lDigest);
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+
+    // the copy of an entry out of the cache
+    std::string lError;
+    double lFetchSeconds = 0.0;
+    int lFetches = 0;
+    {
+        ResultCache lCache;
+        if( !lCache.Open(lCacheDirectory.c_str(), lData.size() * 2, lError) ) printf("%s\n", lError.c_str());
+        lCache.Clear();
+        lCache.Store(lDigest, lPath.c_str());
+
+        lStart = std::chrono::steady_clock::now();
+        do
+        {
+            lCache.Fetch(lDigest, lCopy.c_str());
+            lFetches++;
+            lFetchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+        }
+        while( lFetchSeconds < pMinSeconds );
+        lCache.Clear();
+    }
+    remove(lCopy.c_str());
+    remove(lPath.c_str());
+    rmdir(lCacheDirectory.c_str());
+
+    pResult.mFileBytes               = double(lData.size());
+    pResult.mIterations              = lIterations;
+    pResult.mMsPerHash               = lSeconds * 1e3 / lIterations;
+    pResult.mHashMegaBytesPerSecond  = double(lData.size()) * lIterations / lSeconds / (1024.0 * 1024.0);
+    pResult.mFetchMegaBytesPerSecond = double(lData.size()) * lFetches / lFetchSeconds / (1024.0 * 1024.0);
+}
+
+// fingerprint of the geometry of pMesh and of pSource
+static std::string GetMeshKey(const MeshView& pMesh, const ElementView& pSource)
+{
+    ContentHash lHash;
+    AddMeshGeometry(lHash, pMesh);
+    AddElementValues(lHash, pSource);
+    return lHash.GetDigest();
+}
+
+// merges pMesh, stores its tangents and binormals in a mesh cache and reads them back
+static void RunMeshCacheCase(const SyntheticMesh& pMesh, const char* pDirectory, WorkStealingPool& pPool, double pMinSeconds, MeshCacheResult& pResult)
+{
+    int lCount = GetElementCount(pMesh.mView, pMesh.mSource.mMapping);
+    std::vector<double> lVectors[2], lLoaded[2];
+    std::vector<ElementOutput> lOutputs(2), lLoadOutputs(2);
+    for( int v = 0; v < 2; v++ )
+    {
+        lVectors[v].resize(size_t(lCount) * 4);
+        lLoaded[v].assign(size_t(lCount) * 4, 0.0);
+        ElementOutput lOutput = { &lVectors[v][0], lCount, 4 };
+        ElementOutput lLoadOutput = { &lLoaded[v][0], lCount, 4 };
+        lOutputs[v] = lOutput;
+        lLoadOutputs[v] = lLoadOutput;
+    }
+
+    int lMerges = 0;
+    double lMergeSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        MergeNormals(pMesh.mView, pMesh.mSource, lOutputs[0], lOutputs[1], 0.0, 0, lCount);
+        lMerges++;
+        lMergeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lMergeSeconds < pMinSeconds );
+
+    std::string lDirectory = std::string(pDirectory) + "/mergebench_mesh_cache";
+    std::string lKey = GetMeshKey(pMesh.mView, pMesh.mSource);
+    if( !OpenMeshCache(lDirectory.c_str()) ) printf("cannot write in %s\n", lDirectory.c_str());
+    unsigned long long lEntryBytes = StoreMeshOutputs(lDirectory.c_str(), lKey, lOutputs, 1.5, &pPool);
+
+    int lLoads = 0;
+    double lLoadSeconds = 0.0;
+    double lMaxAngle = 0.0;
+    lStart = std::chrono::steady_clock::now();
+    do
+    {
+        LoadMeshOutputs(lDirectory.c_str(), lKey, lLoadOutputs, lMaxAngle);
+        lLoads++;
+        lLoadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lLoadSeconds < pMinSeconds );
+    ClearMeshCache(lDirectory.c_str());
+    rmdir(lDirectory.c_str());
+
+    pResult.mVertexCount = 2 * lCount;
+    pResult.mEntryBytes  = double(lEntryBytes);
+    pResult.mArrayBytes  = 2.0 * lCount * 4 * sizeof(double);
+    pResult.mIterations  = lLoads;
+    pResult.mMsPerMerge  = lMergeSeconds * 1e3 / lMerges;
+    pResult.mMsPerLoad   = lLoadSeconds * 1e3 / lLoads;
+}
+
+// writes the smooth normals of pMesh to a sidecar under three paths, maps it and compares
+// with the native reader on the same meshes
+static void RunSidecarCase(const SyntheticMesh& pMesh, const char* pDirectory, WorkStealingPool& pPool, double pMinSeconds, SidecarResult& pResult)
+{
+    const int kMeshCount = 3;
+    const char* kPaths[kMeshCount] = { "Root/Smooth0", "Root/Group/Smooth1", "Root/Group/Smooth2" };
+    std::string lPath = std::string(pDirectory) + "/mergebench_sidecar.nms";
+    std::string lFbxPath = std::string(pDirectory) + "/mergebench_sidecar.fbx";
+
+    // the first mesh has its own copy of the arrays, the two others share theirs
+    std::vector<double> lValues(pMesh.mSmoothNormals);
+    std::vector<NormalSidecarMesh> lMeshes(kMeshCount);
+    for( int i = 0; i < kMeshCount; i++ )
+    {
+        lMeshes[i].mPath               = kPaths[i];
+        lMeshes[i].mControlPointCount  = pMesh.mView.mControlPointCount;
+        lMeshes[i].mPolygonCount       = pMesh.mView.mPolygonCount;
+        lMeshes[i].mPolygonVertexCount = pMesh.mView.mPolygonStarts[pMesh.mView.mPolygonCount];
+        lMeshes[i].mNormals            = pMesh.mSource;
+    }
+    lMeshes[0].mNormals.mDirect = &lValues[0];
+
+    std::string lError;
+    NormalSidecarFile lFile;
+    if( !WriteNormalSidecar(lPath.c_str(), lMeshes, lError) ) printf("%s\n", lError.c_str());
+    lFile.Open(lPath.c_str());
+    double lFileBytes = double(lFile.GetFileSize());
+    lFile.Close();
+
+    int lIterations = 0;
+    double lSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        lFile.Open(lPath.c_str());
+        lFile.FindMesh(kPaths[2]);
+        lFile.Close();
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+
+    // the same meshes read natively from a binary FBX file
+    std::vector<const SyntheticMesh*> lFbxMeshes(kMeshCount, &pMesh);
+    std::vector<std::string> lNames;
+    for( int i = 0; i < kMeshCount; i++ ) lNames.push_back("Smooth" + std::to_string(i));
+    BinaryFbxFile lFbxFile;
+    if( !WriteSyntheticFbx(lFbxPath.c_str(), 7500, false, lFbxMeshes, lNames) ) printf("cannot write %s\n", lFbxPath.c_str());
+    double lFbxBytes = 0.0;
+    int lFbxIterations = 0;
+    double lFbxSeconds = 0.0;
+    lStart = std::chrono::steady_clock::now();
+    do
+    {
+        lFbxFile.Open(lFbxPath.c_str(), &pPool);
+        lFbxFile.FindMesh(lNames[2].c_str());
+        lFbxBytes = double(lFbxFile.GetFileSize());
+        lFbxFile.Close();
+        lFbxIterations++;
+        lFbxSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lFbxSeconds < pMinSeconds );
+    remove(lPath.c_str());
+    remove(lFbxPath.c_str());
+
+    pResult.mMeshCount    = kMeshCount;
+    pResult.mVertexCount  = kMeshCount * GetElementCount(pMesh.mView, pMesh.mSource.mMapping);
+    pResult.mFileBytes    = lFileBytes;
+    pResult.mFbxBytes     = lFbxBytes;
+    pResult.mIterations   = lIterations;
+    pResult.mMsPerOpen    = lSeconds * 1e3 / lIterations;
+    pResult.mMsPerFbxOpen = lFbxSeconds * 1e3 / lFbxIterations;
+}
+
+// writes pMesh three times in a binary FBX file and patches the layers of two of them
+static void RunPatchCase(
+                         const SyntheticMesh& pMesh,
+                         const char* pDirectory,
+                         int pVersion,
+                         bool pCompress,
+                         WorkStealingPool& pPool,
+                         double pMinSeconds,
+                         PatchResult& pResult
+                         )
+{
+    const int kMeshCount = 3;
+    const int kPatchedCount = 2;
+    std::vector<const SyntheticMesh*> lMeshes(kMeshCount, &pMesh);
+    std::vector<std::string> lNames;
+    for( int i = 0; i < kMeshCount; i++ ) lNames.push_back("Lighting" + std::to_string(i));
+
+    std::string lPath = std::string(pDirectory) + "/mergebench_patch.fbx";
+    std::string lPatched = std::string(pDirectory) + "/mergebench_patched.fbx";
+    if( !WriteSyntheticFbx(lPath.c_str(), pVersion, pCompress, lMeshes, lNames) ) printf("cannot write %s\n", lPath.c_str());
+
+    BinaryFbxFile lFile;
+    lFile.Open(lPath.c_str(), &pPool);
+
+    // Lighting0 gets direct layers, Lighting1 indexed binormals, Lighting2 nothing
+    std::vector<double> lValues[kPatchedCount][2];
+    std::vector<int> lIndex[kPatchedCount][2];
+    std::vector<BinaryFbxTangents> lLayers;
+    for( int i = 0; i < kPatchedCount; i++ )
+    {
+        BinaryFbxTangents lMeshLayers;
+        lMeshLayers.mMesh = lFile.FindMesh(lNames[i].c_str());
+        if( lMeshLayers.mMesh < 0 ) break;
+
+        const MeshView& lView = lFile.GetMesh(lMeshLayers.mMesh).mView;
+        BuildPatchValues(lView, 2 * i, false, lValues[i][0], lIndex[i][0]);
+        BuildPatchValues(lView, 2 * i + 1, i == 1, lValues[i][1], lIndex[i][1]);
+        lMeshLayers.mTangentName  = "UVChannel_1";
+        lMeshLayers.mBinormalName = "UVChannel_1";
+        lMeshLayers.mTangents     = GetPatchView(lView.mNormals.mMapping, lValues[i][0], lIndex[i][0]);
+        lMeshLayers.mBinormals    = GetPatchView(lView.mNormals.mMapping, lValues[i][1], lIndex[i][1]);
+        lLayers.push_back(lMeshLayers);
+    }
+
+    std::string lError;
+    if( !WritePatchedFbx(lFile, lLayers, lPatched.c_str(), &pPool, lError) ) printf("%s\n", lError.c_str());
+    std::vector<unsigned char> lPatchedData;
+    ReadFileBytes(lPatched, lPatchedData);
+
+    int lIterations = 0;
+    double lSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        WritePatchedFbx(lFile, lLayers, lPatched.c_str(), &pPool, lError);
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+
+    double lFileBytes = double(lFile.GetFileSize());
+    lFile.Close();
+    remove(lPatched.c_str());
+    remove(lPath.c_str());
+
+    pResult.mVersion            = pVersion;
+    pResult.mCompressed         = pCompress;
+    pResult.mPatchedCount       = kPatchedCount;
+    pResult.mVertexCount        = kPatchedCount * pMesh.mView.mPolygonStarts[pMesh.mView.mPolygonCount];
+    pResult.mFileBytes          = lFileBytes;
+    pResult.mPatchedBytes       = double(lPatchedData.size());
+    pResult.mThreadCount        = pPool.GetThreadCount();
+    pResult.mIterations         = lIterations;
+    pResult.mMsPerPatch         = lSeconds * 1e3 / lIterations;
+    pResult.mMegaBytesPerSecond = pResult.mPatchedBytes * lIterations / lSeconds / (1024.0 * 1024.0);
+}
+
+static const char* GetQuantizationName(EGltfQuantization pQuantization)
+{
+    return pQuantization == eGltfInt16 ? "int16" : pQuantization == eGltfInt8 ? "int8" : "float";
+}
+
+// writes pMesh to a GLB file under two nodes, with UVs, its smooth normals and
+// three materials, the polygons of the third one having none
+static void RunGltfCase(
+                        const SyntheticMesh& pMesh,
+                        const char* pDirectory,
+                        EGltfQuantization pQuantization,
+                        WorkStealingPool& pPool,
+                        double pMinSeconds,
+                        GltfResult& pResult
+                        )
+{
+    const MeshView& lView = pMesh.mView;
+
+    // the UVs are the positions in the XZ extent of the mesh
+    double lMin[2] = { HUGE_VAL, HUGE_VAL }, lMax[2] = { -HUGE_VAL, -HUGE_VAL };
+    for( int i = 0; i < lView.mControlPointCount; i++ )
+    {
+        for( int c = 0; c < 2; c++ )
+        {
+            double v = lView.mPositions[size_t(i) * lView.mPositionStride + 2 * c];
+            lMin[c] = std::min(lMin[c], v);
+            lMax[c] = std::max(lMax[c], v);
+        }
+    }
+    std::vector<double> lUVValues(size_t(lView.mControlPointCount) * 2);
+    for( int i = 0; i < lView.mControlPointCount; i++ )
+    {
+        for( int c = 0; c < 2; c++ )
+            lUVValues[size_t(i) * 2 + c] = (lView.mPositions[size_t(i) * lView.mPositionStride + 2 * c] - lMin[c]) / std::max(lMax[c] - lMin[c], 1e-30);
+    }
+    ElementView lUVs = { eMapByControlPoint, eRefDirect, &lUVValues[0], lView.mControlPointCount, 2, NULL, 0 };
+
+    std::vector<int> lPolygonMaterials(lView.mPolygonCount);
+    for( int p = 0; p < lView.mPolygonCount; p++ ) lPolygonMaterials[p] = p % 3;
+
+    GltfScene lScene;
+    lScene.mMaterials.push_back("Skin");
+    lScene.mMaterials.push_back("Cloth");
+
+    GltfMesh lMesh;
+    lMesh.mName = "Lighting";
+    lMesh.mView = lView;
+    lMesh.mAttributes.push_back(GetGltfAttribute("NORMAL", lView.mNormals, 3, true));
+    lMesh.mAttributes.push_back(GetGltfAttribute("TEXCOORD_0", lUVs, 2, true));
+    lMesh.mAttributes.back().mScale[1]  = -1.0;
+    lMesh.mAttributes.back().mOffset[1] = 1.0;
+    lMesh.mAttributes.push_back(GetGltfAttribute("_SMOOTH_NORMAL", pMesh.mSource, 3, true));
+    lMesh.mPolygonMaterials = &lPolygonMaterials[0];
+    lMesh.mMaterials.push_back(1);
+    lMesh.mMaterials.push_back(0);
+    lScene.mMeshes.push_back(lMesh);
+
+    GltfNode lNode = { "Lighting", 0, { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } };
+    lScene.mNodes.push_back(lNode);
+    lNode.mName = "Lighting \"copy\"";
+    lNode.mMatrix[0] = lNode.mMatrix[10] = -1.0;
+    lNode.mMatrix[12] = 2.5;
+    lScene.mNodes.push_back(lNode);
+
+    std::string lPath = std::string(pDirectory) + "/mergebench.glb";
+    std::string lError;
+    GltfStats lStats = { 0, 0, 0 };
+    int lIterations = 0;
+    double lSeconds = 0.0;
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    do
+    {
+        WriteGlb(lScene, pQuantization, lPath.c_str(), &pPool, lError, &lStats);
+        lIterations++;
+        lSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    while( lSeconds < pMinSeconds );
+    if( !lError.empty() ) printf("%s\n", lError.c_str());
+    remove(lPath.c_str());
+
+    pResult.mQuantization       = pQuantization;
+    pResult.mPolygonVertexCount = lView.mPolygonStarts[lView.mPolygonCount];
+    pResult.mVertexCount        = lStats.mVertexCount;
+    pResult.mFileBytes          = double(lStats.mFileBytes);
+    pResult.mThreadCount        = pPool.GetThreadCount();
+    pResult.mIterations         = lIterations;
+    pResult.mMsPerWrite         = lSeconds * 1e3 / lIterations;
+    pResult.mMegaBytesPerSecond = pResult.mFileBytes * lIterations / lSeconds / (1024.0 * 1024.0);
+}
+
+static bool WriteJson(
+                      const char* pPath,
+                      const std::vector<BenchResult>& pResults,
+                      const std::vector<MatchResult>& pMatchResults,
+                      const std::vector<ClosestResult>& pClosestResults,
+                      const std::vector<SmoothResult>& pSmoothResults,
+                      const std::vector<TangentResult>& pTangentResults,
+                      const std::vector<PackResult>& pPackResults,
+                      const std::vector<ReadResult>& pReadResults,
+                      const std::vector<PatchResult>& pPatchResults,
+                      const std::vector<GltfResult>& pGltfResults,
+                      const std::vector<CompactResult>& pCompactResults,
+                      const std::vector<CacheResult>& pCacheResults,
+                      const std::vector<MeshCacheResult>& pMeshCacheResults,
+                      const std::vector<SidecarResult>& pSidecarResults
+                      )
+{
+    FILE* lFile = strcmp(pPath, "-") == 0 ? stdout : fopen(pPath, "w");
+    if( lFile == NULL )
+    {
+        printf("cannot write %s\n", pPath);
+        return false;
+    }
+
+    fprintf(lFile, "{\n  \"benchmark\": \"merge_normals\",\n  \"supported_isa\": \"%s\",\n  \"results\": [\n",
+            GetKernelIsaName(GetSupportedKernelIsa()));
+    for( size_t i = 0; i < pResults.size(); i++ )
+    {
+        const BenchResult& r = pResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"mapping\": \"%s\", \"reference\": \"%s\", \"isa\": \"%s\", "
+                "\"requested_vertices\": %d, \"vertices\": %d, \"control_points\": %d, \"polygons\": %d, "
+                "\"iterations\": %d, \"ns_per_vertex\": %.4f, \"vertices_per_second\": %.0f, "
+                "\"bytes_per_vertex\": %.0f, \"bytes_touched\": %.0f, \"gb_per_second\": %.3f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), GetMappingName(r.mDesc.mMapping), GetReferenceName(r.mDesc.mReference),
+                GetKernelIsaName(r.mIsa), r.mDesc.mElementCount, r.mVertexCount, r.mControlPointCount, r.mPolygonCount,
+                r.mIterations, r.mNsPerVertex, r.mVerticesPerSecond,
+                r.mBytesPerVertex, r.mBytesPerVertex * r.mVertexCount, r.mGigaBytesPerSecond, i + 1 < pResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"match_results\": [\n");
+    for( size_t i = 0; i < pMatchResults.size(); i++ )
+    {
+        const MatchResult& r = pMatchResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"control_points\": %d, \"threads\": %d, \"iterations\": %d, "
+                "\"ns_per_point\": %.4f, \"points_per_second\": %.0f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), r.mControlPointCount, r.mThreadCount, r.mIterations,
+                r.mNsPerPoint, r.mPointsPerSecond, i + 1 < pMatchResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"closest_results\": [\n");
+    for( size_t i = 0; i < pClosestResults.size(); i++ )
+    {
+        const ClosestResult& r = pClosestResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"triangles\": %d, \"nodes\": %d, \"queries\": %d, \"threads\": %d, "
+                "\"iterations\": %d, \"build_ms\": %.3f, \"ns_per_query\": %.4f, \"queries_per_second\": %.0f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), r.mTriangleCount, r.mNodeCount, r.mQueryCount, r.mThreadCount,
+                r.mIterations, r.mBuildMs, r.mNsPerQuery, r.mQueriesPerSecond, i + 1 < pClosestResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"smooth_results\": [\n");
+    for( size_t i = 0; i < pSmoothResults.size(); i++ )
+    {
+        const SmoothResult& r = pSmoothResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"weighting\": \"%s\", \"control_points\": %d, \"welded_points\": %d, "
+                "\"threads\": %d, \"iterations\": %d, \"ns_per_vertex\": %.4f, \"vertices_per_second\": %.0f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), r.mWeighting == eWeightAngle ? "angle" : "area", r.mControlPointCount,
+                r.mWeldedCount, r.mThreadCount, r.mIterations, r.mNsPerVertex, r.mVerticesPerSecond,
+                i + 1 < pSmoothResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"tangent_results\": [\n");
+    for( size_t i = 0; i < pTangentResults.size(); i++ )
+    {
+        const TangentResult& r = pTangentResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"vertices\": %d, \"threads\": %d, \"iterations\": %d, "
+                "\"ns_per_vertex\": %.4f, \"vertices_per_second\": %.0f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), r.mVertexCount, r.mThreadCount, r.mIterations,
+                r.mNsPerVertex, r.mVerticesPerSecond, i + 1 < pTangentResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"pack_results\": [\n");
+    for( size_t i = 0; i < pPackResults.size(); i++ )
+    {
+        const PackResult& r = pPackResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"mapping\": \"%s\", \"reference\": \"%s\", \"isa\": \"%s\", \"bits\": %d, "
+                "\"vertices\": %d, \"iterations\": %d, \"ns_per_vertex\": %.4f, \"vertices_per_second\": %.0f, "
+                "\"max_angle_degrees\": %.6f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), GetMappingName(r.mDesc.mMapping), GetReferenceName(r.mDesc.mReference),
+                GetKernelIsaName(r.mIsa), r.mBits, r.mVertexCount, r.mIterations, r.mNsPerVertex, r.mVerticesPerSecond,
+                r.mMaxAngle, i + 1 < pPackResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"read_results\": [\n");
+    for( size_t i = 0; i < pReadResults.size(); i++ )
+    {
+        const ReadResult& r = pReadResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"mapping\": \"%s\", \"reference\": \"%s\", \"version\": %d, \"compressed\": %s, "
+                "\"meshes\": %d, \"vertices\": %d, \"file_bytes\": %.0f, \"copied_bytes\": %.0f, \"threads\": %d, \"iterations\": %d, "
+                "\"ms_per_open\": %.4f, \"mb_per_second\": %.1f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), GetMappingName(r.mDesc.mMapping), GetReferenceName(r.mDesc.mReference),
+                r.mVersion, r.mCompressed ? "true" : "false", r.mMeshCount, r.mVertexCount, r.mFileBytes, r.mCopiedBytes,
+                r.mThreadCount, r.mIterations, r.mMsPerOpen, r.mMegaBytesPerSecond, i + 1 < pReadResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"patch_results\": [\n");
+    for( size_t i = 0; i < pPatchResults.size(); i++ )
+    {
+        const PatchResult& r = pPatchResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"mapping\": \"%s\", \"reference\": \"%s\", \"version\": %d, \"compressed\": %s, "
+                "\"patched_meshes\": %d, \"vertices\": %d, \"file_bytes\": %.0f, \"patched_bytes\": %.0f, \"threads\": %d, \"iterations\": %d, "
+                "\"ms_per_patch\": %.4f, \"mb_per_second\": %.1f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), GetMappingName(r.mDesc.mMapping), GetReferenceName(r.mDesc.mReference),
+                r.mVersion, r.mCompressed ? "true" : "false", r.mPatchedCount, r.mVertexCount, r.mFileBytes, r.mPatchedBytes,
+                r.mThreadCount, r.mIterations, r.mMsPerPatch, r.mMegaBytesPerSecond, i + 1 < pPatchResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"gltf_results\": [\n");
+    for( size_t i = 0; i < pGltfResults.size(); i++ )
+    {
+        const GltfResult& r = pGltfResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"mapping\": \"%s\", \"reference\": \"%s\", \"quantization\": \"%s\", "
+                "\"polygon_vertices\": %d, \"vertices\": %d, \"file_bytes\": %.0f, \"threads\": %d, \"iterations\": %d, "
+                "\"ms_per_write\": %.4f, \"mb_per_second\": %.1f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), GetMappingName(r.mDesc.mMapping), GetReferenceName(r.mDesc.mReference),
+                GetQuantizationName(r.mQuantization), r.mPolygonVertexCount, r.mVertexCount, r.mFileBytes, r.mThreadCount,
+                r.mIterations, r.mMsPerWrite, r.mMegaBytesPerSecond, i + 1 < pGltfResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"compact_results\": [\n");
+    for( size_t i = 0; i < pCompactResults.size(); i++ )
+    {
+        const CompactResult& r = pCompactResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"mapping\": \"%s\", \"reference\": \"%s\", \"tolerance\": %g, "
+                "\"vertices\": %d, \"distinct\": %d, \"saved_bytes\": %.0f, \"threads\": %d, \"iterations\": %d, "
+                "\"ns_per_vertex\": %.4f, \"vertices_per_second\": %.0f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), GetMappingName(r.mDesc.mMapping), GetReferenceName(r.mDesc.mReference),
+                r.mTolerance, r.mVertexCount, r.mDistinctCount, r.mSavedBytes, r.mThreadCount, r.mIterations,
+                r.mNsPerVertex, r.mVerticesPerSecond, i + 1 < pCompactResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"cache_results\": [\n");
+    for( size_t i = 0; i < pCacheResults.size(); i++ )
+    {
+        const CacheResult& r = pCacheResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"requested_vertices\": %d, \"file_bytes\": %.0f, \"iterations\": %d, "
+                "\"ms_per_hash\": %.4f, \"hash_mb_per_second\": %.1f, \"fetch_mb_per_second\": %.1f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), r.mDesc.mElementCount, r.mFileBytes, r.mIterations, r.mMsPerHash,
+                r.mHashMegaBytesPerSecond, r.mFetchMegaBytesPerSecond, i + 1 < pCacheResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"mesh_cache_results\": [\n");
+    for( size_t i = 0; i < pMeshCacheResults.size(); i++ )
+    {
+        const MeshCacheResult& r = pMeshCacheResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"mapping\": \"%s\", \"reference\": \"%s\", \"requested_vertices\": %d, "
+                "\"vertices\": %d, \"entry_bytes\": %.0f, \"array_bytes\": %.0f, \"iterations\": %d, "
+                "\"ms_per_merge\": %.4f, \"ms_per_load\": %.4f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), GetMappingName(r.mDesc.mMapping), GetReferenceName(r.mDesc.mReference),
+                r.mDesc.mElementCount, r.mVertexCount, r.mEntryBytes, r.mArrayBytes, r.mIterations, r.mMsPerMerge, r.mMsPerLoad,
+                i + 1 < pMeshCacheResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ],\n  \"sidecar_results\": [\n");
+    for( size_t i = 0; i < pSidecarResults.size(); i++ )
+    {
+        const SidecarResult& r = pSidecarResults[i];
+        fprintf(lFile,
+                "    {\"topology\": \"%s\", \"mapping\": \"%s\", \"reference\": \"%s\", \"requested_vertices\": %d, "
+                "\"meshes\": %d, \"vertices\": %d, \"file_bytes\": %.0f, \"fbx_bytes\": %.0f, \"iterations\": %d, "
+                "\"ms_per_open\": %.4f, \"ms_per_fbx_open\": %.4f}%s\n",
+                GetTopologyName(r.mDesc.mTopology), GetMappingName(r.mDesc.mMapping), GetReferenceName(r.mDesc.mReference),
+                r.mDesc.mElementCount, r.mMeshCount, r.mVertexCount, r.mFileBytes, r.mFbxBytes, r.mIterations,
+                r.mMsPerOpen, r.mMsPerFbxOpen, i + 1 < pSidecarResults.size() ? "," : "");
+    }
+    fprintf(lFile, "  ]\n}\n");
+
+    if( lFile != stdout ) fclose(lFile);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions lOptions;
+    if( !ParseOptions(argc, argv, lOptions) )
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    // the table goes to stderr when the JSON is written on stdout
+    FILE* lLog = lOptions.mJsonPath && strcmp(lOptions.mJsonPath, "-") == 0 ? stderr : stdout;
+    fprintf(lLog, "%-9s %-17s %-15s %-6s %10s %10s %10s %12s %8s\n",
+            "topology", "mapping", "reference", "isa", "vertices", "ns/vertex", "Mvert/s", "bytes", "GB/s");
+
+    std::vector<BenchResult> lResults;
+
+    for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+    for( size_t m = 0; m < lOptions.mMappings.size(); m++ )
+    for( size_t r = 0; r < lOptions.mReferences.size(); r++ )
+    for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+    {
+        BenchResult lResult;
+        lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+        lResult.mDesc.mMapping      = lOptions.mMappings[m];
+        lResult.mDesc.mReference    = lOptions.mReferences[r];
+        lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lResult.mDesc, lMesh);
+
+        for( size_t i = 0; i < lOptions.mIsas.size(); i++ )
+        {
+            RunCase(lMesh, lOptions.mIsas[i], lOptions.mMinSeconds, lResult);
+            lResults.push_back(lResult);
+
+            fprintf(lLog, "%-9s %-17s %-15s %-6s %10d %10.3f %10.1f %12.0f %8.2f\n",
+                    GetTopologyName(lResult.mDesc.mTopology), GetMappingName(lResult.mDesc.mMapping),
+                    GetReferenceName(lResult.mDesc.mReference), GetKernelIsaName(lResult.mIsa),
+                    lResult.mVertexCount, lResult.mNsPerVertex, lResult.mVerticesPerSecond * 1e-6,
+                    lResult.mBytesPerVertex * lResult.mVertexCount, lResult.mGigaBytesPerSecond);
+            fflush(lLog);
+        }
+    }
+
+    // the matching only looks at the positions, one mesh per topology and size
+    std::vector<MatchResult> lMatchResults;
+    if( lOptions.mMatch )
+    {
+        WorkStealingPool lPool(lOptions.mThreadCount);
+        fprintf(lLog, "\n%-9s %14s %8s %10s %10s\n", "topology", "control points", "threads", "ns/point", "Mpoint/s");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            MatchResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = eMapByControlPoint;
+            lResult.mDesc.mReference    = eRefDirect;
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+            RunMatchCase(lMesh, lPool, lOptions.mMinSeconds, lResult);
+            lMatchResults.push_back(lResult);
+
+            fprintf(lLog, "%-9s %14d %8d %10.3f %10.2f\n", GetTopologyName(lResult.mDesc.mTopology),
+                    lResult.mControlPointCount, lResult.mThreadCount, lResult.mNsPerPoint, lResult.mPointsPerSecond * 1e-6);
+            fflush(lLog);
+        }
+    }
+
+    // the sampling reads the smooth normals by control point, one mesh per topology and size
+    std::vector<ClosestResult> lClosestResults;
+    if( lOptions.mClosest )
+    {
+        WorkStealingPool lPool(lOptions.mThreadCount);
+        fprintf(lLog, "\n%-9s %10s %10s %8s %10s %10s %10s\n",
+                "topology", "triangles", "queries", "threads", "build ms", "ns/query", "Mquery/s");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            ClosestResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = eMapByControlPoint;
+            lResult.mDesc.mReference    = eRefDirect;
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+            RunClosestCase(lMesh, lPool, lOptions.mMinSeconds, lResult);
+            lClosestResults.push_back(lResult);
+
+            fprintf(lLog, "%-9s %10d %10d %8d %10.2f %10.1f %10.2f\n", GetTopologyName(lResult.mDesc.mTopology),
+                    lResult.mTriangleCount, lResult.mQueryCount, lResult.mThreadCount, lResult.mBuildMs,
+                    lResult.mNsPerQuery, lResult.mQueriesPerSecond * 1e-6);
+            fflush(lLog);
+        }
+    }
+
+    // the generation reads the positions only, one split mesh per topology, size and weighting
+    std::vector<SmoothResult> lSmoothResults;
+    if( lOptions.mSmooth )
+    {
+        WorkStealingPool lPool(lOptions.mThreadCount);
+        fprintf(lLog, "\n%-9s %-9s %14s %8s %10s %10s\n",
+                "topology", "weighting", "control points", "threads", "ns/vertex", "Mvert/s");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        for( int w = eWeightArea; w <= eWeightAngle; w++ )
+        {
+            SmoothResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = eMapByPolygonVertex;
+            lResult.mDesc.mReference    = eRefDirect;
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+            RunSmoothCase(lMesh, ESmoothWeighting(w), lPool, lOptions.mMinSeconds, lResult);
+            lSmoothResults.push_back(lResult);
+
+            fprintf(lLog, "%-9s %-9s %14d %8d %10.3f %10.2f\n", GetTopologyName(lResult.mDesc.mTopology),
+                    w == eWeightAngle ? "angle" : "area", lResult.mControlPointCount, lResult.mThreadCount,
+                    lResult.mNsPerVertex, lResult.mVerticesPerSecond * 1e-6);
+            fflush(lLog);
+        }
+    }
+
+    // the basis reads the normals and UVs by control point, one mesh per topology and size
+    std::vector<TangentResult> lTangentResults;
+    if( lOptions.mTangent )
+    {
+        WorkStealingPool lPool(lOptions.mThreadCount);
+        fprintf(lLog, "\n%-9s %10s %8s %10s %10s\n", "topology", "vertices", "threads", "ns/vertex", "Mvert/s");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            TangentResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = eMapByControlPoint;
+            lResult.mDesc.mReference    = eRefDirect;
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+            RunTangentCase(lMesh, lPool, lOptions.mMinSeconds, lResult);
+            lTangentResults.push_back(lResult);
+
+            fprintf(lLog, "%-9s %10d %8d %10.3f %10.2f\n", GetTopologyName(lResult.mDesc.mTopology),
+                    lResult.mVertexCount, lResult.mThreadCount, lResult.mNsPerVertex, lResult.mVerticesPerSecond * 1e-6);
+            fflush(lLog);
+        }
+    }
+
+    // the packing runs over the same combinations as the merge, for both bit counts
+    std::vector<PackResult> lPackResults;
+    if( lOptions.mPack )
+    {
+        fprintf(lLog, "\n%-9s %-17s %-15s %-6s %4s %10s %10s %10s  %s\n",
+                "topology", "mapping", "reference", "isa", "bits", "vertices", "ns/vertex", "Mvert/s", "max degrees");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t m = 0; m < lOptions.mMappings.size(); m++ )
+        for( size_t r = 0; r < lOptions.mReferences.size(); r++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            PackResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = lOptions.mMappings[m];
+            lResult.mDesc.mReference    = lOptions.mReferences[r];
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+
+            for( size_t i = 0; i < lOptions.mIsas.size(); i++ )
+            for( int lBits = 8; lBits <= 16; lBits += 8 )
+            {
+                RunPackCase(lMesh, lOptions.mIsas[i], lBits, lOptions.mMinSeconds, lResult);
+                lPackResults.push_back(lResult);
+
+                fprintf(lLog, "%-9s %-17s %-15s %-6s %4d %10d %10.3f %10.1f  %.6f\n",
+                        GetTopologyName(lResult.mDesc.mTopology), GetMappingName(lResult.mDesc.mMapping),
+                        GetReferenceName(lResult.mDesc.mReference), GetKernelIsaName(lResult.mIsa), lResult.mBits,
+                        lResult.mVertexCount, lResult.mNsPerVertex, lResult.mVerticesPerSecond * 1e-6,
+                        lResult.mMaxAngle);
+                fflush(lLog);
+            }
+        }
+    }
+
+    // the reader runs over the same combinations as the merge, for both record formats, raw and compressed
+    std::vector<ReadResult> lReadResults;
+    if( lOptions.mRead )
+    {
+        WorkStealingPool lPool(lOptions.mThreadCount);
+        fprintf(lLog, "\n%-9s %-17s %-15s %7s %-4s %10s %10s %10s %10s  %s\n",
+                "topology", "mapping", "reference", "version", "zlib", "vertices", "file MB", "ms/open", "MB/s", "copied MB");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t m = 0; m < lOptions.mMappings.size(); m++ )
+        for( size_t r = 0; r < lOptions.mReferences.size(); r++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            ReadResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = lOptions.mMappings[m];
+            lResult.mDesc.mReference    = lOptions.mReferences[r];
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+
+            for( int lVersion = 7400; lVersion <= 7500; lVersion += 100 )
+#ifdef NORMALMERGER_ZLIB
+            for( int lCompress = 0; lCompress <= 1; lCompress++ )
+#else
+            for( int lCompress = 0; lCompress <= 0; lCompress++ )
+#endif
+            {
+                RunReadCase(lMesh, lOptions.mDirectory, lVersion, lCompress != 0, lPool, lOptions.mMinSeconds, lResult);
+                lReadResults.push_back(lResult);
+
+                fprintf(lLog, "%-9s %-17s %-15s %7d %-4s %10d %10.2f %10.3f %10.1f  %.2f\n",
+                        GetTopologyName(lResult.mDesc.mTopology), GetMappingName(lResult.mDesc.mMapping),
+                        GetReferenceName(lResult.mDesc.mReference), lResult.mVersion, lResult.mCompressed ? "yes" : "no",
+                        lResult.mVertexCount, lResult.mFileBytes / (1024.0 * 1024.0), lResult.mMsPerOpen,
+                        lResult.mMegaBytesPerSecond, lResult.mCopiedBytes / (1024.0 * 1024.0));
+                fflush(lLog);
+            }
+        }
+    }
+
+    // the patch writer runs over the same combinations as the reader
+    std::vector<PatchResult> lPatchResults;
+    if( lOptions.mPatch )
+    {
+        WorkStealingPool lPool(lOptions.mThreadCount);
+        fprintf(lLog, "\n%-9s %-17s %-15s %7s %-4s %10s %10s %10s %10s\n",
+                "topology", "mapping", "reference", "version", "zlib", "vertices", "file MB", "ms/patch", "MB/s");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t m = 0; m < lOptions.mMappings.size(); m++ )
+        for( size_t r = 0; r < lOptions.mReferences.size(); r++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            PatchResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = lOptions.mMappings[m];
+            lResult.mDesc.mReference    = lOptions.mReferences[r];
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+
+            for( int lVersion = 7400; lVersion <= 7500; lVersion += 100 )
+#ifdef NORMALMERGER_ZLIB
+            for( int lCompress = 0; lCompress <= 1; lCompress++ )
+#else
+            for( int lCompress = 0; lCompress <= 0; lCompress++ )
+#endif
+            {
+                RunPatchCase(lMesh, lOptions.mDirectory, lVersion, lCompress != 0, lPool, lOptions.mMinSeconds, lResult);
+                lPatchResults.push_back(lResult);
+
+                fprintf(lLog, "%-9s %-17s %-15s %7d %-4s %10d %10.2f %10.3f %10.1f\n",
+                        GetTopologyName(lResult.mDesc.mTopology), GetMappingName(lResult.mDesc.mMapping),
+                        GetReferenceName(lResult.mDesc.mReference), lResult.mVersion, lResult.mCompressed ? "yes" : "no",
+                        lResult.mVertexCount, lResult.mPatchedBytes / (1024.0 * 1024.0), lResult.mMsPerPatch,
+                        lResult.mMegaBytesPerSecond);
+                fflush(lLog);
+            }
+        }
+    }
+
+    // the GLB writer runs on every mesh in every storage
+    std::vector<GltfResult> lGltfResults;
+    if( lOptions.mGltf )
+    {
+        WorkStealingPool lPool(lOptions.mThreadCount);
+        fprintf(lLog, "\n%-9s %-17s %-15s %-6s %10s %10s %10s %10s %10s\n",
+                "topology", "mapping", "reference", "store", "poly-verts", "vertices", "file MB", "ms/write", "MB/s");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t m = 0; m < lOptions.mMappings.size(); m++ )
+        for( size_t r = 0; r < lOptions.mReferences.size(); r++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            GltfResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = lOptions.mMappings[m];
+            lResult.mDesc.mReference    = lOptions.mReferences[r];
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+
+            for( int q = eGltfFloat; q <= eGltfInt8; q++ )
+            {
+                RunGltfCase(lMesh, lOptions.mDirectory, EGltfQuantization(q), lPool, lOptions.mMinSeconds, lResult);
+                lGltfResults.push_back(lResult);
+
+                fprintf(lLog, "%-9s %-17s %-15s %-6s %10d %10d %10.2f %10.3f %10.1f\n",
+                        GetTopologyName(lResult.mDesc.mTopology), GetMappingName(lResult.mDesc.mMapping),
+                        GetReferenceName(lResult.mDesc.mReference), GetQuantizationName(lResult.mQuantization),
+                        lResult.mPolygonVertexCount, lResult.mVertexCount, lResult.mFileBytes / (1024.0 * 1024.0),
+                        lResult.mMsPerWrite, lResult.mMegaBytesPerSecond);
+                fflush(lLog);
+            }
+        }
+    }
+
+    // the compaction runs over the same combinations as the merge, for both tolerances
+    std::vector<CompactResult> lCompactResults;
+    if( lOptions.mCompact )
+    {
+        WorkStealingPool lPool(lOptions.mThreadCount);
+        fprintf(lLog, "\n%-9s %-17s %-15s %9s %10s %10s %8s %10s %10s  %s\n",
+                "topology", "mapping", "reference", "tolerance", "vertices", "distinct", "threads", "ns/vertex", "Mvert/s", "saved MB");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t m = 0; m < lOptions.mMappings.size(); m++ )
+        for( size_t r = 0; r < lOptions.mReferences.size(); r++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            CompactResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = lOptions.mMappings[m];
+            lResult.mDesc.mReference    = lOptions.mReferences[r];
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+
+            const double lTolerances[2] = { 0.0, 1e-3 };
+            for( int i = 0; i < 2; i++ )
+            {
+                RunCompactCase(lMesh, lTolerances[i], lPool, lOptions.mMinSeconds, lResult);
+                lCompactResults.push_back(lResult);
+
+                fprintf(lLog, "%-9s %-17s %-15s %9g %10d %10d %8d %10.3f %10.1f  %.2f\n",
+                        GetTopologyName(lResult.mDesc.mTopology), GetMappingName(lResult.mDesc.mMapping),
+                        GetReferenceName(lResult.mDesc.mReference), lResult.mTolerance, lResult.mVertexCount,
+                        lResult.mDistinctCount, lResult.mThreadCount, lResult.mNsPerVertex, lResult.mVerticesPerSecond * 1e-6,
+                        lResult.mSavedBytes / (1024.0 * 1024.0));
+                fflush(lLog);
+            }
+        }
+    }
+
+    // the cache only looks at the bytes of the file, one mesh per topology and size
+    std::vector<CacheResult> lCacheResults;
+    if( lOptions.mCache )
+    {
+        fprintf(lLog, "\n%-9s %10s %10s %10s %10s %10s\n", "topology", "vertices", "file MB", "ms/hash", "hash MB/s", "fetch MB/s");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            CacheResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = eMapByPolygonVertex;
+            lResult.mDesc.mReference    = eRefDirect;
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+            RunCacheCase(lMesh, lOptions.mDirectory, lOptions.mMinSeconds, lResult);
+            lCacheResults.push_back(lResult);
+
+            fprintf(lLog, "%-9s %10d %10.2f %10.3f %10.1f %10.1f\n", GetTopologyName(lResult.mDesc.mTopology),
+                    lResult.mDesc.mElementCount, lResult.mFileBytes / (1024.0 * 1024.0), lResult.mMsPerHash,
+                    lResult.mHashMegaBytesPerSecond, lResult.mFetchMegaBytesPerSecond);
+            fflush(lLog);
+        }
+    }
+
+    // the mesh cache runs over the same combinations as the merge
+    std::vector<MeshCacheResult> lMeshCacheResults;
+    if( lOptions.mMeshCache )
+    {
+        WorkStealingPool lPool(lOptions.mThreadCount);
+        fprintf(lLog, "\n%-9s %-17s %-15s %10s %10s %10s %10s %10s %8s\n",
+                "topology", "mapping", "reference", "vertices", "arrays MB", "entry MB", "ms/merge", "ms/load", "speedup");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t m = 0; m < lOptions.mMappings.size(); m++ )
+        for( size_t r = 0; r < lOptions.mReferences.size(); r++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            MeshCacheResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = lOptions.mMappings[m];
+            lResult.mDesc.mReference    = lOptions.mReferences[r];
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+            RunMeshCacheCase(lMesh, lOptions.mDirectory, lPool, lOptions.mMinSeconds, lResult);
+            lMeshCacheResults.push_back(lResult);
+
+            fprintf(lLog, "%-9s %-17s %-15s %10d %10.2f %10.2f %10.3f %10.3f %8.1f\n",
+                    GetTopologyName(lResult.mDesc.mTopology), GetMappingName(lResult.mDesc.mMapping),
+                    GetReferenceName(lResult.mDesc.mReference), lResult.mVertexCount, lResult.mArrayBytes / (1024.0 * 1024.0),
+                    lResult.mEntryBytes / (1024.0 * 1024.0), lResult.mMsPerMerge, lResult.mMsPerLoad,
+                    lResult.mMsPerMerge / lResult.mMsPerLoad);
+            fflush(lLog);
+        }
+    }
+
+    // the sidecar runs over the same combinations as the merge
+    std::vector<SidecarResult> lSidecarResults;
+    if( lOptions.mSidecar )
+    {
+        WorkStealingPool lPool(lOptions.mThreadCount);
+        fprintf(lLog, "\n%-9s %-17s %-15s %10s %10s %10s %10s %10s %8s\n",
+                "topology", "mapping", "reference", "vertices", "file MB", "FBX MB", "ms/open", "FBX ms", "speedup");
+
+        for( size_t t = 0; t < lOptions.mTopologies.size(); t++ )
+        for( size_t m = 0; m < lOptions.mMappings.size(); m++ )
+        for( size_t r = 0; r < lOptions.mReferences.size(); r++ )
+        for( size_t s = 0; s < lOptions.mSizes.size(); s++ )
+        {
+            SidecarResult lResult;
+            lResult.mDesc.mTopology     = lOptions.mTopologies[t];
+            lResult.mDesc.mMapping      = lOptions.mMappings[m];
+            lResult.mDesc.mReference    = lOptions.mReferences[r];
+            lResult.mDesc.mElementCount = lOptions.mSizes[s];
+
+            SyntheticMesh lMesh;
+            BuildSyntheticMesh(lResult.mDesc, lMesh);
+            RunSidecarCase(lMesh, lOptions.mDirectory, lPool, lOptions.mMinSeconds, lResult);
+            lSidecarResults.push_back(lResult);
+
+            fprintf(lLog, "%-9s %-17s %-15s %10d %10.2f %10.2f %10.4f %10.3f %8.1f\n",
+                    GetTopologyName(lResult.mDesc.mTopology), GetMappingName(lResult.mDesc.mMapping),
+                    GetReferenceName(lResult.mDesc.mReference), lResult.mVertexCount, lResult.mFileBytes / (1024.0 * 1024.0),
+                    lResult.mFbxBytes / (1024.0 * 1024.0), lResult.mMsPerOpen, lResult.mMsPerFbxOpen,
+                    lResult.mMsPerFbxOpen / lResult.mMsPerOpen);
+            fflush(lLog);
+        }
+    }
+
+    if( lOptions.mJsonPath && !WriteJson(lOptions.mJsonPath, lResults, lMatchResults, lClosestResults, lSmoothResults, lTangentResults, lPackResults, lReadResults, lPatchResults, lGltfResults, lCompactResults, lCacheResults, lMeshCacheResults, lSidecarResults) )
+        return 1;
+
+    return 0;
+}
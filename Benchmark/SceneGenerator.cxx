@@ -0,0 +1,294 @@
+// SceneGenerator.cxx : writes synthetic (lighting mesh, smooth mesh) FBX pairs.
+
+#include "SceneGenerator.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// the IO settings always come from the manager passed to the function
+#ifdef IOS_REF
+	#undef  IOS_REF
+	#define IOS_REF (*(pSdkManager->GetIOSettings()))
+#endif
+
+static bool ParseCount(const char* pText, int pMin, int& pValue)
+{
+    char* lEnd = NULL;
+    long lValue = strtol(pText, &lEnd, 10);
+    if( lEnd == pText || *lEnd != '\0' || lValue < pMin || lValue > 1000000000L ) return false;
+    pValue = int(lValue);
+    return true;
+}
+
+bool ParseSceneOption(
+                      int pArgc,
+                      char** pArgv,
+                      int& pIndex,
+                      SceneDesc& pDesc,
+                      bool& pKnown
+                      )
+{
+    const char* lName = pArgv[pIndex];
+    pKnown = strcmp(lName, "-nodes") == 0 || strcmp(lName, "-depth") == 0 || strcmp(lName, "-vertices") == 0 ||
+             strcmp(lName, "-layers") == 0 || strcmp(lName, "-anim-stacks") == 0 || strcmp(lName, "-topology") == 0 ||
+             strcmp(lName, "-mapping") == 0 || strcmp(lName, "-reference") == 0;
+    if( !pKnown || pIndex + 1 >= pArgc ) return false;
+
+    const char* lValue = pArgv[++pIndex];
+    if( strcmp(lName, "-nodes") == 0 )       return ParseCount(lValue, 1, pDesc.mNodeCount);
+    if( strcmp(lName, "-depth") == 0 )       return ParseCount(lValue, 1, pDesc.mDepth);
+    if( strcmp(lName, "-vertices") == 0 )    return ParseCount(lValue, 1, pDesc.mVertexCount);
+    if( strcmp(lName, "-layers") == 0 )      return ParseCount(lValue, 1, pDesc.mLayerCount);
+    if( strcmp(lName, "-anim-stacks") == 0 ) return ParseCount(lValue, 0, pDesc.mAnimStackCount);
+
+    if( strcmp(lName, "-topology") == 0 )
+    {
+        if( strcmp(lValue, "tri") == 0 )        pDesc.mTopology = eTopologyTriangles;
+        else if( strcmp(lValue, "quad") == 0 )  pDesc.mTopology = eTopologyQuads;
+        else if( strcmp(lValue, "mixed") == 0 ) pDesc.mTopology = eTopologyMixed;
+        else return false;
+        return true;
+    }
+    if( strcmp(lName, "-mapping") == 0 )
+    {
+        if( strcmp(lValue, "cp") == 0 )      pDesc.mMapping = eMapByControlPoint;
+        else if( strcmp(lValue, "pv") == 0 ) pDesc.mMapping = eMapByPolygonVertex;
+        else return false;
+        return true;
+    }
+
+    if( strcmp(lValue, "direct") == 0 )     pDesc.mReference = eRefDirect;
+    else if( strcmp(lValue, "index") == 0 ) pDesc.mReference = eRefIndexToDirect;
+    else return false;
+    return true;
+}
+
+const char* GetSceneOptionsUsage()
+{
+    return "  -nodes <n>            mesh nodes (16)\n"
+           "  -depth <n>            levels of the node hierarchy (3)\n"
+           "  -vertices <n>         normal elements per mesh (10000)\n"
+           "  -layers <n>           layers per mesh, each with a UV set (1)\n"
+           "  -anim-stacks <n>      animation stacks (0)\n"
+           "  -topology <t>         tri, quad or mixed (quad)\n"
+           "  -mapping <m>          cp or pv (pv)\n"
+           "  -reference <r>        direct or index (direct)\n";
+}
+
+static FbxLayerElement::EMappingMode GetFbxMapping(EElementMapping pMapping)
+{
+    return pMapping == eMapByControlPoint ? FbxLayerElement::eByControlPoint : FbxLayerElement::eByPolygonVertex;
+}
+
+// copies a strided double array into a layer element array
+static void FillVectors(
+                        FbxLayerElementArrayTemplate<FbxVector4>& pArray,
+                        const std::vector<double>& pValues
+                        )
+{
+    int lCount = int(pValues.size() / 4);
+    pArray.SetCount(lCount);
+    if( lCount == 0 ) return;
+
+    FbxVector4* lVectors = pArray.GetLocked(FbxLayerElementArray::eWriteLock);
+    for( int i = 0; i < lCount; i++ )
+    {
+        lVectors[i] = FbxVector4(pValues[size_t(i) * 4], pValues[size_t(i) * 4 + 1], pValues[size_t(i) * 4 + 2], pValues[size_t(i) * 4 + 3]);
+    }
+    pArray.Release(&lVectors);
+}
+
+static void FillIndices(
+                        FbxLayerElementArrayTemplate<int>& pArray,
+                        const std::vector<int>& pValues
+                        )
+{
+    int lCount = int(pValues.size());
+    pArray.SetCount(lCount);
+    if( lCount == 0 ) return;
+
+    int* lIndices = pArray.GetLocked(FbxLayerElementArray::eWriteLock);
+    memcpy(lIndices, &pValues[0], pValues.size() * sizeof(int));
+    pArray.Release(&lIndices);
+}
+
+static FbxMesh* CreateMesh(
+                           FbxScene* pScene,
+                           const char* pName,
+                           const SceneDesc& pDesc,
+                           const SyntheticMesh& pMesh,
+                           bool pSmooth
+                           )
+{
+    FbxMesh* lMesh = FbxMesh::Create(pScene, pName);
+
+    const MeshView& lView = pMesh.mView;
+    lMesh->InitControlPoints(lView.mControlPointCount);
+    FbxVector4* lControlPoints = lMesh->GetControlPoints();
+    for( int i = 0; i < lView.mControlPointCount; i++ )
+    {
+        const double* lPosition = lView.mPositions + size_t(i) * lView.mPositionStride;
+        lControlPoints[i] = FbxVector4(lPosition[0], lPosition[1], lPosition[2]);
+    }
+
+    for( int p = 0; p < lView.mPolygonCount; p++ )
+    {
+        lMesh->BeginPolygon();
+        for( int i = lView.mPolygonStarts[p]; i < lView.mPolygonStarts[p + 1]; i++ )
+        {
+            lMesh->AddPolygon(lView.mPolygonVertices[i]);
+        }
+        lMesh->EndPolygon();
+    }
+
+    FbxGeometryElementNormal* lNormals = lMesh->CreateElementNormal();
+    lNormals->SetMappingMode(GetFbxMapping(pDesc.mMapping));
+    lNormals->SetReferenceMode(pDesc.mReference == eRefDirect ? FbxLayerElement::eDirect : FbxLayerElement::eIndexToDirect);
+    FillVectors(lNormals->GetDirectArray(), pSmooth ? pMesh.mSmoothNormals : pMesh.mNormals);
+    if( pDesc.mReference == eRefIndexToDirect )
+        FillIndices(lNormals->GetIndexArray(), pSmooth ? pMesh.mSmoothIndex : pMesh.mNormalIndex);
+
+    // one UV set per layer, planar projection of the positions
+    int lPolygonVertexCount = lView.mPolygonStarts[lView.mPolygonCount];
+    for( int l = 0; l < pDesc.mLayerCount; l++ )
+    {
+        char lUVName[32];
+        snprintf(lUVName, sizeof(lUVName), "UVSet%d", l);
+
+        FbxGeometryElementUV* lUVs = lMesh->CreateElementUV(lUVName);
+        lUVs->SetMappingMode(FbxLayerElement::eByPolygonVertex);
+        lUVs->SetReferenceMode(FbxLayerElement::eDirect);
+        lUVs->GetDirectArray().SetCount(lPolygonVertexCount);
+
+        FbxVector2* lValues = lUVs->GetDirectArray().GetLocked(FbxLayerElementArray::eWriteLock);
+        for( int i = 0; i < lPolygonVertexCount; i++ )
+        {
+            const double* lPosition = lView.mPositions + size_t(lView.mPolygonVertices[i]) * lView.mPositionStride;
+            lValues[i] = FbxVector2(lPosition[0] * (l + 1) * 0.01, lPosition[2] * (l + 1) * 0.01);
+        }
+        lUVs->GetDirectArray().Release(&lValues);
+    }
+
+    return lMesh;
+}
+
+// a translation curve per axis, with a key per frame at 30 fps over one second
+static void AnimateNode(FbxNode* pNode, FbxAnimLayer* pLayer, int pStack, int pNodeIndex)
+{
+    const char* lChannels[3] = { FBXSDK_CURVENODE_COMPONENT_X, FBXSDK_CURVENODE_COMPONENT_Y, FBXSDK_CURVENODE_COMPONENT_Z };
+    for( int c = 0; c < 3; c++ )
+    {
+        FbxAnimCurve* lCurve = pNode->LclTranslation.GetCurve(pLayer, lChannels[c], true);
+        if( lCurve == NULL ) continue;
+
+        lCurve->KeyModifyBegin();
+        for( int f = 0; f <= 30; f++ )
+        {
+            FbxTime lTime;
+            lTime.SetSecondDouble(f / 30.0);
+            int lKey = lCurve->KeyAdd(lTime);
+            lCurve->KeySetValue(lKey, float(std::sin(0.2 * f + pStack + c + pNodeIndex)));
+            lCurve->KeySetInterpolation(lKey, FbxAnimCurveDef::eInterpolationLinear);
+        }
+        lCurve->KeyModifyEnd();
+    }
+}
+
+// the nodes are spread over the levels in turn, each one under the last node of the level above
+static void BuildScene(
+                       FbxScene* pScene,
+                       const SceneDesc& pDesc,
+                       const SyntheticMesh& pMesh,
+                       bool pSmooth
+                       )
+{
+    std::vector<FbxNode*> lLastOfLevel(pDesc.mDepth, (FbxNode*)NULL);
+    std::vector<FbxNode*> lNodes;
+
+    for( int i = 0; i < pDesc.mNodeCount; i++ )
+    {
+        char lName[32];
+        snprintf(lName, sizeof(lName), "Mesh%d", i);
+
+        FbxNode* lNode = FbxNode::Create(pScene, lName);
+        lNode->SetNodeAttribute(CreateMesh(pScene, lName, pDesc, pMesh, pSmooth));
+        lNode->LclTranslation.Set(FbxDouble3(i * 10.0, 0.0, 0.0));
+
+        int lLevel = i % pDesc.mDepth;
+        FbxNode* lParent = lLevel == 0 ? pScene->GetRootNode() : lLastOfLevel[lLevel - 1];
+        if( lParent == NULL ) lParent = pScene->GetRootNode();
+        lParent->AddChild(lNode);
+
+        lLastOfLevel[lLevel] = lNode;
+        lNodes.push_back(lNode);
+    }
+
+    for( int s = 0; s < pDesc.mAnimStackCount; s++ )
+    {
+        char lName[32];
+        snprintf(lName, sizeof(lName), "Take%d", s);
+
+        FbxAnimStack* lStack = FbxAnimStack::Create(pScene, lName);
+        FbxAnimLayer* lLayer = FbxAnimLayer::Create(pScene, "BaseLayer");
+        lStack->AddMember(lLayer);
+
+        for( size_t n = 0; n < lNodes.size(); n++ )
+        {
+            AnimateNode(lNodes[n], lLayer, s, int(n));
+        }
+    }
+}
+
+static bool WriteScene(
+                       FbxManager* pSdkManager,
+                       FbxScene* pScene,
+                       const char* pFilename,
+                       int pFileFormat
+                       )
+{
+    if( pFileFormat < 0 || pFileFormat >= pSdkManager->GetIOPluginRegistry()->GetWriterFormatCount() )
+        pFileFormat = pSdkManager->GetIOPluginRegistry()->GetNativeWriterFormat();
+
+    IOS_REF.SetBoolProp(EXP_FBX_ANIMATION, true);
+
+    FbxExporter* lExporter = FbxExporter::Create(pSdkManager, "");
+    bool lStatus = lExporter->Initialize(pFilename, pFileFormat, pSdkManager->GetIOSettings()) &&
+                   lExporter->Export(pScene);
+    if( !lStatus )
+        printf("cannot write %s: %s\n", pFilename, lExporter->GetStatus().GetErrorString());
+
+    lExporter->Destroy();
+    return lStatus;
+}
+
+bool GenerateScenePair(
+                       FbxManager* pSdkManager,
+                       const SceneDesc& pDesc,
+                       const char* pLightingFile,
+                       const char* pSmoothFile,
+                       int pFileFormat
+                       )
+{
+    SyntheticMeshDesc lMeshDesc;
+    lMeshDesc.mTopology     = pDesc.mTopology;
+    lMeshDesc.mMapping      = pDesc.mMapping;
+    lMeshDesc.mReference    = pDesc.mReference;
+    lMeshDesc.mElementCount = pDesc.mVertexCount;
+
+    SyntheticMesh lMesh;
+    BuildSyntheticMesh(lMeshDesc, lMesh);
+
+    // one scene at a time to bound the memory
+    bool lStatus = true;
+    for( int lSmooth = 0; lSmooth < 2 && lStatus; lSmooth++ )
+    {
+        FbxScene* lScene = FbxScene::Create(pSdkManager, lSmooth ? "Smooth" : "Lighting");
+        BuildScene(lScene, pDesc, lMesh, lSmooth != 0);
+        lStatus = WriteScene(pSdkManager, lScene, lSmooth ? pSmoothFile : pLightingFile, pFileFormat);
+        lScene->Destroy();
+    }
+    return lStatus;
+}
@@ -0,0 +1,51 @@
+// SceneGenerator.h : writes synthetic (lighting mesh, smooth mesh) FBX pairs.
+//
+// Both files have the same node hierarchy and the same meshes, the lighting
+// file gets the hard normals and the smooth file the smooth normals of the
+// SyntheticMesh, so that the pair can be merged by ImportExport.
+
+#pragma once
+
+// use the fbxsdk.h
+#include <fbxsdk.h>
+
+#include "SyntheticMesh.h"
+
+struct SceneDesc
+{
+    int                mNodeCount;          // mesh nodes, every node has its own mesh
+    int                mDepth;              // levels of the node hierarchy below the root
+    int                mVertexCount;        // normal elements of every mesh
+    int                mLayerCount;         // layers of every mesh, each one with a UV set
+    int                mAnimStackCount;     // animation stacks, with a translation curve per node
+    ESyntheticTopology mTopology;
+    EElementMapping    mMapping;
+    EElementReference  mReference;
+
+    SceneDesc()
+        : mNodeCount(16), mDepth(3), mVertexCount(10000), mLayerCount(1), mAnimStackCount(0)
+        , mTopology(eTopologyQuads), mMapping(eMapByPolygonVertex), mReference(eRefDirect) {}
+};
+
+// parses the scene option at pArgv[pIndex] and advances pIndex past its value.
+// Returns false if pArgv[pIndex] is not a scene option or its value is invalid,
+// pKnown tells which of the two happened.
+bool ParseSceneOption(
+                      int pArgc,
+                      char** pArgv,
+                      int& pIndex,
+                      SceneDesc& pDesc,
+                      bool& pKnown
+                      );
+
+// usage lines of the scene options
+const char* GetSceneOptionsUsage();
+
+// writes the pair with the writer pFileFormat, -1 for the native binary writer
+bool GenerateScenePair(
+                       FbxManager* pSdkManager,
+                       const SceneDesc& pDesc,
+                       const char* pLightingFile,
+                       const char* pSmoothFile,
+                       int pFileFormat
+                       );
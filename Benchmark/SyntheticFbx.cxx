@@ -0,0 +1,209 @@
+// SyntheticFbx.cxx : minimal binary FBX files of synthetic meshes.
+
+#include "SyntheticFbx.h"
+
+#include "BinaryFbxRecord.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+// a record with a single property
+static void AddIntRecord(RecordWriter& pWriter, const char* pName, int32_t pValue)
+{
+    pWriter.Begin(pName);
+    pWriter.AddInt(pValue);
+    pWriter.End();
+}
+
+static void AddStringRecord(RecordWriter& pWriter, const char* pName, const char* pValue)
+{
+    pWriter.Begin(pName);
+    pWriter.AddString(pValue);
+    pWriter.End();
+}
+
+// "name\0\1Class"
+static std::string GetObjectName(const std::string& pName, const char* pClass)
+{
+    return pName + std::string("\0\1", 2) + pClass;
+}
+
+static void WriteNormalLayer(RecordWriter& pWriter, int pLayer, const SyntheticMesh& pMesh, bool pDecoy)
+{
+    const ElementView& lSource = pMesh.mSource;
+    pWriter.Begin("LayerElementNormal");
+    pWriter.AddInt(pLayer);
+    AddIntRecord(pWriter, "Version", 102);
+    AddStringRecord(pWriter, "Name", "");
+    AddStringRecord(pWriter, "MappingInformationType", lSource.mMapping == eMapByControlPoint ? "ByVertice" : "ByPolygonVertex");
+    AddStringRecord(pWriter, "ReferenceInformationType", lSource.mReference == eRefDirect ? "Direct" : "IndexToDirect");
+
+    // the decoy layer has a single, wrong normal
+    std::vector<double> lNormals(size_t(pDecoy ? 1 : lSource.mDirectCount) * 3, 0.0);
+    for( size_t i = 0; i < lNormals.size() && !pDecoy; i++ )
+        lNormals[i] = lSource.mDirect[(i / 3) * lSource.mStride + i % 3];
+    pWriter.Begin("Normals");
+    pWriter.AddArray('d', &lNormals[0], uint32_t(lNormals.size()), sizeof(double));
+    pWriter.End();
+
+    if( lSource.mReference == eRefIndexToDirect && !pDecoy )
+    {
+        pWriter.Begin("NormalsIndex");
+        pWriter.AddArray('i', lSource.mIndex, uint32_t(lSource.mIndexCount), sizeof(int));
+        pWriter.End();
+    }
+    pWriter.End();
+}
+
+static void WriteGeometry(RecordWriter& pWriter, int64_t pId, const std::string& pName, const SyntheticMesh& pMesh)
+{
+    const MeshView& lView = pMesh.mView;
+    pWriter.Begin("Geometry");
+    pWriter.AddLong(pId);
+    std::string lName = GetObjectName(pName, "Geometry");
+    pWriter.AddString(lName.c_str(), lName.size());
+    pWriter.AddString("Mesh");
+
+    std::vector<double> lPositions(size_t(lView.mControlPointCount) * 3);
+    for( size_t i = 0; i < lPositions.size(); i++ )
+        lPositions[i] = lView.mPositions[(i / 3) * lView.mPositionStride + i % 3];
+    pWriter.Begin("Vertices");
+    pWriter.AddArray('d', lPositions.empty() ? NULL : &lPositions[0], uint32_t(lPositions.size()), sizeof(double));
+    pWriter.End();
+
+    // the last corner of a polygon is stored as ~index
+    int lCount = lView.mPolygonStarts[lView.mPolygonCount];
+    std::vector<int> lPolygonVertices(lView.mPolygonVertices, lView.mPolygonVertices + lCount);
+    for( int p = 0; p < lView.mPolygonCount; p++ )
+        lPolygonVertices[lView.mPolygonStarts[p + 1] - 1] = ~lPolygonVertices[lView.mPolygonStarts[p + 1] - 1];
+    pWriter.Begin("PolygonVertexIndex");
+    pWriter.AddArray('i', lPolygonVertices.empty() ? NULL : &lPolygonVertices[0], uint32_t(lCount), sizeof(int));
+    pWriter.End();
+
+    AddIntRecord(pWriter, "GeometryVersion", 124);
+    WriteNormalLayer(pWriter, 1, pMesh, true);
+    WriteNormalLayer(pWriter, 0, pMesh, false);
+
+    // a UV layer the reader skips
+    std::vector<float> lUVs(size_t(lView.mControlPointCount) * 2, 0.5f);
+    pWriter.Begin("LayerElementUV");
+    pWriter.AddInt(0);
+    AddStringRecord(pWriter, "MappingInformationType", "ByVertice");
+    AddStringRecord(pWriter, "ReferenceInformationType", "Direct");
+    pWriter.Begin("UV");
+    pWriter.AddArray('f', lUVs.empty() ? NULL : &lUVs[0], uint32_t(lUVs.size()), sizeof(float));
+    pWriter.End();
+    pWriter.End();
+
+    // the layers list the elements, the second one the decoy normals
+    for( int lLayer = 0; lLayer < 2; lLayer++ )
+    {
+        pWriter.Begin("Layer");
+        pWriter.AddInt(lLayer);
+        AddIntRecord(pWriter, "Version", 100);
+        for( int lElement = 0; lElement < 2 - lLayer; lElement++ )
+        {
+            pWriter.Begin("LayerElement");
+            AddStringRecord(pWriter, "Type", lElement == 0 ? "LayerElementNormal" : "LayerElementUV");
+            AddIntRecord(pWriter, "TypedIndex", lLayer);
+            pWriter.End();
+        }
+        pWriter.End();
+    }
+
+    pWriter.End();
+}
+
+bool WriteSyntheticFbx(
+                       const char* pFilename,
+                       int pVersion,
+                       bool pCompress,
+                       const std::vector<const SyntheticMesh*>& pMeshes,
+                       const std::vector<std::string>& pNames
+                       )
+{
+    RecordWriter lWriter(pVersion, pCompress);
+    std::vector<unsigned char>& lData = lWriter.GetData();
+    lData.assign(kFbxMagic, kFbxMagic + sizeof(kFbxMagic));
+    lData.push_back(0x1a);
+    lData.push_back(0x00);
+    uint32_t lVersion = uint32_t(pVersion);
+    lData.insert(lData.end(), reinterpret_cast<unsigned char*>(&lVersion), reinterpret_cast<unsigned char*>(&lVersion) + 4);
+
+    lWriter.Begin("FBXHeaderExtension");
+    AddIntRecord(lWriter, "FBXHeaderVersion", 1003);
+    AddIntRecord(lWriter, "FBXVersion", pVersion);
+    AddStringRecord(lWriter, "Creator", "NormalMergerBench");
+    lWriter.End();
+
+    lWriter.Begin("GlobalSettings");
+    AddIntRecord(lWriter, "Version", 1000);
+    lWriter.Begin("Properties70");
+    lWriter.Begin("P");
+    lWriter.AddString("UnitScaleFactor");
+    lWriter.AddString("double");
+    lWriter.AddString("Number");
+    lWriter.AddString("");
+    lWriter.AddDouble(1.0);
+    lWriter.End();
+    lWriter.End();
+    lWriter.End();
+
+    lWriter.Begin("Definitions");
+    AddIntRecord(lWriter, "Version", 100);
+    AddIntRecord(lWriter, "Count", int(pMeshes.size()) * 2);
+    lWriter.End();
+
+    // ids: model 1000 + 2i, geometry 1001 + 2i
+    lWriter.Begin("Objects");
+    for( size_t i = 0; i < pMeshes.size(); i++ )
+    {
+        WriteGeometry(lWriter, 1001 + 2 * int64_t(i), pNames[i], *pMeshes[i]);
+
+        lWriter.Begin("Model");
+        lWriter.AddLong(1000 + 2 * int64_t(i));
+        std::string lName = GetObjectName(pNames[i], "Model");
+        lWriter.AddString(lName.c_str(), lName.size());
+        lWriter.AddString("Mesh");
+        AddIntRecord(lWriter, "Version", 232);
+        lWriter.End();
+    }
+    lWriter.End();
+
+    lWriter.Begin("Connections");
+    for( size_t i = 0; i < pMeshes.size(); i++ )
+    {
+        lWriter.Begin("C");
+        lWriter.AddString("OO");
+        lWriter.AddLong(1000 + 2 * int64_t(i));
+        lWriter.AddLong(0);
+        lWriter.End();
+        lWriter.Begin("C");
+        lWriter.AddString("OO");
+        lWriter.AddLong(1001 + 2 * int64_t(i));
+        lWriter.AddLong(1000 + 2 * int64_t(i));
+        lWriter.End();
+    }
+    lWriter.End();
+
+    lWriter.Begin("Takes");
+    AddStringRecord(lWriter, "Current", "");
+    lWriter.End();
+
+    // the null record closing the top records, then the footer
+    static const unsigned char kFooterId[16] = { 0xfa, 0xbc, 0xab, 0x09, 0xd0, 0xc8, 0xd4, 0x66,
+                                                 0xb1, 0x76, 0xfb, 0x83, 0x1c, 0xf7, 0x26, 0x7e };
+    lData.resize(lData.size() + GetRecordHeaderSize(pVersion), 0);
+    lData.insert(lData.end(), kFooterId, kFooterId + sizeof(kFooterId));
+    lData.resize(lData.size() + 4, 0);
+    lData.resize(lData.size() + GetFooterPadding(lData.size()), 0);
+    lData.insert(lData.end(), reinterpret_cast<unsigned char*>(&lVersion), reinterpret_cast<unsigned char*>(&lVersion) + 4);
+    lData.resize(lData.size() + 120, 0);
+    lData.insert(lData.end(), kFbxFooterMagic, kFbxFooterMagic + sizeof(kFbxFooterMagic));
+
+    FILE* lFile = fopen(pFilename, "wb");
+    if( lFile == NULL ) return false;
+    bool lWritten = fwrite(&lData[0], 1, lData.size(), lFile) == lData.size();
+    return fclose(lFile) == 0 && lWritten;
+}
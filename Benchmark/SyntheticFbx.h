@@ -0,0 +1,26 @@
+// SyntheticFbx.h : minimal binary FBX files of synthetic meshes, for the benchmarks
+// of the native reader (BinaryFbx.h) without the FBX SDK.
+//
+// The file has the records the SDK writes around the meshes (header extension,
+// global settings, definitions, takes), records to skip in every geometry (a UV
+// layer, a second normal layer before the first one), one Model per mesh and the
+// Connections. The positions are the control points of the mesh and the normals
+// its smooth normals, in the mapping and reference of its source view.
+
+#pragma once
+
+#include "SyntheticMesh.h"
+
+#include <string>
+#include <vector>
+
+// writes pMeshes, named pNames, as a binary FBX file of version pVersion (7400 and
+// 7500 use 32 and 64 bit record offsets). pCompress deflates the arrays like the SDK,
+// when zlib is there (NORMALMERGER_ZLIB).
+bool WriteSyntheticFbx(
+                       const char* pFilename,
+                       int pVersion,
+                       bool pCompress,
+                       const std::vector<const SyntheticMesh*>& pMeshes,
+                       const std::vector<std::string>& pNames
+                       );
@@ -0,0 +1,196 @@
+// SyntheticMesh.cxx : procedural meshes for the benchmarks.
+
+#include "SyntheticMesh.h"
+
+#include <cmath>
+#include <stddef.h>
+
+const char* GetTopologyName(ESyntheticTopology pTopology)
+{
+    switch( pTopology )
+    {
+    case eTopologyTriangles: return "triangles";
+    case eTopologyQuads:     return "quads";
+    default:                 return "mixed";
+    }
+}
+
+const char* GetMappingName(EElementMapping pMapping)
+{
+    switch( pMapping )
+    {
+    case eMapByControlPoint:  return "by_control_point";
+    case eMapByPolygonVertex: return "by_polygon_vertex";
+    case eMapByPolygon:       return "by_polygon";
+    default:                  return "all_same";
+    }
+}
+
+const char* GetReferenceName(EElementReference pReference)
+{
+    return pReference == eRefDirect ? "direct" : "index_to_direct";
+}
+
+static void AddPolygon(SyntheticMesh& pMesh, const int* pCorners, int pCount)
+{
+    pMesh.mPolygonStarts.push_back(int(pMesh.mPolygonVertices.size()));
+    pMesh.mPolygonVertices.insert(pMesh.mPolygonVertices.end(), pCorners, pCorners + pCount);
+}
+
+// polygons of one row of cells between control point rows pBottom and pTop
+static void AddRow(SyntheticMesh& pMesh, ESyntheticTopology pTopology, int pBottom, int pTop, int pCellCount)
+{
+    int x = 0;
+    int lCell = 0;
+    while( x < pCellCount )
+    {
+        int b = pBottom + x;
+        int t = pTop + x;
+
+        int lType = pTopology == eTopologyTriangles ? 0 : pTopology == eTopologyQuads ? 1 : lCell % 4;
+        if( lType >= 2 && x + 2 > pCellCount ) lType = 1;
+
+        if( lType == 0 )
+        {
+            int lFirst[3]  = { b, b + 1, t + 1 };
+            int lSecond[3] = { b, t + 1, t };
+            AddPolygon(pMesh, lFirst, 3);
+            AddPolygon(pMesh, lSecond, 3);
+            x += 1;
+        }
+        else if( lType == 1 )
+        {
+            int lQuad[4] = { b, b + 1, t + 1, t };
+            AddPolygon(pMesh, lQuad, 4);
+            x += 1;
+        }
+        else if( lType == 2 )
+        {
+            // two cells, the top middle point is left out
+            int lPentagon[5] = { b, b + 1, b + 2, t + 2, t };
+            AddPolygon(pMesh, lPentagon, 5);
+            x += 2;
+        }
+        else
+        {
+            int lHexagon[6] = { b, b + 1, b + 2, t + 2, t + 1, t };
+            AddPolygon(pMesh, lHexagon, 6);
+            x += 2;
+        }
+        lCell++;
+    }
+}
+
+static void SetNormal(double* pNormal, double pX, double pY, double pZ, double pW)
+{
+    pNormal[0] = pX;
+    pNormal[1] = pY;
+    pNormal[2] = pZ;
+    pNormal[3] = pW;
+}
+
+void BuildSyntheticMesh(
+                        const SyntheticMeshDesc& pDesc,
+                        SyntheticMesh& pMesh
+                        )
+{
+    // polygon-vertices per cell, to size the grid for the wanted element count
+    double lPerCell = pDesc.mMapping == eMapByControlPoint ? 1.0 :
+                      pDesc.mTopology == eTopologyTriangles ? 6.0 :
+                      pDesc.mTopology == eTopologyQuads ? 4.0 : 3.75;
+
+    int lCellCount = int(std::ceil(std::sqrt(pDesc.mElementCount / lPerCell)));
+    if( lCellCount < 2 ) lCellCount = 2;
+    int lSide = lCellCount + 1;
+    int lRowCount = lCellCount;
+
+    // grows the number of rows until the element count is reached
+    pMesh = SyntheticMesh();
+    int lRows = 0;
+    for( ;; )
+    {
+        AddRow(pMesh, pDesc.mTopology, lRows * lSide, (lRows + 1) * lSide, lCellCount);
+        lRows++;
+
+        int lElements = pDesc.mMapping == eMapByControlPoint ? (lRows + 1) * lSide : int(pMesh.mPolygonVertices.size());
+        if( lRows >= lRowCount && lElements >= pDesc.mElementCount ) break;
+    }
+    pMesh.mPolygonStarts.push_back(int(pMesh.mPolygonVertices.size()));
+
+    int lControlPointCount = (lRows + 1) * lSide;
+    int lPolygonCount = int(pMesh.mPolygonStarts.size()) - 1;
+    int lPolygonVertexCount = int(pMesh.mPolygonVertices.size());
+
+    // a wavy height field
+    pMesh.mPositions.resize(size_t(lControlPointCount) * 4);
+    for( int i = 0; i < lControlPointCount; i++ )
+    {
+        double x = i % lSide, z = i / lSide;
+        SetNormal(&pMesh.mPositions[size_t(i) * 4], x, std::sin(0.1 * x) * std::cos(0.1 * z), z, 1.0);
+    }
+
+    int lElementCount = pDesc.mMapping == eMapByControlPoint ? lControlPointCount : lPolygonVertexCount;
+
+    // smooth normals: one per control point, not normalized on purpose
+    // (the merge normalizes them), indexed through the polygon-vertices
+    int lSmoothCount = pDesc.mReference == eRefDirect ? lElementCount : lControlPointCount;
+    pMesh.mSmoothNormals.resize(size_t(lSmoothCount) * 4);
+    for( int i = 0; i < lSmoothCount; i++ )
+    {
+        double lAngle = 0.37 * i;
+        SetNormal(&pMesh.mSmoothNormals[size_t(i) * 4], 0.3 * std::sin(lAngle), 1.5, 0.3 * std::cos(lAngle), 0.0);
+    }
+    if( pDesc.mReference == eRefIndexToDirect )
+    {
+        if( pDesc.mMapping == eMapByControlPoint )
+        {
+            pMesh.mSmoothIndex.resize(lElementCount);
+            for( int i = 0; i < lElementCount; i++ ) pMesh.mSmoothIndex[i] = i;
+        }
+        else
+        {
+            pMesh.mSmoothIndex = pMesh.mPolygonVertices;
+        }
+    }
+
+    // lighting normals: unit length, flat (one per polygon) when indexed
+    int lNormalCount = pDesc.mReference == eRefDirect || pDesc.mMapping == eMapByControlPoint ? lElementCount : lPolygonCount;
+    pMesh.mNormals.resize(size_t(lNormalCount) * 4);
+    for( int i = 0; i < lNormalCount; i++ )
+    {
+        double lAngle = 0.001 * i;
+        SetNormal(&pMesh.mNormals[size_t(i) * 4], 0.6 * std::sin(lAngle), 0.8, 0.6 * std::cos(lAngle), 0.0);
+    }
+    if( pDesc.mReference == eRefIndexToDirect )
+    {
+        pMesh.mNormalIndex.resize(lElementCount);
+        if( pDesc.mMapping == eMapByControlPoint )
+        {
+            for( int i = 0; i < lElementCount; i++ ) pMesh.mNormalIndex[i] = i;
+        }
+        else
+        {
+            for( int p = 0; p < lPolygonCount; p++ )
+                for( int i = pMesh.mPolygonStarts[p]; i < pMesh.mPolygonStarts[p + 1]; i++ )
+                    pMesh.mNormalIndex[i] = p;
+        }
+    }
+
+    MeshView& lView = pMesh.mView;
+    lView.mPositions         = &pMesh.mPositions[0];
+    lView.mPositionStride    = 4;
+    lView.mControlPointCount = lControlPointCount;
+    lView.mPolygonVertices   = &pMesh.mPolygonVertices[0];
+    lView.mPolygonStarts     = &pMesh.mPolygonStarts[0];
+    lView.mPolygonCount      = lPolygonCount;
+
+    bool lIndexed = pDesc.mReference == eRefIndexToDirect;
+
+    ElementView lNormals = { pDesc.mMapping, pDesc.mReference, &pMesh.mNormals[0], lNormalCount, 4,
+                             lIndexed ? &pMesh.mNormalIndex[0] : NULL, lIndexed ? lElementCount : 0 };
+    lView.mNormals = lNormals;
+
+    ElementView lSource = { pDesc.mMapping, pDesc.mReference, &pMesh.mSmoothNormals[0], lSmoothCount, 4,
+                            lIndexed ? &pMesh.mSmoothIndex[0] : NULL, lIndexed ? lElementCount : 0 };
+    pMesh.mSource = lSource;
+}
@@ -0,0 +1,52 @@
+// SyntheticMesh.h : procedural meshes for the benchmarks.
+//
+// The meshes are rows of polygons over a grid of control points, so that the
+// polygon-vertices of neighbouring polygons share control points like in a
+// real model. Normal arrays use FbxVector4 layout (4 doubles per vector).
+
+#pragma once
+
+#include "MergeCore.h"
+
+#include <vector>
+
+enum ESyntheticTopology
+{
+    eTopologyTriangles,
+    eTopologyQuads,
+    eTopologyMixed          // triangles, quads, pentagons and hexagons
+};
+
+struct SyntheticMeshDesc
+{
+    ESyntheticTopology mTopology;
+    EElementMapping    mMapping;            // eMapByControlPoint or eMapByPolygonVertex
+    EElementReference  mReference;          // of both the smooth and the lighting normals
+    int                mElementCount;       // wanted number of normal elements, the mesh gets at least this many
+};
+
+// a mesh with its lighting normals and the smooth normals of the second input
+struct SyntheticMesh
+{
+    std::vector<double> mPositions;
+    std::vector<int>    mPolygonVertices;
+    std::vector<int>    mPolygonStarts;
+
+    std::vector<double> mNormals;
+    std::vector<int>    mNormalIndex;
+    std::vector<double> mSmoothNormals;
+    std::vector<int>    mSmoothIndex;
+
+    MeshView            mView;
+    ElementView         mSource;
+};
+
+const char* GetTopologyName(ESyntheticTopology pTopology);
+const char* GetMappingName(EElementMapping pMapping);
+const char* GetReferenceName(EElementReference pReference);
+
+// builds the mesh, the views point into pMesh which must not be copied afterwards
+void BuildSyntheticMesh(
+                        const SyntheticMeshDesc& pDesc,
+                        SyntheticMesh& pMesh
+                        );
@@ -0,0 +1,453 @@
+// BinaryFbx.cxx : native reader of the meshes and normals of a binary FBX file.
+
+#include "BinaryFbx.h"
+#include "BinaryFbxRecord.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef NORMALMERGER_ZLIB
+static const char*  kDamagedError = "damaged record or array";
+#else
+static const char*  kDamagedError = "damaged record or array, or compressed array (built without zlib)";
+#endif
+
+// an array to read outside of the mapping, once all the records are walked
+struct ArrayRead
+{
+    Property mProperty;
+    void*    mValues;
+    size_t   mElementSize;      // of the values in the file
+    bool     mFloat;            // float values read into doubles
+};
+
+static bool RunArrayRead(const ArrayRead& pRead)
+{
+    if( !pRead.mFloat ) return ReadArrayValues(pRead.mProperty, pRead.mElementSize, pRead.mValues);
+
+    std::vector<float> lFloats(pRead.mProperty.mCount);
+    if( !ReadArrayValues(pRead.mProperty, sizeof(float), &lFloats[0]) ) return false;
+    std::copy(lFloats.begin(), lFloats.end(), static_cast<double*>(pRead.mValues));
+    return true;
+}
+
+// an array of T ('d' or 'i'), or of float converted to double ('f'). A raw aligned
+// array is read in the mapping unless pCopy, the others are sized in pStorage and
+// added to pReads.
+template <class T>
+static bool PrepareArray(
+                         const Property& pProperty,
+                         char pType,
+                         bool pCopy,
+                         std::vector<T>& pStorage,
+                         const T*& pValues,
+                         std::vector<ArrayRead>& pReads
+                         )
+{
+    bool lFloat = pProperty.mType == 'f' && pType == 'd';
+    size_t lElementSize = lFloat ? sizeof(float) : sizeof(T);
+    if( (pProperty.mType != pType && !lFloat) || pProperty.mCount > 0x7fffffffu ) return false;
+    if( pProperty.mEncoding == 0 && pProperty.mSize != size_t(pProperty.mCount) * lElementSize ) return false;
+#ifdef NORMALMERGER_ZLIB
+    if( pProperty.mEncoding > 1 ) return false;
+#else
+    if( pProperty.mEncoding > 0 ) return false;
+#endif
+
+    bool lAligned = reinterpret_cast<uintptr_t>(pProperty.mData) % sizeof(T) == 0;
+    if( pProperty.mEncoding == 0 && lAligned && !lFloat && !pCopy )
+    {
+        pStorage.clear();
+        pValues = reinterpret_cast<const T*>(pProperty.mData);
+        return true;
+    }
+
+    pStorage.resize(pProperty.mCount);
+    pValues = pStorage.empty() ? NULL : &pStorage[0];
+    if( pStorage.empty() ) return true;
+
+    ArrayRead lRead = { pProperty, &pStorage[0], lElementSize, lFloat };
+    pReads.push_back(lRead);
+    return true;
+}
+
+// the array property of the child pName of pRecord; false if there is none or it can't be read
+template <class T>
+static bool PrepareChildArray(
+                              const RecordReader& pReader,
+                              const Record& pRecord,
+                              const char* pName,
+                              char pType,
+                              bool pCopy,
+                              std::vector<T>& pStorage,
+                              const T*& pValues,
+                              int& pCount,
+                              std::vector<ArrayRead>& pReads,
+                              bool& pDamaged
+                              )
+{
+    Record lChild;
+    Property lProperty;
+    if( !pReader.FindChild(pRecord, pName, lChild, pDamaged) || !pReader.GetProperty(lChild, 0, lProperty) ) return false;
+    if( !PrepareArray(lProperty, pType, pCopy, pStorage, pValues, pReads) )
+    {
+        pDamaged = true;
+        return false;
+    }
+    pCount = int(lProperty.mCount);
+    return true;
+}
+
+static bool GetMapping(const std::string& pName, EElementMapping& pMapping)
+{
+    if( pName == "ByVertice" || pName == "ByVertex" || pName == "ByControlPoint" ) pMapping = eMapByControlPoint;
+    else if( pName == "ByPolygonVertex" ) pMapping = eMapByPolygonVertex;
+    else if( pName == "ByPolygon" )       pMapping = eMapByPolygon;
+    else if( pName == "AllSame" )         pMapping = eMapAllSame;
+    else return false;
+    return true;
+}
+
+// finds the positions, the polygons and the first normal layer of a Geometry record and
+// adds their arrays to pReads. Returns false if the mesh is left out; pDamaged is set if
+// an array can't be read.
+static bool PrepareGeometry(
+                            const RecordReader& pReader,
+                            const Record& pGeometry,
+                            BinaryFbxMesh& pMesh,
+                            std::vector<ArrayRead>& pReads,
+                            bool& pDamaged
+                            )
+{
+    MeshView& lView = pMesh.mView;
+    int lCount = 0;
+    size_t lFirstRead = pReads.size();
+
+    if( !PrepareChildArray(pReader, pGeometry, "Vertices", 'd', false, pMesh.mPositionValues, lView.mPositions, lCount, pReads, pDamaged) ||
+        lCount % 3 != 0 )
+    {
+        pReads.resize(lFirstRead);
+        return false;
+    }
+    lView.mPositionStride    = 3;
+    lView.mControlPointCount = lCount / 3;
+
+    // the polygon-vertices are copied to be decoded in place (FinishGeometry)
+    const int* lPolygonVertices = NULL;
+    if( !PrepareChildArray(pReader, pGeometry, "PolygonVertexIndex", 'i', true, pMesh.mPolygonVertices, lPolygonVertices, lCount, pReads, pDamaged) )
+    {
+        pReads.resize(lFirstRead);
+        return false;
+    }
+
+    Record lLayer;
+    bool lFound = pReader.FindLayerElement(pGeometry, "LayerElementNormal", lLayer, pDamaged);
+
+    ElementView& lNormals = lView.mNormals;
+    std::string lMapping, lReference;
+    Record lRecord;
+    bool lValid = lFound && pReader.FindChild(lLayer, "MappingInformationType", lRecord, pDamaged) &&
+                  pReader.GetString(lRecord, 0, lMapping) && GetMapping(lMapping, lNormals.mMapping);
+    if( lValid )
+    {
+        if( !pReader.FindChild(lLayer, "ReferenceInformationType", lRecord, pDamaged) || !pReader.GetString(lRecord, 0, lReference) )
+            lReference = "Direct";
+        lNormals.mReference  = lReference == "Direct" ? eRefDirect : eRefIndexToDirect;
+        lNormals.mStride     = 3;
+        lNormals.mIndex      = NULL;
+        lNormals.mIndexCount = 0;
+
+        lValid = PrepareChildArray(pReader, lLayer, "Normals", 'd', false, pMesh.mNormalValues, lNormals.mDirect, lCount, pReads, pDamaged) &&
+                 lCount % 3 == 0;
+        lNormals.mDirectCount = lCount / 3;
+    }
+    if( lValid && lNormals.mReference == eRefIndexToDirect )
+        lValid = PrepareChildArray(pReader, lLayer, "NormalsIndex", 'i', false, pMesh.mNormalIndex, lNormals.mIndex, lNormals.mIndexCount, pReads, pDamaged);
+
+    if( !lValid ) pReads.resize(lFirstRead);
+    return lValid;
+}
+
+// decodes the polygons once the arrays are read: the last corner of a polygon is stored
+// as ~index. Returns false if the last polygon is not closed or a polygon-vertex is not
+// a control point of the mesh.
+static bool FinishGeometry(BinaryFbxMesh& pMesh)
+{
+    MeshView& lView = pMesh.mView;
+    int lCount = int(pMesh.mPolygonVertices.size());
+    bool lValid = true;
+    pMesh.mPolygonStarts.assign(1, 0);
+    for( int i = 0; i < lCount; i++ )
+    {
+        if( pMesh.mPolygonVertices[i] < 0 )
+        {
+            pMesh.mPolygonVertices[i] = ~pMesh.mPolygonVertices[i];
+            pMesh.mPolygonStarts.push_back(i + 1);
+        }
+        lValid = lValid && pMesh.mPolygonVertices[i] < lView.mControlPointCount;
+    }
+    lView.mPolygonCount = int(pMesh.mPolygonStarts.size()) - 1;
+    return lValid && pMesh.mPolygonStarts.back() == lCount;
+}
+
+BinaryFbxFile::BinaryFbxFile()
+    : mData(NULL)
+    , mSize(0)
+    , mMapping(NULL)
+    , mVersion(0)
+{
+}
+
+BinaryFbxFile::~BinaryFbxFile()
+{
+    Close();
+}
+
+bool BinaryFbxFile::Open(const char* pFilename, WorkStealingPool* pPool)
+{
+    Close();
+    if( !Map(pFilename) ) return false;
+    if( Parse(pPool) ) return true;
+
+    Close();
+    return false;
+}
+
+void BinaryFbxFile::Close()
+{
+    mMeshes.clear();
+    mNodes.clear();
+    mVersion = 0;
+    if( mData == NULL ) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(mData);
+    CloseHandle(mMapping);
+#else
+    munmap(const_cast<unsigned char*>(mData), mSize);
+#endif
+    mData = NULL;
+    mSize = 0;
+    mMapping = NULL;
+}
+
+size_t BinaryFbxFile::GetCopiedBytes() const
+{
+    size_t lBytes = 0;
+    for( size_t i = 0; i < mMeshes.size(); i++ )
+    {
+        const BinaryFbxMesh& lMesh = mMeshes[i];
+        lBytes += (lMesh.mPositionValues.capacity() + lMesh.mNormalValues.capacity()) * sizeof(double) +
+                  (lMesh.mNormalIndex.capacity() + lMesh.mPolygonVertices.capacity() + lMesh.mPolygonStarts.capacity()) * sizeof(int);
+    }
+    return lBytes;
+}
+
+int BinaryFbxFile::FindMesh(const char* pName) const
+{
+    std::vector<std::pair<std::string, int> >::const_iterator lFound =
+        std::lower_bound(mNodes.begin(), mNodes.end(), std::make_pair(std::string(pName), -1));
+    return lFound != mNodes.end() && lFound->first == pName ? lFound->second : -1;
+}
+
+bool BinaryFbxFile::Map(const char* pFilename)
+{
+    mError = std::string("cannot map ") + pFilename;
+#ifdef _WIN32
+    HANDLE lFile = CreateFileA(pFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if( lFile == INVALID_HANDLE_VALUE ) return false;
+
+    LARGE_INTEGER lSize;
+    HANDLE lMapping = NULL;
+    if( GetFileSizeEx(lFile, &lSize) && lSize.QuadPart > 0 )
+        lMapping = CreateFileMappingA(lFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(lFile);
+    if( lMapping == NULL ) return false;
+
+    void* lData = MapViewOfFile(lMapping, FILE_MAP_READ, 0, 0, 0);
+    if( lData == NULL )
+    {
+        CloseHandle(lMapping);
+        return false;
+    }
+    mMapping = lMapping;
+    mSize = size_t(lSize.QuadPart);
+#else
+    int lFile = open(pFilename, O_RDONLY);
+    if( lFile < 0 ) return false;
+
+    struct stat lStat;
+    void* lData = MAP_FAILED;
+    if( fstat(lFile, &lStat) == 0 && lStat.st_size > 0 )
+        lData = mmap(NULL, size_t(lStat.st_size), PROT_READ, MAP_PRIVATE, lFile, 0);
+    close(lFile);
+    if( lData == MAP_FAILED ) return false;
+    mSize = size_t(lStat.st_size);
+#endif
+    mData = static_cast<const unsigned char*>(lData);
+    mError.clear();
+    return true;
+}
+
+bool BinaryFbxFile::Parse(WorkStealingPool* pPool)
+{
+    if( mSize < kFbxHeaderSize || memcmp(mData, kFbxMagic, sizeof(kFbxMagic)) != 0 || mData[21] != 0x1a )
+    {
+        mError = "not a binary FBX file";
+        return false;
+    }
+    mVersion = int(ReadValue<uint32_t>(mData + 23));
+    if( mVersion < 7000 || mVersion >= 8000 )
+    {
+        char lMessage[64];
+        snprintf(lMessage, sizeof(lMessage), "binary FBX version %d is not 7.x", mVersion);
+        mError = lMessage;
+        return false;
+    }
+
+    RecordReader lReader(mData, mVersion);
+    std::map<int64_t, std::string> lModels;         // id -> name
+    std::vector<int64_t> lMeshIds;                  // of the geometry of every mesh
+    std::vector<std::pair<int64_t, int64_t> > lLinks;
+    std::vector<ArrayRead> lReads;
+    bool lDamaged = false;
+
+    Record lTop;
+    size_t lOffset = kFbxHeaderSize;
+    for( ; lReader.ReadRecord(lOffset, mSize, lTop, lDamaged); lOffset = lTop.mEnd )
+    {
+        Record lObject;
+        if( lTop.IsNamed("Objects") )
+        {
+            for( size_t lChild = lTop.mChildren; lReader.ReadRecord(lChild, lTop.mEnd, lObject, lDamaged); lChild = lObject.mEnd )
+            {
+                bool lModel = lObject.IsNamed("Model");
+                if( !lModel && !lObject.IsNamed("Geometry") ) continue;
+
+                // the name is "name\0\1Class"
+                int64_t lId;
+                std::string lName, lType;
+                if( !lReader.GetInteger(lObject, 0, lId) || !lReader.GetString(lObject, 1, lName) ) continue;
+                lName = lName.substr(0, lName.find('\0'));
+                if( lModel )
+                {
+                    lModels[lId] = lName;
+                    continue;
+                }
+                if( !lReader.GetString(lObject, 2, lType) || lType != "Mesh" ) continue;
+
+                // the reads point into the arrays of lMesh, which keep their memory in mMeshes
+                BinaryFbxMesh lMesh;
+                size_t lFirstRead = lReads.size();
+                if( PrepareGeometry(lReader, lObject, lMesh, lReads, lDamaged) )
+                {
+                    lMesh.mRecord = lObject.mStart;
+                    lMesh.mCompressed = false;
+                    for( size_t i = lFirstRead; i < lReads.size(); i++ ) lMesh.mCompressed |= lReads[i].mProperty.mEncoding != 0;
+                    lMeshIds.push_back(lId);
+                    mMeshes.push_back(BinaryFbxMesh());
+                    std::swap(mMeshes.back(), lMesh);
+                }
+                if( lDamaged ) break;
+            }
+        }
+        else if( lTop.IsNamed("Connections") )
+        {
+            // "C", "OO", child, parent: the geometry is the child of its model
+            for( size_t lChild = lTop.mChildren; lReader.ReadRecord(lChild, lTop.mEnd, lObject, lDamaged); lChild = lObject.mEnd )
+            {
+                int64_t lSource, lDestination;
+                std::string lType;
+                if( lObject.IsNamed("C") && lReader.GetString(lObject, 0, lType) && lType == "OO" &&
+                    lReader.GetInteger(lObject, 1, lSource) && lReader.GetInteger(lObject, 2, lDestination) )
+                    lLinks.push_back(std::make_pair(lSource, lDestination));
+            }
+        }
+        if( lDamaged ) break;
+    }
+
+    // the top records end with a null record, a file cut between two records has none
+    if( lDamaged || lOffset + GetRecordHeaderSize(mVersion) > mSize )
+    {
+        mError = kDamagedError;
+        return false;
+    }
+
+    // the arrays are inflated in parallel, biggest first
+    std::stable_sort(lReads.begin(), lReads.end(), [](const ArrayRead& pA, const ArrayRead& pB)
+    {
+        return pA.mProperty.mSize > pB.mProperty.mSize;
+    });
+    std::vector<char> lRead(lReads.size(), 0);
+    std::vector<char> lClosed(mMeshes.size(), 0);
+    if( pPool )
+    {
+        pPool->Run(int(lReads.size()), [&](int pRead) { lRead[pRead] = RunArrayRead(lReads[pRead]); });
+        pPool->Run(int(mMeshes.size()), [&](int pMesh) { lClosed[pMesh] = FinishGeometry(mMeshes[pMesh]); });
+    }
+    else
+    {
+        for( size_t i = 0; i < lReads.size(); i++ ) lRead[i] = RunArrayRead(lReads[i]);
+        for( size_t i = 0; i < mMeshes.size(); i++ ) lClosed[i] = FinishGeometry(mMeshes[i]);
+    }
+    if( std::find(lRead.begin(), lRead.end(), 0) != lRead.end() )
+    {
+        mError = kDamagedError;
+        return false;
+    }
+
+    // the meshes with an open polygon or a polygon-vertex out of range are left out
+    std::map<int64_t, size_t> lGeometries;          // id -> mesh
+    size_t lKept = 0;
+    for( size_t i = 0; i < mMeshes.size(); i++ )
+    {
+        if( !lClosed[i] ) continue;
+        if( lKept != i ) std::swap(mMeshes[lKept], mMeshes[i]);
+        lGeometries[lMeshIds[i]] = lKept++;
+    }
+    mMeshes.resize(lKept);
+
+    // an instanced geometry is found under every model using it, and is named after the first one
+    for( size_t i = 0; i < lLinks.size(); i++ )
+    {
+        std::map<int64_t, size_t>::const_iterator lGeometry = lGeometries.find(lLinks[i].first);
+        std::map<int64_t, std::string>::const_iterator lModel = lModels.find(lLinks[i].second);
+        if( lGeometry == lGeometries.end() || lModel == lModels.end() ) continue;
+
+        BinaryFbxMesh& lMesh = mMeshes[lGeometry->second];
+        if( lMesh.mName.empty() ) lMesh.mName = lModel->second;
+        mNodes.push_back(std::make_pair(lModel->second, int(lGeometry->second)));
+    }
+    std::sort(mNodes.begin(), mNodes.end());
+
+    // the arrays of the meshes do not move anymore, the views not in the mapping point into them
+    for( size_t i = 0; i < mMeshes.size(); i++ )
+    {
+        BinaryFbxMesh& lMesh = mMeshes[i];
+        if( !lMesh.mPositionValues.empty() ) lMesh.mView.mPositions = &lMesh.mPositionValues[0];
+        if( !lMesh.mNormalValues.empty() )   lMesh.mView.mNormals.mDirect = &lMesh.mNormalValues[0];
+        if( !lMesh.mNormalIndex.empty() )    lMesh.mView.mNormals.mIndex = &lMesh.mNormalIndex[0];
+        lMesh.mView.mPolygonVertices = lMesh.mPolygonVertices.empty() ? NULL : &lMesh.mPolygonVertices[0];
+        lMesh.mView.mPolygonStarts   = &lMesh.mPolygonStarts[0];
+    }
+    return true;
+}
@@ -0,0 +1,83 @@
+// BinaryFbx.h : native reader of the meshes and normals of a binary FBX file.
+//
+// The smooth scene only gives its normals, so instead of an SDK import the file
+// is memory mapped and its node records are walked in place: only the Model and
+// Geometry records of Objects and the Connections are read, every other record
+// is skipped through its end offset. The arrays used (Vertices,
+// PolygonVertexIndex and the first LayerElementNormal) are inflated when they are
+// compressed, copied when they are not aligned, and otherwise read in the
+// mapping. The arrays are inflated once all the records are walked, in parallel.
+// Binary FBX 7.x only (32 bit record offsets before 7.5, 64 bit after); the
+// compressed arrays need zlib (NORMALMERGER_ZLIB).
+
+#pragma once
+
+#include "MergeCore.h"
+
+#include <stddef.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+class WorkStealingPool;
+
+// a mesh of the file, the views point into the file and into the arrays of the mesh
+struct BinaryFbxMesh
+{
+    std::string         mName;              // of the Model of the geometry, "" if it has none
+    MeshView            mView;              // positions and normals stride 3
+    size_t              mRecord;            // offset of the Geometry record in the file
+    bool                mCompressed;        // some of its arrays are compressed
+
+    std::vector<double> mPositionValues;    // compressed or unaligned arrays
+    std::vector<double> mNormalValues;
+    std::vector<int>    mNormalIndex;
+    std::vector<int>    mPolygonVertices;   // always decoded: the last corner of a polygon is stored as ~index
+    std::vector<int>    mPolygonStarts;
+};
+
+class BinaryFbxFile
+{
+public:
+    BinaryFbxFile();
+    ~BinaryFbxFile();
+
+    // maps pFilename and reads its meshes, false if it is not a binary FBX 7.x file or a
+    // needed record is damaged (GetError). A geometry without normals, with normals in
+    // a mapping the core does not handle, with an open polygon or with a polygon-vertex
+    // which is not a control point is left out.
+    // pPool inflates the arrays in parallel, NULL inflates them on the calling thread.
+    // The views are valid until Close().
+    bool Open(const char* pFilename, WorkStealingPool* pPool = NULL);
+    void Close();
+
+    const char* GetError() const { return mError.c_str(); }
+    int GetVersion() const { return mVersion; }
+    size_t GetFileSize() const { return mSize; }
+    const unsigned char* GetData() const { return mData; }
+
+    // bytes of the arrays read outside of the mapping
+    size_t GetCopiedBytes() const;
+
+    int GetMeshCount() const { return int(mMeshes.size()); }
+    const BinaryFbxMesh& GetMesh(int pIndex) const { return mMeshes[pIndex]; }
+
+    // the mesh of the model named pName, -1 if there is none. An instanced geometry is
+    // found under the names of all its models.
+    int FindMesh(const char* pName) const;
+
+private:
+    BinaryFbxFile(const BinaryFbxFile&);
+    BinaryFbxFile& operator=(const BinaryFbxFile&);
+
+    bool Map(const char* pFilename);
+    bool Parse(WorkStealingPool* pPool);
+
+    const unsigned char*       mData;
+    size_t                     mSize;
+    void*                      mMapping;        // handle of the mapping on Windows
+    int                        mVersion;
+    std::string                mError;
+    std::vector<BinaryFbxMesh> mMeshes;
+    std::vector<std::pair<std::string, int> > mNodes;   // model name and mesh, sorted
+};
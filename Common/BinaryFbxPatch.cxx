@@ -0,0 +1,473 @@
+// BinaryFbxPatch.cxx : copy of a binary FBX file with new tangent and binormal layers.
+
+#include "BinaryFbxPatch.h"
+#include "BinaryFbxRecord.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+// the names of the records of a layer
+struct LayerNames
+{
+    const char* mRecord;
+    const char* mValues;
+    const char* mW;
+    const char* mIndex;
+};
+
+static const LayerNames kLayerNames[2] =
+{
+    { "LayerElementTangent",  "Tangents",  "TangentsW",  "TangentsIndex" },
+    { "LayerElementBinormal", "Binormals", "BinormalsW", "BinormalsIndex" }
+};
+
+// bytes written instead of [mBegin, mEnd) of the file, an insertion if mBegin == mEnd.
+// The records are written at offset 0 and relocated when the splice is written.
+struct Splice
+{
+    size_t       mBegin;
+    size_t       mEnd;
+    RecordWriter mWriter;
+
+    Splice(size_t pBegin, size_t pEnd, int pVersion) : mBegin(pBegin), mEnd(pEnd), mWriter(pVersion, false) {}
+};
+
+// an array of a new layer: the xyz, the W or the index of a view
+struct ArrayJob
+{
+    const ElementView* mView;
+    int                mPart;       // 0 xyz, 1 W, 2 index
+    bool               mCompress;
+    EncodedArray       mArray;
+};
+
+// where the layers of a mesh go: the tangent and binormal records replaced, or added
+// before the null record of the geometry and listed in Layer 0
+struct MeshPatch
+{
+    const BinaryFbxTangents* mTangents;
+    size_t                   mGeometryEnd;      // null record of the geometry
+    size_t                   mLayerEnd;         // null record of Layer 0, 0 if there is none
+    Record                   mElements[2];
+    bool                     mReplaced[2];
+    bool                     mListed[2];
+    size_t                   mFirstJob;         // 3 per layer
+};
+
+static const char* GetMappingName(EElementMapping pMapping)
+{
+    switch( pMapping )
+    {
+    case eMapByControlPoint:  return "ByVertice";
+    case eMapByPolygonVertex: return "ByPolygonVertex";
+    case eMapByPolygon:       return "ByPolygon";
+    default:                  return "AllSame";
+    }
+}
+
+static void RunArrayJob(ArrayJob& pJob)
+{
+    const ElementView& lView = *pJob.mView;
+    EncodedArray& lArray = pJob.mArray;
+    lArray.mEncoding = 0;
+    if( pJob.mPart == 2 )
+    {
+        const unsigned char* lIndex = reinterpret_cast<const unsigned char*>(lView.mIndex);
+        lArray.mType  = 'i';
+        lArray.mCount = uint32_t(lView.mIndexCount);
+        lArray.mBytes.assign(lIndex, lIndex + size_t(lView.mIndexCount) * sizeof(int));
+    }
+    else
+    {
+        int lComponents = pJob.mPart == 0 ? 3 : 1;
+        int lFirst      = pJob.mPart == 0 ? 0 : 3;
+        lArray.mType  = 'd';
+        lArray.mCount = uint32_t(size_t(lView.mDirectCount) * lComponents);
+        lArray.mBytes.resize(size_t(lArray.mCount) * sizeof(double));
+        for( int i = 0; i < lView.mDirectCount; i++ )
+        {
+            memcpy(&lArray.mBytes[(size_t(i) * lComponents) * sizeof(double)], lView.mDirect + size_t(i) * lView.mStride + lFirst,
+                   lComponents * sizeof(double));
+        }
+    }
+    if( pJob.mCompress ) CompressArray(lArray);
+}
+
+// the offset of the null record closing the children of pRecord, false if it has none
+static bool GetListEnd(const RecordReader& pReader, const unsigned char* pData, int pVersion, const Record& pRecord, size_t& pEnd)
+{
+    Record lChild;
+    bool lDamaged = false;
+    size_t lOffset = pRecord.mChildren;
+    while( pReader.ReadRecord(lOffset, pRecord.mEnd, lChild, lDamaged) ) lOffset = lChild.mEnd;
+    if( lDamaged || lOffset + GetRecordHeaderSize(pVersion) != pRecord.mEnd ) return false;
+
+    for( size_t i = lOffset; i < pRecord.mEnd; i++ )
+    {
+        if( pData[i] != 0 ) return false;
+    }
+    pEnd = lOffset;
+    return true;
+}
+
+// whether pLayer lists the element pType of index pIndex
+static bool IsListed(const RecordReader& pReader, const Record& pLayer, const char* pType, int64_t pIndex)
+{
+    Record lEntry, lField;
+    bool lDamaged = false;
+    for( size_t lOffset = pLayer.mChildren; pReader.ReadRecord(lOffset, pLayer.mEnd, lEntry, lDamaged); lOffset = lEntry.mEnd )
+    {
+        std::string lType;
+        int64_t lIndex = -1;
+        if( lEntry.IsNamed("LayerElement") &&
+            pReader.FindChild(lEntry, "Type", lField, lDamaged) && pReader.GetString(lField, 0, lType) && lType == pType &&
+            pReader.FindChild(lEntry, "TypedIndex", lField, lDamaged) && pReader.GetInteger(lField, 0, lIndex) && lIndex == pIndex )
+            return true;
+    }
+    return false;
+}
+
+// finds Layer 0 among the children of pGeometry
+static bool FindLayerZero(const RecordReader& pReader, const Record& pGeometry, Record& pLayer, bool& pDamaged)
+{
+    Record lChild;
+    for( size_t lOffset = pGeometry.mChildren; pReader.ReadRecord(lOffset, pGeometry.mEnd, lChild, pDamaged); lOffset = lChild.mEnd )
+    {
+        int64_t lIndex = -1;
+        if( !lChild.IsNamed("Layer") || !pReader.GetInteger(lChild, 0, lIndex) || lIndex != 0 ) continue;
+        pLayer = lChild;
+        return true;
+    }
+    return false;
+}
+
+// finds where the layers of pTangents go in its geometry
+static bool PlanMesh(
+                     const RecordReader& pReader,
+                     const BinaryFbxFile& pFile,
+                     const BinaryFbxTangents& pTangents,
+                     MeshPatch& pPatch,
+                     std::string& pError
+                     )
+{
+    const BinaryFbxMesh& lMesh = pFile.GetMesh(pTangents.mMesh);
+    pPatch.mTangents    = &pTangents;
+    pPatch.mGeometryEnd = 0;
+    pPatch.mLayerEnd    = 0;
+
+    Record lGeometry;
+    bool lDamaged = false;
+    if( !pReader.ReadRecord(lMesh.mRecord, pFile.GetFileSize(), lGeometry, lDamaged) ||
+        !GetListEnd(pReader, pFile.GetData(), pFile.GetVersion(), lGeometry, pPatch.mGeometryEnd) )
+    {
+        pError = "damaged geometry " + lMesh.mName;
+        return false;
+    }
+
+    // an added layer has index 0 and is listed in Layer 0, which is only read once found
+    Record lLayer;
+    bool lLayerFound = FindLayerZero(pReader, lGeometry, lLayer, lDamaged);
+
+    bool lNeedsLayer = false;
+    for( int l = 0; l < 2; l++ )
+    {
+        pPatch.mReplaced[l] = pReader.FindLayerElement(lGeometry, kLayerNames[l].mRecord, pPatch.mElements[l], lDamaged);
+        pPatch.mListed[l]   = pPatch.mReplaced[l] || (lLayerFound && IsListed(pReader, lLayer, kLayerNames[l].mRecord, 0));
+        lNeedsLayer |= !pPatch.mListed[l];
+    }
+    if( lNeedsLayer && (!lLayerFound || !GetListEnd(pReader, pFile.GetData(), pFile.GetVersion(), lLayer, pPatch.mLayerEnd)) )
+    {
+        pError = "geometry " + lMesh.mName + " has no Layer 0 to list its tangents";
+        return false;
+    }
+    return true;
+}
+
+// the record of a new layer, its arrays being encoded by pJobs
+static void WriteLayer(
+                       RecordWriter& pWriter,
+                       const LayerNames& pNames,
+                       int64_t pIndex,
+                       const std::string& pName,
+                       const ElementView& pView,
+                       const ArrayJob* pJobs
+                       )
+{
+    pWriter.Begin(pNames.mRecord);
+    pWriter.AddInt(int32_t(pIndex));
+    pWriter.Begin("Version");
+    pWriter.AddInt(102);
+    pWriter.End();
+    pWriter.Begin("Name");
+    pWriter.AddString(pName.c_str(), pName.size());
+    pWriter.End();
+    pWriter.Begin("MappingInformationType");
+    pWriter.AddString(GetMappingName(pView.mMapping));
+    pWriter.End();
+    pWriter.Begin("ReferenceInformationType");
+    pWriter.AddString(pView.mReference == eRefDirect ? "Direct" : "IndexToDirect");
+    pWriter.End();
+
+    const char* lArrays[3] = { pNames.mValues, pNames.mW, pNames.mIndex };
+    for( int a = 0; a < 3; a++ )
+    {
+        if( a == 2 && pView.mReference == eRefDirect ) continue;
+        pWriter.Begin(lArrays[a]);
+        pWriter.AddArray(pJobs[a].mArray);
+        pWriter.End();
+    }
+    pWriter.End();
+}
+
+// writes the records of the file in one pass, the splices instead of the bytes they
+// replace, and moves the end offsets after them
+class PatchStream
+{
+public:
+    PatchStream(const BinaryFbxFile& pFile, std::vector<Splice>& pSplices, FILE* pOutput)
+        : mReader(pFile.GetData(), pFile.GetVersion())
+        , mData(pFile.GetData())
+        , mVersion(pFile.GetVersion())
+        , mSplices(pSplices)
+        , mNext(0)
+        , mPosition(0)
+        , mShift(0)
+        , mOutput(pOutput)
+        , mFailed(false)
+        , mOverflow(false)
+    {
+    }
+
+    uint64_t GetPosition() const { return mPosition; }
+    bool IsFailed() const { return mFailed; }
+    bool IsOverflow() const { return mOverflow; }
+
+    void Copy(size_t pBegin, size_t pEnd) { Write(mData + pBegin, pEnd - pBegin); }
+
+    void Write(const void* pData, size_t pSize)
+    {
+        if( pSize == 0 || mFailed ) return;
+        mFailed = fwrite(pData, 1, pSize, mOutput) != pSize;
+        mPosition += pSize;
+    }
+
+    // the records of the list [pOffset, pEnd), then its null record
+    bool WriteList(size_t pOffset, size_t pEnd)
+    {
+        Record lRecord;
+        bool lDamaged = false;
+        for( ;; )
+        {
+            while( mNext < mSplices.size() && mSplices[mNext].mBegin == pOffset && mSplices[mNext].mEnd == pOffset )
+            {
+                if( !WriteSplice() ) return false;
+            }
+            if( !mReader.ReadRecord(pOffset, pEnd, lRecord, lDamaged) ) break;
+
+            if( mNext < mSplices.size() && mSplices[mNext].mBegin == pOffset )
+            {
+                if( mSplices[mNext].mEnd != lRecord.mEnd || !WriteSplice() ) return false;
+            }
+            else if( mShift == 0 && (mNext == mSplices.size() || mSplices[mNext].mBegin >= lRecord.mEnd) )
+            {
+                Copy(pOffset, lRecord.mEnd);
+            }
+            else
+            {
+                // the new end counts the splices inside the record
+                int64_t lShift = mShift;
+                for( size_t i = mNext; i < mSplices.size() && mSplices[i].mBegin < lRecord.mEnd; i++ )
+                    lShift += int64_t(mSplices[i].mWriter.GetData().size()) - int64_t(mSplices[i].mEnd - mSplices[i].mBegin);
+
+                uint64_t lEnd = uint64_t(int64_t(lRecord.mEnd) + lShift);
+                size_t lField = mVersion >= 7500 ? 8 : 4;
+                mOverflow = lField == 4 && lEnd > 0xffffffffu;
+                if( mOverflow ) return false;
+                uint32_t lEnd32 = uint32_t(lEnd);
+                Write(lField == 8 ? static_cast<const void*>(&lEnd) : static_cast<const void*>(&lEnd32), lField);
+                Copy(pOffset + lField, lRecord.mChildren);
+                if( !WriteList(lRecord.mChildren, lRecord.mEnd) ) return false;
+            }
+            pOffset = lRecord.mEnd;
+        }
+        if( lDamaged ) return false;
+
+        Copy(pOffset, pEnd);
+        return !mFailed;
+    }
+
+private:
+    bool WriteSplice()
+    {
+        Splice& lSplice = mSplices[mNext++];
+        mOverflow = !lSplice.mWriter.Relocate(mPosition);
+        if( mOverflow ) return false;
+
+        const std::vector<unsigned char>& lBytes = lSplice.mWriter.GetData();
+        if( !lBytes.empty() ) Write(&lBytes[0], lBytes.size());
+        mShift += int64_t(lBytes.size()) - int64_t(lSplice.mEnd - lSplice.mBegin);
+        return !mFailed;
+    }
+
+    RecordReader          mReader;
+    const unsigned char*  mData;
+    int                   mVersion;
+    std::vector<Splice>&  mSplices;
+    size_t                mNext;
+    uint64_t              mPosition;
+    int64_t               mShift;           // new minus old offset of the bytes being copied
+    FILE*                 mOutput;
+    bool                  mFailed;
+    bool                  mOverflow;        // an end offset does not fit in 32 bits
+};
+
+bool WritePatchedFbx(
+                     const BinaryFbxFile& pFile,
+                     const std::vector<BinaryFbxTangents>& pTangents,
+                     const char* pFilename,
+                     WorkStealingPool* pPool,
+                     std::string& pError
+                     )
+{
+    RecordReader lReader(pFile.GetData(), pFile.GetVersion());
+    std::vector<MeshPatch> lPatches(pTangents.size());
+    std::vector<ArrayJob> lJobs;
+    std::vector<char> lPatched(pFile.GetMeshCount(), 0);
+    for( size_t i = 0; i < pTangents.size(); i++ )
+    {
+        const BinaryFbxTangents& lTangents = pTangents[i];
+        if( lTangents.mMesh < 0 || lTangents.mMesh >= pFile.GetMeshCount() || lPatched[lTangents.mMesh] )
+        {
+            pError = "no mesh or a mesh patched twice";
+            return false;
+        }
+        lPatched[lTangents.mMesh] = 1;
+
+        const BinaryFbxMesh& lMesh = pFile.GetMesh(lTangents.mMesh);
+        const ElementView* lViews[2] = { &lTangents.mTangents, &lTangents.mBinormals };
+        for( int l = 0; l < 2; l++ )
+        {
+            if( lViews[l]->mStride != 4 || !IsElementValid(*lViews[l], GetElementCount(lMesh.mView, lViews[l]->mMapping)) )
+            {
+                pError = "the tangents of " + lMesh.mName + " do not fit its geometry";
+                return false;
+            }
+        }
+        if( !PlanMesh(lReader, pFile, lTangents, lPatches[i], pError) ) return false;
+
+        lPatches[i].mFirstJob = lJobs.size();
+        for( int j = 0; j < 6; j++ )
+        {
+            ArrayJob lJob;
+            lJob.mView     = lViews[j / 3];
+            lJob.mPart     = j % 3;
+            lJob.mCompress = lMesh.mCompressed;
+            lJobs.push_back(lJob);
+        }
+    }
+
+    // the arrays are built and compressed in parallel, biggest first
+    std::vector<int> lOrder;
+    for( size_t i = 0; i < lJobs.size(); i++ )
+    {
+        if( lJobs[i].mPart < 2 || lJobs[i].mView->mReference == eRefIndexToDirect ) lOrder.push_back(int(i));
+    }
+    std::stable_sort(lOrder.begin(), lOrder.end(), [&](int pA, int pB)
+    {
+        return lJobs[pA].mView->mDirectCount > lJobs[pB].mView->mDirectCount;
+    });
+    if( pPool ) pPool->Run(int(lOrder.size()), [&](int pTask) { RunArrayJob(lJobs[lOrder[pTask]]); });
+    else        for( size_t i = 0; i < lOrder.size(); i++ ) RunArrayJob(lJobs[lOrder[i]]);
+
+    // the new records, in the order of the file
+    std::vector<Splice> lSplices;
+    for( size_t i = 0; i < lPatches.size(); i++ )
+    {
+        const MeshPatch& lPatch = lPatches[i];
+        const ElementView* lViews[2] = { &lPatch.mTangents->mTangents, &lPatch.mTangents->mBinormals };
+        const std::string* lNames[2] = { &lPatch.mTangents->mTangentName, &lPatch.mTangents->mBinormalName };
+        for( int l = 0; l < 2; l++ )
+        {
+            int64_t lIndex = 0;
+            if( lPatch.mReplaced[l] ) lReader.GetInteger(lPatch.mElements[l], 0, lIndex);
+            size_t lBegin = lPatch.mReplaced[l] ? lPatch.mElements[l].mStart : lPatch.mGeometryEnd;
+            size_t lEnd   = lPatch.mReplaced[l] ? lPatch.mElements[l].mEnd : lPatch.mGeometryEnd;
+            lSplices.push_back(Splice(lBegin, lEnd, pFile.GetVersion()));
+            WriteLayer(lSplices.back().mWriter, kLayerNames[l], lIndex, *lNames[l], *lViews[l], &lJobs[lPatch.mFirstJob + 3 * l]);
+        }
+        if( lPatch.mListed[0] && lPatch.mListed[1] ) continue;
+
+        lSplices.push_back(Splice(lPatch.mLayerEnd, lPatch.mLayerEnd, pFile.GetVersion()));
+        RecordWriter& lWriter = lSplices.back().mWriter;
+        for( int l = 0; l < 2; l++ )
+        {
+            if( lPatch.mListed[l] ) continue;
+            lWriter.Begin("LayerElement");
+            lWriter.Begin("Type");
+            lWriter.AddString(kLayerNames[l].mRecord);
+            lWriter.End();
+            lWriter.Begin("TypedIndex");
+            lWriter.AddInt(0);
+            lWriter.End();
+            lWriter.End();
+        }
+    }
+    std::stable_sort(lSplices.begin(), lSplices.end(), [](const Splice& pA, const Splice& pB) { return pA.mBegin < pB.mBegin; });
+    std::vector<ArrayJob>().swap(lJobs);
+
+    // the top records end with a null record, then the footer
+    Record lTop;
+    bool lDamaged = false;
+    size_t lTopEnd = kFbxHeaderSize;
+    while( lReader.ReadRecord(lTopEnd, pFile.GetFileSize(), lTop, lDamaged) ) lTopEnd = lTop.mEnd;
+    lTopEnd += GetRecordHeaderSize(pFile.GetVersion());
+
+    std::string lPartName = std::string(pFilename) + ".part";
+    FILE* lOutput = fopen(lPartName.c_str(), "wb");
+    if( lOutput == NULL )
+    {
+        pError = "cannot write " + lPartName;
+        return false;
+    }
+    setvbuf(lOutput, NULL, _IOFBF, 1 << 20);
+
+    PatchStream lStream(pFile, lSplices, lOutput);
+    lStream.Copy(0, kFbxHeaderSize);
+    bool lWritten = lStream.WriteList(kFbxHeaderSize, lTopEnd);
+
+    // the footer pads its version to 16 bytes, the padding follows the new size of the file
+    const unsigned char* lData = pFile.GetData();
+    size_t lSize = pFile.GetFileSize();
+    bool lFooter = lSize >= lTopEnd + kFbxFooterStart + kFbxFooterEnd;
+    for( size_t i = lTopEnd + 16; lFooter && i < lSize - kFbxFooterEnd; i++ ) lFooter = lData[i] == 0;
+    if( lFooter )
+    {
+        static const unsigned char kZeros[20] = { 0 };
+        lStream.Copy(lTopEnd, lTopEnd + 16);
+        lStream.Write(kZeros, 4);
+        lStream.Write(kZeros, GetFooterPadding(lStream.GetPosition()));
+        lStream.Copy(lSize - kFbxFooterEnd, lSize);
+    }
+    else
+    {
+        lStream.Copy(lTopEnd, lSize);
+    }
+
+    lWritten = fclose(lOutput) == 0 && lWritten && !lStream.IsFailed();
+    if( lWritten )
+    {
+        remove(pFilename);
+        lWritten = rename(lPartName.c_str(), pFilename) == 0;
+    }
+    if( !lWritten )
+    {
+        remove(lPartName.c_str());
+        pError = lStream.IsOverflow() ? "the patched file does not fit the 32 bit offsets of its version"
+                                      : std::string("cannot write ") + pFilename;
+        return false;
+    }
+    return true;
+}
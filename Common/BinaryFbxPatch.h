@@ -0,0 +1,45 @@
+// BinaryFbxPatch.h : writes a binary FBX file as a copy of another one with new
+// tangent and binormal layers.
+//
+// The merge only changes the tangents and binormals of the lighting meshes, so
+// instead of an SDK export of the whole scene the lighting file is copied record
+// by record: the LayerElementTangent and LayerElementBinormal records of the
+// patched geometries are replaced (or added, with their entries in Layer 0), the
+// end offsets after them are moved by the size difference, and every other byte
+// of the file is kept. The new arrays are built and compressed in parallel, the
+// file is then written in one pass.
+
+#pragma once
+
+#include "BinaryFbx.h"
+#include "MergeCore.h"
+
+#include <string>
+#include <vector>
+
+class WorkStealingPool;
+
+// the new tangent and binormal layers of a mesh of a BinaryFbxFile
+struct BinaryFbxTangents
+{
+    int         mMesh;              // index in the file
+    std::string mTangentName;       // names of the layer elements
+    std::string mBinormalName;
+    ElementView mTangents;          // stride 4, the W are written too
+    ElementView mBinormals;
+};
+
+// writes pFile to pFilename, the meshes of pTangents getting their new layers; the
+// other meshes and records are copied as they are. The arrays are compressed when
+// the mesh has compressed arrays in pFile. pPool builds them in parallel, NULL
+// builds them on the calling thread.
+// The file is written next to pFilename and renamed once complete. Returns false,
+// with the reason in pError, if a layer does not fit its mesh, a geometry has no
+// Layer 0 to list a new layer or the file can't be written.
+bool WritePatchedFbx(
+                     const BinaryFbxFile& pFile,
+                     const std::vector<BinaryFbxTangents>& pTangents,
+                     const char* pFilename,
+                     WorkStealingPool* pPool,
+                     std::string& pError
+                     );
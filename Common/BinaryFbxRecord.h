@@ -0,0 +1,405 @@
+// BinaryFbxRecord.h : node records of the binary FBX 7.x files, shared by the native
+// reader (BinaryFbx.h), the patch writer (BinaryFbxPatch.h) and the synthetic files
+// of the benchmarks.
+//
+// A record is a header (end offset, property count, property bytes, name length;
+// 32 bit fields before 7.5, 64 bit from 7.5), the name, the properties, then the
+// child records closed by a null record. The end offsets are absolute in the file.
+// The numbers of the file are little endian like the hosts of the merger.
+
+#pragma once
+
+#include <cstring>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef NORMALMERGER_ZLIB
+#include <zlib.h>
+#endif
+
+// "Kaydara FBX Binary  \0", 0x1A, 0x00, then the version
+static const char   kFbxMagic[] = "Kaydara FBX Binary  ";
+static const size_t kFbxHeaderSize = 27;
+
+// the footer after the null record closing the top records: a 16 byte id, 4 zero bytes,
+// zeros up to a 16 byte boundary (16 if already aligned), the version, 120 zero bytes,
+// then kFbxFooterMagic
+static const unsigned char kFbxFooterMagic[16] = { 0xf8, 0x5a, 0x8c, 0x6a, 0xde, 0xf5, 0xd9, 0x7e,
+                                                   0xec, 0xe9, 0x0c, 0xe3, 0x75, 0x8f, 0x29, 0x0b };
+static const size_t kFbxFooterStart = 16 + 4;
+static const size_t kFbxFooterEnd   = 4 + 120 + sizeof(kFbxFooterMagic);
+
+// the zeros after the start of the footer ending at pOffset
+inline size_t GetFooterPadding(uint64_t pOffset) { return size_t(16 - pOffset % 16); }
+
+// size of a record header without the name, and of the null record closing a list
+inline size_t GetRecordHeaderSize(int pVersion) { return pVersion >= 7500 ? 25 : 13; }
+
+// a node record: header, name, properties, then the child records up to mEnd
+struct Record
+{
+    size_t      mStart;
+    size_t      mEnd;
+    size_t      mProperties;
+    size_t      mChildren;
+    size_t      mPropertyCount;
+    const char* mName;
+    size_t      mNameLength;
+
+    Record() : mStart(0), mEnd(0), mProperties(0), mChildren(0), mPropertyCount(0), mName(""), mNameLength(0) {}
+
+    bool IsNamed(const char* pName) const { return strlen(pName) == mNameLength && memcmp(mName, pName, mNameLength) == 0; }
+};
+
+// a property of a record; mData is the value, or the possibly compressed values of an array
+struct Property
+{
+    char                 mType;
+    const unsigned char* mData;
+    size_t               mSize;
+    uint32_t             mCount;        // arrays only
+    uint32_t             mEncoding;     // arrays only, 0 raw, 1 zlib
+
+    Property() : mType(0), mData(NULL), mSize(0), mCount(0), mEncoding(0) {}
+};
+
+template <class T>
+inline T ReadValue(const unsigned char* pData)
+{
+    T lValue;
+    memcpy(&lValue, pData, sizeof(T));
+    return lValue;
+}
+
+// walks the records of a list and the properties of a record, every read is bounds checked
+class RecordReader
+{
+public:
+    RecordReader(const unsigned char* pData, int pVersion)
+        : mData(pData), mWide(pVersion >= 7500) {}
+
+    // reads the record at pOffset of a list ending at pLimit. Returns false at the null
+    // record closing the list or at the end of the list; pDamaged is set if the record
+    // does not fit in the list.
+    bool ReadRecord(size_t pOffset, size_t pLimit, Record& pRecord, bool& pDamaged) const
+    {
+        size_t lHeader = mWide ? 25 : 13;
+        if( pOffset + lHeader > pLimit ) return false;
+
+        const unsigned char* lData = mData + pOffset;
+        uint64_t lEnd   = mWide ? ReadValue<uint64_t>(lData)      : ReadValue<uint32_t>(lData);
+        uint64_t lCount = mWide ? ReadValue<uint64_t>(lData + 8)  : ReadValue<uint32_t>(lData + 4);
+        uint64_t lBytes = mWide ? ReadValue<uint64_t>(lData + 16) : ReadValue<uint32_t>(lData + 8);
+        size_t lNameLength = lData[lHeader - 1];
+        if( lEnd == 0 ) return false;
+
+        if( lEnd > pLimit || lEnd < pOffset + lHeader + lNameLength || lBytes > lEnd - pOffset - lHeader - lNameLength ||
+            lCount > lBytes )
+        {
+            pDamaged = true;
+            return false;
+        }
+
+        pRecord.mStart         = pOffset;
+        pRecord.mEnd           = size_t(lEnd);
+        pRecord.mName          = reinterpret_cast<const char*>(lData + lHeader);
+        pRecord.mNameLength    = lNameLength;
+        pRecord.mProperties    = pOffset + lHeader + lNameLength;
+        pRecord.mChildren      = pRecord.mProperties + size_t(lBytes);
+        pRecord.mPropertyCount = size_t(lCount);
+        return true;
+    }
+
+    // the property at pOffset, pOffset moves to the next one; false if it does not fit before pLimit
+    bool ReadProperty(size_t& pOffset, size_t pLimit, Property& pProperty) const
+    {
+        if( pOffset >= pLimit ) return false;
+
+        pProperty.mType = char(mData[pOffset]);
+        size_t lOffset = pOffset + 1;
+        size_t lSize;
+        switch( pProperty.mType )
+        {
+        case 'C': lSize = 1; break;
+        case 'Y': lSize = 2; break;
+        case 'I': case 'F': lSize = 4; break;
+        case 'D': case 'L': lSize = 8; break;
+        case 'S': case 'R':
+            if( lOffset + 4 > pLimit ) return false;
+            lSize = ReadValue<uint32_t>(mData + lOffset);
+            lOffset += 4;
+            break;
+        case 'b': case 'i': case 'f': case 'l': case 'd':
+            if( lOffset + 12 > pLimit ) return false;
+            pProperty.mCount    = ReadValue<uint32_t>(mData + lOffset);
+            pProperty.mEncoding = ReadValue<uint32_t>(mData + lOffset + 4);
+            lSize               = ReadValue<uint32_t>(mData + lOffset + 8);
+            lOffset += 12;
+            break;
+        default:
+            return false;
+        }
+        if( lSize > pLimit - lOffset ) return false;
+
+        pProperty.mData = mData + lOffset;
+        pProperty.mSize = lSize;
+        pOffset = lOffset + lSize;
+        return true;
+    }
+
+    // the property pIndex of pRecord
+    bool GetProperty(const Record& pRecord, size_t pIndex, Property& pProperty) const
+    {
+        size_t lOffset = pRecord.mProperties;
+        for( size_t i = 0; i <= pIndex; i++ )
+        {
+            if( i >= pRecord.mPropertyCount || !ReadProperty(lOffset, pRecord.mChildren, pProperty) ) return false;
+        }
+        return true;
+    }
+
+    bool GetString(const Record& pRecord, size_t pIndex, std::string& pValue) const
+    {
+        Property lProperty;
+        if( !GetProperty(pRecord, pIndex, lProperty) || lProperty.mType != 'S' ) return false;
+        pValue.assign(reinterpret_cast<const char*>(lProperty.mData), lProperty.mSize);
+        return true;
+    }
+
+    bool GetInteger(const Record& pRecord, size_t pIndex, int64_t& pValue) const
+    {
+        Property lProperty;
+        if( !GetProperty(pRecord, pIndex, lProperty) ) return false;
+        if( lProperty.mType == 'L' )      pValue = ReadValue<int64_t>(lProperty.mData);
+        else if( lProperty.mType == 'I' ) pValue = ReadValue<int32_t>(lProperty.mData);
+        else return false;
+        return true;
+    }
+
+    // the first child of pRecord named pName
+    bool FindChild(const Record& pRecord, const char* pName, Record& pChild, bool& pDamaged) const
+    {
+        for( size_t lOffset = pRecord.mChildren; ReadRecord(lOffset, pRecord.mEnd, pChild, pDamaged); lOffset = pChild.mEnd )
+        {
+            if( pChild.IsNamed(pName) ) return true;
+        }
+        return false;
+    }
+
+    // the child pName of pGeometry with the lowest index (LayerElementNormal, ...), which is
+    // the element 0 of the SDK
+    bool FindLayerElement(const Record& pGeometry, const char* pName, Record& pElement, bool& pDamaged) const
+    {
+        Record lChild;
+        bool lFound = false;
+        int64_t lLowest = 0;
+        for( size_t lOffset = pGeometry.mChildren; ReadRecord(lOffset, pGeometry.mEnd, lChild, pDamaged); lOffset = lChild.mEnd )
+        {
+            int64_t lIndex = 0;
+            if( !lChild.IsNamed(pName) ) continue;
+            GetInteger(lChild, 0, lIndex);
+            if( lFound && lIndex >= lLowest ) continue;
+            pElement = lChild;
+            lLowest = lIndex;
+            lFound = true;
+        }
+        return lFound;
+    }
+
+private:
+    const unsigned char* mData;
+    bool                 mWide;     // 64 bit record header, from 7.5
+};
+
+// inflates or copies the pCount values of pElementSize bytes of an array property
+inline bool ReadArrayValues(const Property& pProperty, size_t pElementSize, void* pValues)
+{
+    size_t lBytes = size_t(pProperty.mCount) * pElementSize;
+    if( pProperty.mEncoding == 0 )
+    {
+        if( pProperty.mSize != lBytes ) return false;
+        memcpy(pValues, pProperty.mData, lBytes);
+        return true;
+    }
+#ifdef NORMALMERGER_ZLIB
+    uLongf lInflated = uLongf(lBytes);
+    if( uLongf(lBytes) != lBytes || uLong(pProperty.mSize) != pProperty.mSize ) return false;
+    return uncompress(static_cast<Bytef*>(pValues), &lInflated, pProperty.mData, uLong(pProperty.mSize)) == Z_OK && lInflated == lBytes;
+#else
+    return false;
+#endif
+}
+
+// the values of an array property to write, raw or deflated
+struct EncodedArray
+{
+    char                       mType;       // 'd', 'f', 'i', 'l' or 'b'
+    uint32_t                   mCount;
+    uint32_t                   mEncoding;   // 0 raw, 1 zlib
+    std::vector<unsigned char> mBytes;
+
+    EncodedArray() : mType(0), mCount(0), mEncoding(0) {}
+};
+
+// deflates the raw values of pArray at the fastest level, like the SDK. They stay raw
+// without zlib, or if they do not shrink.
+inline void CompressArray(EncodedArray& pArray)
+{
+#ifdef NORMALMERGER_ZLIB
+    if( pArray.mEncoding != 0 || pArray.mBytes.empty() || uLong(pArray.mBytes.size()) != pArray.mBytes.size() ) return;
+
+    std::vector<unsigned char> lCompressed(compressBound(uLong(pArray.mBytes.size())));
+    uLongf lSize = uLongf(lCompressed.size());
+    if( compress2(&lCompressed[0], &lSize, &pArray.mBytes[0], uLong(pArray.mBytes.size()), Z_BEST_SPEED) != Z_OK ||
+        lSize >= pArray.mBytes.size() )
+        return;
+    lCompressed.resize(lSize);
+    pArray.mBytes.swap(lCompressed);
+    pArray.mEncoding = 1;
+#else
+    (void)pArray;
+#endif
+}
+
+// appends records to a buffer, the end offsets are patched when a record is closed.
+// They are relative to the start of the buffer plus pBase.
+class RecordWriter
+{
+public:
+    RecordWriter(int pVersion, bool pCompress, uint64_t pBase = 0)
+        : mBase(pBase), mWide(pVersion >= 7500), mCompress(pCompress) {}
+
+    std::vector<unsigned char>& GetData() { return mData; }
+
+    void Begin(const char* pName)
+    {
+        CloseProperties();
+
+        OpenRecord lRecord;
+        lRecord.mStart = mData.size();
+        lRecord.mPropertyCount = 0;
+        lRecord.mHasChildren = false;
+        if( !mOpen.empty() ) mOpen.back().mHasChildren = true;
+
+        mData.resize(mData.size() + (mWide ? 24 : 12), 0);
+        mData.push_back((unsigned char)strlen(pName));
+        Append(pName, strlen(pName));
+        lRecord.mProperties = mData.size();
+        lRecord.mPropertiesEnd = 0;
+        mOpen.push_back(lRecord);
+    }
+
+    // a record with children ends with a null record
+    void End()
+    {
+        CloseProperties();
+        if( mOpen.back().mHasChildren ) mData.resize(mData.size() + (mWide ? 25 : 13), 0);
+
+        const OpenRecord& lRecord = mOpen.back();
+        WriteHeaderValue(lRecord.mStart, 0, mBase + mData.size());
+        WriteHeaderValue(lRecord.mStart, 1, lRecord.mPropertyCount);
+        WriteHeaderValue(lRecord.mStart, 2, lRecord.mPropertiesEnd - lRecord.mProperties);
+        mClosed.push_back(lRecord.mStart);
+        mOpen.pop_back();
+    }
+
+    // moves the records written so far to pBase; false if an end offset does not fit in 32 bits
+    bool Relocate(uint64_t pBase)
+    {
+        for( size_t i = 0; i < mClosed.size(); i++ )
+        {
+            uint64_t lEnd = mWide ? ReadValue<uint64_t>(&mData[mClosed[i]]) : ReadValue<uint32_t>(&mData[mClosed[i]]);
+            lEnd = lEnd - mBase + pBase;
+            if( !mWide && lEnd > 0xffffffffu ) return false;
+            WriteHeaderValue(mClosed[i], 0, lEnd);
+        }
+        mBase = pBase;
+        return true;
+    }
+
+    void AddInt(int32_t pValue)    { AddValue('I', pValue); }
+    void AddLong(int64_t pValue)   { AddValue('L', pValue); }
+    void AddDouble(double pValue)  { AddValue('D', pValue); }
+
+    void AddString(const char* pValue, size_t pLength)
+    {
+        mData.push_back('S');
+        uint32_t lLength = uint32_t(pLength);
+        Append(&lLength, 4);
+        Append(pValue, pLength);
+        mOpen.back().mPropertyCount++;
+    }
+    void AddString(const char* pValue) { AddString(pValue, strlen(pValue)); }
+
+    // 'd', 'i' or 'f' array of pCount values of pElementSize bytes, deflated if the writer compresses
+    void AddArray(char pType, const void* pValues, uint32_t pCount, size_t pElementSize)
+    {
+        EncodedArray lArray;
+        lArray.mType     = pType;
+        lArray.mCount    = pCount;
+        lArray.mEncoding = 0;
+        const unsigned char* lValues = static_cast<const unsigned char*>(pValues);
+        lArray.mBytes.assign(lValues, lValues + size_t(pCount) * pElementSize);
+        if( mCompress ) CompressArray(lArray);
+        AddArray(lArray);
+    }
+
+    // an array encoded beforehand
+    void AddArray(const EncodedArray& pArray)
+    {
+        mData.push_back((unsigned char)pArray.mType);
+        uint32_t lHeader[3] = { pArray.mCount, pArray.mEncoding, uint32_t(pArray.mBytes.size()) };
+        Append(lHeader, sizeof(lHeader));
+        if( !pArray.mBytes.empty() ) Append(&pArray.mBytes[0], pArray.mBytes.size());
+        mOpen.back().mPropertyCount++;
+    }
+
+private:
+    struct OpenRecord
+    {
+        size_t   mStart;
+        size_t   mProperties;
+        size_t   mPropertiesEnd;
+        uint64_t mPropertyCount;
+        bool     mHasChildren;
+    };
+
+    template <class T>
+    void AddValue(char pType, T pValue)
+    {
+        mData.push_back((unsigned char)pType);
+        Append(&pValue, sizeof(T));
+        mOpen.back().mPropertyCount++;
+    }
+
+    void Append(const void* pData, size_t pSize)
+    {
+        const unsigned char* lData = static_cast<const unsigned char*>(pData);
+        mData.insert(mData.end(), lData, lData + pSize);
+    }
+
+    // the properties of the innermost record end at its first child or at its end
+    void CloseProperties()
+    {
+        if( !mOpen.empty() && mOpen.back().mPropertiesEnd == 0 ) mOpen.back().mPropertiesEnd = mData.size();
+    }
+
+    void WriteHeaderValue(size_t pRecord, int pField, uint64_t pValue)
+    {
+        if( mWide ) memcpy(&mData[pRecord + pField * 8], &pValue, 8);
+        else
+        {
+            uint32_t lValue = uint32_t(pValue);
+            memcpy(&mData[pRecord + pField * 4], &lValue, 4);
+        }
+    }
+
+    std::vector<unsigned char> mData;
+    std::vector<OpenRecord>    mOpen;
+    std::vector<size_t>        mClosed;     // start of the records written
+    uint64_t                   mBase;
+    bool                       mWide;
+    bool                       mCompress;
+};
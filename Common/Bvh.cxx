@@ -0,0 +1,590 @@
+// Bvh.cxx : bounding volume hierarchy of triangles for closest point queries.
+
+#include "Bvh.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stddef.h>
+
+static const int kMaxLeafSize = 4;
+// bins of the large ranges, small ranges use one bin per triangle
+static const int kBinCount = 16;
+
+// ranges above this size are split on the calling thread before the parallel subtree builds
+static const int kParallelGrain = 16 * 1024;
+
+// ranges above this size are binned in parallel
+static const int kParallelBinning = 64 * 1024;
+
+// the build works on float bounds rounded outwards, half the memory traffic of doubles
+struct Bounds
+{
+    float mMin[3];
+    float mMax[3];
+
+    void Clear()
+    {
+        for( int c = 0; c < 3; c++ )
+        {
+            mMin[c] = std::numeric_limits<float>::max();
+            mMax[c] = -std::numeric_limits<float>::max();
+        }
+    }
+    void Grow(const float* pPoint)
+    {
+        for( int c = 0; c < 3; c++ )
+        {
+            mMin[c] = std::min(mMin[c], pPoint[c]);
+            mMax[c] = std::max(mMax[c], pPoint[c]);
+        }
+    }
+    void Grow(const Bounds& pBounds)
+    {
+        for( int c = 0; c < 3; c++ )
+        {
+            mMin[c] = std::min(mMin[c], pBounds.mMin[c]);
+            mMax[c] = std::max(mMax[c], pBounds.mMax[c]);
+        }
+    }
+    double GetArea() const
+    {
+        double x = double(mMax[0]) - mMin[0], y = double(mMax[1]) - mMin[1], z = double(mMax[2]) - mMin[2];
+        return x < 0.0 ? 0.0 : x * y + y * z + z * x;
+    }
+};
+
+// a triangle during the build. The ranges of nodes are partitioned in place,
+// so that every level reads its triangles sequentially.
+struct BuildTriangle
+{
+    Bounds mBounds;
+    int    mIndex;
+
+    float GetCenter(int pAxis) const { return 0.5f * (mBounds.mMin[pAxis] + mBounds.mMax[pAxis]); }
+};
+
+typedef std::vector<BuildTriangle> BuildData;
+
+struct Bin
+{
+    Bounds mBounds;
+    Bounds mCenterBounds;
+    int    mCount;
+
+    void Clear()
+    {
+        mBounds.Clear();
+        mCenterBounds.Clear();
+        mCount = 0;
+    }
+};
+
+// triangles [mBegin, mEnd) of the build data, with their bounds
+struct BuildRange
+{
+    int    mBegin;
+    int    mEnd;
+    Bounds mBounds;
+    Bounds mCenterBounds;
+};
+
+// a range waiting for its split, and the node it becomes
+struct TriangleBvh::BuildItem
+{
+    int        mNode;
+    BuildRange mRange;
+};
+
+// float bounds that contain the double ones
+static float RoundDown(double pValue)
+{
+    float lValue = float(pValue);
+    return double(lValue) > pValue ? std::nextafter(lValue, -std::numeric_limits<float>::max()) : lValue;
+}
+
+static float RoundUp(double pValue)
+{
+    float lValue = float(pValue);
+    return double(lValue) < pValue ? std::nextafter(lValue, std::numeric_limits<float>::max()) : lValue;
+}
+
+// bounds of the triangles and of their centers, only needed for the root and
+// the rare splits that do not come from the bins
+static void GetRangeBounds(const BuildData& pData, BuildRange& pRange)
+{
+    pRange.mBounds.Clear();
+    pRange.mCenterBounds.Clear();
+    for( int i = pRange.mBegin; i < pRange.mEnd; i++ )
+    {
+        float lCenter[3] = { pData[i].GetCenter(0), pData[i].GetCenter(1), pData[i].GetCenter(2) };
+        pRange.mBounds.Grow(pData[i].mBounds);
+        pRange.mCenterBounds.Grow(lCenter);
+    }
+}
+
+// bins of the centers along one axis
+struct Binning
+{
+    int    mAxis;
+    int    mCount;
+    double mMin;
+    double mScale;
+
+    int GetBin(const BuildTriangle& pTriangle) const
+    {
+        int lBin = int((pTriangle.GetCenter(mAxis) - mMin) * mScale);
+        return lBin < 0 ? 0 : lBin >= mCount ? mCount - 1 : lBin;
+    }
+};
+
+static void AddBin(Bin& pBin, const Bin& pOther)
+{
+    if( pOther.mCount == 0 ) return;
+    pBin.mBounds.Grow(pOther.mBounds);
+    pBin.mCenterBounds.Grow(pOther.mCenterBounds);
+    pBin.mCount += pOther.mCount;
+}
+
+static void FillBins(const BuildData& pData, int pBegin, int pEnd, const Binning& pBinning, Bin* pBins)
+{
+    for( int b = 0; b < pBinning.mCount; b++ ) pBins[b].Clear();
+    for( int i = pBegin; i < pEnd; i++ )
+    {
+        float lCenter[3] = { pData[i].GetCenter(0), pData[i].GetCenter(1), pData[i].GetCenter(2) };
+        Bin& lBin = pBins[pBinning.GetBin(pData[i])];
+        lBin.mBounds.Grow(pData[i].mBounds);
+        lBin.mCenterBounds.Grow(lCenter);
+        lBin.mCount++;
+    }
+}
+
+// splits pRange with binned SAH on the largest center axis, or at the median
+// when the SAH finds nothing. Returns false if the range should be a leaf.
+static bool SplitRange(
+                       BuildData& pData,
+                       const BuildRange& pRange,
+                       WorkStealingPool* pPool,
+                       BuildRange& pLeft,
+                       BuildRange& pRight
+                       )
+{
+    int lCount = pRange.mEnd - pRange.mBegin;
+    if( lCount <= kMaxLeafSize ) return false;
+
+    const Bounds& lCenterBounds = pRange.mCenterBounds;
+    int lAxis = 0;
+    for( int c = 1; c < 3; c++ )
+    {
+        if( lCenterBounds.mMax[c] - lCenterBounds.mMin[c] > lCenterBounds.mMax[lAxis] - lCenterBounds.mMin[lAxis] )
+            lAxis = c;
+    }
+
+    pLeft.mBegin = pRange.mBegin;
+    pRight.mEnd = pRange.mEnd;
+
+    int lBestBin = -1;
+    double lExtent = double(lCenterBounds.mMax[lAxis]) - lCenterBounds.mMin[lAxis];
+    int lBinCount = std::min(lCount, kBinCount);
+    Binning lBinning = { lAxis, lBinCount, lCenterBounds.mMin[lAxis], lExtent > 0.0 ? lBinCount / lExtent : 0.0 };
+    Bin lBins[kBinCount];
+
+    if( lExtent > 0.0 )
+    {
+        if( pPool && lCount > kParallelBinning )
+        {
+            // every chunk bins its triangles, the chunk bins are then added up
+            int lChunkCount = (lCount + kParallelBinning - 1) / kParallelBinning;
+            std::vector<Bin> lChunkBins(size_t(lChunkCount) * kBinCount);
+            pPool->ParallelFor(pRange.mBegin, pRange.mEnd, kParallelBinning, [&](int pChunkBegin, int pChunkEnd)
+            {
+                FillBins(pData, pChunkBegin, pChunkEnd, lBinning, &lChunkBins[size_t((pChunkBegin - pRange.mBegin) / kParallelBinning) * kBinCount]);
+            });
+            for( int b = 0; b < kBinCount; b++ ) lBins[b].Clear();
+            for( int k = 0; k < lChunkCount; k++ )
+            {
+                for( int b = 0; b < lBinCount; b++ ) AddBin(lBins[b], lChunkBins[size_t(k) * kBinCount + b]);
+            }
+        }
+        else
+        {
+            FillBins(pData, pRange.mBegin, pRange.mEnd, lBinning, lBins);
+        }
+
+        // cost of every split plane: area x count on each side
+        Bin lRight[kBinCount];
+        lRight[lBinCount - 1] = lBins[lBinCount - 1];
+        for( int b = lBinCount - 2; b > 0; b-- )
+        {
+            lRight[b] = lRight[b + 1];
+            AddBin(lRight[b], lBins[b]);
+        }
+
+        Bin lLeft;
+        lLeft.Clear();
+        double lBestCost = std::numeric_limits<double>::max();
+        for( int b = 1; b < lBinCount; b++ )
+        {
+            AddBin(lLeft, lBins[b - 1]);
+            if( lLeft.mCount == 0 || lLeft.mCount == lCount ) continue;
+
+            double lCost = lLeft.mBounds.GetArea() * lLeft.mCount + lRight[b].mBounds.GetArea() * lRight[b].mCount;
+            if( lCost < lBestCost )
+            {
+                lBestCost = lCost;
+                lBestBin = b;
+                pLeft.mBounds = lLeft.mBounds;
+                pLeft.mCenterBounds = lLeft.mCenterBounds;
+                pRight.mBounds = lRight[b].mBounds;
+                pRight.mCenterBounds = lRight[b].mCenterBounds;
+            }
+        }
+    }
+
+    if( lBestBin < 0 )
+    {
+        // all the centers in one bin, cut in the middle of the list
+        int lMiddle = pRange.mBegin + lCount / 2;
+        std::nth_element(pData.begin() + pRange.mBegin, pData.begin() + lMiddle, pData.begin() + pRange.mEnd,
+                         [&](const BuildTriangle& pA, const BuildTriangle& pB) { return pA.GetCenter(lAxis) < pB.GetCenter(lAxis); });
+        pLeft.mEnd = lMiddle;
+        pRight.mBegin = lMiddle;
+        GetRangeBounds(pData, pLeft);
+        GetRangeBounds(pData, pRight);
+        return true;
+    }
+
+    BuildData::iterator lSplit = std::partition(pData.begin() + pRange.mBegin, pData.begin() + pRange.mEnd,
+        [&](const BuildTriangle& pTriangle) { return lBinning.GetBin(pTriangle) < lBestBin; });
+    pLeft.mEnd = int(lSplit - pData.begin());
+    pRight.mBegin = pLeft.mEnd;
+    return true;
+}
+
+template <class NodeType>
+static void SetNodeBounds(NodeType& pNode, const Bounds& pBounds)
+{
+    for( int c = 0; c < 3; c++ )
+    {
+        pNode.mMin[c] = pBounds.mMin[c];
+        pNode.mMax[c] = pBounds.mMax[c];
+    }
+}
+
+// builds the subtree of pNodes[pNode] on the calling thread
+template <class NodeType>
+static void BuildSubtree(BuildData& pData, std::vector<NodeType>& pNodes, int pNode, const BuildRange& pRange)
+{
+    SetNodeBounds(pNodes[pNode], pRange.mBounds);
+
+    BuildRange lLeftRange, lRightRange;
+    if( !SplitRange(pData, pRange, NULL, lLeftRange, lRightRange) )
+    {
+        pNodes[pNode].mFirst = pRange.mBegin;
+        pNodes[pNode].mCount = pRange.mEnd - pRange.mBegin;
+        return;
+    }
+
+    int lLeft = int(pNodes.size());
+    pNodes[pNode].mFirst = lLeft;
+    pNodes[pNode].mCount = 0;
+    pNodes.resize(pNodes.size() + 2);
+
+    BuildSubtree(pData, pNodes, lLeft, lLeftRange);
+    BuildSubtree(pData, pNodes, lLeft + 1, lRightRange);
+}
+
+TriangleBvh::TriangleBvh(
+                         const std::vector<double>& pCorners,
+                         WorkStealingPool* pPool
+                         )
+{
+    int lCount = int(pCorners.size() / 9);
+    if( lCount == 0 ) return;
+
+    BuildData lData(lCount);
+    std::function<void(int, int)> lPrepare = [&](int pBegin, int pEnd)
+    {
+        for( int t = pBegin; t < pEnd; t++ )
+        {
+            const double* lCorners = &pCorners[size_t(t) * 9];
+            for( int c = 0; c < 3; c++ )
+            {
+                lData[t].mBounds.mMin[c] = RoundDown(std::min(std::min(lCorners[c], lCorners[3 + c]), lCorners[6 + c]));
+                lData[t].mBounds.mMax[c] = RoundUp(std::max(std::max(lCorners[c], lCorners[3 + c]), lCorners[6 + c]));
+            }
+            lData[t].mIndex = t;
+        }
+    };
+    if( pPool ) pPool->ParallelFor(0, lCount, kParallelBinning, lPrepare);
+    else        lPrepare(0, lCount);
+
+    // top levels on the calling thread, until the ranges are small enough or
+    // there are enough of them to keep all the threads busy
+    int lTaskTarget = pPool ? 8 * pPool->GetThreadCount() : 1;
+    mNodes.resize(1);
+
+    std::vector<BuildItem> lOpen(1), lTasks;
+    lOpen[0].mNode = 0;
+    lOpen[0].mRange.mBegin = 0;
+    lOpen[0].mRange.mEnd = lCount;
+    GetRangeBounds(lData, lOpen[0].mRange);
+
+    while( !lOpen.empty() )
+    {
+        BuildItem lItem = lOpen.back();
+        lOpen.pop_back();
+
+        BuildItem lLeftItem, lRightItem;
+        if( lItem.mRange.mEnd - lItem.mRange.mBegin <= kParallelGrain || int(lOpen.size() + lTasks.size()) >= lTaskTarget ||
+            !SplitRange(lData, lItem.mRange, pPool, lLeftItem.mRange, lRightItem.mRange) )
+        {
+            lTasks.push_back(lItem);
+            continue;
+        }
+
+        SetNodeBounds(mNodes[lItem.mNode], lItem.mRange.mBounds);
+        lLeftItem.mNode = int(mNodes.size());
+        lRightItem.mNode = lLeftItem.mNode + 1;
+        mNodes[lItem.mNode].mFirst = lLeftItem.mNode;
+        mNodes[lItem.mNode].mCount = 0;
+        mNodes.resize(mNodes.size() + 2);
+
+        lOpen.push_back(lLeftItem);
+        lOpen.push_back(lRightItem);
+    }
+
+    // the subtrees, each in its own array with its root at 0
+    std::vector<std::vector<Node> > lSubtrees(lTasks.size());
+    std::function<void(int)> lBuild = [&](int pTask)
+    {
+        lSubtrees[pTask].resize(1);
+        BuildSubtree(lData, lSubtrees[pTask], 0, lTasks[pTask].mRange);
+    };
+    if( pPool ) pPool->Run(int(lTasks.size()), lBuild);
+    else        for( int i = 0; i < int(lTasks.size()); i++ ) lBuild(i);
+
+    // appended to the top levels, the local index i > 0 becomes lBase + i - 1
+    for( size_t i = 0; i < lTasks.size(); i++ )
+    {
+        const std::vector<Node>& lSubtree = lSubtrees[i];
+        int lBase = int(mNodes.size());
+
+        Node lRoot = lSubtree[0];
+        if( lRoot.mCount == 0 ) lRoot.mFirst += lBase - 1;
+        mNodes[lTasks[i].mNode] = lRoot;
+
+        for( size_t n = 1; n < lSubtree.size(); n++ )
+        {
+            Node lNode = lSubtree[n];
+            if( lNode.mCount == 0 ) lNode.mFirst += lBase - 1;
+            mNodes.push_back(lNode);
+        }
+        std::vector<Node>().swap(lSubtrees[i]);
+    }
+
+    // the triangles in leaf order
+    mTriangles.resize(lCount);
+    mLeafOfTriangle.resize(lCount);
+    std::function<void(int, int)> lCopy = [&](int pBegin, int pEnd)
+    {
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            int t = lData[i].mIndex;
+            const double* lCorners = &pCorners[size_t(t) * 9];
+
+            Triangle& lTriangle = mTriangles[i];
+            for( int c = 0; c < 3; c++ )
+            {
+                lTriangle.mA[c] = lCorners[c];
+                lTriangle.mB[c] = lCorners[3 + c];
+                lTriangle.mC[c] = lCorners[6 + c];
+            }
+            lTriangle.mIndex = t;
+            mLeafOfTriangle[t] = i;
+        }
+    };
+    if( pPool ) pPool->ParallelFor(0, lCount, kParallelBinning, lCopy);
+    else        lCopy(0, lCount);
+}
+
+static inline double Dot(const double* a, const double* b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// closest point of a triangle, from Ericson, Real-Time Collision Detection 5.1.5
+void TriangleBvh::TestTriangle(const Triangle& pTriangle, const double* p, ClosestHit& pHit) const
+{
+    const double* a = pTriangle.mA;
+    const double* b = pTriangle.mB;
+    const double* c = pTriangle.mC;
+
+    // the box of the corners rejects most of the triangles of a leaf for less
+    double lBoxDistance2 = 0.0;
+    for( int k = 0; k < 3; k++ )
+    {
+        double d = std::max(std::max(std::min(std::min(a[k], b[k]), c[k]) - p[k], p[k] - std::max(std::max(a[k], b[k]), c[k])), 0.0);
+        lBoxDistance2 += d * d;
+    }
+    if( lBoxDistance2 > pHit.mDistance2 ) return;
+
+    double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    double ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    double ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+
+    double u, v, w;
+    double d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+    if( d1 <= 0.0 && d2 <= 0.0 )
+    {
+        u = 1.0; v = 0.0; w = 0.0;
+    }
+    else
+    {
+        double bp[3] = { p[0] - b[0], p[1] - b[1], p[2] - b[2] };
+        double d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+        double cp[3] = { p[0] - c[0], p[1] - c[1], p[2] - c[2] };
+        double d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+        double vc = d1 * d4 - d3 * d2;
+        double vb = d5 * d2 - d1 * d6;
+        double va = d3 * d6 - d5 * d4;
+
+        if( d3 >= 0.0 && d4 <= d3 )
+        {
+            u = 0.0; v = 1.0; w = 0.0;
+        }
+        else if( vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0 )
+        {
+            v = d1 / (d1 - d3); u = 1.0 - v; w = 0.0;
+        }
+        else if( d6 >= 0.0 && d5 <= d6 )
+        {
+            u = 0.0; v = 0.0; w = 1.0;
+        }
+        else if( vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0 )
+        {
+            w = d2 / (d2 - d6); u = 1.0 - w; v = 0.0;
+        }
+        else if( va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0 )
+        {
+            w = (d4 - d3) / ((d4 - d3) + (d5 - d6)); v = 1.0 - w; u = 0.0;
+        }
+        else
+        {
+            double lDenominator = va + vb + vc;
+            if( !(lDenominator > 0.0) )
+            {
+                // degenerate triangle seen from its plane, take its first corner
+                u = 1.0; v = 0.0; w = 0.0;
+            }
+            else
+            {
+                v = vb / lDenominator; w = vc / lDenominator; u = 1.0 - v - w;
+            }
+        }
+    }
+
+    double x = u * a[0] + v * b[0] + w * c[0] - p[0];
+    double y = u * a[1] + v * b[1] + w * c[1] - p[1];
+    double z = u * a[2] + v * b[2] + w * c[2] - p[2];
+    double lDistance2 = x * x + y * y + z * z;
+
+    // the lowest input index wins the ties, so that the result does not depend on the build
+    if( pHit.mTriangle < 0 || lDistance2 < pHit.mDistance2 ||
+        (lDistance2 == pHit.mDistance2 && pTriangle.mIndex < pHit.mTriangle) )
+    {
+        pHit.mTriangle  = pTriangle.mIndex;
+        pHit.mBary[0]   = u;
+        pHit.mBary[1]   = v;
+        pHit.mBary[2]   = w;
+        pHit.mDistance2 = lDistance2;
+    }
+}
+
+static inline double GetBoxDistance2(const float* pMin, const float* pMax, const double* p)
+{
+    double lDistance2 = 0.0;
+    for( int c = 0; c < 3; c++ )
+    {
+        double d = std::max(std::max(pMin[c] - p[c], p[c] - pMax[c]), 0.0);
+        lDistance2 += d * d;
+    }
+    return lDistance2;
+}
+
+bool TriangleBvh::FindClosest(
+                              const double* pPosition,
+                              int pHint,
+                              ClosestHit& pHit
+                              ) const
+{
+    pHit.mTriangle = -1;
+    pHit.mDistance2 = std::numeric_limits<double>::max();
+    if( mTriangles.empty() ) return false;
+
+    // a close triangle first gives a small bound that prunes most of the tree
+    if( pHint >= 0 && pHint < int(mLeafOfTriangle.size()) )
+        TestTriangle(mTriangles[mLeafOfTriangle[pHint]], pPosition, pHit);
+
+    // nodes to visit, the vector only takes the overflow of very deep trees
+    const int kStackSize = 64;
+    int lStack[kStackSize];
+    int lStackSize = 0;
+    std::vector<int> lOverflow;
+    int lNode = 0;
+
+    for(;;)
+    {
+        const Node& lCurrent = mNodes[lNode];
+        if( lCurrent.mCount > 0 )
+        {
+            for( int i = lCurrent.mFirst; i < lCurrent.mFirst + lCurrent.mCount; i++ )
+                TestTriangle(mTriangles[i], pPosition, pHit);
+        }
+        else
+        {
+            // the nearer child first, the other one is pushed if it may hold a closer point
+            int lLeft = lCurrent.mFirst, lRight = lCurrent.mFirst + 1;
+            double lLeftDistance2  = GetBoxDistance2(mNodes[lLeft].mMin, mNodes[lLeft].mMax, pPosition);
+            double lRightDistance2 = GetBoxDistance2(mNodes[lRight].mMin, mNodes[lRight].mMax, pPosition);
+            if( lRightDistance2 < lLeftDistance2 )
+            {
+                std::swap(lLeft, lRight);
+                std::swap(lLeftDistance2, lRightDistance2);
+            }
+
+            if( lLeftDistance2 <= pHit.mDistance2 )
+            {
+                if( lRightDistance2 <= pHit.mDistance2 )
+                {
+                    if( lStackSize < kStackSize ) lStack[lStackSize++] = lRight;
+                    else                          lOverflow.push_back(lRight);
+                }
+                lNode = lLeft;
+                continue;
+            }
+        }
+
+        // next pushed node that can still hold a closer point
+        lNode = -1;
+        while( lStackSize > 0 || !lOverflow.empty() )
+        {
+            int lCandidate;
+            if( lOverflow.empty() ) lCandidate = lStack[--lStackSize];
+            else
+            {
+                lCandidate = lOverflow.back();
+                lOverflow.pop_back();
+            }
+            if( GetBoxDistance2(mNodes[lCandidate].mMin, mNodes[lCandidate].mMax, pPosition) <= pHit.mDistance2 )
+            {
+                lNode = lCandidate;
+                break;
+            }
+        }
+        if( lNode < 0 ) break;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+// Bvh.h : bounding volume hierarchy of triangles for closest point queries.
+//
+// The nodes are stored in one flat array, the two children of a node next to
+// each other, with float bounds rounded outwards (32 bytes per node). The
+// triangles are copied in leaf order, so that a leaf reads contiguous memory.
+// The top levels are split with binned SAH on the calling thread, with a
+// parallel binning, and the subtrees below them are built in parallel.
+
+#pragma once
+
+#include <vector>
+
+class WorkStealingPool;
+
+// result of a closest point query
+struct ClosestHit
+{
+    int    mTriangle;       // index of the triangle in the build input
+    double mBary[3];        // weights of the 3 corners at the closest point
+    double mDistance2;      // squared distance to the closest point
+};
+
+class TriangleBvh
+{
+public:
+    // pCorners holds 9 doubles (3 corners) per triangle.
+    // pPool runs the build in parallel, NULL builds on the calling thread.
+    TriangleBvh(
+                const std::vector<double>& pCorners,
+                WorkStealingPool* pPool
+                );
+
+    int GetTriangleCount() const { return int(mTriangles.size()); }
+    int GetNodeCount() const     { return int(mNodes.size()); }
+
+    // closest point of the triangles to pPosition. pHint is a triangle index
+    // likely to be close (the hit of the previous query of a coherent sequence),
+    // -1 if none. Returns false when there are no triangles.
+    bool FindClosest(
+                     const double* pPosition,
+                     int pHint,
+                     ClosestHit& pHit
+                     ) const;
+
+private:
+    struct Node
+    {
+        float mMin[3];
+        float mMax[3];
+        int   mFirst;       // first child, or first triangle of a leaf
+        int   mCount;       // triangles of a leaf, 0 for an inner node
+    };
+
+    struct Triangle
+    {
+        double mA[3];
+        double mB[3];
+        double mC[3];
+        int    mIndex;      // index in the build input
+    };
+
+    struct BuildItem;
+
+    void TestTriangle(const Triangle& pTriangle, const double* pPosition, ClosestHit& pHit) const;
+
+    std::vector<Node>     mNodes;
+    std::vector<Triangle> mTriangles;
+    std::vector<int>      mLeafOfTriangle;  // position in mTriangles of every input triangle
+};
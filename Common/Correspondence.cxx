@@ -0,0 +1,234 @@
+// Correspondence.cxx : matches the elements of two meshes whose vertex order differ.
+
+#include "Correspondence.h"
+#include "Bvh.h"
+#include "PositionHash.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stddef.h>
+
+// control points referenced by at least one polygon-vertex
+static void GetUsedControlPoints(const MeshView& pMesh, std::vector<char>& pUsed)
+{
+    pUsed.assign(pMesh.mControlPointCount, 0);
+
+    int lPolygonVertexCount = pMesh.mPolygonStarts[pMesh.mPolygonCount];
+    for( int i = 0; i < lPolygonVertexCount; i++ )
+    {
+        int lControlPoint = pMesh.mPolygonVertices[i];
+        if( lControlPoint >= 0 && lControlPoint < pMesh.mControlPointCount ) pUsed[lControlPoint] = 1;
+    }
+}
+
+int MatchControlPoints(
+                       const MeshView& pTarget,
+                       const MeshView& pSource,
+                       double pTolerance,
+                       WorkStealingPool* pPool,
+                       std::vector<int>& pMatches
+                       )
+{
+    std::vector<char> lSourceUsed, lTargetUsed;
+    GetUsedControlPoints(pSource, lSourceUsed);
+    GetUsedControlPoints(pTarget, lTargetUsed);
+
+    std::vector<int> lSourcePoints;
+    for( int i = 0; i < pSource.mControlPointCount; i++ )
+    {
+        if( lSourceUsed[i] ) lSourcePoints.push_back(i);
+    }
+
+    PositionHash lHash(pSource.mPositions, pSource.mPositionStride, lSourcePoints, pTolerance, pPool);
+
+    pMatches.assign(pTarget.mControlPointCount, -1);
+    std::atomic<int> lUnmatched(0);
+
+    std::function<void(int, int)> lMatch = [&](int pBegin, int pEnd)
+    {
+        int lMissing = 0;
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            if( !lTargetUsed[i] ) continue;
+
+            pMatches[i] = lHash.FindClosest(pTarget.mPositions + size_t(i) * pTarget.mPositionStride);
+            if( pMatches[i] < 0 ) lMissing++;
+        }
+        lUnmatched += lMissing;
+    };
+
+    if( pPool ) pPool->ParallelFor(0, pTarget.mControlPointCount, 16 * 1024, lMatch);
+    else        lMatch(0, pTarget.mControlPointCount);
+
+    return lUnmatched;
+}
+
+bool RemapElement(
+                  const MeshView& pTarget,
+                  EElementMapping pMapping,
+                  const MeshView& pSource,
+                  const ElementView& pSourceElement,
+                  const std::vector<int>& pMatches,
+                  std::vector<int>& pIndex,
+                  ElementView& pRemapped
+                  )
+{
+    if( pMapping != eMapByControlPoint && pMapping != eMapByPolygonVertex ) return false;
+    if( pSourceElement.mMapping != eMapByControlPoint && pSourceElement.mMapping != eMapByPolygonVertex ) return false;
+
+    // element of the source element for every source control point
+    std::vector<int> lSourceElement;
+    if( pSourceElement.mMapping == eMapByControlPoint )
+    {
+        lSourceElement.resize(pSource.mControlPointCount);
+        for( int i = 0; i < pSource.mControlPointCount; i++ ) lSourceElement[i] = i;
+    }
+    else
+    {
+        lSourceElement.assign(pSource.mControlPointCount, -1);
+        for( int i = pSource.mPolygonStarts[pSource.mPolygonCount] - 1; i >= 0; i-- )
+        {
+            int lControlPoint = pSource.mPolygonVertices[i];
+            if( lControlPoint >= 0 && lControlPoint < pSource.mControlPointCount ) lSourceElement[lControlPoint] = i;
+        }
+    }
+
+    int lCount = GetElementCount(pTarget, pMapping);
+    pIndex.resize(lCount);
+    for( int i = 0; i < lCount; i++ )
+    {
+        int lControlPoint = pMapping == eMapByControlPoint ? i : pTarget.mPolygonVertices[i];
+        int lMatch = lControlPoint >= 0 && lControlPoint < int(pMatches.size()) ? pMatches[lControlPoint] : -1;
+        int lElement = lMatch >= 0 ? lSourceElement[lMatch] : -1;
+        if( lElement < 0 ) lElement = 0;
+
+        pIndex[i] = pSourceElement.mReference == eRefDirect ? lElement : pSourceElement.mIndex[lElement];
+    }
+
+    pRemapped.mMapping     = pMapping;
+    pRemapped.mReference   = eRefIndexToDirect;
+    pRemapped.mDirect      = pSourceElement.mDirect;
+    pRemapped.mDirectCount = pSourceElement.mDirectCount;
+    pRemapped.mStride      = pSourceElement.mStride;
+    pRemapped.mIndex       = lCount > 0 ? &pIndex[0] : NULL;
+    pRemapped.mIndexCount  = lCount;
+    return true;
+}
+
+void TriangulateMesh(
+                     const MeshView& pMesh,
+                     const ElementView& pElement,
+                     std::vector<double>& pCorners,
+                     std::vector<double>& pCornerValues
+                     )
+{
+    int lTriangleCount = 0;
+    for( int p = 0; p < pMesh.mPolygonCount; p++ )
+    {
+        int lSize = pMesh.mPolygonStarts[p + 1] - pMesh.mPolygonStarts[p];
+        if( lSize >= 3 ) lTriangleCount += lSize - 2;
+    }
+
+    pCorners.resize(size_t(lTriangleCount) * 9);
+    pCornerValues.resize(size_t(lTriangleCount) * 9);
+
+    size_t lOffset = 0;
+    for( int p = 0; p < pMesh.mPolygonCount; p++ )
+    {
+        int lStart = pMesh.mPolygonStarts[p];
+        int lSize = pMesh.mPolygonStarts[p + 1] - lStart;
+
+        for( int k = 1; k + 1 < lSize; k++ )
+        {
+            int lPolygonVertices[3] = { lStart, lStart + k, lStart + k + 1 };
+            for( int c = 0; c < 3; c++ )
+            {
+                int lPolygonVertex = lPolygonVertices[c];
+                int lControlPoint = pMesh.mPolygonVertices[lPolygonVertex];
+
+                const double* lPosition = pMesh.mPositions + size_t(lControlPoint) * pMesh.mPositionStride;
+                const double* lValue = GetElementValue(pElement, p, lPolygonVertex, lControlPoint);
+                for( int i = 0; i < 3; i++ )
+                {
+                    pCorners[lOffset + i] = lPosition[i];
+                    pCornerValues[lOffset + i] = lValue[i];
+                }
+                lOffset += 3;
+            }
+        }
+    }
+}
+
+bool SampleSurface(
+                   const TriangleBvh& pBvh,
+                   const std::vector<double>& pCornerValues,
+                   const MeshView& pTarget,
+                   EElementMapping pMapping,
+                   WorkStealingPool* pPool,
+                   std::vector<double>& pValues
+                   )
+{
+    if( pMapping == eMapAllSame || pBvh.GetTriangleCount() == 0 ) return false;
+
+    // one query per control point, or per polygon
+    bool lByPolygon = pMapping == eMapByPolygon;
+    int lQueryCount = lByPolygon ? pTarget.mPolygonCount : pTarget.mControlPointCount;
+
+    std::vector<double> lSamples;
+    std::vector<double>& lQueryValues = pMapping == eMapByPolygonVertex ? lSamples : pValues;
+    lQueryValues.resize(size_t(lQueryCount) * 4);
+
+    std::function<void(int, int)> lSample = [&](int pBegin, int pEnd)
+    {
+        // neighbour elements are usually close on the surface too
+        int lHint = -1;
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            double lPosition[3];
+            if( lByPolygon )
+            {
+                int lStart = pTarget.mPolygonStarts[i];
+                int lSize = pTarget.mPolygonStarts[i + 1] - lStart;
+                lPosition[0] = lPosition[1] = lPosition[2] = 0.0;
+                for( int k = 0; k < lSize; k++ )
+                {
+                    const double* lCorner = pTarget.mPositions + size_t(pTarget.mPolygonVertices[lStart + k]) * pTarget.mPositionStride;
+                    for( int c = 0; c < 3; c++ ) lPosition[c] += lCorner[c];
+                }
+                for( int c = 0; c < 3 && lSize > 0; c++ ) lPosition[c] /= lSize;
+            }
+            else
+            {
+                const double* lPoint = pTarget.mPositions + size_t(i) * pTarget.mPositionStride;
+                for( int c = 0; c < 3; c++ ) lPosition[c] = lPoint[c];
+            }
+
+            ClosestHit lHit;
+            pBvh.FindClosest(lPosition, lHint, lHit);
+            lHint = lHit.mTriangle;
+
+            const double* lCorners = &pCornerValues[size_t(lHit.mTriangle) * 9];
+            double* lValue = &lQueryValues[size_t(i) * 4];
+            for( int c = 0; c < 3; c++ )
+                lValue[c] = lHit.mBary[0] * lCorners[c] + lHit.mBary[1] * lCorners[3 + c] + lHit.mBary[2] * lCorners[6 + c];
+            lValue[3] = 1.0;
+        }
+    };
+
+    if( pPool ) pPool->ParallelFor(0, lQueryCount, 4 * 1024, lSample);
+    else        lSample(0, lQueryCount);
+
+    // the polygon-vertices take the sample of their control point
+    if( pMapping == eMapByPolygonVertex )
+    {
+        int lCount = pTarget.mPolygonStarts[pTarget.mPolygonCount];
+        pValues.resize(size_t(lCount) * 4);
+        for( int i = 0; i < lCount; i++ )
+        {
+            const double* lSampleValue = &lSamples[size_t(pTarget.mPolygonVertices[i]) * 4];
+            std::copy(lSampleValue, lSampleValue + 4, &pValues[size_t(i) * 4]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+// Correspondence.h : matches the elements of two meshes whose vertex order differ.
+//
+// The merge reads the smooth normal of element i of the lighting mesh at element
+// i of the smooth mesh. When a tool re-orders the vertices on export, the
+// control points are matched by position instead and the smooth normals are
+// read through a composed index array (RemapElement). When the topologies differ
+// (LODs, cages), the smooth normals are sampled on the closest point of the
+// smooth surface (TriangulateMesh, SampleSurface).
+
+#pragma once
+
+#include "MergeCore.h"
+
+#include <vector>
+
+class TriangleBvh;
+class WorkStealingPool;
+
+// how the elements of the lighting mesh find their smooth normal
+enum ECorrespondence
+{
+    eCorrespondIndex,       // same element index in both meshes
+    eCorrespondPosition,    // closest control point within the weld tolerance
+    eCorrespondClosestPoint // normal interpolated at the closest point of the smooth surface
+};
+
+// pMatches[c] is the control point of pSource closest to the control point c of
+// pTarget within pTolerance, or -1. Only the control points used by polygons are
+// considered on both sides. Returns the number of used target control points
+// without a match. pPool runs the hash build and the lookups in parallel, NULL
+// runs them on the calling thread.
+int MatchControlPoints(
+                       const MeshView& pTarget,
+                       const MeshView& pSource,
+                       double pTolerance,
+                       WorkStealingPool* pPool,
+                       std::vector<int>& pMatches
+                       );
+
+// builds an eRefIndexToDirect view, in the pMapping element order of pTarget, of the
+// pSourceElement values of the matched control points. pMapping and the mapping of
+// pSourceElement must be eMapByControlPoint or eMapByPolygonVertex; a by polygon-vertex
+// source gives the value of the first polygon-vertex of the matched control point
+// (smooth normals are the same on all of them). Unmatched control points take the
+// first source value. pSourceElement must be valid (IsElementValid) and pIndex must
+// outlive pRemapped.
+bool RemapElement(
+                  const MeshView& pTarget,
+                  EElementMapping pMapping,
+                  const MeshView& pSource,
+                  const ElementView& pSourceElement,
+                  const std::vector<int>& pMatches,
+                  std::vector<int>& pIndex,
+                  ElementView& pRemapped
+                  );
+
+// fan triangulation of the polygons of pMesh: 3 corners (9 doubles) per triangle in
+// pCorners, and the pElement vector at each of these corners in pCornerValues.
+// pElement must be valid (IsElementValid) for its mapping on pMesh.
+void TriangulateMesh(
+                     const MeshView& pMesh,
+                     const ElementView& pElement,
+                     std::vector<double>& pCorners,
+                     std::vector<double>& pCornerValues
+                     );
+
+// for every pMapping element of pTarget, the corner values of the triangle of pBvh
+// closest to the element interpolated at the closest point, 4 doubles per element
+// in pValues (W = 1, not normalized). eMapByControlPoint and eMapByPolygonVertex
+// elements are sampled at their control point, eMapByPolygon elements at the
+// center of their polygon. pCornerValues are the corner values of the triangles
+// pBvh was built from. pPool runs the queries in parallel, NULL runs them on the
+// calling thread. Returns false for eMapAllSame or an empty pBvh.
+bool SampleSurface(
+                   const TriangleBvh& pBvh,
+                   const std::vector<double>& pCornerValues,
+                   const MeshView& pTarget,
+                   EElementMapping pMapping,
+                   WorkStealingPool* pPool,
+                   std::vector<double>& pValues
+                   );
@@ -0,0 +1,180 @@
+// ElementCompaction.cxx : index to direct compaction of vector elements.
+
+#include "ElementCompaction.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+// keys of the values too far from 0 for their multiple of the tolerance
+static const double kMaxKey = 4.0e18;
+
+// the multiple of pTolerance closest to pValue, or its bits for a 0 tolerance
+static long long GetKey(double pValue, double pTolerance)
+{
+    if( pTolerance > 0.0 )
+    {
+        double lScaled = pValue / pTolerance;
+        if( lScaled != lScaled ) return -(long long)kMaxKey - 1;
+        return (long long)std::floor(std::max(-kMaxKey, std::min(kMaxKey, lScaled)) + 0.5);
+    }
+
+    // -0 and 0 are the same vector
+    long long lBits = 0;
+    if( pValue != 0.0 ) memcpy(&lBits, &pValue, sizeof(lBits));
+    return lBits;
+}
+
+static unsigned long long HashKey(const long long* pKey, int pComponents)
+{
+    unsigned long long h = 0x9E3779B97F4A7C15ull;
+    for( int c = 0; c < pComponents; c++ )
+    {
+        h ^= (unsigned long long)pKey[c];
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+    }
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 29;
+    return h;
+}
+
+int CompactElement(
+                   const double* pValues,
+                   int pCount,
+                   int pStride,
+                   int pComponents,
+                   double pTolerance,
+                   WorkStealingPool* pPool,
+                   std::vector<int>& pIndex,
+                   std::vector<int>& pFirst
+                   )
+{
+    pIndex.assign(size_t(std::max(pCount, 0)), 0);
+    pFirst.clear();
+    if( pCount <= 0 || pComponents <= 0 ) return 0;
+
+    const int kGrain = 64 * 1024;
+    const int lChunkCount = (pCount + kGrain - 1) / kGrain;
+
+    // a few shards per thread, the shard of an element is given by the high bits of its hash
+    int lShardBits = 0;
+    int lThreadCount = pPool ? pPool->GetThreadCount() : 1;
+    while( (1 << lShardBits) < 4 * lThreadCount && lShardBits < 8 && (kGrain << lShardBits) < pCount ) lShardBits++;
+    const int lShardCount = 1 << lShardBits;
+
+    // the keys and hashes, and the number of elements of every shard in every chunk
+    std::vector<long long> lKeys(size_t(pCount) * pComponents);
+    std::vector<unsigned long long> lHashes(pCount);
+    std::vector<int> lCounts(size_t(lChunkCount) * lShardCount, 0);
+    ForRange(pPool, pCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        int* lChunkCounts = &lCounts[size_t(pBegin / kGrain) * lShardCount];
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            long long* lKey = &lKeys[size_t(i) * pComponents];
+            const double* lValue = pValues + size_t(i) * pStride;
+            for( int c = 0; c < pComponents; c++ ) lKey[c] = GetKey(lValue[c], pTolerance);
+
+            lHashes[i] = HashKey(lKey, pComponents);
+            if( lShardBits > 0 ) lChunkCounts[lHashes[i] >> (64 - lShardBits)]++;
+            else                 lChunkCounts[0]++;
+        }
+    });
+
+    // scatter the elements by shard, in increasing order inside a shard
+    std::vector<int> lShardStarts(lShardCount + 1);
+    std::vector<int> lOffsets(lCounts.size());
+    int lStart = 0;
+    for( int s = 0; s < lShardCount; s++ )
+    {
+        lShardStarts[s] = lStart;
+        for( int k = 0; k < lChunkCount; k++ )
+        {
+            lOffsets[size_t(k) * lShardCount + s] = lStart;
+            lStart += lCounts[size_t(k) * lShardCount + s];
+        }
+    }
+    lShardStarts[lShardCount] = lStart;
+
+    std::vector<int> lElements(pCount);
+    ForRange(pPool, pCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        int* lChunkOffsets = &lOffsets[size_t(pBegin / kGrain) * lShardCount];
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            int s = lShardBits > 0 ? int(lHashes[i] >> (64 - lShardBits)) : 0;
+            lElements[lChunkOffsets[s]++] = i;
+        }
+    });
+
+    // every element finds the first element with its key in the open addressing table of its shard
+    std::vector<int> lFirst(pCount);
+    std::function<void(int)> lCompactShard = [&](int pShard)
+    {
+        int lBegin = lShardStarts[pShard], lEnd = lShardStarts[pShard + 1];
+        if( lBegin == lEnd ) return;
+
+        size_t lSize = 16;
+        while( lSize < size_t(lEnd - lBegin) * 2 ) lSize <<= 1;
+        const size_t lMask = lSize - 1;
+        std::vector<int> lTable(lSize, -1);
+
+        for( int e = lBegin; e < lEnd; e++ )
+        {
+            int i = lElements[e];
+            const long long* lKey = &lKeys[size_t(i) * pComponents];
+            for( size_t lSlot = size_t(lHashes[i]) & lMask; ; lSlot = (lSlot + 1) & lMask )
+            {
+                int j = lTable[lSlot];
+                if( j < 0 )
+                {
+                    lTable[lSlot] = i;
+                    lFirst[i] = i;
+                    break;
+                }
+                if( lHashes[j] == lHashes[i] && memcmp(&lKeys[size_t(j) * pComponents], lKey, sizeof(long long) * pComponents) == 0 )
+                {
+                    lFirst[i] = j;
+                    break;
+                }
+            }
+        }
+    };
+    if( pPool ) pPool->Run(lShardCount, lCompactShard);
+    else        for( int s = 0; s < lShardCount; s++ ) lCompactShard(s);
+
+    // number the distinct vectors in order of first use: count them per chunk, then
+    // give them their numbers, then the other elements take the number of their first
+    std::vector<int> lChunkStarts(lChunkCount + 1, 0);
+    ForRange(pPool, pCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        int lDistinct = 0;
+        for( int i = pBegin; i < pEnd; i++ ) lDistinct += lFirst[i] == i;
+        lChunkStarts[pBegin / kGrain + 1] = lDistinct;
+    });
+    for( int k = 0; k < lChunkCount; k++ ) lChunkStarts[k + 1] += lChunkStarts[k];
+
+    pFirst.resize(lChunkStarts[lChunkCount]);
+    ForRange(pPool, pCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        int lNumber = lChunkStarts[pBegin / kGrain];
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            if( lFirst[i] != i ) continue;
+            pIndex[i] = lNumber;
+            pFirst[lNumber++] = i;
+        }
+    });
+    ForRange(pPool, pCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            if( lFirst[i] != i ) pIndex[i] = pIndex[lFirst[i]];
+        }
+    });
+
+    return int(pFirst.size());
+}
@@ -0,0 +1,32 @@
+// ElementCompaction.h : index to direct compaction of vector elements.
+//
+// The merge writes one tangent and one binormal per element of the normals, most
+// of them repeated when the normals are by polygon-vertex. The vectors are
+// quantized with a tolerance and hashed, every distinct vector is kept once and
+// the elements point at it through an index, like an eIndexToDirect layer element.
+// The elements are split in shards by hash and the shards are compacted in
+// parallel; the result does not depend on the number of threads.
+
+#pragma once
+
+#include <vector>
+
+class WorkStealingPool;
+
+// finds the distinct vectors of the pCount vectors of pValues, pStride doubles apart,
+// comparing their first pComponents values. Two vectors are the same when all their
+// values round to the same multiple of pTolerance, 0 compares the exact values.
+// pIndex receives the distinct vector of every element, numbered in order of first
+// use, and pFirst the first element of every distinct vector, whose value it keeps.
+// pPool runs the passes in parallel, NULL runs them on the calling thread.
+// Returns the number of distinct vectors.
+int CompactElement(
+                   const double* pValues,
+                   int pCount,
+                   int pStride,
+                   int pComponents,
+                   double pTolerance,
+                   WorkStealingPool* pPool,
+                   std::vector<int>& pIndex,
+                   std::vector<int>& pFirst
+                   );
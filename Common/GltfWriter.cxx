@@ -0,0 +1,549 @@
+// GltfWriter.cxx : GLB file of meshes with interleaved vertex buffers.
+
+#include "GltfWriter.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+// glTF component types
+enum
+{
+    kGltfByte          = 5120,
+    kGltfUnsignedByte  = 5121,
+    kGltfShort         = 5122,
+    kGltfUnsignedShort = 5123,
+    kGltfUnsignedInt   = 5125,
+    kGltfFloat         = 5126
+};
+
+// storage of an attribute in the vertices of a mesh
+struct AttributeFormat
+{
+    int mComponentType;
+    int mOffset;            // in the vertex
+};
+
+// the triangles of a material, [mFirst, mFirst + mCount) of the indices
+struct Primitive
+{
+    int    mMaterial;       // -1 for none
+    size_t mFirst;
+    size_t mCount;
+};
+
+// the buffers of a mesh, empty if it has no triangles
+struct MeshBuffers
+{
+    std::vector<unsigned char>   mVertices;
+    std::vector<unsigned char>   mIndices;
+    std::vector<AttributeFormat> mFormats;          // of the attributes, the positions are floats at 0
+    std::vector<Primitive>       mPrimitives;
+    int                          mVertexCount;
+    int                          mStride;
+    int                          mIndexSize;        // 2 or 4
+    float                        mMin[3];           // of the positions
+    float                        mMax[3];
+    std::string                  mError;
+};
+
+GltfAttribute GetGltfAttribute(
+                               const char* pName,
+                               const ElementView& pView,
+                               int pComponents,
+                               bool pQuantize
+                               )
+{
+    GltfAttribute lAttribute;
+    lAttribute.mName       = pName;
+    lAttribute.mView       = pView;
+    lAttribute.mComponents = pComponents;
+    lAttribute.mQuantize   = pQuantize;
+    for( int c = 0; c < 4; c++ )
+    {
+        lAttribute.mScale[c]  = 1.0;
+        lAttribute.mOffset[c] = 0.0;
+    }
+    return lAttribute;
+}
+
+// the direct element of pView at a polygon-vertex
+static int GetDirectElement(const ElementView& pView, int pPolygon, int pPolygonVertex, int pControlPoint)
+{
+    int lElement = pView.mMapping == eMapByControlPoint  ? pControlPoint :
+                   pView.mMapping == eMapByPolygonVertex ? pPolygonVertex :
+                   pView.mMapping == eMapByPolygon       ? pPolygon : 0;
+    return pView.mReference == eRefIndexToDirect ? pView.mIndex[lElement] : lElement;
+}
+
+static int GetComponentSize(int pComponentType)
+{
+    switch( pComponentType )
+    {
+    case kGltfByte:
+    case kGltfUnsignedByte:  return 1;
+    case kGltfShort:
+    case kGltfUnsignedShort: return 2;
+    default:                 return 4;
+    }
+}
+
+// the component type of the written values of an attribute. KHR_mesh_quantization
+// allows the signed types only for NORMAL and TANGENT, the unsigned ones only for
+// COLOR_n; TEXCOORD_n and the application specific attributes take either.
+static int GetComponentType(const GltfAttribute& pAttribute, EGltfQuantization pQuantization, const std::vector<int>& pVertexElements)
+{
+    if( pQuantization == eGltfFloat || !pAttribute.mQuantize ) return kGltfFloat;
+    bool lSignedOnly   = pAttribute.mName == "NORMAL" || pAttribute.mName == "TANGENT";
+    bool lUnsignedOnly = pAttribute.mName.compare(0, 6, "COLOR_") == 0;
+
+    bool lUnit = true, lSigned = true;
+    const ElementView& lView = pAttribute.mView;
+    for( size_t i = 0; i < pVertexElements.size() && lSigned; i++ )
+    {
+        const double* lValue = lView.mDirect + size_t(pVertexElements[i]) * lView.mStride;
+        for( int c = 0; c < pAttribute.mComponents; c++ )
+        {
+            double v = lValue[c] * pAttribute.mScale[c] + pAttribute.mOffset[c];
+            lUnit   = lUnit && v >= 0.0 && v <= 1.0;
+            lSigned = lSigned && v >= -1.0 && v <= 1.0;
+        }
+    }
+    if( lUnit && !lSignedOnly )     return pQuantization == eGltfInt16 ? kGltfUnsignedShort : kGltfUnsignedByte;
+    if( lSigned && !lUnsignedOnly ) return pQuantization == eGltfInt16 ? kGltfShort : kGltfByte;
+    return kGltfFloat;
+}
+
+// writes v, in the range of the type for the normalized ones
+static void WriteComponent(unsigned char* pTarget, int pComponentType, double v)
+{
+    switch( pComponentType )
+    {
+    case kGltfByte:          { int8_t   q = int8_t(floor(v * 127.0 + 0.5));     memcpy(pTarget, &q, 1); break; }
+    case kGltfUnsignedByte:  { uint8_t  q = uint8_t(floor(v * 255.0 + 0.5));    memcpy(pTarget, &q, 1); break; }
+    case kGltfShort:         { int16_t  q = int16_t(floor(v * 32767.0 + 0.5));  memcpy(pTarget, &q, 2); break; }
+    case kGltfUnsignedShort: { uint16_t q = uint16_t(floor(v * 65535.0 + 0.5)); memcpy(pTarget, &q, 2); break; }
+    default:                 { float    f = float(v);                           memcpy(pTarget, &f, 4); break; }
+    }
+}
+
+// checks the polygons and the attributes of pMesh, false with the reason in pError
+static bool IsMeshValid(const GltfMesh& pMesh, std::string& pError)
+{
+    const MeshView& lView = pMesh.mView;
+    int lPolygonVertexCount = lView.mPolygonCount > 0 ? lView.mPolygonStarts[lView.mPolygonCount] : 0;
+    bool lValid = lView.mPolygonCount == 0 || lView.mPolygonStarts[0] == 0;
+    for( int p = 0; p < lView.mPolygonCount && lValid; p++ )
+        lValid = lView.mPolygonStarts[p] <= lView.mPolygonStarts[p + 1];
+    for( int i = 0; i < lPolygonVertexCount && lValid; i++ )
+        lValid = lView.mPolygonVertices[i] >= 0 && lView.mPolygonVertices[i] < lView.mControlPointCount;
+    if( !lValid )
+    {
+        pError = "the polygons of " + pMesh.mName + " do not fit its control points";
+        return false;
+    }
+
+    for( size_t a = 0; a < pMesh.mAttributes.size(); a++ )
+    {
+        const GltfAttribute& lAttribute = pMesh.mAttributes[a];
+        if( lAttribute.mComponents < 1 || lAttribute.mComponents > 4 || lAttribute.mComponents > lAttribute.mView.mStride ||
+            !IsElementValid(lAttribute.mView, GetElementCount(lView, lAttribute.mView.mMapping)) )
+        {
+            pError = "the attribute " + lAttribute.mName + " of " + pMesh.mName + " does not fit its mesh";
+            return false;
+        }
+    }
+    return true;
+}
+
+// the vertices and the triangles of pMesh
+static void BuildMeshBuffers(const GltfMesh& pMesh, EGltfQuantization pQuantization, MeshBuffers& pBuffers)
+{
+    pBuffers.mVertexCount = 0;
+    pBuffers.mStride      = 0;
+    pBuffers.mIndexSize   = 4;
+    if( !IsMeshValid(pMesh, pBuffers.mError) ) return;
+
+    // the key of a polygon-vertex: its control point and the direct element of every attribute
+    const MeshView& lView = pMesh.mView;
+    int lPolygonVertexCount = lView.mPolygonCount > 0 ? lView.mPolygonStarts[lView.mPolygonCount] : 0;
+    size_t lWidth = 1 + pMesh.mAttributes.size();
+    std::vector<int> lKeys(size_t(lPolygonVertexCount) * lWidth);
+    size_t lTriangleCount = 0;
+    for( int p = 0; p < lView.mPolygonCount; p++ )
+    {
+        int lStart = lView.mPolygonStarts[p], lEnd = lView.mPolygonStarts[p + 1];
+        if( lEnd - lStart >= 3 ) lTriangleCount += lEnd - lStart - 2;
+        for( int i = lStart; i < lEnd; i++ )
+        {
+            int* lKey = &lKeys[size_t(i) * lWidth];
+            lKey[0] = lView.mPolygonVertices[i];
+            for( size_t a = 0; a < pMesh.mAttributes.size(); a++ )
+                lKey[1 + a] = GetDirectElement(pMesh.mAttributes[a].mView, p, i, lKey[0]);
+        }
+    }
+    if( lTriangleCount == 0 ) return;
+
+    // the polygon-vertices with the same key share a vertex, numbered by first use:
+    // an open addressing table of the first polygon-vertex of every key
+    size_t lCapacity = 16;
+    while( lCapacity < 2 * size_t(lPolygonVertexCount) ) lCapacity *= 2;
+    std::vector<int> lTable(lCapacity, -1);
+    std::vector<int> lVertexOf(lPolygonVertexCount);
+    std::vector<int> lFirstUse;
+    for( int i = 0; i < lPolygonVertexCount; i++ )
+    {
+        const int* lKey = &lKeys[size_t(i) * lWidth];
+        uint64_t lHash = 14695981039346656037ull;
+        for( size_t k = 0; k < lWidth; k++ ) lHash = (lHash ^ uint32_t(lKey[k])) * 1099511628211ull;
+
+        size_t lSlot = size_t(lHash ^ (lHash >> 29)) & (lCapacity - 1);
+        while( lTable[lSlot] >= 0 && memcmp(&lKeys[size_t(lFirstUse[lTable[lSlot]]) * lWidth], lKey, lWidth * sizeof(int)) != 0 )
+            lSlot = (lSlot + 1) & (lCapacity - 1);
+        if( lTable[lSlot] < 0 )
+        {
+            lTable[lSlot] = int(lFirstUse.size());
+            lFirstUse.push_back(i);
+        }
+        lVertexOf[i] = lTable[lSlot];
+    }
+    std::vector<int>().swap(lTable);
+    int lVertexCount = int(lFirstUse.size());
+
+    // the layout of a vertex: the positions, then the attributes aligned to 4 bytes
+    pBuffers.mStride = 12;
+    std::vector<int> lElements(lVertexCount);
+    for( size_t a = 0; a < pMesh.mAttributes.size(); a++ )
+    {
+        for( int v = 0; v < lVertexCount; v++ ) lElements[v] = lKeys[size_t(lFirstUse[v]) * lWidth + 1 + a];
+
+        AttributeFormat lFormat;
+        lFormat.mComponentType = GetComponentType(pMesh.mAttributes[a], pQuantization, lElements);
+        lFormat.mOffset        = pBuffers.mStride;
+        pBuffers.mFormats.push_back(lFormat);
+        pBuffers.mStride += (pMesh.mAttributes[a].mComponents * GetComponentSize(lFormat.mComponentType) + 3) & ~3;
+    }
+
+    pBuffers.mVertexCount = lVertexCount;
+    pBuffers.mVertices.assign(size_t(lVertexCount) * pBuffers.mStride, 0);
+    for( int c = 0; c < 3; c++ )
+    {
+        pBuffers.mMin[c] = HUGE_VALF;
+        pBuffers.mMax[c] = -HUGE_VALF;
+    }
+    for( int v = 0; v < lVertexCount; v++ )
+    {
+        unsigned char* lVertex = &pBuffers.mVertices[size_t(v) * pBuffers.mStride];
+        const int* lKey = &lKeys[size_t(lFirstUse[v]) * lWidth];
+        const double* lPosition = lView.mPositions + size_t(lKey[0]) * lView.mPositionStride;
+        for( int c = 0; c < 3; c++ )
+        {
+            float f = float(lPosition[c]);
+            memcpy(lVertex + 4 * c, &f, 4);
+            pBuffers.mMin[c] = std::min(pBuffers.mMin[c], f);
+            pBuffers.mMax[c] = std::max(pBuffers.mMax[c], f);
+        }
+        for( size_t a = 0; a < pMesh.mAttributes.size(); a++ )
+        {
+            const GltfAttribute& lAttribute = pMesh.mAttributes[a];
+            const AttributeFormat& lFormat = pBuffers.mFormats[a];
+            const double* lValue = lAttribute.mView.mDirect + size_t(lKey[1 + a]) * lAttribute.mView.mStride;
+            int lSize = GetComponentSize(lFormat.mComponentType);
+            for( int c = 0; c < lAttribute.mComponents; c++ )
+                WriteComponent(lVertex + lFormat.mOffset + c * lSize, lFormat.mComponentType, lValue[c] * lAttribute.mScale[c] + lAttribute.mOffset[c]);
+        }
+    }
+    std::vector<int>().swap(lKeys);
+
+    // the fanned triangles grouped by material, slot 0 being the polygons without material
+    int lMaterialCount = int(pMesh.mMaterials.size());
+    std::vector<size_t> lSlotStarts(lMaterialCount + 2, 0);
+    std::vector<int> lSlots(lView.mPolygonCount);
+    for( int p = 0; p < lView.mPolygonCount; p++ )
+    {
+        int lMaterial = pMesh.mPolygonMaterials ? pMesh.mPolygonMaterials[p] : 0;
+        lSlots[p] = lMaterial >= 0 && lMaterial < lMaterialCount ? lMaterial + 1 : 0;
+        int lSize = lView.mPolygonStarts[p + 1] - lView.mPolygonStarts[p];
+        if( lSize >= 3 ) lSlotStarts[lSlots[p] + 1] += 3 * size_t(lSize - 2);
+    }
+    for( int s = 0; s <= lMaterialCount; s++ )
+    {
+        if( lSlotStarts[s + 1] > 0 )
+        {
+            Primitive lPrimitive = { s > 0 ? pMesh.mMaterials[s - 1] : -1, lSlotStarts[s], lSlotStarts[s + 1] };
+            pBuffers.mPrimitives.push_back(lPrimitive);
+        }
+        lSlotStarts[s + 1] += lSlotStarts[s];
+    }
+
+    // a 16 bit index can't be 65535, the primitive restart value
+    pBuffers.mIndexSize = lVertexCount < 65535 ? 2 : 4;
+    pBuffers.mIndices.resize((3 * lTriangleCount * pBuffers.mIndexSize + 3) & ~size_t(3), 0);
+    for( int p = 0; p < lView.mPolygonCount; p++ )
+    {
+        int lStart = lView.mPolygonStarts[p], lEnd = lView.mPolygonStarts[p + 1];
+        for( int i = lStart + 1; i + 1 < lEnd; i++ )
+        {
+            int lCorners[3] = { lVertexOf[lStart], lVertexOf[i], lVertexOf[i + 1] };
+            for( int c = 0; c < 3; c++ )
+            {
+                unsigned char* lTarget = &pBuffers.mIndices[lSlotStarts[lSlots[p]]++ * pBuffers.mIndexSize];
+                uint32_t lIndex = uint32_t(lCorners[c]);
+                uint16_t lShort = uint16_t(lIndex);
+                if( pBuffers.mIndexSize == 2 ) memcpy(lTarget, &lShort, 2);
+                else                           memcpy(lTarget, &lIndex, 4);
+            }
+        }
+    }
+}
+
+static void AppendFormat(std::string& pText, const char* pFormat, ...)
+{
+    char lBuffer[512];
+    va_list lArgs;
+    va_start(lArgs, pFormat);
+    int lLength = vsnprintf(lBuffer, sizeof(lBuffer), pFormat, lArgs);
+    va_end(lArgs);
+    if( lLength > 0 ) pText.append(lBuffer, std::min(size_t(lLength), sizeof(lBuffer) - 1));
+}
+
+// pString as a JSON string
+static void AppendString(std::string& pText, const std::string& pString)
+{
+    pText += '"';
+    for( size_t i = 0; i < pString.size(); i++ )
+    {
+        unsigned char c = (unsigned char)pString[i];
+        if( c == '"' || c == '\\' )  { pText += '\\'; pText += char(c); }
+        else if( c < 0x20 )          AppendFormat(pText, "\\u%04x", c);
+        else                         pText += char(c);
+    }
+    pText += '"';
+}
+
+static const char* GetAccessorType(int pComponents)
+{
+    static const char* kTypes[4] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+    return kTypes[pComponents - 1];
+}
+
+static bool IsIdentity(const double pMatrix[16])
+{
+    for( int i = 0; i < 16; i++ )
+    {
+        if( pMatrix[i] != (i % 5 == 0 ? 1.0 : 0.0) ) return false;
+    }
+    return true;
+}
+
+bool WriteGlb(
+              const GltfScene& pScene,
+              EGltfQuantization pQuantization,
+              const char* pFilename,
+              WorkStealingPool* pPool,
+              std::string& pError,
+              GltfStats* pStats
+              )
+{
+    int lMeshCount = int(pScene.mMeshes.size());
+    for( size_t n = 0; n < pScene.mNodes.size(); n++ )
+    {
+        if( pScene.mNodes[n].mMesh < -1 || pScene.mNodes[n].mMesh >= lMeshCount )
+        {
+            pError = "the node " + pScene.mNodes[n].mName + " has no mesh in the scene";
+            return false;
+        }
+    }
+    for( int m = 0; m < lMeshCount; m++ )
+    {
+        const std::vector<int>& lMaterials = pScene.mMeshes[m].mMaterials;
+        for( size_t i = 0; i < lMaterials.size(); i++ )
+        {
+            if( lMaterials[i] < 0 || lMaterials[i] >= int(pScene.mMaterials.size()) )
+            {
+                pError = "a material of " + pScene.mMeshes[m].mName + " is not in the scene";
+                return false;
+            }
+        }
+    }
+
+    // the buffers are built in parallel, biggest first
+    std::vector<MeshBuffers> lBuffers(lMeshCount);
+    std::vector<int> lOrder(lMeshCount);
+    for( int m = 0; m < lMeshCount; m++ ) lOrder[m] = m;
+    std::stable_sort(lOrder.begin(), lOrder.end(), [&](int pA, int pB)
+    {
+        const MeshView& a = pScene.mMeshes[pA].mView;
+        const MeshView& b = pScene.mMeshes[pB].mView;
+        return (a.mPolygonCount > 0 ? a.mPolygonStarts[a.mPolygonCount] : 0) > (b.mPolygonCount > 0 ? b.mPolygonStarts[b.mPolygonCount] : 0);
+    });
+    std::function<void(int)> lBuild = [&](int pTask) { BuildMeshBuffers(pScene.mMeshes[lOrder[pTask]], pQuantization, lBuffers[lOrder[pTask]]); };
+    if( pPool ) pPool->Run(lMeshCount, lBuild);
+    else        for( int m = 0; m < lMeshCount; m++ ) lBuild(m);
+
+    for( int m = 0; m < lMeshCount; m++ )
+    {
+        if( !lBuffers[m].mError.empty() )
+        {
+            pError = lBuffers[m].mError;
+            return false;
+        }
+    }
+
+    // the standard attributes need KHR_mesh_quantization to be integers
+    bool lQuantized = false;
+    for( int m = 0; m < lMeshCount; m++ )
+    {
+        for( size_t a = 0; a < lBuffers[m].mFormats.size(); a++ )
+        {
+            lQuantized = lQuantized || (lBuffers[m].mFormats[a].mComponentType != kGltfFloat && pScene.mMeshes[m].mAttributes[a].mName[0] != '_');
+        }
+    }
+
+    // the meshes, their accessors and buffer views: the vertices then the indices of each mesh
+    std::string lMeshes, lAccessors, lViews;
+    std::vector<int> lGltfMeshes(lMeshCount, -1);
+    int lGltfMeshCount = 0, lAccessorCount = 0, lViewCount = 0;
+    size_t lBinaryBytes = 0;
+    GltfStats lStats = { 0, 0, 0 };
+    for( int m = 0; m < lMeshCount; m++ )
+    {
+        const GltfMesh& lMesh = pScene.mMeshes[m];
+        const MeshBuffers& lMeshBuffers = lBuffers[m];
+        if( lMeshBuffers.mPrimitives.empty() ) continue;
+        lGltfMeshes[m] = lGltfMeshCount++;
+        lStats.mVertexCount += lMeshBuffers.mVertexCount;
+
+        AppendFormat(lViews, "%s{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"byteStride\":%d,\"target\":34962}",
+                     lViewCount > 0 ? "," : "", lBinaryBytes, lMeshBuffers.mVertices.size(), lMeshBuffers.mStride);
+        lBinaryBytes += lMeshBuffers.mVertices.size();
+        AppendFormat(lViews, ",{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":34963}",
+                     lBinaryBytes, lMeshBuffers.mIndices.size());
+        lBinaryBytes += lMeshBuffers.mIndices.size();
+        int lVertexView = lViewCount;
+        lViewCount += 2;
+
+        std::string lAttributes;
+        AppendFormat(lAccessors, "%s{\"bufferView\":%d,\"componentType\":%d,\"count\":%d,\"type\":\"VEC3\",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]}",
+                     lAccessorCount > 0 ? "," : "", lVertexView, kGltfFloat, lMeshBuffers.mVertexCount,
+                     lMeshBuffers.mMin[0], lMeshBuffers.mMin[1], lMeshBuffers.mMin[2], lMeshBuffers.mMax[0], lMeshBuffers.mMax[1], lMeshBuffers.mMax[2]);
+        AppendFormat(lAttributes, "\"POSITION\":%d", lAccessorCount++);
+        for( size_t a = 0; a < lMesh.mAttributes.size(); a++ )
+        {
+            const AttributeFormat& lFormat = lMeshBuffers.mFormats[a];
+            AppendFormat(lAccessors, ",{\"bufferView\":%d,\"byteOffset\":%d,\"componentType\":%d,%s\"count\":%d,\"type\":\"%s\"}",
+                         lVertexView, lFormat.mOffset, lFormat.mComponentType, lFormat.mComponentType != kGltfFloat ? "\"normalized\":true," : "",
+                         lMeshBuffers.mVertexCount, GetAccessorType(lMesh.mAttributes[a].mComponents));
+            lAttributes += ',';
+            AppendString(lAttributes, lMesh.mAttributes[a].mName);
+            AppendFormat(lAttributes, ":%d", lAccessorCount++);
+        }
+
+        lMeshes += lGltfMeshes[m] > 0 ? ",{\"name\":" : "{\"name\":";
+        AppendString(lMeshes, lMesh.mName);
+        lMeshes += ",\"primitives\":[";
+        for( size_t p = 0; p < lMeshBuffers.mPrimitives.size(); p++ )
+        {
+            const Primitive& lPrimitive = lMeshBuffers.mPrimitives[p];
+            AppendFormat(lAccessors, ",{\"bufferView\":%d,\"byteOffset\":%zu,\"componentType\":%d,\"count\":%zu,\"type\":\"SCALAR\"}",
+                         lVertexView + 1, lPrimitive.mFirst * lMeshBuffers.mIndexSize,
+                         lMeshBuffers.mIndexSize == 2 ? kGltfUnsignedShort : kGltfUnsignedInt, lPrimitive.mCount);
+            lMeshes += p > 0 ? ",{\"attributes\":{" : "{\"attributes\":{";
+            lMeshes += lAttributes;
+            AppendFormat(lMeshes, "},\"indices\":%d", lAccessorCount++);
+            if( lPrimitive.mMaterial >= 0 ) AppendFormat(lMeshes, ",\"material\":%d", lPrimitive.mMaterial);
+            lMeshes += ",\"mode\":4}";
+            lStats.mTriangleCount += int(lPrimitive.mCount / 3);
+        }
+        lMeshes += "]}";
+    }
+
+    std::string lJson = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"NormalMerger\"}";
+    if( lQuantized ) lJson += ",\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"]";
+    lJson += ",\"scene\":0,\"scenes\":[{\"nodes\":[";
+    for( size_t n = 0; n < pScene.mNodes.size(); n++ ) AppendFormat(lJson, "%s%d", n > 0 ? "," : "", int(n));
+    lJson += "]}],\"nodes\":[";
+    for( size_t n = 0; n < pScene.mNodes.size(); n++ )
+    {
+        const GltfNode& lNode = pScene.mNodes[n];
+        lJson += n > 0 ? ",{\"name\":" : "{\"name\":";
+        AppendString(lJson, lNode.mName);
+        if( lNode.mMesh >= 0 && lGltfMeshes[lNode.mMesh] >= 0 ) AppendFormat(lJson, ",\"mesh\":%d", lGltfMeshes[lNode.mMesh]);
+        if( !IsIdentity(lNode.mMatrix) )
+        {
+            lJson += ",\"matrix\":[";
+            for( int i = 0; i < 16; i++ ) AppendFormat(lJson, "%s%.17g", i > 0 ? "," : "", lNode.mMatrix[i]);
+            lJson += ']';
+        }
+        lJson += '}';
+    }
+    lJson += ']';
+    if( !pScene.mMaterials.empty() )
+    {
+        lJson += ",\"materials\":[";
+        for( size_t i = 0; i < pScene.mMaterials.size(); i++ )
+        {
+            lJson += i > 0 ? ",{\"name\":" : "{\"name\":";
+            AppendString(lJson, pScene.mMaterials[i]);
+            lJson += '}';
+        }
+        lJson += ']';
+    }
+    if( lGltfMeshCount > 0 )
+    {
+        lJson += ",\"meshes\":[" + lMeshes + "],\"accessors\":[" + lAccessors + "],\"bufferViews\":[" + lViews + "]";
+        AppendFormat(lJson, ",\"buffers\":[{\"byteLength\":%zu}]", lBinaryBytes);
+    }
+    lJson += '}';
+    lJson.append((4 - lJson.size() % 4) % 4, ' ');
+
+    // the header, the JSON chunk and the binary chunk
+    size_t lFileBytes = 12 + 8 + lJson.size() + (lBinaryBytes > 0 ? 8 + lBinaryBytes : 0);
+    if( lFileBytes > 0xffffffffu )
+    {
+        pError = "the meshes do not fit the 32 bit length of a GLB file";
+        return false;
+    }
+    uint32_t lHeader[5] = { 0x46546c67u, 2u, uint32_t(lFileBytes), uint32_t(lJson.size()), 0x4e4f534au };
+    uint32_t lBinaryHeader[2] = { uint32_t(lBinaryBytes), 0x004e4942u };
+
+    std::string lPartName = std::string(pFilename) + ".part";
+    FILE* lOutput = fopen(lPartName.c_str(), "wb");
+    if( lOutput == NULL )
+    {
+        pError = "cannot write " + lPartName;
+        return false;
+    }
+    setvbuf(lOutput, NULL, _IOFBF, 1 << 20);
+
+    bool lWritten = fwrite(lHeader, sizeof(lHeader), 1, lOutput) == 1 && fwrite(lJson.data(), 1, lJson.size(), lOutput) == lJson.size();
+    if( lBinaryBytes > 0 ) lWritten = lWritten && fwrite(lBinaryHeader, sizeof(lBinaryHeader), 1, lOutput) == 1;
+    for( int m = 0; m < lMeshCount && lWritten; m++ )
+    {
+        const MeshBuffers& lMeshBuffers = lBuffers[m];
+        if( lMeshBuffers.mPrimitives.empty() ) continue;
+        lWritten = fwrite(&lMeshBuffers.mVertices[0], 1, lMeshBuffers.mVertices.size(), lOutput) == lMeshBuffers.mVertices.size() &&
+                   fwrite(&lMeshBuffers.mIndices[0], 1, lMeshBuffers.mIndices.size(), lOutput) == lMeshBuffers.mIndices.size();
+    }
+
+    lWritten = fclose(lOutput) == 0 && lWritten;
+    if( lWritten )
+    {
+        remove(pFilename);
+        lWritten = rename(lPartName.c_str(), pFilename) == 0;
+    }
+    if( !lWritten )
+    {
+        remove(lPartName.c_str());
+        pError = std::string("cannot write ") + pFilename;
+        return false;
+    }
+
+    lStats.mFileBytes = lFileBytes;
+    if( pStats ) *pStats = lStats;
+    return true;
+}
@@ -0,0 +1,95 @@
+// GltfWriter.h : writes meshes to a binary glTF 2.0 file (GLB).
+//
+// The engine reads glTF, so instead of an FBX export converted again by another
+// tool the merged meshes can be written straight to a GLB. A mesh gets one
+// interleaved vertex buffer, with a glTF vertex per distinct combination of
+// control point and attribute elements of its polygon-vertices, and one index
+// buffer of its polygons fanned into triangles, one primitive per material.
+// The attributes can be stored as normalized 8 or 16 bit integers when their
+// values fit (KHR_mesh_quantization for the standard ones); the positions stay
+// floats. The buffers of the meshes are built in parallel, the file is then
+// written in one pass.
+
+#pragma once
+
+#include "MergeCore.h"
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class WorkStealingPool;
+
+// storage of the attributes which allow it (GltfAttribute::mQuantize)
+enum EGltfQuantization
+{
+    eGltfFloat,         // 32 bit floats
+    eGltfInt16,         // normalized shorts: unsigned if the values are in [0, 1], signed in [-1, 1],
+                        // floats otherwise; NORMAL and TANGENT are always signed, COLOR_n unsigned
+    eGltfInt8           // same with bytes
+};
+
+// a vertex attribute of a mesh
+struct GltfAttribute
+{
+    std::string mName;          // glTF semantic, application specific ones start with '_'
+    ElementView mView;
+    int         mComponents;    // first values of each vector written, 1 to 4
+    double      mScale[4];      // written value = value * scale + offset
+    double      mOffset[4];
+    bool        mQuantize;      // may be written as normalized integers
+};
+
+struct GltfMesh
+{
+    std::string                mName;
+    MeshView                   mView;               // positions and polygons, the normals are an attribute
+    std::vector<GltfAttribute> mAttributes;
+    const int*                 mPolygonMaterials;   // material of every polygon, NULL if they all use the first
+    std::vector<int>           mMaterials;          // scene material of each material of the mesh, empty for none
+};
+
+struct GltfNode
+{
+    std::string mName;
+    int         mMesh;          // -1 for none
+    double      mMatrix[16];    // column major, like glTF
+};
+
+// the nodes are all roots of the scene
+struct GltfScene
+{
+    std::vector<GltfMesh>    mMeshes;
+    std::vector<GltfNode>    mNodes;
+    std::vector<std::string> mMaterials;    // names, the materials have the default values
+};
+
+// what WriteGlb wrote
+struct GltfStats
+{
+    int    mVertexCount;        // glTF vertices of all the meshes
+    int    mTriangleCount;
+    size_t mFileBytes;
+};
+
+// attribute of the first pComponents values of pView, written as they are
+GltfAttribute GetGltfAttribute(
+                               const char* pName,
+                               const ElementView& pView,
+                               int pComponents,
+                               bool pQuantize
+                               );
+
+// writes pScene to pFilename. pPool builds the buffers of the meshes in parallel, NULL
+// builds them on the calling thread.
+// The file is written next to pFilename and renamed once complete. Returns false,
+// with the reason in pError, if an attribute or a polygon does not fit its mesh or
+// the file can't be written. A mesh without triangles is left out, its nodes kept.
+bool WriteGlb(
+              const GltfScene& pScene,
+              EGltfQuantization pQuantization,
+              const char* pFilename,
+              WorkStealingPool* pPool,
+              std::string& pError,
+              GltfStats* pStats = NULL
+              );
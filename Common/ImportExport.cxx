@@ -10,99 +10,489 @@
 ****************************************************************************************/
 
 #include "ImportExport.h"
+#include "Bvh.h"
+#include "ElementCompaction.h"
+#include "MergeCore.h"
+#include "MergeKernel.h"
+#include "MeshCache.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <string.h>
+#include <thread>
 
 // declare global
 FbxManager*   gSdkManager = NULL;
 
+// serializes the creation and destruction of the managers
+static std::mutex gContextMutex;
+
+const char* kSmoothNormalLayerName = "SmoothNormal";
+
+const char* kNormalMergerVersion = "1.0";
+
+// the IO settings always come from the manager passed to the function,
+// so that every worker thread can use its own manager
 #ifdef IOS_REF
 	#undef  IOS_REF
-	#define IOS_REF (*(gSdkManager->GetIOSettings()))
+	#define IOS_REF (*(pSdkManager->GetIOSettings()))
 #endif
 
 
 // a UI file provide a function to print messages
 extern void UI_Printf(const char* msg, ...);
 
+// seconds since the previous Lap() or the construction
+class PhaseTimer
+{
+public:
+    PhaseTimer() : mStart(std::chrono::steady_clock::now()) {}
+
+    double Lap()
+    {
+        std::chrono::steady_clock::time_point lNow = std::chrono::steady_clock::now();
+        double lSeconds = std::chrono::duration<double>(lNow - mStart).count();
+        mStart = lNow;
+        return lSeconds;
+    }
+
+private:
+    std::chrono::steady_clock::time_point mStart;
+};
+
+// the pool of the mesh tasks, NULL when pOptions.mMeshThreads is 1
+static WorkStealingPool* CreateMeshPool(const MergeOptions& pOptions)
+{
+    return pOptions.mMeshThreads != 1 ? new WorkStealingPool(pOptions.mMeshThreads) : NULL;
+}
+
+// writes pScene with SavePatchedScene if the output is the native binary format and the
+// lighting file a binary FBX file, false with the reason printed otherwise
+static bool PatchScene(
+                       const MergeContext& pContext,
+                       const MergeOptions& pOptions,
+                       const std::vector<MergeSource>& pSources,
+                       FbxScene* pScene,
+                       const char* pImportFileName,
+                       const char* pExportFileName,
+                       int pWriteFileFormat
+                       )
+{
+    for (size_t i = 0; i < pSources.size(); i++)
+    {
+        if (pSources[i].mOutput == eOutputTangent) continue;
+        UI_Printf("Patch writer: the uv and color outputs add layers, the scene is exported with the SDK");
+        return false;
+    }
+    if (pWriteFileFormat != pContext.mSdkManager->GetIOPluginRegistry()->GetNativeWriterFormat())
+    {
+        UI_Printf("Patch writer: the output is not binary FBX, the scene is exported with the SDK");
+        return false;
+    }
+
+    std::unique_ptr<WorkStealingPool> lPool(CreateMeshPool(pOptions));
+
+    BinaryFbxFile lFile;
+    if (!lFile.Open(pImportFileName, lPool.get()))
+    {
+        UI_Printf("Patch writer: %s, the scene is exported with the SDK", lFile.GetError());
+        return false;
+    }
+    if (!SavePatchedScene(pScene, lFile, pExportFileName, lPool.get()))
+    {
+        UI_Printf("Patch writer: the scene is exported with the SDK");
+        return false;
+    }
+    return true;
+}
+
+// a smooth input of ImportExport once loaded
+struct LoadedSource
+{
+    FbxScene*         mScene;       // NULL when the source is read natively, mapped or generated
+    BinaryFbxFile     mFile;
+    NormalSidecarFile mSidecarFile;
+    bool              mNative;
+    bool              mSidecar;     // mapped from mSidecarFile
+    bool              mLoaded;
+
+    LoadedSource() : mScene(NULL), mNative(false), mSidecar(false), mLoaded(false) {}
+};
+
+// reads the smooth normals of pFileName without the SDK: maps it if it is a sidecar, reads it
+// natively if asked and possible. Returns false if it has to be imported with ImportSource.
+static bool ReadSource(
+                       const MergeOptions& pOptions,
+                       const char* pFileName,
+                       LoadedSource& pSource
+                       )
+{
+    if (IsNormalSidecar(pFileName))
+    {
+        if (pOptions.mCorrespondence != eCorrespondIndex)
+        {
+            UI_Printf("Sidecar: %s has no positions, it is merged by index only", pFileName);
+            return true;
+        }
+        pSource.mSidecar = pSource.mSidecarFile.Open(pFileName);
+        if (pSource.mSidecar)
+            UI_Printf("Sidecar: %d meshes, %.1f MB mapped", pSource.mSidecarFile.GetMeshCount(), pSource.mSidecarFile.GetFileSize() / 1048576.0);
+        else
+            UI_Printf("Sidecar: %s, %s", pSource.mSidecarFile.GetError(), pFileName);
+        pSource.mLoaded = pSource.mSidecar;
+        return true;
+    }
+
+    if (pOptions.mNativeReader2 && pOptions.mCorrespondence != eCorrespondClosestPoint)
+    {
+        std::unique_ptr<WorkStealingPool> lPool(CreateMeshPool(pOptions));
+        pSource.mNative = pSource.mFile.Open(pFileName, lPool.get());
+        if (pSource.mNative)
+        {
+            UI_Printf("Native reader: %d meshes, FBX %d, %.1f MB mapped, %.1f MB copied", pSource.mFile.GetMeshCount(), pSource.mFile.GetVersion(),
+                      pSource.mFile.GetFileSize() / 1048576.0, pSource.mFile.GetCopiedBytes() / 1048576.0);
+            pSource.mLoaded = true;
+            return true;
+        }
+        UI_Printf("Native reader: %s, %s is imported with the SDK", pSource.mFile.GetError(), pFileName);
+    }
+    return false;
+}
+
+// imports the smooth normals of pFileName with the manager of pContext
+static void ImportSource(
+                         const MergeContext& pContext,
+                         const MergeOptions& pOptions,
+                         const char* pFileName,
+                         LoadedSource& pSource
+                         )
+{
+    pSource.mScene = FbxScene::Create(pContext.mSdkManager, "");
+    pSource.mLoaded = LoadScene(pContext.mSdkManager, pSource.mScene, pFileName, pOptions.mImportProfile2);
+}
+
+// destroys the scene of a source
+static void DestroySource(LoadedSource& pSource)
+{
+    pSource.mSidecarFile.Close();
+    if (pSource.mScene) pSource.mScene->Destroy();
+    pSource.mScene = NULL;
+}
+
 // to read and write a file using the FBXSDK readers/writers
 //
 // const char *ImportFileName : the full path of the file to be read
+// const char* ImportFileName2: the full path of the file providing the smooth normals,
+//                              NULL or empty to compute them from the first file
 // const char* ExportFileName : the full path of the file to be written
 // int pWriteFileFormat       : the specific file format number
 //                                  for the writer
-
-void ImportExport(
+// MergeTimings* pTimings     : if not NULL, receives the time of each phase
+//
+// returns false if one of the imports or the export failed
+bool ImportExport(
+                  const MergeContext& pContext,
+                  const MergeOptions& pOptions,
                   const char *ImportFileName,
 	              const char* ImportFileName2,
                   const char* ExportFileName,
-                  int pWriteFileFormat
+                  int pWriteFileFormat,
+                  MergeTimings* pTimings
+                  )
+{
+    std::vector<MergeSource> lSources(1);
+    lSources[0].mFileName = ImportFileName2 ? ImportFileName2 : "";
+    lSources[0].mOutput   = pOptions.mOutput;
+    lSources[0].mPackBits = pOptions.mPackBits;
+
+    return ImportExport(pContext, pOptions, ImportFileName, lSources, ExportFileName, pWriteFileFormat, pTimings);
+}
+
+bool ImportExport(
+                  const MergeContext& pContext,
+                  const MergeOptions& pOptions,
+                  const char *ImportFileName,
+                  const std::vector<MergeSource>& pSources,
+                  const char* ExportFileName,
+                  int pWriteFileFormat,
+                  MergeTimings* pTimings
                   )
 {
+    LoadedMerge lMerge;
+    bool r = ImportMergeScenes(pContext, pOptions, ImportFileName, pSources, pWriteFileFormat, lMerge);
+    if (r)
+    {
+        MergeLoadedScenes(pOptions, pSources, lMerge);
+        r = ExportMergedScene(pContext, pOptions, pSources, ImportFileName, ExportFileName, pWriteFileFormat, lMerge);
+    }
+
+	if (pTimings) *pTimings = lMerge.mTimings;
+	return r;
+}
+
+LoadedMerge::LoadedMerge() : mScene(NULL)
+{
+}
+
+LoadedMerge::~LoadedMerge()
+{
+    for (size_t i = 0; i < mSources.size(); i++) DestroySource(*mSources[i]);
+    if (mScene) mScene->Destroy();
+}
+
+bool IsImportProfileWritable(
+                             const MergeOptions& pOptions,
+                             const std::vector<MergeSource>& pSources,
+                             bool pBinary,
+                             std::string& pError
+                             )
+{
+    if (pOptions.mImportProfile == eImportFull) return true;
+
+    std::string lProfile = GetImportProfileName(pOptions.mImportProfile);
+    if (pOptions.mWriter != eWriterPatch)
+    {
+        pError = "the " + lProfile + " import of the lighting scene needs the patch writer";
+        return false;
+    }
+    for (size_t i = 0; i < pSources.size(); i++)
+    {
+        if (pSources[i].mOutput == eOutputTangent) continue;
+        pError = "the " + lProfile + " import of the lighting scene can't be patched with uv or color outputs";
+        return false;
+    }
+    if (!pBinary)
+    {
+        pError = "the " + lProfile + " import of the lighting scene can only be patched into binary FBX";
+        return false;
+    }
+    return true;
+}
+
+bool ImportMergeScenes(
+                       const MergeContext& pContext,
+                       const MergeOptions& pOptions,
+                       const char* pImportFileName,
+                       const std::vector<MergeSource>& pSources,
+                       int pWriteFileFormat,
+                       LoadedMerge& pMerge
+                       )
+{
+    PhaseTimer lTimer;
+
+    std::string lError;
+    bool lBinary = pWriteFileFormat == pContext.mSdkManager->GetIOPluginRegistry()->GetNativeWriterFormat();
+    if (!AreMergeSourcesValid(pSources, lError) || !IsImportProfileWritable(pOptions, pSources, lBinary, lError))
+    {
+        UI_Printf("------- ERROR! %s -------", lError.c_str());
+        return false;
+    }
+
 	// Create a scene
-	FbxScene* lScene = FbxScene::Create(gSdkManager,"");
-    FbxScene* lScene2 = FbxScene::Create(gSdkManager, "");
+	pMerge.mScene = FbxScene::Create(pContext.mSdkManager,"");
 
     UI_Printf("------- Import started ---------------------------");
 
+    // the sources after the first one are mapped or read natively on their own threads while
+    // the scene loads, their messages tagged with the job of this thread
+    std::vector<std::unique_ptr<LoadedSource> >& lSources = pMerge.mSources;
+    std::vector<char> lRead(pSources.size(), 1);
+    int lJobTag = gJobTag;
+    std::vector<std::thread> lThreads;
+    for (size_t i = 0; i < pSources.size(); i++)
+    {
+        lSources.push_back(std::unique_ptr<LoadedSource>(new LoadedSource));
+        if (i == 0 || pSources[i].mFileName.empty()) continue;
+
+        LoadedSource* lSource = lSources.back().get();
+        const char* lFileName = pSources[i].mFileName.c_str();
+        char* lSourceRead = &lRead[i];
+        lThreads.push_back(std::thread([lSource, lFileName, lSourceRead, lJobTag, &pOptions]()
+        {
+            gJobTag = lJobTag;
+            *lSourceRead = ReadSource(pOptions, lFileName, *lSource);
+        }));
+    }
+
     // Load the scene.
-    bool r = LoadScene(gSdkManager, lScene, ImportFileName);
+    bool r = LoadScene(pContext.mSdkManager, pMerge.mScene, pImportFileName, pOptions.mImportProfile);
+    pMerge.mTimings.mImport = lTimer.Lap();
+
+	// Read the first source natively, then import the sources the native reader can't one after
+	// the other with the manager of the scene, already warm, rather than a new one per source
+    if (r && !pSources[0].mFileName.empty()) lRead[0] = ReadSource(pOptions, pSources[0].mFileName.c_str(), *lSources[0]);
+    for (size_t i = 0; i < lThreads.size(); i++) lThreads[i].join();
+    for (size_t i = 0; r && i < pSources.size(); i++)
+    {
+        if (!lRead[i]) ImportSource(pContext, pOptions, pSources[i].mFileName.c_str(), *lSources[i]);
+    }
+    pMerge.mTimings.mImport2 = lTimer.Lap();
+
+    for (size_t i = 0; i < pSources.size(); i++)
+    {
+        bool lGenerate = pSources[i].mFileName.empty();
+        if (!r || lGenerate || lSources[i]->mLoaded) continue;
+
+        UI_Printf("------- ERROR! %s can't be imported -------", pSources[i].mFileName.c_str());
+        r = false;
+    }
     if(r)
         UI_Printf("------- Import succeeded -------------------------");
     else
     {
         UI_Printf("------- Import failed ----------------------------");
 
-        // Destroy the scene
-		lScene->Destroy();
-        return;
+        // Destroy the scenes
+        for (size_t i = 0; i < lSources.size(); i++) DestroySource(*lSources[i]);
+        lSources.clear();
+		pMerge.mScene->Destroy();
+        pMerge.mScene = NULL;
+        return false;
     }
 
-	// Load the scene.
-    r = LoadScene(gSdkManager, lScene2, ImportFileName2);
-	if (r)
-		UI_Printf("------- Import succeeded -------------------------");
-	else
-	{
-		UI_Printf("------- Import failed ----------------------------");
+    UI_Printf("\r\n"); // add a blank line
+    return true;
+}
 
-		// Destroy the scene
-		lScene2->Destroy();
-		return;
-	}
+void MergeLoadedScenes(
+                       const MergeOptions& pOptions,
+                       const std::vector<MergeSource>& pSources,
+                       LoadedMerge& pMerge
+                       )
+{
+    PhaseTimer lTimer;
 
-    UI_Printf("\r\n"); // add a blank line
+    // merge normal form outline mesh to lighting mesh, or generate them, one channel after the other
+    std::vector<std::unique_ptr<LoadedSource> >& lSources = pMerge.mSources;
+    std::set<FbxMesh*> lWritten;
+    for (size_t i = 0; i < pSources.size(); i++)
+    {
+        MergeOptions lOptions = pOptions;
+        lOptions.mOutput   = pSources[i].mOutput;
+        lOptions.mPackBits = pSources[i].mPackBits;
+
+        if (pSources[i].mFileName.empty()) ProcessSceneGenerated(pMerge.mScene, lOptions, &lWritten);
+        else if (lSources[i]->mNative)     ProcessSceneNative(pMerge.mScene, lSources[i]->mFile, lOptions, &lWritten);
+        else if (lSources[i]->mSidecar)    ProcessSceneSidecar(pMerge.mScene, lSources[i]->mSidecarFile, lOptions, &lWritten);
+        else                               ProcessScene(pMerge.mScene, lSources[i]->mScene, lOptions, &lWritten);
+    }
+    if (pOptions.mCompactTolerance >= 0.0 && !lWritten.empty())
+    {
+        std::unique_ptr<WorkStealingPool> lPool(CreateMeshPool(pOptions));
+        CompactTangentElements(pMerge.mScene, lWritten, pOptions.mCompactTolerance, lPool.get());
+    }
+
+    // the sources are not needed by the export
+    for (size_t i = 0; i < lSources.size(); i++) DestroySource(*lSources[i]);
+    lSources.clear();
+    pMerge.mTimings.mMerge = lTimer.Lap();
+}
 
-    // merge normal form outline mesh to lighting mesh
-    ProcessNode(lScene->GetRootNode(), lScene2->GetRootNode());
+bool ExportMergedScene(
+                       const MergeContext& pContext,
+                       const MergeOptions& pOptions,
+                       const std::vector<MergeSource>& pSources,
+                       const char* pImportFileName,
+                       const char* pExportFileName,
+                       int pWriteFileFormat,
+                       LoadedMerge& pMerge
+                       )
+{
+    PhaseTimer lTimer;
+    FbxScene* lScene = pMerge.mScene;
 
     UI_Printf("------- Export started ---------------------------");
 
-    // Save the scene.
-    r = SaveScene(gSdkManager, 
-        lScene,               // to export this scene...
-        ExportFileName,       // to this path/filename...
-        pWriteFileFormat,     // using this file format.
-        false);               // Don't embed media files, if any.
+    // Write the meshes to a GLB file, patch a copy of the lighting file, or save the scene;
+    // the SDK writes the scenes the patch writer can't
+    bool r;
+    if (pOptions.mWriter == eWriterGltf)
+    {
+        std::unique_ptr<WorkStealingPool> lPool(CreateMeshPool(pOptions));
+        r = SaveGltfScene(lScene, pOptions, pSources, pExportFileName, lPool.get());
+    }
+    else if (pOptions.mWriter == eWriterPatch && PatchScene(pContext, pOptions, pSources, lScene, pImportFileName, pExportFileName, pWriteFileFormat))
+        r = true;
+    else if (pOptions.mImportProfile != eImportFull)
+    {
+        UI_Printf("Patch writer: the %s import of the lighting scene can't be exported with the SDK", GetImportProfileName(pOptions.mImportProfile));
+        r = false;
+    }
+    else
+        r = SaveScene(pContext.mSdkManager, 
+            lScene,               // to export this scene...
+            pExportFileName,      // to this path/filename...
+            pWriteFileFormat,     // using this file format.
+            false);               // Don't embed media files, if any.
+    pMerge.mTimings.mExport = lTimer.Lap();
 
     if(r) UI_Printf("------- Export succeeded -------------------------");
     else  UI_Printf("------- Export failed ----------------------------");
 
-	// destroy the scene
+	// destroy the scene, the manager is kept alive for the next call
 	lScene->Destroy();
+    pMerge.mScene = NULL;
+	return r;
+}
+
+// same as above, using the global SDK manager of the UI
+bool ImportExport(
+                  const char *ImportFileName,
+	              const char* ImportFileName2,
+                  const char* ExportFileName,
+                  int pWriteFileFormat
+                  )
+{
+    MergeContext lContext;
+    lContext.mSdkManager = gSdkManager;
+    lContext.mIOSettings = gSdkManager->GetIOSettings();
+
+    return ImportExport(lContext, MergeOptions(), ImportFileName, ImportFileName2, ExportFileName, pWriteFileFormat);
 }
 
 // Creates an instance of the SDK manager.
 void InitializeSdkManager()
 {
+    MergeContext lContext;
+    InitializeMergeContext(lContext);
+
+    gSdkManager = lContext.mSdkManager;
+}
+
+// Creates a SDK manager and its IOSettings for one worker.
+void InitializeMergeContext(
+                            MergeContext& pContext
+                            )
+{
+    std::lock_guard<std::mutex> lLock(gContextMutex);
+
     // Create the FBX SDK memory manager object.
     // The SDK Manager allocates and frees memory
     // for almost all the classes in the SDK.
-    gSdkManager = FbxManager::Create();
+    pContext.mSdkManager = FbxManager::Create();
 
 	// create an IOSettings object
-	FbxIOSettings * ios = FbxIOSettings::Create(gSdkManager, IOSROOT );
-	gSdkManager->SetIOSettings(ios);
+	pContext.mIOSettings = FbxIOSettings::Create(pContext.mSdkManager, IOSROOT );
+	pContext.mSdkManager->SetIOSettings(pContext.mIOSettings);
+}
+
+// Destroys the SDK manager of a worker and all the objects it still owns.
+void DestroyMergeContext(
+                         MergeContext& pContext
+                         )
+{
+    std::lock_guard<std::mutex> lLock(gContextMutex);
+    DestroySdkObjects(pContext.mSdkManager, false);
 
+    pContext.mSdkManager = NULL;
+    pContext.mIOSettings = NULL;
 }
 
 // Destroys an instance of the SDK manager
@@ -120,12 +510,143 @@ void DestroySdkObjects(
 	if( pExitStatus ) FBXSDK_printf("Program Success!\n");
 }
 
+const char* GetImportProfileName(EImportProfile pProfile)
+{
+    switch (pProfile)
+    {
+    case eImportStatic:   return "static";
+    case eImportGeometry: return "geometry";
+    default:              return "full";
+    }
+}
+
+const char* GetOutputWriterName(EOutputWriter pWriter)
+{
+    switch (pWriter)
+    {
+    case eWriterPatch: return "patch";
+    case eWriterGltf:  return "glb";
+    default:           return "sdk";
+    }
+}
+
+bool AreMergeSourcesValid(
+                          const std::vector<MergeSource>& pSources,
+                          std::string& pError
+                          )
+{
+    if (pSources.empty())
+    {
+        pError = "no smooth normal source";
+        return false;
+    }
+
+    int lChannels = 0, lTangentWriters = 0;
+    for (size_t i = 0; i < pSources.size(); i++)
+    {
+        const MergeSource& lSource = pSources[i];
+        int lChannel = 1 << lSource.mOutput;
+        if (lChannels & lChannel)
+        {
+            pError = "two sources are merged in the " + GetMergeChannelName(lSource) + " channel";
+            return false;
+        }
+        lChannels |= lChannel;
+
+        if (lSource.mPackBits != 0 && (lSource.mOutput == eOutputTangent || (lSource.mPackBits != 8 && lSource.mPackBits != 16)))
+        {
+            pError = "the smooth normals are packed in 8 or 16 bits, in the uv or color channel only";
+            return false;
+        }
+        lTangentWriters += lSource.mPackBits == 0;
+    }
+    if (lTangentWriters > 1)
+    {
+        pError = "the tangent channel and the tangent basis of the unpacked uv and color channels share the tangent layer";
+        return false;
+    }
+    return true;
+}
+
+bool ParseMergeChannels(
+                        const char* pText,
+                        std::vector<MergeSource>& pSources
+                        )
+{
+    pSources.clear();
+    std::string lText = pText;
+    size_t lStart = 0;
+    for (;;)
+    {
+        size_t lEnd = lText.find(',', lStart);
+        std::string lName = lText.substr(lStart, lEnd == std::string::npos ? std::string::npos : lEnd - lStart);
+
+        MergeSource lSource;
+        size_t lColon = lName.find(':');
+        std::string lChannel = lName.substr(0, lColon);
+        if (lChannel == "tangent")    lSource.mOutput = eOutputTangent;
+        else if (lChannel == "uv")    lSource.mOutput = eOutputUV;
+        else if (lChannel == "color") lSource.mOutput = eOutputColor;
+        else return false;
+
+        if (lColon != std::string::npos)
+        {
+            std::string lPacking = lName.substr(lColon + 1);
+            if (lPacking == "oct8")       lSource.mPackBits = 8;
+            else if (lPacking == "oct16") lSource.mPackBits = 16;
+            else return false;
+        }
+        pSources.push_back(lSource);
+
+        if (lEnd == std::string::npos) return true;
+        lStart = lEnd + 1;
+    }
+}
+
+std::string GetMergeChannelName(const MergeSource& pSource)
+{
+    std::string lName = pSource.mOutput == eOutputUV ? "uv" : pSource.mOutput == eOutputColor ? "color" : "tangent";
+    if (pSource.mPackBits > 0) lName += pSource.mPackBits == 8 ? ":oct8" : ":oct16";
+    return lName;
+}
+
+std::string GetMergeSettingsText(
+                                 const MergeOptions& pOptions,
+                                 const std::vector<MergeSource>& pSources,
+                                 int pWriteFileFormat
+                                 )
+{
+    // the channels of the single source come from the options
+    std::vector<MergeSource> lSources = pSources;
+    if (lSources.empty())
+    {
+        lSources.resize(1);
+        lSources[0].mOutput   = pOptions.mOutput;
+        lSources[0].mPackBits = pOptions.mPackBits;
+    }
+    std::string lChannels;
+    for (size_t i = 0; i < lSources.size(); i++) lChannels += (i > 0 ? "," : "") + GetMergeChannelName(lSources[i]);
+
+    // the mesh threads give the same result as the serial path
+    char lText[1024];
+    snprintf(lText, sizeof(lText),
+        "NormalMerger %s; FBX SDK %s; kernel %s; format %d; match %d; weld %.17g; smooth %d; channels %s; "
+        "import %s, %s; reader2 %s; writer %s; quantize %d; compact %.17g",
+        kNormalMergerVersion, FBXSDK_VERSION_STRING, GetKernelIsaName(GetKernelIsa()), pWriteFileFormat,
+        int(pOptions.mCorrespondence), pOptions.mWeldTolerance, int(pOptions.mSmoothWeighting), lChannels.c_str(),
+        GetImportProfileName(pOptions.mImportProfile), GetImportProfileName(pOptions.mImportProfile2),
+        pOptions.mNativeReader2 ? "native" : "sdk", GetOutputWriterName(pOptions.mWriter), int(pOptions.mQuantization),
+        pOptions.mCompactTolerance);
+    return lText;
+}
+
 // Creates an importer object, and uses it to
 // import a file into a scene.
 bool LoadScene(
                FbxManager* pSdkManager,  // Use this memory manager...
                FbxScene* pScene,            // to import into this scene
-               const char* pFilename         // the data from this file.
+               const char* pFilename,        // the data from this file,
+               EImportProfile pProfile       // with this profile.
                )
 {
     int lFileMajor, lFileMinor, lFileRevision;
@@ -204,26 +725,39 @@ bool LoadScene(
         }
 
         // Import options determine what kind of data is to be imported.
-        // The default is true, but here we set the options explictly.
-
-        IOS_REF.SetBoolProp(IMP_FBX_MATERIAL,        true);
-        IOS_REF.SetBoolProp(IMP_FBX_TEXTURE,         true);
-        IOS_REF.SetBoolProp(IMP_FBX_LINK,            true);
-        IOS_REF.SetBoolProp(IMP_FBX_SHAPE,           true);
-        IOS_REF.SetBoolProp(IMP_FBX_GOBO,            true);
-        IOS_REF.SetBoolProp(IMP_FBX_ANIMATION,       true);
+        // The default is true, but here we set the options explictly:
+        // the settings are shared by the imports of the manager.
+        // EvaluateGlobalTransform() reads the static transforms, the
+        // merge never needs the animation.
+        bool lStatic   = pProfile != eImportFull;
+        bool lGeometry = pProfile == eImportGeometry;
+
+        IOS_REF.SetBoolProp(IMP_FBX_MATERIAL,        !lGeometry);
+        IOS_REF.SetBoolProp(IMP_FBX_TEXTURE,         !lGeometry);
+        IOS_REF.SetBoolProp(IMP_FBX_LINK,            !lGeometry);
+        IOS_REF.SetBoolProp(IMP_FBX_SHAPE,           !lGeometry);
+        IOS_REF.SetBoolProp(IMP_FBX_GOBO,            !lStatic);
+        IOS_REF.SetBoolProp(IMP_FBX_ANIMATION,       !lStatic);
+        IOS_REF.SetBoolProp(IMP_FBX_CHARACTER,       !lStatic);
+        IOS_REF.SetBoolProp(IMP_FBX_CONSTRAINT,      !lStatic);
+        IOS_REF.SetBoolProp(IMP_FBX_AUDIO,           !lStatic);
         IOS_REF.SetBoolProp(IMP_FBX_GLOBAL_SETTINGS, true);
 
-
+        // the animation stacks are not even read
+        for(i = 0; i < lAnimStackCount && lStatic; i++)
+        {
+            lImporter->GetTakeInfo(i)->mSelect = false;
+        }
     }
 
 	// new 
+    bool lAllLayers = pProfile != eImportGeometry;
     IOS_REF.SetBoolProp(IMP_FBX_NORMAL, true);
-	IOS_REF.SetBoolProp(IMP_FBX_BINORMAL, true);
-	IOS_REF.SetBoolProp(IMP_FBX_TANGENT, true);
-	IOS_REF.SetBoolProp(IMP_FBX_VERTEXCOLOR, true);
-	IOS_REF.SetBoolProp(IMP_FBX_SMOOTHING, true);
-	IOS_REF.SetBoolProp(IMP_SMOOTHING_GROUPS, true);
+	IOS_REF.SetBoolProp(IMP_FBX_BINORMAL, lAllLayers);
+	IOS_REF.SetBoolProp(IMP_FBX_TANGENT, lAllLayers);
+	IOS_REF.SetBoolProp(IMP_FBX_VERTEXCOLOR, lAllLayers);
+	IOS_REF.SetBoolProp(IMP_FBX_SMOOTHING, lAllLayers);
+	IOS_REF.SetBoolProp(IMP_SMOOTHING_GROUPS, lAllLayers);
 
     // Import the scene.
     lStatus = lImporter->Import(pScene);
@@ -345,163 +879,1527 @@ bool SaveScene(
     return lStatus;
 }
 
-void ProcessNode(FbxNode* pNode,FbxNode* pNode2)
+// prints the largest angle of the octahedral packing of a mesh
+static void ReportPacking(const MeshTransfer& pTransfer, double pMaxAngle)
 {
-    if (pNode->GetNodeAttribute() && pNode2->GetNodeAttribute())
+    if (pTransfer.IsPacked() && pTransfer.GetCount() > 0)
+        UI_Printf("Mesh %s: %d packed normals, max angular error %.4f degrees", pTransfer.GetName(), pTransfer.GetCount(), pMaxAngle);
+}
+
+// calls pTask(i) for every i in [0, pCount), on pPool or on the calling thread if pPool is NULL
+static void RunTasks(WorkStealingPool* pPool, int pCount, const std::function<void(int)>& pTask)
+{
+    if (pPool) pPool->Run(pCount, pTask);
+    else       for (int i = 0; i < pCount; i++) pTask(i);
+}
+
+// runs the transfers on pPool, or on the calling thread if pPool is NULL, and returns the
+// max angle of each one
+static void RunTransfers(WorkStealingPool* pPool, const std::vector<MeshTransfer*>& pTransfers, std::vector<double>& pMaxAngles)
+{
+    pMaxAngles.assign(pTransfers.size(), 0.0);
+    if (pPool == NULL)
     {
-		if (pNode->GetNodeAttribute()->GetAttributeType() != pNode2->GetNodeAttribute()->GetAttributeType())
-		{
-            UI_Printf("------- ERROR! Input Mesh don't match! ---------------------------");
-            return;
-		}
-		else
-		{
-            switch (pNode->GetNodeAttribute()->GetAttributeType())
-            {
-            case FbxNodeAttribute::EType::eMesh:
-                ProcessMesh(pNode, pNode2);
-                break;
-            default:
-                break;
-            }
-		}
+        for (size_t i = 0; i < pTransfers.size(); i++)
+        {
+            pTransfers[i]->Prepare(NULL);
+            pMaxAngles[i] = pTransfers[i]->Run(0, pTransfers[i]->GetCount());
+        }
+        return;
     }
-    
-    int ChildCount = pNode->GetChildCount();
-    int ChildCount2 = pNode2->GetChildCount();
-    if (ChildCount != ChildCount2)
+
+    // big meshes are cut in ranges so that one mesh does not keep a single thread busy
+    const int kRangeSize = 64 * 1024;
+
+    // the tangent bases: a big mesh splits its faces over the pool, the small ones run one per task
+    std::vector<MeshTransfer*> lSmall;
+    for (size_t i = 0; i < pTransfers.size(); i++)
     {
-		UI_Printf("------- ERROR! Input Mesh don't match! ---------------------------");
-		return;
+        if (pTransfers[i]->GetPolygonCount() >= kRangeSize) pTransfers[i]->Prepare(pPool);
+        else                                                lSmall.push_back(pTransfers[i]);
     }
-    else
+    pPool->Run(int(lSmall.size()), [&](int pTask) { lSmall[pTask]->Prepare(NULL); });
+    std::vector<std::pair<int, int> > lRanges;
+    for (size_t i = 0; i < pTransfers.size(); i++)
     {
-        for (int i = 0; i < ChildCount; ++i)
+        for (int lBegin = 0; lBegin < pTransfers[i]->GetCount(); lBegin += kRangeSize)
         {
-            ProcessNode(pNode->GetChild(i), pNode2->GetChild(i));
+            lRanges.push_back(std::make_pair(int(i), lBegin));
         }
     }
+
+    // every range keeps its own max angle, merged per mesh afterwards
+    std::vector<double> lAngles(lRanges.size(), 0.0);
+    pPool->Run(int(lRanges.size()), [&](int pTask)
+    {
+        const MeshTransfer& lTransfer = *pTransfers[lRanges[pTask].first];
+        int lBegin = lRanges[pTask].second;
+        lAngles[pTask] = lTransfer.Run(lBegin, std::min(lBegin + kRangeSize, lTransfer.GetCount()));
+    });
+
+    for (size_t i = 0; i < lRanges.size(); i++)
+        pMaxAngles[lRanges[i].first] = std::max(pMaxAngles[lRanges[i].first], lAngles[i]);
 }
 
-void ProcessMesh(FbxNode* pNode, FbxNode* pNode2)
+// same, the meshes found in the mesh cache pMeshCache (empty for none) reading their
+// outputs back instead of running, the other ones being stored once they ran. The meshes
+// whose tangents and binormals were written are added to pWritten, if not NULL.
+static void RunTransfers(
+                         WorkStealingPool* pPool,
+                         const std::vector<std::unique_ptr<MeshTransfer> >& pTransfers,
+                         const std::string& pMeshCache,
+                         std::set<FbxMesh*>* pWritten
+                         )
 {
-    // get mesh
-    FbxMesh* pMesh = pNode->GetMesh();
-    FbxMesh* pMesh2 = pNode2->GetMesh();
+    int lCount = int(pTransfers.size());
+    std::vector<std::string> lKeys(lCount);
+    std::vector<double> lMaxAngles(lCount, 0.0);
+    std::vector<char> lReused(lCount, 0);
 
-    if (pMesh == nullptr || pMesh2 == nullptr)
+    // one mesh per task: its fingerprint, then its entry
+    if (!pMeshCache.empty())
     {
-        UI_Printf("------- ERROR! Input Mesh don't match! ---------------------------");
-        return;
+        RunTasks(pPool, lCount, [&](int pTask)
+        {
+            const MeshTransfer& lTransfer = *pTransfers[pTask];
+            std::vector<ElementOutput> lOutputs;
+            lTransfer.GetOutputs(lOutputs);
+            if (lOutputs.empty()) return;
+
+            lKeys[pTask] = lTransfer.GetFingerprint();
+            lReused[pTask] = LoadMeshOutputs(pMeshCache.c_str(), lKeys[pTask], lOutputs, lMaxAngles[pTask]);
+        });
     }
 
-	FbxGeometryElementNormal* lNormalElementSrc = pMesh2->GetElementNormal(0);
-	FbxGeometryElementNormal* lNormalElementDst = pMesh->GetElementNormal(0);
-    FbxGeometryElementTangent* lTangentElement = pMesh->GetElementTangent(0);
-    FbxGeometryElementBinormal* lBinormalElement = pMesh->GetElementBinormal(0);
-
-    if (lTangentElement == nullptr)
+    std::vector<MeshTransfer*> lRun;
+    std::vector<int> lRunIndex;
+    for (int i = 0; i < lCount; i++)
     {
-        lTangentElement = pMesh->CreateElementTangent();
+        if (lReused[i]) continue;
+        lRun.push_back(pTransfers[i].get());
+        lRunIndex.push_back(i);
     }
-    if (lBinormalElement == nullptr)
+    std::vector<double> lRunAngles;
+    RunTransfers(pPool, lRun, lRunAngles);
+    for (size_t i = 0; i < lRun.size(); i++) lMaxAngles[lRunIndex[i]] = lRunAngles[i];
+
+    for (int i = 0; i < lCount; i++)
     {
-        lBinormalElement = pMesh->CreateElementBinormal();
+        ReportPacking(*pTransfers[i], lMaxAngles[i]);
+        if (pWritten && pTransfers[i]->WritesTangents()) pWritten->insert(pTransfers[i]->GetFbxMesh());
     }
+    if (pMeshCache.empty()) return;
 
-    //lTangentElement->Clear();
-    //lBinormalElement->Clear();
-	int Size = lNormalElementSrc->GetDirectArray().GetCount();
-	lTangentElement->GetDirectArray().SetCount(Size);
-    lBinormalElement->GetDirectArray().SetCount(Size);
-	
-    lTangentElement->SetMappingMode(lNormalElementDst->GetMappingMode());
-	lBinormalElement->SetMappingMode(lNormalElementDst->GetMappingMode());
-    lTangentElement->SetReferenceMode(lNormalElementDst->GetReferenceMode());
-	lBinormalElement->SetReferenceMode(lNormalElementDst->GetReferenceMode());
-
-	if (lNormalElementSrc && lTangentElement && lBinormalElement)
-	{
-		if (lNormalElementSrc->GetMappingMode() == FbxGeometryElement::eByControlPoint)
-		{
-			//Let's get normals of each vertex, since the mapping mode of normal element is by control point
-			for (int lVertexIndex = 0; lVertexIndex < pMesh->GetControlPointsCount(); lVertexIndex++)
-			{
-				int lNormalIndex = 0;
-				//reference mode is direct, the normal index is same as vertex index.
-				//get normals by the index of control vertex
-				if (lNormalElementSrc->GetReferenceMode() == FbxGeometryElement::eDirect)
-					lNormalIndex = lVertexIndex;
-
-				//reference mode is index-to-direct, get normals by the index-to-direct
-				if (lNormalElementSrc->GetReferenceMode() == FbxGeometryElement::eIndexToDirect)
-					lNormalIndex = lNormalElementSrc->GetIndexArray().GetAt(lVertexIndex);
-
-				//Got normals of each vertex.
-				FbxVector4 lNormal = lNormalElementDst->GetDirectArray().GetAt(lNormalIndex);
-				//Got normals of each polygon-vertex.
-				FbxVector4 lTangent = lNormalElementSrc->GetDirectArray().GetAt(lNormalIndex);
-				lTangent.Normalize();
-				FbxVector4 lBitangent = lNormal.CrossProduct(lTangent);
-                
-                int lTangentIndex = 0;
-                if (lTangentElement->GetReferenceMode() == FbxLayerElement::eDirect)
-                    lTangentIndex = lVertexIndex;
-                if (lTangentElement->GetReferenceMode() == FbxGeometryElement::eIndexToDirect)
-                    lTangentIndex = lTangentElement->GetIndexArray().GetAt(lVertexIndex);
-
-				lTangentElement->GetDirectArray().SetAt(lTangentIndex, lTangent);
-				lBinormalElement->GetDirectArray().SetAt(lTangentIndex, lBitangent);
-
-			}//end for lVertexIndex
-		}//end eByControlPoint
-
-		else if (lNormalElementSrc->GetMappingMode() == FbxGeometryElement::eByPolygonVertex)
-		{
-			int lIndexByPolygonVertex = 0;
-			//Let's get normals of each polygon, since the mapping mode of normal element is by polygon-vertex.
-			for (int lPolygonIndex = 0; lPolygonIndex < pMesh->GetPolygonCount(); lPolygonIndex++)
-			{
-				//get polygon size, you know how many vertices in current polygon.
-				int lPolygonSize = pMesh->GetPolygonSize(lPolygonIndex);
-
-				//retrieve each vertex of current polygon.
-				for (int i = 0; i < lPolygonSize; i++)
-				{
-					int lNormalIndex = 0;
-					//reference mode is direct, the normal index is same as lIndexByPolygonVertex.
-					if (lNormalElementSrc->GetReferenceMode() == FbxGeometryElement::eDirect)
-						lNormalIndex = lIndexByPolygonVertex;
+    // the meshes which ran are stored one per task; a Run nested in a task runs inline, so
+    // each mesh compacts its arrays on its own thread
+    std::vector<char> lStored(lRun.size(), 0);
+    RunTasks(pPool, int(lRun.size()), [&](int pTask)
+    {
+        int lIndex = lRunIndex[pTask];
+        std::vector<ElementOutput> lOutputs;
+        lRun[pTask]->GetOutputs(lOutputs);
+        if (lOutputs.empty() || lKeys[lIndex].empty()) return;
+        lStored[pTask] = StoreMeshOutputs(pMeshCache.c_str(), lKeys[lIndex], lOutputs, lMaxAngles[lIndex], pPool) > 0;
+    });
+
+    int lReusedCount = 0, lStoredCount = 0;
+    for (int i = 0; i < lCount; i++) lReusedCount += lReused[i];
+    for (size_t i = 0; i < lStored.size(); i++) lStoredCount += lStored[i];
+    UI_Printf("Mesh cache: %d of %d meshes reused, %d stored", lReusedCount, lCount, lStoredCount);
+}
 
-					//reference mode is index-to-direct, get normals by the index-to-direct
-					if (lNormalElementSrc->GetReferenceMode() == FbxGeometryElement::eIndexToDirect)
-						lNormalIndex = lNormalElementSrc->GetIndexArray().GetAt(lIndexByPolygonVertex);
+// the indices of the nodes of pNodes merged by the ProcessScene functions: a mesh
+// instanced by several nodes is merged once, with its last node like ProcessNode
+static std::vector<int> FindMergedNodes(const std::vector<FbxNode*>& pNodes)
+{
+    std::vector<int> lIndices;
+    std::set<FbxMesh*> lSeen;
+    for (int i = int(pNodes.size()) - 1; i >= 0; i--)
+    {
+        FbxMesh* lMesh = pNodes[i]->GetMesh();
+        if (lMesh && lSeen.insert(lMesh).second) lIndices.push_back(i);
+    }
+    std::reverse(lIndices.begin(), lIndices.end());
+    return lIndices;
+}
 
-                    FbxVector4 lNormal = lNormalElementDst->GetDirectArray().GetAt(lNormalIndex);
+// creates the transfer of every mesh of pTasks with pCreateTransfer(task), biggest meshes
+// first so that they do not finish last, then runs them. The arrays are locked and released
+// serially, a source mesh can be shared by several tasks.
+static void RunMeshTransfers(
+                             WorkStealingPool* pPool,
+                             const std::vector<FbxNode*>& pTasks,
+                             const std::function<MeshTransfer*(int)>& pCreateTransfer,
+                             const MergeOptions& pOptions,
+                             std::set<FbxMesh*>* pWritten
+                             )
+{
+    std::vector<int> lOrder(pTasks.size());
+    for (size_t i = 0; i < lOrder.size(); i++) lOrder[i] = int(i);
+    std::stable_sort(lOrder.begin(), lOrder.end(), [&](int pA, int pB)
+    {
+        return pTasks[pA]->GetMesh()->GetPolygonVertexCount() > pTasks[pB]->GetMesh()->GetPolygonVertexCount();
+    });
 
-					//Got normals of each polygon-vertex.
-					FbxVector4 lTangent = lNormalElementSrc->GetDirectArray().GetAt(lNormalIndex);
-                    lTangent.Normalize();
+    std::vector<std::unique_ptr<MeshTransfer> > lTransfers;
+    for (size_t i = 0; i < lOrder.size(); i++) lTransfers.push_back(std::unique_ptr<MeshTransfer>(pCreateTransfer(lOrder[i])));
 
-                    FbxVector4 lBitangent = lNormal.CrossProduct(lTangent);
+    RunTransfers(pPool, lTransfers, pOptions.mMeshCacheDirectory, pWritten);
+}
 
-					int lTangentIndex = 0;
-					if (lTangentElement->GetReferenceMode() == FbxLayerElement::eDirect)
-						lTangentIndex = lIndexByPolygonVertex;
-					if (lTangentElement->GetReferenceMode() == FbxGeometryElement::eIndexToDirect)
-						lTangentIndex = lTangentElement->GetIndexArray().GetAt(lIndexByPolygonVertex);
+// merge the normals of all the meshes of pScene2 into pScene
+void ProcessScene(
+                  FbxScene* pScene,
+                  FbxScene* pScene2,
+                  const MergeOptions& pOptions,
+                  std::set<FbxMesh*>* pWritten
+                  )
+{
+    if( pOptions.mCorrespondence == eCorrespondClosestPoint )
+    {
+        ProcessSceneClosest(pScene, pScene2, pOptions, pWritten);
+        return;
+    }
+
+    if( pOptions.mMeshThreads == 1 )
+    {
+        ProcessNode(pScene->GetRootNode(), pScene2->GetRootNode(), pOptions, pWritten);
+        return;
+    }
+
+    WorkStealingPool lPool(pOptions.mMeshThreads);
+
+    // phase 1: find the mesh pairs and do the structural changes serially
+    std::vector<MeshPair> lPairs;
+    CollectMeshPairs(pScene->GetRootNode(), pScene2->GetRootNode(), lPairs);
+    std::vector<FbxNode*> lNodes(lPairs.size());
+    for( size_t i = 0; i < lPairs.size(); i++ ) lNodes[i] = lPairs[i].mNode;
+
+    // the position matching of a mesh runs on the pool
+    std::vector<FbxNode*> lTasks, lSources;
+    std::vector<std::vector<int> > lMatches;
+    std::vector<int> lMerged = FindMergedNodes(lNodes);
+    for( size_t i = 0; i < lMerged.size(); i++ )
+    {
+        const MeshPair& lPair = lPairs[lMerged[i]];
+        std::vector<int> lMeshMatches;
+        if( !PrepareMesh(lPair.mNode, lPair.mNode2, pOptions, &lPool, lMeshMatches) ) continue;
+
+        lTasks.push_back(lPair.mNode);
+        lSources.push_back(lPair.mNode2);
+        lMatches.push_back(std::vector<int>());
+        lMatches.back().swap(lMeshMatches);
+    }
+
+    // phase 2: transfer the normals
+    RunMeshTransfers(&lPool, lTasks, [&](int pTask)
+    {
+        MeshTransfer* lTransfer = new MeshTransfer(lTasks[pTask]->GetMesh(), lSources[pTask]->GetMesh(), lMatches[pTask], pOptions.mOutput, pOptions.mPackBits);
+        std::vector<int>().swap(lMatches[pTask]);
+        return lTransfer;
+    }, pOptions, pWritten);
+}
+
+// same traversal as ProcessNode, but only records the mesh pairs
+void CollectMeshPairs(
+                      FbxNode* pNode,
+                      FbxNode* pNode2,
+                      std::vector<MeshPair>& pPairs
+                      )
+{
+    if (pNode->GetNodeAttribute() && pNode2->GetNodeAttribute())
+    {
+        if (pNode->GetNodeAttribute()->GetAttributeType() != pNode2->GetNodeAttribute()->GetAttributeType())
+        {
+            UI_Printf("------- ERROR! Input Mesh don't match! ---------------------------");
+            return;
+        }
+        else if (pNode->GetNodeAttribute()->GetAttributeType() == FbxNodeAttribute::EType::eMesh)
+        {
+            MeshPair lPair;
+            lPair.mNode  = pNode;
+            lPair.mNode2 = pNode2;
+            pPairs.push_back(lPair);
+        }
+    }
+
+    int ChildCount = pNode->GetChildCount();
+    int ChildCount2 = pNode2->GetChildCount();
+    if (ChildCount != ChildCount2)
+    {
+        UI_Printf("------- ERROR! Input Mesh don't match! ---------------------------");
+        return;
+    }
+
+    for (int i = 0; i < ChildCount; ++i)
+    {
+        CollectMeshPairs(pNode->GetChild(i), pNode2->GetChild(i), pPairs);
+    }
+}
+
+void ProcessNode(FbxNode* pNode,FbxNode* pNode2, const MergeOptions& pOptions, std::set<FbxMesh*>* pWritten)
+{
+    if (pNode->GetNodeAttribute() && pNode2->GetNodeAttribute())
+    {
+		if (pNode->GetNodeAttribute()->GetAttributeType() != pNode2->GetNodeAttribute()->GetAttributeType())
+		{
+            UI_Printf("------- ERROR! Input Mesh don't match! ---------------------------");
+            return;
+		}
+		else
+		{
+            switch (pNode->GetNodeAttribute()->GetAttributeType())
+            {
+            case FbxNodeAttribute::EType::eMesh:
+                ProcessMesh(pNode, pNode2, pOptions, pWritten);
+                break;
+            default:
+                break;
+            }
+		}
+    }
+    
+    int ChildCount = pNode->GetChildCount();
+    int ChildCount2 = pNode2->GetChildCount();
+    if (ChildCount != ChildCount2)
+    {
+		UI_Printf("------- ERROR! Input Mesh don't match! ---------------------------");
+		return;
+    }
+    else
+    {
+        for (int i = 0; i < ChildCount; ++i)
+        {
+            ProcessNode(pNode->GetChild(i), pNode2->GetChild(i), pOptions, pWritten);
+        }
+    }
+}
+
+void ProcessMesh(FbxNode* pNode, FbxNode* pNode2, const MergeOptions& pOptions, std::set<FbxMesh*>* pWritten)
+{
+    std::vector<int> lMatches;
+    if (PrepareMesh(pNode, pNode2, pOptions, NULL, lMatches))
+    {
+        TransferMesh(pNode, pNode2, lMatches, pOptions.mOutput, pOptions.mPackBits, pOptions.mMeshCacheDirectory.c_str(), pWritten);
+    }
+}
+
+static EElementMapping GetElementMapping(FbxLayerElement::EMappingMode pMappingMode)
+{
+    switch (pMappingMode)
+    {
+    case FbxLayerElement::eByControlPoint:  return eMapByControlPoint;
+    case FbxLayerElement::eByPolygonVertex: return eMapByPolygonVertex;
+    case FbxLayerElement::eByPolygon:       return eMapByPolygon;
+    default:                                return eMapAllSame;
+    }
+}
+
+// number of values of a layer element with the given mapping mode, -1 if the mode is not supported
+static int GetElementCount(FbxMesh* pMesh, FbxLayerElement::EMappingMode pMappingMode)
+{
+    switch (pMappingMode)
+    {
+    case FbxLayerElement::eByControlPoint:  return pMesh->GetControlPointsCount();
+    case FbxLayerElement::eByPolygonVertex: return pMesh->GetPolygonVertexCount();
+    case FbxLayerElement::eByPolygon:       return pMesh->GetPolygonCount();
+    case FbxLayerElement::eAllSame:         return 1;
+    default:                                return -1;
+    }
+}
 
-                    lTangentElement->GetDirectArray().SetAt(lTangentIndex, lTangent);
-                    lBinormalElement->GetDirectArray().SetAt(lTangentIndex, lBitangent);
+// core view of the positions and polygons of a mesh, pPolygonStarts holds the polygon starts.
+// The normals are left to the caller.
+static void GetMeshView(FbxMesh* pMesh, std::vector<int>& pPolygonStarts, MeshView& pView)
+{
+    int lPolygonCount = pMesh->GetPolygonCount();
+    pPolygonStarts.resize(lPolygonCount + 1);
+    for (int i = 0; i < lPolygonCount; i++)
+    {
+        pPolygonStarts[i] = pMesh->GetPolygonVertexIndex(i);
+    }
+    pPolygonStarts[lPolygonCount] = pMesh->GetPolygonVertexCount();
+
+    pView.mPositions         = pMesh->GetControlPoints() ? pMesh->GetControlPoints()->mData : NULL;
+    pView.mPositionStride    = 4;
+    pView.mControlPointCount = pMesh->GetControlPointsCount();
+    pView.mPolygonVertices   = pMesh->GetPolygonVertices();
+    pView.mPolygonStarts     = &pPolygonStarts[0];
+    pView.mPolygonCount      = lPolygonCount;
+}
+
+// the doubles of a vector or a color of a layer element
+static const double* GetDoubles(const FbxVector4* pValue) { return pValue ? pValue->mData : NULL; }
+static const double* GetDoubles(const FbxVector2* pValue) { return pValue ? pValue->mData : NULL; }
+static const double* GetDoubles(const FbxColor* pValue)   { return pValue ? &pValue->mRed : NULL; }
+
+// core view of a locked vector or color element, eIndex is the pre 7.0 name of eIndexToDirect
+template <class T>
+static ElementView GetElementView(
+                                  const FbxLayerElementTemplate<T>* pElement,
+                                  const LayerElementSpan<T>& pSpan
+                                  )
+{
+    ElementView lView;
+    lView.mMapping     = GetElementMapping(pElement->GetMappingMode());
+    lView.mReference   = pElement->GetReferenceMode() == FbxLayerElement::eDirect ? eRefDirect : eRefIndexToDirect;
+    lView.mDirect      = GetDoubles(pSpan.GetDirect());
+    lView.mDirectCount = pSpan.GetDirectCount();
+    lView.mStride      = int(sizeof(T) / sizeof(double));
+    lView.mIndex       = pSpan.GetIndex();
+    lView.mIndexCount  = pSpan.GetIndexCount();
+    return lView;
+}
+
+// one direct tangent and one direct binormal per element, in the mapping of the normals
+static void CreateTangentElements(FbxMesh* pMesh, FbxLayerElement::EMappingMode pMappingMode, int pCount)
+{
+    FbxGeometryElementTangent* lTangentElement = pMesh->GetElementTangent(0);
+    FbxGeometryElementBinormal* lBinormalElement = pMesh->GetElementBinormal(0);
+
+    if (lTangentElement == nullptr)
+    {
+        lTangentElement = pMesh->CreateElementTangent();
+    }
+    if (lBinormalElement == nullptr)
+    {
+        lBinormalElement = pMesh->CreateElementBinormal();
+    }
 
-                    lIndexByPolygonVertex++;
+	lTangentElement->GetDirectArray().SetCount(pCount);
+    lBinormalElement->GetDirectArray().SetCount(pCount);
+    lTangentElement->GetIndexArray().Clear();
+    lBinormalElement->GetIndexArray().Clear();
+	
+    lTangentElement->SetMappingMode(pMappingMode);
+	lBinormalElement->SetMappingMode(pMappingMode);
+    lTangentElement->SetReferenceMode(FbxLayerElement::eDirect);
+	lBinormalElement->SetReferenceMode(FbxLayerElement::eDirect);
+}
 
-				}//end for i //lPolygonSize
-			}//end for lPolygonIndex //PolygonCount
-		}//end eByPolygonVertex
+// the vertex color layer of the encoded smooth normals, NULL if there is none
+static FbxGeometryElementVertexColor* GetEncodedColorElement(FbxMesh* pMesh)
+{
+    for (int i = 0; i < pMesh->GetElementVertexColorCount(); i++)
+    {
+        FbxGeometryElementVertexColor* lElement = pMesh->GetElementVertexColor(i);
+        if (strcmp(lElement->GetName(), kSmoothNormalLayerName) == 0) return lElement;
+    }
+    return NULL;
+}
 
-	}//end if lNormalElementSrc
+// creates the elements written by a transfer: for eOutputTangent, the tangents in the
+// mapping of the normals; packed, the layer of the packed normals in the mapping of the
+// normals; otherwise a tangent basis by polygon-vertex and the layer of the encoded
+// smooth normals, which needs valid UVs in the first UV set
+static bool CreateOutputElements(FbxNode* pNode, FbxLayerElement::EMappingMode pMappingMode, int pCount, EOutputChannel pOutput, int pPackBits)
+{
+    FbxMesh* lMesh = pNode->GetMesh();
+    if (pOutput == eOutputTangent)
+    {
+        CreateTangentElements(lMesh, pMappingMode, pCount);
+        return true;
+    }
 
+    FbxGeometryElementUV* lUVElement = lMesh->GetElementUV(0);
+    bool lValid = lUVElement != nullptr || pPackBits > 0;
+    if (lValid && pPackBits == 0)
+    {
+        LayerElementSpan<FbxVector2> lUV(lUVElement, FbxLayerElementArray::eReadLock);
+        lValid = IsElementValid(GetElementView(lUVElement, lUV), GetElementCount(lMesh, lUVElement->GetMappingMode()));
+    }
+    if (!lValid)
+    {
+        UI_Printf("------- ERROR! Mesh %s has no valid UVs for its tangents! -------", pNode->GetName());
+        return false;
+    }
+
+    // the packed normals follow the normals, the tangent space ones the tangent basis
+    int lEncodedCount = pPackBits > 0 ? pCount : lMesh->GetPolygonVertexCount();
+    FbxLayerElement::EMappingMode lEncodedMapping = pPackBits > 0 ? pMappingMode : FbxLayerElement::eByPolygonVertex;
+    if (pPackBits == 0) CreateTangentElements(lMesh, FbxLayerElement::eByPolygonVertex, lEncodedCount);
+
+    FbxLayerElement* lEncoded;
+    if (pOutput == eOutputUV)
+    {
+        FbxGeometryElementUV* lElement = lMesh->GetElementUV(kSmoothNormalLayerName);
+        if (lElement == nullptr) lElement = lMesh->CreateElementUV(kSmoothNormalLayerName);
+        lElement->GetDirectArray().SetCount(lEncodedCount);
+        lElement->GetIndexArray().Clear();
+        lEncoded = lElement;
+    }
+    else
+    {
+        FbxGeometryElementVertexColor* lElement = GetEncodedColorElement(lMesh);
+        if (lElement == nullptr)
+        {
+            lElement = lMesh->CreateElementVertexColor();
+            lElement->SetName(kSmoothNormalLayerName);
+        }
+        lElement->GetDirectArray().SetCount(lEncodedCount);
+        lElement->GetIndexArray().Clear();
+        lEncoded = lElement;
+    }
+    lEncoded->SetMappingMode(lEncodedMapping);
+    lEncoded->SetReferenceMode(FbxLayerElement::eDirect);
+    return true;
+}
+
+// creates and sizes the tangent and binormal elements of the lighting mesh, and
+// matches the control points of the two meshes for eCorrespondPosition.
+// Changes the layers of the mesh, so it is always called serially.
+bool PrepareMesh(
+                 FbxNode* pNode,
+                 FbxNode* pNode2,
+                 const MergeOptions& pOptions,
+                 WorkStealingPool* pPool,
+                 std::vector<int>& pMatches
+                 )
+{
+    // get mesh
+    FbxMesh* pMesh = pNode->GetMesh();
+    FbxMesh* pMesh2 = pNode2->GetMesh();
+
+    if (pMesh == nullptr || pMesh2 == nullptr)
+    {
+        UI_Printf("------- ERROR! Input Mesh don't match! ---------------------------");
+        return false;
+    }
+
+	FbxGeometryElementNormal* lNormalElementSrc = pMesh2->GetElementNormal(0);
+	FbxGeometryElementNormal* lNormalElementDst = pMesh->GetElementNormal(0);
+
+    if (lNormalElementSrc == nullptr || lNormalElementDst == nullptr)
+    {
+        UI_Printf("------- ERROR! Mesh %s has no normals! ---------------------------", pNode->GetName());
+        return false;
+    }
+    if (GetElementCount(pMesh2, lNormalElementSrc->GetMappingMode()) < 0)
+    {
+        UI_Printf("------- ERROR! Normal mapping modes of mesh %s don't match! -------", pNode->GetName());
+        return false;
+    }
+
+    std::vector<int> lPolygonStarts2;
+    MeshView lView2;
+    GetMeshView(pMesh2, lPolygonStarts2, lView2);
+
+    LayerElementSpan<FbxVector4> lSource(lNormalElementSrc, FbxLayerElementArray::eReadLock);
+    lView2.mNormals = GetElementView(lNormalElementSrc, lSource);
+    return PrepareMesh(pNode, lView2, pOptions, pPool, pMatches);
+}
+
+bool PrepareMesh(
+                 FbxNode* pNode,
+                 const MeshView& pMesh2,
+                 const MergeOptions& pOptions,
+                 WorkStealingPool* pPool,
+                 std::vector<int>& pMatches
+                 )
+{
+    FbxMesh* pMesh = pNode->GetMesh();
+	FbxGeometryElementNormal* lNormalElementDst = pMesh ? pMesh->GetElementNormal(0) : NULL;
+
+    if (lNormalElementDst == nullptr)
+    {
+        UI_Printf("------- ERROR! Mesh %s has no normals! ---------------------------", pNode->GetName());
+        return false;
+    }
+
+    // the tangents follow the mapping of the lighting normals
+    FbxLayerElement::EMappingMode lMappingMode = lNormalElementDst->GetMappingMode();
+    EElementMapping lSourceMapping = pMesh2.mNormals.mMapping;
+    int lCount = GetElementCount(pMesh, lMappingMode);
+
+    // a sidecar has no polygons, its elements are only counted by the position path
+    bool lPosition = pOptions.mCorrespondence == eCorrespondPosition;
+    int lSourceCount = lPosition ? GetElementCount(pMesh2, lSourceMapping) : 0;
+    if (lPosition)
+    {
+        // the matching goes through the control points
+        if ((lMappingMode != FbxLayerElement::eByControlPoint && lMappingMode != FbxLayerElement::eByPolygonVertex) ||
+            (lSourceMapping != eMapByControlPoint && lSourceMapping != eMapByPolygonVertex))
+        {
+            UI_Printf("------- ERROR! Normal mapping modes of mesh %s can't be matched by position! -------", pNode->GetName());
+            return false;
+        }
+    }
+    else if (lCount < 0 || GetElementMapping(lMappingMode) != lSourceMapping)
+    {
+        // both normal elements are read with the same element index
+        UI_Printf("------- ERROR! Normal mapping modes of mesh %s don't match! -------", pNode->GetName());
+        return false;
+    }
+
+    bool lValid;
+    {
+        LayerElementSpan<FbxVector4> lNormal(lNormalElementDst, FbxLayerElementArray::eReadLock);
+        lValid = IsElementValid(pMesh2.mNormals, lPosition ? lSourceCount : lCount) &&
+                 IsElementValid(GetElementView(lNormalElementDst, lNormal), lCount);
+    }
+    if (!lValid)
+    {
+        UI_Printf("------- ERROR! Input Mesh %s don't match! ---------------------------", pNode->GetName());
+        return false;
+    }
+
+    pMatches.clear();
+    if (lPosition)
+    {
+        std::vector<int> lPolygonStarts;
+        MeshView lView;
+        GetMeshView(pMesh, lPolygonStarts, lView);
+
+        int lUnmatched = MatchControlPoints(lView, pMesh2, pOptions.mWeldTolerance, pPool, pMatches);
+        if (lUnmatched > 0)
+        {
+            UI_Printf("------- ERROR! %d vertices of mesh %s have no smooth vertex within %g! -------",
+                lUnmatched, pNode->GetName(), pOptions.mWeldTolerance);
+            return false;
+        }
+    }
+
+    return CreateOutputElements(pNode, lMappingMode, lCount, pOptions.mOutput, pOptions.mPackBits);
+}
+
+// the elements of pMesh locked, pSource the smooth normals locked for reading, NULL for none
+MeshTransfer::MeshTransfer(FbxMesh* pMesh, FbxGeometryElementNormal* pSource, EOutputChannel pOutput, int pPackBits)
+    : mSource(pSource, FbxLayerElementArray::eReadLock)
+    , mNormal(pMesh->GetElementNormal(0), FbxLayerElementArray::eReadLock)
+    , mTangent(pMesh->GetElementTangent(0), FbxLayerElementArray::eWriteLock)
+    , mBinormal(pMesh->GetElementBinormal(0), FbxLayerElementArray::eWriteLock)
+    , mUV(pOutput != eOutputTangent && pPackBits == 0 ? pMesh->GetElementUV(0) : NULL, FbxLayerElementArray::eReadLock)
+    , mEncodedUV(pOutput == eOutputUV ? pMesh->GetElementUV(kSmoothNormalLayerName) : NULL, FbxLayerElementArray::eWriteLock)
+    , mEncodedColor(pOutput == eOutputColor ? GetEncodedColorElement(pMesh) : NULL, FbxLayerElementArray::eWriteLock)
+    , mOutput(pOutput)
+    , mPackBits(pOutput != eOutputTangent ? pPackBits : 0)
+    , mName(pMesh->GetNode() ? pMesh->GetNode()->GetName() : "")
+    , mFbxMesh(pMesh)
+{
+    GetMeshView(pMesh, mPolygonStarts, mMesh);
+    mMesh.mNormals = GetElementView(pMesh->GetElementNormal(0), mNormal);
+}
+
+MeshTransfer::MeshTransfer(FbxMesh* pMesh, FbxMesh* pMesh2, const std::vector<int>& pMatches, EOutputChannel pOutput, int pPackBits)
+    : MeshTransfer(pMesh, pMesh2->GetElementNormal(0), pOutput, pPackBits)
+{
+
+    // the polygons of the smooth mesh are only read through the matches
+    std::vector<int> lPolygonStarts2;
+    MeshView lView2 = MeshView();
+    if (!pMatches.empty()) GetMeshView(pMesh2, lPolygonStarts2, lView2);
+    lView2.mNormals = GetElementView(pMesh2->GetElementNormal(0), mSource);
+
+    InitializeSource(lView2, pMatches);
+    InitializeOutput(pMesh);
+}
+
+MeshTransfer::MeshTransfer(FbxMesh* pMesh, const MeshView& pMesh2, const std::vector<int>& pMatches, EOutputChannel pOutput, int pPackBits)
+    : MeshTransfer(pMesh, NULL, pOutput, pPackBits)
+{
+
+    InitializeSource(pMesh2, pMatches);
+    InitializeOutput(pMesh);
+}
+
+MeshTransfer::MeshTransfer(FbxMesh* pMesh, std::vector<double>& pValues, EElementMapping pValueMapping, EOutputChannel pOutput, int pPackBits)
+    : MeshTransfer(pMesh, NULL, pOutput, pPackBits)
+{
+    mCount = GetElementCount(mMesh, mMesh.mNormals.mMapping);
+
+    mSourceValues.swap(pValues);
+
+    // by control point values of by polygon-vertex normals are read through the polygon-vertices
+    bool lByControlPoint = pValueMapping == eMapByControlPoint && mMesh.mNormals.mMapping == eMapByPolygonVertex;
+    int lValueCount = lByControlPoint ? mMesh.mControlPointCount : mCount;
+    if ((pValueMapping != mMesh.mNormals.mMapping && !lByControlPoint) || mSourceValues.size() < size_t(lValueCount) * 4) mCount = 0;
+
+    mSourceView.mMapping     = mMesh.mNormals.mMapping;
+    mSourceView.mReference   = lByControlPoint ? eRefIndexToDirect : eRefDirect;
+    mSourceView.mDirect      = mCount > 0 ? &mSourceValues[0] : NULL;
+    mSourceView.mDirectCount = mCount > 0 ? lValueCount : 0;
+    mSourceView.mStride      = 4;
+    mSourceView.mIndex       = lByControlPoint ? mMesh.mPolygonVertices : NULL;
+    mSourceView.mIndexCount  = lByControlPoint ? mCount : 0;
+    InitializeOutput(pMesh);
+}
+
+// the smooth normals, read through the matched control points when there are matches
+void MeshTransfer::InitializeSource(const MeshView& pMesh2, const std::vector<int>& pMatches)
+{
+    mSourceView = pMesh2.mNormals;
+    mCount = GetElementCount(mMesh, mMesh.mNormals.mMapping);
+
+    if (!pMatches.empty() && !RemapElement(mMesh, mMesh.mNormals.mMapping, pMesh2, mSourceView, pMatches, mSourceIndex, mSourceView))
+        mCount = 0;
+}
+
+// the tangent space outputs run per polygon and the packed ones per normal, once
+// their elements (CreateOutputElements) are locked
+void MeshTransfer::InitializeOutput(FbxMesh* pMesh)
+{
+    if (mOutput == eOutputTangent) return;
+
+    bool lLocked = mOutput == eOutputUV ? mEncodedUV.GetDirect() != nullptr : mEncodedColor.GetDirect() != nullptr;
+    if (mPackBits > 0)
+    {
+        int lEncodedCount = mOutput == eOutputUV ? mEncodedUV.GetDirectCount() : mEncodedColor.GetDirectCount();
+        if (!lLocked || lEncodedCount < mCount) mCount = 0;
+        return;
+    }
+
+    lLocked = lLocked && mUV.GetDirect();
+    if (lLocked) mUVView = GetElementView(pMesh->GetElementUV(0), mUV);
+    mCount = mCount > 0 && lLocked ? mMesh.mPolygonCount : 0;
+}
+
+std::string MeshTransfer::GetFingerprint() const
+{
+    // the settings the outputs depend on besides the views
+    const double lBinormalW = FbxVector4().CrossProduct(FbxVector4())[3];
+    char lSettings[256];
+    snprintf(lSettings, sizeof(lSettings), "NormalMerger %s; kernel %s; channel %d; pack %d; count %d; w %.17g",
+             kNormalMergerVersion, GetKernelIsaName(GetKernelIsa()), int(mOutput), mPackBits, mCount, lBinormalW);
+
+    ContentHash lHash;
+    lHash.Add(lSettings, strlen(lSettings));
+    AddMeshGeometry(lHash, mMesh);
+    AddElementValues(lHash, mMesh.mNormals);
+    AddElementValues(lHash, mSourceView);
+    if (mOutput != eOutputTangent && mPackBits == 0) AddElementValues(lHash, mUVView);
+    return lHash.GetDigest();
+}
+
+bool MeshTransfer::WritesTangents() const
+{
+    return mCount > 0 && (mOutput == eOutputTangent || mPackBits == 0) && mTangent.GetDirect() && mBinormal.GetDirect();
+}
+
+void MeshTransfer::GetOutputs(std::vector<ElementOutput>& pOutputs) const
+{
+    pOutputs.clear();
+    if (mCount == 0) return;
+
+    if (mOutput == eOutputTangent || mPackBits == 0)
+    {
+        if (mTangent.GetDirect() == nullptr || mBinormal.GetDirect() == nullptr) return;
+        ElementOutput lTangents  = { mTangent.GetDirect()->mData,  mTangent.GetDirectCount(),  4 };
+        ElementOutput lBinormals = { mBinormal.GetDirect()->mData, mBinormal.GetDirectCount(), 4 };
+        pOutputs.push_back(lTangents);
+        pOutputs.push_back(lBinormals);
+    }
+    if (mOutput == eOutputTangent) return;
+
+    double* lEncoded = mOutput == eOutputUV ? (mEncodedUV.GetDirect() ? mEncodedUV.GetDirect()->mData : NULL)
+                                            : (mEncodedColor.GetDirect() ? &mEncodedColor.GetDirect()->mRed : NULL);
+    if (lEncoded == NULL)
+    {
+        pOutputs.clear();
+        return;
+    }
+    ElementOutput lOutput = { lEncoded, mOutput == eOutputUV ? mEncodedUV.GetDirectCount() : mEncodedColor.GetDirectCount(),
+                              mOutput == eOutputUV ? 2 : 4 };
+    pOutputs.push_back(lOutput);
+}
+
+void MeshTransfer::Prepare(WorkStealingPool* pPool)
+{
+    if (mOutput == eOutputTangent || mPackBits > 0 || mCount == 0) return;
+    ComputeTangentFrames(mMesh, mUVView, pPool, mFrames);
+}
+
+double MeshTransfer::Run(int pBegin, int pEnd) const
+{
+    if (mCount == 0) return 0.0;
+
+    if (mPackBits > 0)
+    {
+        ElementOutput lPacked;
+        if (mOutput == eOutputUV)
+        {
+            ElementOutput lUV = { mEncodedUV.GetDirect()->mData, mEncodedUV.GetDirectCount(), 2 };
+            lPacked = lUV;
+        }
+        else
+        {
+            ElementOutput lColor = { &mEncodedColor.GetDirect()->mRed, mEncodedColor.GetDirectCount(), 4 };
+            lPacked = lColor;
+        }
+        return PackNormals(mMesh, mSourceView, mPackBits, lPacked, pBegin, pEnd);
+    }
+
+    if (mTangent.GetDirect() == nullptr) return 0.0;
+
+    ElementOutput lTangents  = { mTangent.GetDirect()->mData,  mTangent.GetDirectCount(),  4 };
+    ElementOutput lBinormals = { mBinormal.GetDirect()->mData, mBinormal.GetDirectCount(), 4 };
+
+    // W of the vectors returned by FbxVector4::CrossProduct
+    const double lBinormalW = FbxVector4().CrossProduct(FbxVector4())[3];
+
+    if (mOutput == eOutputTangent)
+    {
+        MergeNormals(mMesh, mSourceView, lTangents, lBinormals, lBinormalW, pBegin, pEnd);
+        return 0.0;
+    }
+
+    ElementOutput lEncoded;
+    if (mOutput == eOutputUV)
+    {
+        ElementOutput lUV = { mEncodedUV.GetDirect()->mData, mEncodedUV.GetDirectCount(), 2 };
+        lEncoded = lUV;
+    }
+    else
+    {
+        ElementOutput lColor = { &mEncodedColor.GetDirect()->mRed, mEncodedColor.GetDirectCount(), 4 };
+        lEncoded = lColor;
+    }
+    EncodeTangentSpace(mMesh, mSourceView, mFrames, mOutput == eOutputUV ? eEncodeXY : eEncodeColor,
+                       lTangents, lBinormals, lBinormalW, lEncoded, pBegin, pEnd);
+    return 0.0;
+}
+
+// writes the smooth normals of pNode2 in the output channel of pNode
+void TransferMesh(FbxNode* pNode, FbxNode* pNode2, const std::vector<int>& pMatches, EOutputChannel pOutput, int pPackBits, const char* pMeshCache,
+                  std::set<FbxMesh*>* pWritten)
+{
+    MeshTransfer lTransfer(pNode->GetMesh(), pNode2->GetMesh(), pMatches, pOutput, pPackBits);
+    if (pWritten && lTransfer.WritesTangents()) pWritten->insert(pNode->GetMesh());
+
+    std::vector<ElementOutput> lOutputs;
+    std::string lKey;
+    double lMaxAngle = 0.0;
+    if (pMeshCache && pMeshCache[0]) lTransfer.GetOutputs(lOutputs);
+    if (!lOutputs.empty())
+    {
+        lKey = lTransfer.GetFingerprint();
+        if (LoadMeshOutputs(pMeshCache, lKey, lOutputs, lMaxAngle))
+        {
+            UI_Printf("Mesh %s: reused from the mesh cache", pNode->GetName());
+            ReportPacking(lTransfer, lMaxAngle);
+            return;
+        }
+    }
+
+    lTransfer.Prepare(NULL);
+    lMaxAngle = lTransfer.Run(0, lTransfer.GetCount());
+    ReportPacking(lTransfer, lMaxAngle);
+    if (!lKey.empty()) StoreMeshOutputs(pMeshCache, lKey, lOutputs, lMaxAngle, NULL);
+}
+
+// all the mesh nodes below pNode, pNode included
+void CollectMeshNodes(
+                      FbxNode* pNode,
+                      std::vector<FbxNode*>& pNodes
+                      )
+{
+    if (pNode->GetNodeAttribute() && pNode->GetNodeAttribute()->GetAttributeType() == FbxNodeAttribute::EType::eMesh)
+    {
+        pNodes.push_back(pNode);
+    }
+
+    for (int i = 0; i < pNode->GetChildCount(); ++i)
+    {
+        CollectMeshNodes(pNode->GetChild(i), pNodes);
+    }
+}
+
+// transform of the geometry of a node to world space, the geometric transform included
+static FbxAMatrix GetWorldTransform(FbxNode* pNode)
+{
+    FbxAMatrix lGeometry(pNode->GetGeometricTranslation(FbxNode::eSourcePivot),
+                         pNode->GetGeometricRotation(FbxNode::eSourcePivot),
+                         pNode->GetGeometricScaling(FbxNode::eSourcePivot));
+    return pNode->EvaluateGlobalTransform() * lGeometry;
+}
+
+// the control points of pView moved to world space, pView then points at pPositions
+static void TransformPositions(const FbxAMatrix& pTransform, std::vector<double>& pPositions, MeshView& pView)
+{
+    pPositions.resize(size_t(pView.mControlPointCount) * 3);
+    for (int i = 0; i < pView.mControlPointCount; i++)
+    {
+        const double* lPoint = pView.mPositions + size_t(i) * pView.mPositionStride;
+        FbxVector4 lWorld = pTransform.MultT(FbxVector4(lPoint[0], lPoint[1], lPoint[2], 1.0));
+        for (int c = 0; c < 3; c++) pPositions[size_t(i) * 3 + c] = lWorld[c];
+    }
+
+    pView.mPositions      = pPositions.empty() ? NULL : &pPositions[0];
+    pView.mPositionStride = 3;
+}
+
+// multiplies the vectors by the transpose of the 3x3 part of pMatrix. With the
+// inverse of a world transform, takes normals to world space; with the world
+// transform itself, takes world space normals back to the local space.
+static void TransformNormals(const FbxAMatrix& pMatrix, double* pValues, size_t pCount, int pStride)
+{
+    double lMatrix[3][3];
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++) lMatrix[r][c] = pMatrix.Get(c, r);
+
+    for (size_t i = 0; i < pCount; i++)
+    {
+        double* lValue = pValues + i * pStride;
+        double x = lValue[0], y = lValue[1], z = lValue[2];
+        for (int c = 0; c < 3; c++) lValue[c] = x * lMatrix[0][c] + y * lMatrix[1][c] + z * lMatrix[2][c];
+    }
+}
+
+// world space triangles of smooth meshes, their corner normals and their BVH
+struct SmoothSurface
+{
+    std::vector<double>          mCorners;
+    std::vector<double>          mCornerNormals;
+    std::unique_ptr<TriangleBvh> mBvh;
+};
+
+// appends the triangles of a smooth mesh node to pSurface
+static bool AppendSurface(FbxNode* pNode, SmoothSurface& pSurface)
+{
+    FbxMesh* lMesh = pNode->GetMesh();
+    FbxGeometryElementNormal* lNormalElement = lMesh ? lMesh->GetElementNormal(0) : NULL;
+    if (lNormalElement == nullptr)
+    {
+        UI_Printf("------- ERROR! Mesh %s has no normals! ---------------------------", pNode->GetName());
+        return false;
+    }
+
+    std::vector<int> lPolygonStarts;
+    std::vector<double> lPositions, lCorners, lCornerNormals;
+    MeshView lView;
+    GetMeshView(lMesh, lPolygonStarts, lView);
+
+    FbxAMatrix lTransform = GetWorldTransform(pNode);
+    TransformPositions(lTransform, lPositions, lView);
+    {
+        LayerElementSpan<FbxVector4> lNormal(lNormalElement, FbxLayerElementArray::eReadLock);
+        ElementView lNormals = GetElementView(lNormalElement, lNormal);
+        if (GetElementCount(lMesh, lNormalElement->GetMappingMode()) < 0 ||
+            !IsElementValid(lNormals, GetElementCount(lView, lNormals.mMapping)))
+        {
+            UI_Printf("------- ERROR! Normals of mesh %s are not valid! ---------------------------", pNode->GetName());
+            return false;
+        }
+        TriangulateMesh(lView, lNormals, lCorners, lCornerNormals);
+    }
+    TransformNormals(lTransform.Inverse(), lCornerNormals.empty() ? NULL : &lCornerNormals[0], lCornerNormals.size() / 3, 3);
+
+    pSurface.mCorners.insert(pSurface.mCorners.end(), lCorners.begin(), lCorners.end());
+    pSurface.mCornerNormals.insert(pSurface.mCornerNormals.end(), lCornerNormals.begin(), lCornerNormals.end());
+    return true;
+}
+
+void ProcessSceneClosest(
+                         FbxScene* pScene,
+                         FbxScene* pScene2,
+                         const MergeOptions& pOptions,
+                         std::set<FbxMesh*>* pWritten
+                         )
+{
+    std::unique_ptr<WorkStealingPool> lPool(CreateMeshPool(pOptions));
+
+    std::vector<FbxNode*> lNodes, lSourceNodes;
+    CollectMeshNodes(pScene->GetRootNode(), lNodes);
+    CollectMeshNodes(pScene2->GetRootNode(), lSourceNodes);
+
+    // the smooth surfaces built so far, the one of the whole smooth scene under NULL
+    std::map<FbxNode*, std::unique_ptr<SmoothSurface> > lSurfaces;
+
+    std::vector<FbxNode*> lTasks;
+    std::vector<std::vector<double> > lTaskValues;
+    std::vector<EElementMapping> lTaskMappings;
+    std::vector<int> lMerged = FindMergedNodes(lNodes);
+    for (size_t n = 0; n < lMerged.size(); n++)
+    {
+        FbxNode* lNode = lNodes[lMerged[n]];
+        FbxMesh* lMesh = lNode->GetMesh();
+
+        FbxGeometryElementNormal* lNormalElement = lMesh->GetElementNormal(0);
+        if (lNormalElement == nullptr)
+        {
+            UI_Printf("------- ERROR! Mesh %s has no normals! ---------------------------", lNode->GetName());
+            continue;
+        }
+
+        FbxLayerElement::EMappingMode lMappingMode = lNormalElement->GetMappingMode();
+        int lCount = GetElementCount(lMesh, lMappingMode);
+        if (lCount < 0 || lMappingMode == FbxLayerElement::eAllSame)
+        {
+            UI_Printf("------- ERROR! Normal mapping mode of mesh %s can't be sampled! -------", lNode->GetName());
+            continue;
+        }
+
+        // the smooth mesh of the same name, or the whole smooth scene
+        FbxNode* lSourceNode = NULL;
+        for (size_t i = 0; i < lSourceNodes.size() && lSourceNode == NULL; i++)
+        {
+            if (strcmp(lSourceNodes[i]->GetName(), lNode->GetName()) == 0) lSourceNode = lSourceNodes[i];
+        }
+
+        std::unique_ptr<SmoothSurface>& lSurface = lSurfaces[lSourceNode];
+        if (!lSurface)
+        {
+            lSurface.reset(new SmoothSurface());
+            if (lSourceNode)
+            {
+                AppendSurface(lSourceNode, *lSurface);
+            }
+            else
+            {
+                for (size_t i = 0; i < lSourceNodes.size(); i++) AppendSurface(lSourceNodes[i], *lSurface);
+            }
+            lSurface->mBvh.reset(new TriangleBvh(lSurface->mCorners, lPool.get()));
+            std::vector<double>().swap(lSurface->mCorners);
+        }
+
+        // the lighting control points in world space
+        std::vector<int> lPolygonStarts;
+        std::vector<double> lPositions, lValues;
+        MeshView lView;
+        GetMeshView(lMesh, lPolygonStarts, lView);
+
+        FbxAMatrix lTransform = GetWorldTransform(lNode);
+        TransformPositions(lTransform, lPositions, lView);
+
+        if (!SampleSurface(*lSurface->mBvh, lSurface->mCornerNormals, lView, GetElementMapping(lMappingMode), lPool.get(), lValues))
+        {
+            UI_Printf("------- ERROR! No smooth surface for mesh %s! -------", lNode->GetName());
+            continue;
+        }
+        TransformNormals(lTransform, lValues.empty() ? NULL : &lValues[0], lValues.size() / 4, 4);
+
+        if (!CreateOutputElements(lNode, lMappingMode, lCount, pOptions.mOutput, pOptions.mPackBits)) continue;
+        lTasks.push_back(lNode);
+        lTaskValues.push_back(std::vector<double>());
+        lTaskValues.back().swap(lValues);
+        lTaskMappings.push_back(GetElementMapping(lMappingMode));
+    }
+
+    RunMeshTransfers(lPool.get(), lTasks, [&](int pTask)
+    {
+        return new MeshTransfer(lTasks[pTask]->GetMesh(), lTaskValues[pTask], lTaskMappings[pTask], pOptions.mOutput, pOptions.mPackBits);
+    }, pOptions, pWritten);
+}
+
+void ProcessSceneGenerated(
+                           FbxScene* pScene,
+                           const MergeOptions& pOptions,
+                           std::set<FbxMesh*>* pWritten
+                           )
+{
+    std::unique_ptr<WorkStealingPool> lPool(CreateMeshPool(pOptions));
+
+    std::vector<FbxNode*> lNodes;
+    CollectMeshNodes(pScene->GetRootNode(), lNodes);
+
+    // the normals are in mesh space, any node of an instanced mesh gives the same ones
+    std::vector<FbxNode*> lTasks;
+    std::vector<std::vector<double> > lTaskValues;
+    std::vector<int> lMerged = FindMergedNodes(lNodes);
+    for (size_t n = 0; n < lMerged.size(); n++)
+    {
+        FbxNode* lNode = lNodes[lMerged[n]];
+        FbxMesh* lMesh = lNode->GetMesh();
+
+        FbxGeometryElementNormal* lNormalElement = lMesh->GetElementNormal(0);
+        if (lNormalElement == nullptr)
+        {
+            UI_Printf("------- ERROR! Mesh %s has no normals! ---------------------------", lNode->GetName());
+            continue;
+        }
+
+        // the welding goes through the control points
+        FbxLayerElement::EMappingMode lMappingMode = lNormalElement->GetMappingMode();
+        if (lMappingMode != FbxLayerElement::eByControlPoint && lMappingMode != FbxLayerElement::eByPolygonVertex)
+        {
+            UI_Printf("------- ERROR! Normal mapping mode of mesh %s can't be smoothed! -------", lNode->GetName());
+            continue;
+        }
+
+        int lCount = GetElementCount(lMesh, lMappingMode);
+        bool lValid;
+        {
+            LayerElementSpan<FbxVector4> lNormal(lNormalElement, FbxLayerElementArray::eReadLock);
+            lValid = IsElementValid(GetElementView(lNormalElement, lNormal), lCount);
+        }
+        if (!lValid || lMesh->GetControlPoints() == NULL)
+        {
+            UI_Printf("------- ERROR! Input Mesh %s is not valid! ---------------------------", lNode->GetName());
+            continue;
+        }
+
+        std::vector<int> lPolygonStarts;
+        std::vector<double> lValues;
+        MeshView lView;
+        GetMeshView(lMesh, lPolygonStarts, lView);
+
+        ComputeSmoothNormals(lView, pOptions.mSmoothWeighting, pOptions.mWeldTolerance, lPool.get(), lValues);
+
+        if (!CreateOutputElements(lNode, lMappingMode, lCount, pOptions.mOutput, pOptions.mPackBits)) continue;
+        lTasks.push_back(lNode);
+        lTaskValues.push_back(std::vector<double>());
+        lTaskValues.back().swap(lValues);
+    }
+
+    RunMeshTransfers(lPool.get(), lTasks, [&](int pTask)
+    {
+        return new MeshTransfer(lTasks[pTask]->GetMesh(), lTaskValues[pTask], eMapByControlPoint, pOptions.mOutput, pOptions.mPackBits);
+    }, pOptions, pWritten);
+}
+
+void ProcessSceneNative(
+                        FbxScene* pScene,
+                        const BinaryFbxFile& pFile2,
+                        const MergeOptions& pOptions,
+                        std::set<FbxMesh*>* pWritten
+                        )
+{
+    std::unique_ptr<WorkStealingPool> lPool(CreateMeshPool(pOptions));
+
+    std::vector<FbxNode*> lNodes;
+    CollectMeshNodes(pScene->GetRootNode(), lNodes);
+
+    std::vector<FbxNode*> lTasks;
+    std::vector<const BinaryFbxMesh*> lSources;
+    std::vector<std::vector<int> > lMatches;
+    std::vector<int> lMerged = FindMergedNodes(lNodes);
+    for (size_t n = 0; n < lMerged.size(); n++)
+    {
+        FbxNode* lNode = lNodes[lMerged[n]];
+        FbxMesh* lMesh = lNode->GetMesh();
+
+        int lIndex = pFile2.FindMesh(lNode->GetName());
+        if (lIndex < 0)
+        {
+            UI_Printf("------- ERROR! Mesh %s has no smooth mesh of the same name! -------", lNode->GetName());
+            continue;
+        }
+
+        // the index correspondence needs the same topology
+        const MeshView& lView2 = pFile2.GetMesh(lIndex).mView;
+        if (pOptions.mCorrespondence == eCorrespondIndex &&
+            (lMesh->GetControlPointsCount() != lView2.mControlPointCount || lMesh->GetPolygonCount() != lView2.mPolygonCount ||
+             lMesh->GetPolygonVertexCount() != lView2.mPolygonStarts[lView2.mPolygonCount]))
+        {
+            UI_Printf("------- ERROR! Input Mesh %s don't match! ---------------------------", lNode->GetName());
+            continue;
+        }
+
+        std::vector<int> lMeshMatches;
+        if (!PrepareMesh(lNode, lView2, pOptions, lPool.get(), lMeshMatches)) continue;
+
+        lTasks.push_back(lNode);
+        lSources.push_back(&pFile2.GetMesh(lIndex));
+        lMatches.push_back(std::vector<int>());
+        lMatches.back().swap(lMeshMatches);
+    }
+
+    RunMeshTransfers(lPool.get(), lTasks, [&](int pTask)
+    {
+        MeshTransfer* lTransfer = new MeshTransfer(lTasks[pTask]->GetMesh(), lSources[pTask]->mView, lMatches[pTask], pOptions.mOutput, pOptions.mPackBits);
+        std::vector<int>().swap(lMatches[pTask]);
+        return lTransfer;
+    }, pOptions, pWritten);
+}
+
+std::string GetNodePath(FbxNode* pNode)
+{
+    std::string lPath;
+    for (FbxNode* lNode = pNode; lNode && lNode->GetParent(); lNode = lNode->GetParent())
+        lPath = lNode == pNode ? std::string(lNode->GetName()) : std::string(lNode->GetName()) + "/" + lPath;
+    return lPath;
+}
+
+void ProcessSceneSidecar(
+                         FbxScene* pScene,
+                         const NormalSidecarFile& pFile2,
+                         const MergeOptions& pOptions,
+                         std::set<FbxMesh*>* pWritten
+                         )
+{
+    std::unique_ptr<WorkStealingPool> lPool(CreateMeshPool(pOptions));
+
+    std::vector<FbxNode*> lNodes;
+    CollectMeshNodes(pScene->GetRootNode(), lNodes);
+
+    std::vector<FbxNode*> lTasks;
+    std::vector<int> lSources;
+    std::vector<int> lMerged = FindMergedNodes(lNodes);
+    for (size_t n = 0; n < lMerged.size(); n++)
+    {
+        FbxNode* lNode = lNodes[lMerged[n]];
+        FbxMesh* lMesh = lNode->GetMesh();
+
+        std::string lPath = GetNodePath(lNode);
+        int lIndex = pFile2.FindMesh(lPath);
+        if (lIndex < 0)
+        {
+            UI_Printf("------- ERROR! Mesh %s has no smooth mesh at the same path! -------", lPath.c_str());
+            continue;
+        }
+
+        // the index correspondence needs the same topology
+        const MeshView& lView2 = pFile2.GetMesh(lIndex);
+        if (lMesh->GetControlPointsCount() != lView2.mControlPointCount || lMesh->GetPolygonCount() != lView2.mPolygonCount ||
+            lMesh->GetPolygonVertexCount() != pFile2.GetPolygonVertexCount(lIndex))
+        {
+            UI_Printf("------- ERROR! Input Mesh %s don't match! ---------------------------", lNode->GetName());
+            continue;
+        }
+
+        std::vector<int> lMatches;
+        if (!PrepareMesh(lNode, lView2, pOptions, lPool.get(), lMatches)) continue;
+
+        lTasks.push_back(lNode);
+        lSources.push_back(lIndex);
+    }
+
+    const std::vector<int> lNoMatches;
+    RunMeshTransfers(lPool.get(), lTasks, [&](int pTask)
+    {
+        return new MeshTransfer(lTasks[pTask]->GetMesh(), pFile2.GetMesh(lSources[pTask]), lNoMatches, pOptions.mOutput, pOptions.mPackBits);
+    }, pOptions, pWritten);
+}
+
+bool WriteSmoothSidecar(
+                        const MergeContext& pContext,
+                        const MergeOptions& pOptions,
+                        const char* pSmoothFile,
+                        const char* pSidecar
+                        )
+{
+    FbxScene* lScene = FbxScene::Create(pContext.mSdkManager, "");
+    if (!LoadScene(pContext.mSdkManager, lScene, pSmoothFile, pOptions.mImportProfile2))
+    {
+        UI_Printf("------- ERROR! %s can't be imported -------", pSmoothFile);
+        lScene->Destroy();
+        return false;
+    }
+
+    std::vector<FbxNode*> lNodes;
+    CollectMeshNodes(lScene->GetRootNode(), lNodes);
+
+    // the arrays stay locked until the file is written, once per mesh so that the nodes
+    // of an instanced mesh share them
+    std::vector<std::unique_ptr<LayerElementSpan<FbxVector4> > > lSpans;
+    std::map<FbxMesh*, LayerElementSpan<FbxVector4>*> lLocked;
+    std::vector<NormalSidecarMesh> lMeshes;
+    for (size_t i = 0; i < lNodes.size(); i++)
+    {
+        FbxMesh* lMesh = lNodes[i]->GetMesh();
+        FbxGeometryElementNormal* lNormals = lMesh ? lMesh->GetElementNormal(0) : NULL;
+        if (lNormals == nullptr || GetElementCount(lMesh, lNormals->GetMappingMode()) < 0)
+        {
+            UI_Printf("Sidecar: mesh %s has no normals the merge can read, it is left out", lNodes[i]->GetName());
+            continue;
+        }
+        LayerElementSpan<FbxVector4>*& lSpan = lLocked[lMesh];
+        if (lSpan == NULL)
+        {
+            lSpans.push_back(std::unique_ptr<LayerElementSpan<FbxVector4> >(new LayerElementSpan<FbxVector4>(lNormals, FbxLayerElementArray::eReadLock)));
+            lSpan = lSpans.back().get();
+        }
+
+        NormalSidecarMesh lSidecarMesh;
+        lSidecarMesh.mPath               = GetNodePath(lNodes[i]);
+        lSidecarMesh.mControlPointCount  = lMesh->GetControlPointsCount();
+        lSidecarMesh.mPolygonCount       = lMesh->GetPolygonCount();
+        lSidecarMesh.mPolygonVertexCount = lMesh->GetPolygonVertexCount();
+        lSidecarMesh.mNormals            = GetElementView(lNormals, *lSpan);
+        lMeshes.push_back(lSidecarMesh);
+    }
+
+    std::string lError;
+    bool lStatus = WriteNormalSidecar(pSidecar, lMeshes, lError);
+    if (lStatus) UI_Printf("Sidecar: %d meshes of %s written to %s", int(lMeshes.size()), pSmoothFile, pSidecar);
+    else         UI_Printf("------- ERROR! Sidecar: %s -------", lError.c_str());
+
+    lSpans.clear();
+    lScene->Destroy();
+    return lStatus;
+}
+
+// replaces the direct array of pElement by its distinct vectors and an index array, when
+// it makes the element smaller. Returns the number of vectors stored.
+static int CompactVectorElement(FbxLayerElementTemplate<FbxVector4>* pElement, double pTolerance, WorkStealingPool* pPool)
+{
+    std::vector<int> lIndex, lFirst;
+    std::vector<FbxVector4> lValues;
+    {
+        LayerElementSpan<FbxVector4> lSpan(pElement, FbxLayerElementArray::eReadLock);
+        int lCount = lSpan.GetDirectCount();
+        if (lSpan.GetDirect() == nullptr) return lCount;
+
+        // an index costs an int per element, a vector 4 doubles
+        int lDistinct = CompactElement(lSpan.GetDirect()->mData, lCount, 4, 4, pTolerance, pPool, lIndex, lFirst);
+        if (size_t(lCount - lDistinct) * sizeof(FbxVector4) <= size_t(lCount) * sizeof(int)) return lCount;
+
+        lValues.resize(lDistinct);
+        for (int i = 0; i < lDistinct; i++) lValues[i] = lSpan.GetDirect()[lFirst[i]];
+    }
+
+    FbxLayerElementArrayTemplate<FbxVector4>& lDirectArray = pElement->GetDirectArray();
+    lDirectArray.SetCount(int(lValues.size()));
+    FbxVector4* lDirect = lDirectArray.GetLocked(FbxLayerElementArray::eWriteLock);
+    std::copy(lValues.begin(), lValues.end(), lDirect);
+    lDirectArray.Release(&lDirect);
+
+    FbxLayerElementArrayTemplate<int>& lIndexArray = pElement->GetIndexArray();
+    lIndexArray.SetCount(int(lIndex.size()));
+    int* lIndices = lIndexArray.GetLocked(FbxLayerElementArray::eWriteLock);
+    std::copy(lIndex.begin(), lIndex.end(), lIndices);
+    lIndexArray.Release(&lIndices);
+
+    pElement->SetReferenceMode(FbxLayerElement::eIndexToDirect);
+    return int(lValues.size());
+}
+
+void CompactTangentElements(
+                            FbxScene* pScene,
+                            const std::set<FbxMesh*>& pMeshes,
+                            double pTolerance,
+                            WorkStealingPool* pPool
+                            )
+{
+    std::vector<FbxNode*> lNodes;
+    CollectMeshNodes(pScene->GetRootNode(), lNodes);
+
+    // the elements change size, so the meshes are compacted one after the other
+    int lMeshCount = 0, lCount = 0, lDistinct = 0;
+    std::set<FbxMesh*> lSeen;
+    for (size_t n = 0; n < lNodes.size(); n++)
+    {
+        FbxMesh* lMesh = lNodes[n]->GetMesh();
+        if (pMeshes.count(lMesh) == 0 || !lSeen.insert(lMesh).second) continue;
+
+        FbxLayerElementTemplate<FbxVector4>* lElements[2] = { lMesh->GetElementTangent(0), lMesh->GetElementBinormal(0) };
+        bool lIndexed = false;
+        for (int e = 0; e < 2; e++)
+        {
+            if (lElements[e] == nullptr || lElements[e]->GetReferenceMode() != FbxLayerElement::eDirect ||
+                lElements[e]->GetMappingMode() == FbxLayerElement::eAllSame) continue;
+
+            int lElementCount = lElements[e]->GetDirectArray().GetCount();
+            int lStored = CompactVectorElement(lElements[e], pTolerance, pPool);
+            lIndexed = lIndexed || lStored < lElementCount;
+            lCount += lElementCount;
+            lDistinct += lStored;
+        }
+        lMeshCount += lIndexed;
+    }
+    UI_Printf("Compaction: %d tangents and binormals stored as %d vectors, %d meshes indexed", lCount, lDistinct, lMeshCount);
+}
+
+bool SavePatchedScene(
+                      FbxScene* pScene,
+                      const BinaryFbxFile& pFile,
+                      const char* pFilename,
+                      WorkStealingPool* pPool
+                      )
+{
+    std::vector<FbxNode*> lNodes;
+    CollectMeshNodes(pScene->GetRootNode(), lNodes);
+
+    // a mesh instanced by several nodes is written once, the spans keep its arrays locked until the file is written
+    std::vector<BinaryFbxTangents> lLayers;
+    std::vector<std::unique_ptr<LayerElementSpan<FbxVector4> > > lSpans;
+    std::map<int, FbxNode*> lGeometries;
+    std::set<FbxMesh*> lSeen;
+    for (size_t n = 0; n < lNodes.size(); n++)
+    {
+        FbxNode* lNode = lNodes[n];
+        FbxMesh* lMesh = lNode->GetMesh();
+        if (!lSeen.insert(lMesh).second) continue;
+
+        FbxGeometryElementTangent* lTangentElement = lMesh->GetElementTangent(0);
+        FbxGeometryElementBinormal* lBinormalElement = lMesh->GetElementBinormal(0);
+        if (lTangentElement == nullptr || lBinormalElement == nullptr ||
+            GetElementCount(lMesh, lTangentElement->GetMappingMode()) < 0 || GetElementCount(lMesh, lBinormalElement->GetMappingMode()) < 0)
+            continue;
+
+        int lIndex = pFile.FindMesh(lNode->GetName());
+        const MeshView* lView = lIndex >= 0 ? &pFile.GetMesh(lIndex).mView : NULL;
+        if (lView == NULL || lView->mControlPointCount != lMesh->GetControlPointsCount() || lView->mPolygonCount != lMesh->GetPolygonCount() ||
+            lView->mPolygonStarts[lView->mPolygonCount] != lMesh->GetPolygonVertexCount())
+        {
+            UI_Printf("Patch writer: mesh %s has no geometry of the same name and topology in the lighting file", lNode->GetName());
+            return false;
+        }
+        std::pair<std::map<int, FbxNode*>::iterator, bool> lGeometry = lGeometries.insert(std::make_pair(lIndex, lNode));
+        if (!lGeometry.second)
+        {
+            UI_Printf("Patch writer: meshes %s and %s find the same geometry in the lighting file", lGeometry.first->second->GetName(), lNode->GetName());
+            return false;
+        }
+
+        lSpans.push_back(std::unique_ptr<LayerElementSpan<FbxVector4> >(new LayerElementSpan<FbxVector4>(lTangentElement, FbxLayerElementArray::eReadLock)));
+        lSpans.push_back(std::unique_ptr<LayerElementSpan<FbxVector4> >(new LayerElementSpan<FbxVector4>(lBinormalElement, FbxLayerElementArray::eReadLock)));
+
+        BinaryFbxTangents lMeshLayers;
+        lMeshLayers.mMesh         = lIndex;
+        lMeshLayers.mTangentName  = lTangentElement->GetName();
+        lMeshLayers.mBinormalName = lBinormalElement->GetName();
+        lMeshLayers.mTangents     = GetElementView(lTangentElement, *lSpans[lSpans.size() - 2]);
+        lMeshLayers.mBinormals    = GetElementView(lBinormalElement, *lSpans.back());
+        lLayers.push_back(lMeshLayers);
+    }
+
+    std::string lError;
+    if (!WritePatchedFbx(pFile, lLayers, pFilename, pPool, lError))
+    {
+        UI_Printf("Patch writer: %s", lError.c_str());
+        return false;
+    }
+    UI_Printf("Patch writer: %d meshes patched into a copy of the lighting file", int(lLayers.size()));
+    return true;
+}
+
+// the locked elements of the meshes of SaveGltfScene, kept alive until the file is written
+struct GltfSpans
+{
+    std::vector<std::unique_ptr<LayerElementSpan<FbxVector4> > > mVectors;
+    std::vector<std::unique_ptr<LayerElementSpan<FbxVector2> > > mUVs;
+    std::vector<std::unique_ptr<LayerElementSpan<FbxColor> > >   mColors;
+    std::vector<std::unique_ptr<std::vector<int> > >             mArrays;    // polygon starts and materials
+};
+
+// appends the attribute pName of pElement to pMesh if its mapping is supported
+template <class T>
+static void AddGltfAttribute(
+                             FbxMesh* pMesh,
+                             FbxLayerElementTemplate<T>* pElement,
+                             const char* pName,
+                             int pComponents,
+                             std::vector<std::unique_ptr<LayerElementSpan<T> > >& pSpans,
+                             GltfMesh& pGltfMesh
+                             )
+{
+    if (pElement == nullptr || GetElementCount(pMesh, pElement->GetMappingMode()) < 0) return;
+
+    pSpans.push_back(std::unique_ptr<LayerElementSpan<T> >(new LayerElementSpan<T>(pElement, FbxLayerElementArray::eReadLock)));
+    pGltfMesh.mAttributes.push_back(GetGltfAttribute(pName, GetElementView(pElement, *pSpans.back()), pComponents, true));
+}
+
+bool SaveGltfScene(
+                   FbxScene* pScene,
+                   const MergeOptions& pOptions,
+                   const std::vector<MergeSource>& pSources,
+                   const char* pFilename,
+                   WorkStealingPool* pPool
+                   )
+{
+    // glTF is Y up, in meters
+    if (pScene->GetGlobalSettings().GetAxisSystem() != FbxAxisSystem::OpenGL) FbxAxisSystem::OpenGL.ConvertScene(pScene);
+    if (pScene->GetGlobalSettings().GetSystemUnit() != FbxSystemUnit::m)     FbxSystemUnit::m.ConvertScene(pScene);
+    pScene->GetAnimationEvaluator()->Reset();
+
+    std::vector<FbxNode*> lNodes;
+    CollectMeshNodes(pScene->GetRootNode(), lNodes);
+
+    // the tangent basis of the encoded smooth normals, written by one source at most
+    bool lTangentSpace = false;
+    for (size_t i = 0; i < pSources.size(); i++)
+        lTangentSpace = lTangentSpace || (pSources[i].mOutput != eOutputTangent && pSources[i].mPackBits == 0);
+
+    GltfScene lGltfScene;
+    GltfSpans lSpans;
+    std::map<FbxMesh*, int> lMeshes;
+    std::map<FbxSurfaceMaterial*, int> lMaterials;
+    for (size_t n = 0; n < lNodes.size(); n++)
+    {
+        FbxNode* lNode = lNodes[n];
+        FbxMesh* lMesh = lNode->GetMesh();
+
+        GltfNode lGltfNode;
+        lGltfNode.mName = lNode->GetName();
+        FbxAMatrix lTransform = GetWorldTransform(lNode);
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++) lGltfNode.mMatrix[4 * r + c] = lTransform.Get(r, c);
+
+        std::pair<std::map<FbxMesh*, int>::iterator, bool> lInserted = lMeshes.insert(std::make_pair(lMesh, int(lGltfScene.mMeshes.size())));
+        lGltfNode.mMesh = lInserted.first->second;
+        lGltfScene.mNodes.push_back(lGltfNode);
+        if (!lInserted.second) continue;
+
+        lGltfScene.mMeshes.push_back(GltfMesh());
+        GltfMesh& lGltfMesh = lGltfScene.mMeshes.back();
+        lGltfMesh.mName = lNode->GetName();
+        lGltfMesh.mPolygonMaterials = NULL;
+        lSpans.mArrays.push_back(std::unique_ptr<std::vector<int> >(new std::vector<int>));
+        GetMeshView(lMesh, *lSpans.mArrays.back(), lGltfMesh.mView);
+
+        AddGltfAttribute(lMesh, lMesh->GetElementNormal(0), "NORMAL", 3, lSpans.mVectors, lGltfMesh);
+        if (lTangentSpace)
+            AddGltfAttribute(lMesh, lMesh->GetElementTangent(0), "TANGENT", 4, lSpans.mVectors, lGltfMesh);
+
+        // the V of glTF goes down
+        for (int i = 0; i < lMesh->GetElementUVCount(); i++)
+        {
+            FbxGeometryElementUV* lUVElement = lMesh->GetElementUV(i);
+            if (strcmp(lUVElement->GetName(), kSmoothNormalLayerName) == 0) continue;
+
+            size_t lCount = lGltfMesh.mAttributes.size();
+            AddGltfAttribute(lMesh, lUVElement, "TEXCOORD_0", 2, lSpans.mUVs, lGltfMesh);
+            if (lGltfMesh.mAttributes.size() > lCount)
+            {
+                lGltfMesh.mAttributes.back().mScale[1]  = -1.0;
+                lGltfMesh.mAttributes.back().mOffset[1] = 1.0;
+            }
+            break;
+        }
+
+        for (size_t i = 0; i < pSources.size(); i++)
+        {
+            std::string lName = "_SMOOTH_NORMAL";
+            if (i > 0) lName += "_" + std::to_string(i);
+
+            if (pSources[i].mOutput == eOutputTangent)
+                AddGltfAttribute(lMesh, lMesh->GetElementTangent(0), lName.c_str(), 3, lSpans.mVectors, lGltfMesh);
+            else if (pSources[i].mOutput == eOutputUV)
+                AddGltfAttribute(lMesh, lMesh->GetElementUV(kSmoothNormalLayerName), lName.c_str(), 2, lSpans.mUVs, lGltfMesh);
+            else
+                AddGltfAttribute(lMesh, GetEncodedColorElement(lMesh), lName.c_str(), pSources[i].mPackBits > 0 ? 2 : 3, lSpans.mColors, lGltfMesh);
+        }
+
+        // the polygons of the materials of the node
+        FbxGeometryElementMaterial* lMaterialElement = lMesh->GetElementMaterial(0);
+        if (lMaterialElement == nullptr || lNode->GetMaterialCount() == 0) continue;
+        for (int i = 0; i < lNode->GetMaterialCount(); i++)
+        {
+            FbxSurfaceMaterial* lMaterial = lNode->GetMaterial(i);
+            std::pair<std::map<FbxSurfaceMaterial*, int>::iterator, bool> lMaterialIndex =
+                lMaterials.insert(std::make_pair(lMaterial, int(lGltfScene.mMaterials.size())));
+            if (lMaterialIndex.second) lGltfScene.mMaterials.push_back(lMaterial ? lMaterial->GetName() : "");
+            lGltfMesh.mMaterials.push_back(lMaterialIndex.first->second);
+        }
+
+        FbxLayerElementArrayTemplate<int>& lIndexArray = lMaterialElement->GetIndexArray();
+        int lIndexCount = lIndexArray.GetCount();
+        if (lMaterialElement->GetMappingMode() == FbxLayerElement::eByPolygon && lIndexCount >= lGltfMesh.mView.mPolygonCount)
+        {
+            int* lIndex = lIndexArray.GetLocked(FbxLayerElementArray::eReadLock);
+            lSpans.mArrays.push_back(std::unique_ptr<std::vector<int> >(new std::vector<int>(lIndex, lIndex + lGltfMesh.mView.mPolygonCount)));
+            lIndexArray.Release(&lIndex);
+            lGltfMesh.mPolygonMaterials = &(*lSpans.mArrays.back())[0];
+        }
+        else
+        {
+            // all the polygons use the first material of the index
+            int lFirst = lIndexCount > 0 ? lIndexArray.GetAt(0) : 0;
+            lSpans.mArrays.push_back(std::unique_ptr<std::vector<int> >(new std::vector<int>(lGltfMesh.mView.mPolygonCount, lFirst)));
+            lGltfMesh.mPolygonMaterials = lSpans.mArrays.back()->empty() ? NULL : &(*lSpans.mArrays.back())[0];
+        }
+    }
+
+    std::string lError;
+    GltfStats lStats;
+    if (!WriteGlb(lGltfScene, pOptions.mQuantization, pFilename, pPool, lError, &lStats))
+    {
+        UI_Printf("GLB writer: %s", lError.c_str());
+        return false;
+    }
+    UI_Printf("GLB writer: %d meshes, %d nodes, %d vertices, %d triangles, %.1f MB", int(lGltfScene.mMeshes.size()),
+              int(lGltfScene.mNodes.size()), lStats.mVertexCount, lStats.mTriangleCount, lStats.mFileBytes / 1048576.0);
+    return true;
 }
 
 // Get the filters for the <Open file> dialog
@@ -12,16 +12,271 @@
 // use the fbxsdk.h
 #include <fbxsdk.h>
 
-void ImportExport(
+#include "LayerElementAccess.h"
+#include "BinaryFbx.h"
+#include "BinaryFbxPatch.h"
+#include "GltfWriter.h"
+#include "MergeCore.h"
+#include "NormalSidecar.h"
+#include "Correspondence.h"
+#include "SmoothNormals.h"
+#include "TangentSpace.h"
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// the SDK objects used by one merge job.
+// A manager is not thread safe, each worker thread owns its own context.
+struct MergeContext
+{
+    FbxManager*    mSdkManager;
+    FbxIOSettings* mIOSettings;
+};
+
+// where the smooth normals are written
+enum EOutputChannel
+{
+    eOutputTangent,     // raw smooth normals in the tangent layer, binormal = normal x smooth normal
+    eOutputUV,          // a generated tangent basis in the tangent layer, the smooth normals in that
+                        // basis in the UV set kSmoothNormalLayerName (x, y)
+    eOutputColor        // same, in the vertex color layer kSmoothNormalLayerName (xyz * 0.5 + 0.5)
+};
+
+// with mPackBits, eOutputUV and eOutputColor instead hold the octahedral encoding of the
+// smooth normals (PackNormals) in the mapping of the normals, and the tangent layer is
+// left as it is: x, y in the UV set, or red, green in the vertex color layer
+
+// what LoadScene reads of a file
+enum EImportProfile
+{
+    eImportFull,        // everything
+    eImportStatic,      // no animation, gobos, characters, constraints, audio
+    eImportGeometry     // same, and no materials, textures, skins, shapes, tangents,
+                        // vertex colors or smoothing: the meshes, UVs and normals
+};
+
+// how the merged scene is written
+enum EOutputWriter
+{
+    eWriterSdk,         // the SDK exports the scene
+    eWriterPatch,       // eOutputTangent to the native binary format: the tangent layers are patched into
+                        // a copy of the lighting file (SavePatchedScene), other cases go to the SDK
+    eWriterGltf         // the meshes go to a GLB file (SaveGltfScene), the smooth normals in the
+                        // attribute _SMOOTH_NORMAL
+};
+
+// name of the UV set and of the vertex color layer of eOutputUV and eOutputColor
+extern const char* kSmoothNormalLayerName;
+
+// version of the tool in the settings of a merge, changed with the output of a merge
+extern const char* kNormalMergerVersion;
+
+// options of a merge
+struct MergeOptions
+{
+    int             mMeshThreads;       // threads merging the meshes of a scene, 1 for the serial path, 0 for all cores
+    ECorrespondence mCorrespondence;    // how the lighting vertices find their smooth vertex
+    double          mWeldTolerance;     // max distance of matched or welded control points
+    ESmoothWeighting mSmoothWeighting;  // of the generated smooth normals, without a smooth scene
+    EOutputChannel  mOutput;
+    int             mPackBits;          // 0 for the tangent space encoding, 8 or 16 for octahedral packing
+    EImportProfile  mImportProfile;     // of the lighting scene, which is written back: eImportFull
+                                        // unless mWriter is eWriterPatch
+    EImportProfile  mImportProfile2;    // of the smooth scene, only its normals are read
+    bool            mNativeReader2;     // reads a binary smooth file with BinaryFbxFile instead of the SDK,
+                                        // the meshes being paired by node name (ProcessSceneNative)
+    EOutputWriter   mWriter;
+    EGltfQuantization mQuantization;    // of the attributes of eWriterGltf
+    double          mCompactTolerance;  // tolerance of CompactTangentElements after the merge, negative to keep
+                                        // the tangents and binormals direct
+    std::string     mMeshCacheDirectory;    // the outputs of every mesh are stored there and read back while its
+                                            // fingerprint is the same (MeshCache.h), empty for none
+
+    MergeOptions() : mMeshThreads(1), mCorrespondence(eCorrespondIndex), mWeldTolerance(1e-4), mSmoothWeighting(eWeightArea),
+                     mOutput(eOutputTangent), mPackBits(0), mImportProfile(eImportFull), mImportProfile2(eImportGeometry),
+                     mNativeReader2(false), mWriter(eWriterSdk), mQuantization(eGltfFloat), mCompactTolerance(-1.0) {}
+};
+
+// seconds spent in each phase of an ImportExport call
+struct MergeTimings
+{
+    double mImport;         // lighting scene
+    double mImport2;        // smooth normal scenes or files, 0 when the normals are generated;
+                            // the time waited for them once the lighting scene is imported
+    double mMerge;
+    double mExport;
+
+    MergeTimings() : mImport(0.0), mImport2(0.0), mMerge(0.0), mExport(0.0) {}
+};
+
+// an input of smooth normals and the channel they are written to
+struct MergeSource
+{
+    std::string    mFileName;       // empty to compute the smooth normals from the lighting scene
+    EOutputChannel mOutput;
+    int            mPackBits;       // as MergeOptions::mPackBits
+
+    MergeSource() : mOutput(eOutputTangent), mPackBits(0) {}
+};
+
+// a mesh node of the lighting scene and the matching node of the smooth scene
+struct MeshPair
+{
+    FbxNode* mNode;
+    FbxNode* mNode2;
+};
+
+bool ImportExport(
+                    const MergeContext& pContext,
+                    const MergeOptions& pOptions,
+                    const char *ImportFileName, 
+                    const char* ImportFileName2,
+                    const char* ExportFileName, 
+                    int pWriteFileFormat,
+                    MergeTimings* pTimings = NULL
+                 );
+
+// same for several smooth inputs: the lighting file is imported and exported once,
+// every source being merged in its own channel, in order (pOptions.mOutput and
+// mPackBits are those of the source). The sources are mapped or read natively at the
+// same time, the ones that need the SDK are imported after it with pContext.
+bool ImportExport(
+                    const MergeContext& pContext,
+                    const MergeOptions& pOptions,
+                    const char *ImportFileName, 
+                    const std::vector<MergeSource>& pSources,
+                    const char* ExportFileName, 
+                    int pWriteFileFormat,
+                    MergeTimings* pTimings = NULL
+                 );
+
+bool ImportExport(
                     const char *ImportFileName, 
                     const char* ImportFileName2,
                     const char* ExportFileName, 
                     int pWriteFileFormat
                  );
 
+struct LoadedSource;
+
+// the scenes of a merge between the phases of ImportExport, which runs ImportMergeScenes,
+// MergeLoadedScenes and ExportMergedScene in a row. A pipeline runs the phases of different
+// jobs at the same time on different threads: the phases of a job then use the same context,
+// never two of them at the same time.
+struct LoadedMerge
+{
+    FbxScene*    mScene;        // lighting scene, NULL once exported
+    std::vector<std::unique_ptr<LoadedSource> > mSources;   // empty once merged
+    MergeTimings mTimings;
+
+    LoadedMerge();
+    ~LoadedMerge();             // destroys what is still loaded
+
+private:
+    LoadedMerge(const LoadedMerge&);
+    LoadedMerge& operator=(const LoadedMerge&);
+};
+
+// checks that the lighting scene imported with pOptions.mImportProfile can be written back:
+// a static or geometry import keeps only what the patch writer rewrites, so it needs
+// eWriterPatch, eOutputTangent sources and a binary FBX output (pBinary).
+// Returns false with the reason in pError.
+bool IsImportProfileWritable(
+                             const MergeOptions& pOptions,
+                             const std::vector<MergeSource>& pSources,
+                             bool pBinary,
+                             std::string& pError
+                            );
+
+// imports the lighting file and the sources of a merge into pMerge, the sources read
+// without the SDK on threads and the other ones with pContext. Returns false, with the
+// reason printed and nothing left loaded, if the sources are not valid, the merged scene
+// could not be written in pWriteFileFormat (IsImportProfileWritable) or an import failed.
+bool ImportMergeScenes(
+                       const MergeContext& pContext,
+                       const MergeOptions& pOptions,
+                       const char* pImportFileName,
+                       const std::vector<MergeSource>& pSources,
+                       int pWriteFileFormat,
+                       LoadedMerge& pMerge
+                      );
+
+// merges the sources of pMerge into its scene, in order, then destroys them
+void MergeLoadedScenes(
+                       const MergeOptions& pOptions,
+                       const std::vector<MergeSource>& pSources,
+                       LoadedMerge& pMerge
+                      );
+
+// writes the scene of pMerge to pExportFileName, then destroys it. pImportFileName is the
+// lighting file, copied by the patch writer. Returns false if the export failed.
+bool ExportMergedScene(
+                       const MergeContext& pContext,
+                       const MergeOptions& pOptions,
+                       const std::vector<MergeSource>& pSources,
+                       const char* pImportFileName,
+                       const char* pExportFileName,
+                       int pWriteFileFormat,
+                       LoadedMerge& pMerge
+                      );
+
+// checks that pSources can be merged in the same scene: one source per channel, the
+// packing on UV and color only, and the tangent layer written by one source at most
+// (eOutputTangent, or the tangent basis of an unpacked UV or color output).
+// Returns false with the reason in pError.
+bool AreMergeSourcesValid(
+                          const std::vector<MergeSource>& pSources,
+                          std::string& pError
+                         );
+
+// writes the smooth normals of pSmoothFile, imported with pOptions.mImportProfile2, to the
+// sidecar pSidecar (NormalSidecar.h): one section per mesh node, under its node path.
+// A smooth input which is a sidecar is mapped instead of imported (ProcessSceneSidecar).
+// Returns false, with the reason printed, if the file can't be imported or written.
+bool WriteSmoothSidecar(
+                        const MergeContext& pContext,
+                        const MergeOptions& pOptions,
+                        const char* pSmoothFile,
+                        const char* pSidecar
+                       );
+
+// names of the nodes from the child of the root node to pNode, separated by '/'
+std::string GetNodePath(FbxNode* pNode);
+
+// reads the channels of a comma separated list, tangent, uv or color, the last two
+// optionally followed by :oct8 or :oct16, in the channels of pSources. Returns false
+// if one of them is not a channel.
+bool ParseMergeChannels(
+                        const char* pText,
+                        std::vector<MergeSource>& pSources
+                       );
+
+// the channel of pSource in the syntax of ParseMergeChannels
+std::string GetMergeChannelName(const MergeSource& pSource);
+
+// text of what the output of ImportExport depends on besides its input files: the
+// tool, SDK and kernel versions, the writer format and the options. pSources is empty
+// for the single source of pOptions. Keys the result cache (ResultCache.h).
+std::string GetMergeSettingsText(
+                                 const MergeOptions& pOptions,
+                                 const std::vector<MergeSource>& pSources,
+                                 int pWriteFileFormat
+                                );
+
 
 void InitializeSdkManager();
 
+// creates and destroys the managers one at a time, they can be called from any thread
+void InitializeMergeContext(
+                            MergeContext& pContext
+                           );
+
+void DestroyMergeContext(
+                         MergeContext& pContext
+                        );
+
 void DestroySdkObjects(
                             FbxManager* pSdkManager,
 							bool pExitStatus
@@ -38,9 +293,14 @@ const char *GetFileFormatExt(
 bool LoadScene(
                 FbxManager* pSdkManager, 
                 FbxScene* pScene, 
-                const char* pFilename
+                const char* pFilename,
+                EImportProfile pProfile = eImportFull
               );
 
+const char* GetImportProfileName(EImportProfile pProfile);
+
+const char* GetOutputWriterName(EOutputWriter pWriter);
+
 bool SaveScene(
                 FbxManager* pSdkManager, 
                 FbxScene* pScene, 
@@ -49,8 +309,200 @@ bool SaveScene(
                 bool pEmbedMedia
               );
 
-void ProcessNode(FbxNode* pNode, FbxNode* pNode2);
-void ProcessMesh(FbxNode* pNode, FbxNode* pNode2);
+// replaces the direct tangent and binormal elements of the meshes of pScene by their
+// distinct vectors (CompactElement, within pTolerance) and an eIndexToDirect index array,
+// when that makes an element smaller. Only the meshes of pMeshes, whose elements the
+// transfers wrote, are compacted: the tangents of the other meshes are user data. Called
+// once the transfers are done; the meshes are compacted one after the other, each one on
+// pPool, NULL running on the calling thread.
+void CompactTangentElements(
+                            FbxScene* pScene,
+                            const std::set<FbxMesh*>& pMeshes,
+                            double pTolerance,
+                            WorkStealingPool* pPool
+                           );
+
+// writes the tangent and binormal layers of the meshes of pScene into a copy of pFile,
+// the binary file pScene was imported from (WritePatchedFbx), instead of exporting the
+// scene: everything else keeps the bytes of the file. The meshes pair with the
+// geometries of the file by node name and must have their topology; the meshes
+// without tangents are left as they are. Returns false, with the reason printed,
+// if a mesh can't be paired or the file can't be written.
+bool SavePatchedScene(
+                      FbxScene* pScene,
+                      const BinaryFbxFile& pFile,
+                      const char* pFilename,
+                      WorkStealingPool* pPool
+                     );
+
+// writes the meshes of pScene, moved to the Y up axis system and to meters, to the GLB
+// file pFilename (WriteGlb), one root node per mesh node with its world transform.
+// The attributes are NORMAL, TANGENT (tangent space encoded smooth normals only),
+// TEXCOORD_0 (the first UV set which is not kSmoothNormalLayerName, V flipped) and
+// _SMOOTH_NORMAL, the channel of the first source of pSources: xyz of the tangent layer,
+// or the encoded or packed values of the UV set or the vertex color layer; the channels
+// of the next sources go to _SMOOTH_NORMAL_1, _SMOOTH_NORMAL_2... An instanced mesh is
+// written once, with the materials of its first node.
+// Returns false, with the reason printed, if the file can't be written.
+bool SaveGltfScene(
+                   FbxScene* pScene,
+                   const MergeOptions& pOptions,
+                   const std::vector<MergeSource>& pSources,
+                   const char* pFilename,
+                   WorkStealingPool* pPool
+                  );
+
+// merges the normals of all the meshes of pScene2 into pScene. The meshes whose
+// tangents and binormals are written are added to pWritten, if not NULL; the same for
+// the other ProcessScene functions.
+void ProcessScene(
+                  FbxScene* pScene,
+                  FbxScene* pScene2,
+                  const MergeOptions& pOptions,
+                  std::set<FbxMesh*>* pWritten = NULL
+                 );
+
+void CollectMeshPairs(
+                      FbxNode* pNode,
+                      FbxNode* pNode2,
+                      std::vector<MeshPair>& pPairs
+                     );
+
+// the closest point path: every mesh of pScene samples the smooth normals on the
+// surface of the mesh of pScene2 with the same node name, or on all the meshes of
+// pScene2 if there is none. The hierarchies and the topologies may differ.
+void ProcessSceneClosest(
+                         FbxScene* pScene,
+                         FbxScene* pScene2,
+                         const MergeOptions& pOptions,
+                         std::set<FbxMesh*>* pWritten = NULL
+                        );
+
+void CollectMeshNodes(
+                      FbxNode* pNode,
+                      std::vector<FbxNode*>& pNodes
+                     );
+
+// the path without a smooth scene: the smooth normals of every mesh of pScene are
+// computed from the mesh itself (ComputeSmoothNormals) and written in its tangents
+void ProcessSceneGenerated(
+                           FbxScene* pScene,
+                           const MergeOptions& pOptions,
+                           std::set<FbxMesh*>* pWritten = NULL
+                          );
+
+// the path of the native reader: every mesh of pScene takes the normals of the mesh of
+// pFile2 under the same node name, by index or by position (eCorrespondClosestPoint
+// needs the transforms of the smooth scene and is not read natively)
+void ProcessSceneNative(
+                        FbxScene* pScene,
+                        const BinaryFbxFile& pFile2,
+                        const MergeOptions& pOptions,
+                        std::set<FbxMesh*>* pWritten = NULL
+                       );
+
+// the path of a sidecar: every mesh of pScene takes the normals of the section of
+// pFile2 at its node path, by index only, the sidecar holding no positions
+void ProcessSceneSidecar(
+                         FbxScene* pScene,
+                         const NormalSidecarFile& pFile2,
+                         const MergeOptions& pOptions,
+                         std::set<FbxMesh*>* pWritten = NULL
+                        );
+
+// the locked arrays of a mesh prepared by PrepareMesh, seen through the core views.
+// Locking and releasing change the arrays, so transfers are created and destroyed
+// serially; Run() can be called in parallel for different meshes or disjoint ranges,
+// once Prepare() computed the tangent basis of the eOutputUV and eOutputColor outputs.
+// pPackBits is MergeOptions::mPackBits.
+class MeshTransfer
+{
+public:
+    // pMatches are the control point matches of PrepareMesh, empty for eCorrespondIndex
+    MeshTransfer(FbxMesh* pMesh, FbxMesh* pMesh2, const std::vector<int>& pMatches, EOutputChannel pOutput, int pPackBits);
+
+    // same, the smooth mesh and its normals being a core view which must outlive the transfer
+    MeshTransfer(FbxMesh* pMesh, const MeshView& pMesh2, const std::vector<int>& pMatches, EOutputChannel pOutput, int pPackBits);
+
+    // pValues are smooth normals computed for the lighting mesh, 4 doubles per element of
+    // pValueMapping: the mapping of the lighting normals, or eMapByControlPoint for by
+    // polygon-vertex normals. They are moved into the transfer.
+    MeshTransfer(FbxMesh* pMesh, std::vector<double>& pValues, EElementMapping pValueMapping, EOutputChannel pOutput, int pPackBits);
+
+    // pPool splits the faces of the mesh, NULL runs on the calling thread
+    void Prepare(WorkStealingPool* pPool);
+
+    // number of items of Run(): tangents or packed normals, or polygons for the tangent space outputs
+    int  GetCount() const { return mCount; }
+    int  GetPolygonCount() const { return mMesh.mPolygonCount; }
+    bool IsPacked() const { return mPackBits > 0; }
+    const char* GetName() const { return mName; }
+    FbxMesh* GetFbxMesh() const { return mFbxMesh; }
+
+    // true if Run() writes the tangent and binormal elements of the mesh
+    bool WritesTangents() const;
+
+    // returns the largest angle, in degrees, of the packed normals of the range, 0 if not packed
+    double Run(int pBegin, int pEnd) const;
+
+    // key of the outputs in the mesh cache: a hash of the geometry and the normals of the mesh,
+    // of the smooth normals read by its elements, of the UVs of the tangent basis and of the channel
+    std::string GetFingerprint() const;
+
+    // the arrays written by Run(), empty if there are none
+    void GetOutputs(std::vector<ElementOutput>& pOutputs) const;
+
+private:
+    MeshTransfer(FbxMesh* pMesh, FbxGeometryElementNormal* pSource, EOutputChannel pOutput, int pPackBits);
+
+    void InitializeSource(const MeshView& pMesh2, const std::vector<int>& pMatches);
+    void InitializeOutput(FbxMesh* pMesh);
+
+    LayerElementSpan<FbxVector4> mSource;
+    LayerElementSpan<FbxVector4> mNormal;
+    LayerElementSpan<FbxVector4> mTangent;
+    LayerElementSpan<FbxVector4> mBinormal;
+    LayerElementSpan<FbxVector2> mUV;               // first UV set, the encoded outputs only
+    LayerElementSpan<FbxVector2> mEncodedUV;
+    LayerElementSpan<FbxColor>   mEncodedColor;
+    EOutputChannel               mOutput;
+    int                          mPackBits;
+    const char*                  mName;             // of the node of the mesh, for the reports
+    FbxMesh*                     mFbxMesh;
+    ElementView                  mUVView;
+    std::vector<double>          mFrames;           // tangent basis of the encoded outputs
+    std::vector<int>             mPolygonStarts;
+    MeshView                     mMesh;
+    ElementView                  mSourceView;
+    std::vector<int>             mSourceIndex;      // composed index of the matched source elements
+    std::vector<double>          mSourceValues;     // sampled source normals
+    int                          mCount;
+};
+
+void ProcessNode(FbxNode* pNode, FbxNode* pNode2, const MergeOptions& pOptions, std::set<FbxMesh*>* pWritten = NULL);
+void ProcessMesh(FbxNode* pNode, FbxNode* pNode2, const MergeOptions& pOptions, std::set<FbxMesh*>* pWritten = NULL);
+
+bool PrepareMesh(
+                 FbxNode* pNode,
+                 FbxNode* pNode2,
+                 const MergeOptions& pOptions,
+                 WorkStealingPool* pPool,
+                 std::vector<int>& pMatches
+                );
+
+// same, the smooth mesh and its normals being a core view
+bool PrepareMesh(
+                 FbxNode* pNode,
+                 const MeshView& pMesh2,
+                 const MergeOptions& pOptions,
+                 WorkStealingPool* pPool,
+                 std::vector<int>& pMatches
+                );
+
+// pMeshCache is the directory of the mesh cache, NULL for none; the mesh is added to
+// pWritten, if not NULL, when its tangents and binormals are written
+void TransferMesh(FbxNode* pNode, FbxNode* pNode2, const std::vector<int>& pMatches, EOutputChannel pOutput, int pPackBits,
+                  const char* pMeshCache = NULL, std::set<FbxMesh*>* pWritten = NULL);
 
 void ReadNormal(FbxMesh* pMesh, int ctrlPointIndex, int vertexCounter, FbxVector4& OutNormal);
 void ReadTangent(FbxMesh* pMesh, int ctrlPointIndex, int vertexCounter, FbxVector4& OutTangent);
@@ -0,0 +1,64 @@
+// LayerElementAccess.h : locked raw access to the arrays of the FBX layer elements.
+//
+// GetAt/SetAt go through the SDK for every value. A LayerElementSpan locks the
+// direct array (and the index array of eIndexToDirect elements) once, gives
+// plain pointers to their memory, and releases the locks when it is destroyed.
+
+#pragma once
+
+// use the fbxsdk.h
+#include <fbxsdk.h>
+
+template <class T>
+class LayerElementSpan
+{
+public:
+    // pLockMode applies to the direct array, the index array is only read.
+    // A NULL pElement gives an empty span.
+    LayerElementSpan(
+                     FbxLayerElementTemplate<T>* pElement,
+                     FbxLayerElementArray::ELockMode pLockMode
+                     )
+        : mDirectArray(pElement ? &pElement->GetDirectArray() : NULL)
+        , mIndexArray(NULL)
+        , mDirect(NULL)
+        , mIndex(NULL)
+        , mDirectCount(pElement ? mDirectArray->GetCount() : 0)
+        , mIndexCount(0)
+    {
+        if( pElement == NULL ) return;
+
+        if( mDirectCount > 0 ) mDirect = mDirectArray->GetLocked(pLockMode);
+
+        if( pElement->GetReferenceMode() != FbxLayerElement::eDirect )
+        {
+            mIndexArray = &pElement->GetIndexArray();
+            mIndexCount = mIndexArray->GetCount();
+            if( mIndexCount > 0 ) mIndex = mIndexArray->GetLocked(FbxLayerElementArray::eReadLock);
+        }
+    }
+
+    ~LayerElementSpan()
+    {
+        if( mDirect ) mDirectArray->Release(&mDirect);
+        if( mIndex )  mIndexArray->Release(&mIndex);
+    }
+
+    T*         GetDirect() const      { return mDirect; }
+    int        GetDirectCount() const { return mDirectCount; }
+
+    // NULL for eDirect elements
+    const int* GetIndex() const       { return mIndex; }
+    int        GetIndexCount() const  { return mIndexCount; }
+
+private:
+    LayerElementSpan(const LayerElementSpan&);
+    LayerElementSpan& operator=(const LayerElementSpan&);
+
+    FbxLayerElementArrayTemplate<T>*   mDirectArray;
+    FbxLayerElementArrayTemplate<int>* mIndexArray;
+    T*                                 mDirect;
+    int*                               mIndex;
+    int                                mDirectCount;
+    int                                mIndexCount;
+};
@@ -0,0 +1,221 @@
+// MergeCore.cxx : FBX independent view of a mesh and the normal merge.
+
+#include "MergeCore.h"
+#include "MergeKernel.h"
+
+#include <cmath>
+#include <stddef.h>
+#include <vector>
+
+int GetElementCount(
+                    const MeshView& pMesh,
+                    EElementMapping pMapping
+                    )
+{
+    switch( pMapping )
+    {
+    case eMapByControlPoint:  return pMesh.mControlPointCount;
+    case eMapByPolygonVertex: return pMesh.mPolygonStarts[pMesh.mPolygonCount];
+    case eMapByPolygon:       return pMesh.mPolygonCount;
+    default:                  return 1;
+    }
+}
+
+bool IsElementValid(
+                    const ElementView& pElement,
+                    int pCount
+                    )
+{
+    if( pElement.mReference == eRefDirect )
+        return pElement.mDirectCount >= pCount;
+
+    if( pElement.mIndexCount < pCount )
+        return false;
+
+    for( int i = 0; i < pCount; i++ )
+    {
+        int lIndex = pElement.mIndex[i];
+        if( lIndex < 0 || lIndex >= pElement.mDirectCount ) return false;
+    }
+    return true;
+}
+
+// merge loop of one (source reference, target normal reference) combination.
+// The modes are compile time constants, the loop has no per element mode test.
+template <EElementReference SourceReference, EElementReference NormalReference>
+static void MergeNormalsRange(
+                              const ElementView& pSource,
+                              const ElementView& pNormals,
+                              const ElementOutput& pTangents,
+                              const ElementOutput& pBinormals,
+                              double pBinormalW,
+                              int pBegin,
+                              int pEnd
+                              )
+{
+    // the normals are gathered by blocks in float SoA buffers
+    // and normalized/crossed by the vectorized kernel
+    const int kBlockSize = 1024;
+    std::vector<float> lBuffer(12 * kBlockSize);
+
+    SoaStream lSource    = { &lBuffer[0],              &lBuffer[kBlockSize],      &lBuffer[2 * kBlockSize] };
+    SoaStream lNormal    = { &lBuffer[3 * kBlockSize], &lBuffer[4 * kBlockSize],  &lBuffer[5 * kBlockSize] };
+    SoaStream lTangent   = { &lBuffer[6 * kBlockSize], &lBuffer[7 * kBlockSize],  &lBuffer[8 * kBlockSize] };
+    SoaStream lBitangent = { &lBuffer[9 * kBlockSize], &lBuffer[10 * kBlockSize], &lBuffer[11 * kBlockSize] };
+
+    const int lSourceStride = pSource.mStride;
+    const int lNormalStride = pNormals.mStride;
+
+    for( int lBlockStart = pBegin; lBlockStart < pEnd; lBlockStart += kBlockSize )
+    {
+        int lBlockCount = pEnd - lBlockStart < kBlockSize ? pEnd - lBlockStart : kBlockSize;
+
+        for( int i = 0; i < lBlockCount; i++ )
+        {
+            int lElementIndex = lBlockStart + i;
+            int lSourceIndex = SourceReference == eRefDirect ? lElementIndex : pSource.mIndex[lElementIndex];
+            int lNormalIndex = NormalReference == eRefDirect ? lElementIndex : pNormals.mIndex[lElementIndex];
+
+            const double* lSourceValue = pSource.mDirect + size_t(lSourceIndex) * lSourceStride;
+            const double* lNormalValue = pNormals.mDirect + size_t(lNormalIndex) * lNormalStride;
+
+            lSource.mX[i] = float(lSourceValue[0]);
+            lSource.mY[i] = float(lSourceValue[1]);
+            lSource.mZ[i] = float(lSourceValue[2]);
+            lNormal.mX[i] = float(lNormalValue[0]);
+            lNormal.mY[i] = float(lNormalValue[1]);
+            lNormal.mZ[i] = float(lNormalValue[2]);
+        }
+
+        NormalizeCross(lBlockCount, lSource, lNormal, lTangent, lBitangent);
+
+        for( int i = 0; i < lBlockCount; i++ )
+        {
+            int lElementIndex = lBlockStart + i;
+            int lSourceIndex = SourceReference == eRefDirect ? lElementIndex : pSource.mIndex[lElementIndex];
+
+            double* lTangentValue = pTangents.mDirect + size_t(lElementIndex) * pTangents.mStride;
+            lTangentValue[0] = lTangent.mX[i];
+            lTangentValue[1] = lTangent.mY[i];
+            lTangentValue[2] = lTangent.mZ[i];
+            if( pTangents.mStride > 3 )
+                lTangentValue[3] = lSourceStride > 3 ? pSource.mDirect[size_t(lSourceIndex) * lSourceStride + 3] : 1.0;
+
+            double* lBinormalValue = pBinormals.mDirect + size_t(lElementIndex) * pBinormals.mStride;
+            lBinormalValue[0] = lBitangent.mX[i];
+            lBinormalValue[1] = lBitangent.mY[i];
+            lBinormalValue[2] = lBitangent.mZ[i];
+            if( pBinormals.mStride > 3 )
+                lBinormalValue[3] = pBinormalW;
+        }
+    }
+}
+
+void MergeNormals(
+                  const MeshView& pTarget,
+                  const ElementView& pSource,
+                  const ElementOutput& pTangents,
+                  const ElementOutput& pBinormals,
+                  double pBinormalW,
+                  int pBegin,
+                  int pEnd
+                  )
+{
+    const ElementView& lNormals = pTarget.mNormals;
+
+    // pick the merge loop of the modes once per call
+    if( pSource.mReference == eRefDirect )
+    {
+        if( lNormals.mReference == eRefDirect )
+            MergeNormalsRange<eRefDirect, eRefDirect>(pSource, lNormals, pTangents, pBinormals, pBinormalW, pBegin, pEnd);
+        else
+            MergeNormalsRange<eRefDirect, eRefIndexToDirect>(pSource, lNormals, pTangents, pBinormals, pBinormalW, pBegin, pEnd);
+    }
+    else
+    {
+        if( lNormals.mReference == eRefDirect )
+            MergeNormalsRange<eRefIndexToDirect, eRefDirect>(pSource, lNormals, pTangents, pBinormals, pBinormalW, pBegin, pEnd);
+        else
+            MergeNormalsRange<eRefIndexToDirect, eRefIndexToDirect>(pSource, lNormals, pTangents, pBinormals, pBinormalW, pBegin, pEnd);
+    }
+}
+
+// packing loop of one (source reference, target normal reference) combination
+template <EElementReference SourceReference, EElementReference NormalReference>
+static double PackNormalsRange(
+                               const ElementView& pSource,
+                               const ElementView& pNormals,
+                               int pBits,
+                               const ElementOutput& pPacked,
+                               int pBegin,
+                               int pEnd
+                               )
+{
+    const int kBlockSize = 1024;
+    std::vector<float> lBuffer(6 * kBlockSize);
+
+    SoaStream lSource = { &lBuffer[0], &lBuffer[kBlockSize], &lBuffer[2 * kBlockSize] };
+    float* lU   = &lBuffer[3 * kBlockSize];
+    float* lV   = &lBuffer[4 * kBlockSize];
+    float* lError = &lBuffer[5 * kBlockSize];
+
+    float lMaxError = 0.0f;
+    for( int lBlockStart = pBegin; lBlockStart < pEnd; lBlockStart += kBlockSize )
+    {
+        int lBlockCount = pEnd - lBlockStart < kBlockSize ? pEnd - lBlockStart : kBlockSize;
+
+        for( int i = 0; i < lBlockCount; i++ )
+        {
+            int lElementIndex = lBlockStart + i;
+            int lSourceIndex = SourceReference == eRefDirect ? lElementIndex : pSource.mIndex[lElementIndex];
+            const double* lValue = pSource.mDirect + size_t(lSourceIndex) * pSource.mStride;
+
+            // a null smooth normal keeps the lighting normal
+            if( lValue[0] == 0.0 && lValue[1] == 0.0 && lValue[2] == 0.0 )
+            {
+                int lNormalIndex = NormalReference == eRefDirect ? lElementIndex : pNormals.mIndex[lElementIndex];
+                lValue = pNormals.mDirect + size_t(lNormalIndex) * pNormals.mStride;
+            }
+            lSource.mX[i] = float(lValue[0]);
+            lSource.mY[i] = float(lValue[1]);
+            lSource.mZ[i] = float(lValue[2]);
+        }
+
+        OctahedralEncode(lBlockCount, lSource, pBits, lU, lV, lError);
+
+        for( int i = 0; i < lBlockCount; i++ )
+        {
+            double* lPacked = pPacked.mDirect + size_t(lBlockStart + i) * pPacked.mStride;
+            lPacked[0] = lU[i];
+            lPacked[1] = lV[i];
+            if( pPacked.mStride > 2 ) lPacked[2] = 0.0;
+            if( pPacked.mStride > 3 ) lPacked[3] = 1.0;
+            if( lError[i] > lMaxError ) lMaxError = lError[i];
+        }
+    }
+
+    // the error is the chord between the unit vectors
+    return 2.0 * std::asin(lMaxError > 2.0f ? 1.0 : 0.5 * lMaxError) * 180.0 / 3.14159265358979323846;
+}
+
+double PackNormals(
+                   const MeshView& pTarget,
+                   const ElementView& pSource,
+                   int pBits,
+                   const ElementOutput& pPacked,
+                   int pBegin,
+                   int pEnd
+                   )
+{
+    const ElementView& lNormals = pTarget.mNormals;
+
+    if( pSource.mReference == eRefDirect )
+    {
+        if( lNormals.mReference == eRefDirect )
+            return PackNormalsRange<eRefDirect, eRefDirect>(pSource, lNormals, pBits, pPacked, pBegin, pEnd);
+        return PackNormalsRange<eRefDirect, eRefIndexToDirect>(pSource, lNormals, pBits, pPacked, pBegin, pEnd);
+    }
+    if( lNormals.mReference == eRefDirect )
+        return PackNormalsRange<eRefIndexToDirect, eRefDirect>(pSource, lNormals, pBits, pPacked, pBegin, pEnd);
+    return PackNormalsRange<eRefIndexToDirect, eRefIndexToDirect>(pSource, lNormals, pBits, pPacked, pBegin, pEnd);
+}
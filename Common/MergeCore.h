@@ -0,0 +1,115 @@
+// MergeCore.h : FBX independent view of a mesh and the normal merge.
+//
+// The views point at memory owned by someone else (locked FBX arrays,
+// benchmark buffers, ...), vectors are stored as doubles with a stride.
+
+#pragma once
+
+#include <stddef.h>
+
+// same meaning as FbxLayerElement::EMappingMode
+enum EElementMapping
+{
+    eMapByControlPoint,
+    eMapByPolygonVertex,
+    eMapByPolygon,
+    eMapAllSame
+};
+
+// same meaning as FbxLayerElement::EReferenceMode, eIndex is eRefIndexToDirect
+enum EElementReference
+{
+    eRefDirect,
+    eRefIndexToDirect
+};
+
+// read only view of a vector layer element
+struct ElementView
+{
+    EElementMapping   mMapping;
+    EElementReference mReference;
+    const double*     mDirect;          // mDirectCount vectors
+    int               mDirectCount;
+    int               mStride;          // doubles between two vectors, 4 for FbxVector4 arrays
+    const int*        mIndex;           // eRefIndexToDirect only
+    int               mIndexCount;
+};
+
+// writable direct array with one vector per element
+struct ElementOutput
+{
+    double*           mDirect;
+    int               mCount;
+    int               mStride;
+};
+
+// read only view of a polygon mesh
+struct MeshView
+{
+    const double*     mPositions;           // mControlPointCount control points
+    int               mPositionStride;
+    int               mControlPointCount;
+    const int*        mPolygonVertices;     // control point of every polygon-vertex
+    const int*        mPolygonStarts;       // first polygon-vertex of every polygon, mPolygonCount + 1 entries
+    int               mPolygonCount;
+    ElementView       mNormals;
+};
+
+// number of values of an element with the given mapping on pMesh
+int GetElementCount(
+                    const MeshView& pMesh,
+                    EElementMapping pMapping
+                    );
+
+// the vector of pElement at the polygon-vertex pPolygonVertex of the polygon pPolygon,
+// whose control point is pControlPoint, for any mapping
+inline const double* GetElementValue(
+                                     const ElementView& pElement,
+                                     int pPolygon,
+                                     int pPolygonVertex,
+                                     int pControlPoint
+                                     )
+{
+    int lElement = pElement.mMapping == eMapByControlPoint  ? pControlPoint :
+                   pElement.mMapping == eMapByPolygonVertex ? pPolygonVertex :
+                   pElement.mMapping == eMapByPolygon       ? pPolygon : 0;
+    if( pElement.mReference == eRefIndexToDirect ) lElement = pElement.mIndex[lElement];
+    return pElement.mDirect + size_t(lElement) * pElement.mStride;
+}
+
+// checks that the element gives a valid vector for its first pCount values
+bool IsElementValid(
+                    const ElementView& pElement,
+                    int pCount
+                    );
+
+// writes, for every element [pBegin, pEnd) of the mapping of the target normals:
+//   tangent  = normalize(source normal), W copied from the source
+//   binormal = target normal x tangent,  W set to pBinormalW
+// pSource must use the same mapping as the target normals, both must be valid
+// (IsElementValid) and the outputs sized to the element count.
+// Disjoint ranges of the same mesh can run in parallel.
+void MergeNormals(
+                  const MeshView& pTarget,
+                  const ElementView& pSource,
+                  const ElementOutput& pTangents,
+                  const ElementOutput& pBinormals,
+                  double pBinormalW,
+                  int pBegin,
+                  int pEnd
+                  );
+
+// writes, for every element [pBegin, pEnd) of the mapping of the target normals, the
+// octahedral encoding (OctahedralEncode) of the source normal with pBits bits per
+// component, 1 to 16, in the first two components of pPacked; a third component is
+// set to 0 and a fourth to 1 (the alpha of a color). A null source normal packs the
+// target normal. Same requirements as MergeNormals.
+// Returns the largest angle, in degrees, between a normal and its decoded value.
+double PackNormals(
+                   const MeshView& pTarget,
+                   const ElementView& pSource,
+                   int pBits,
+                   const ElementOutput& pPacked,
+                   int pBegin,
+                   int pEnd
+                   );
@@ -0,0 +1,529 @@
+// MergeKernel.cxx : vectorized normal to tangent/bitangent transfer.
+
+#include "MergeKernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define MERGE_KERNEL_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+#endif
+
+// gcc and clang only emit AVX code in functions compiled for it,
+// msvc accepts the intrinsics everywhere
+#if defined(__GNUC__)
+    #define MERGE_TARGET(pIsa) __attribute__((target(pIsa)))
+#else
+    #define MERGE_TARGET(pIsa)
+#endif
+
+// same threshold as FbxEqual(lLength, 0.0) in FbxVector4::Normalize
+static const float kMinLength = 1e-6f;
+
+static void NormalizeCrossScalar(
+                                 int pBegin,
+                                 int pEnd,
+                                 const SoaStream& S,
+                                 const SoaStream& N,
+                                 const SoaStream& T,
+                                 const SoaStream& B
+                                 )
+{
+    for( int i = pBegin; i < pEnd; i++ )
+    {
+        float sx = S.mX[i], sy = S.mY[i], sz = S.mZ[i];
+
+        float lLength = std::sqrt(sx * sx + sy * sy + sz * sz);
+        if( lLength >= kMinLength )
+        {
+            sx /= lLength;
+            sy /= lLength;
+            sz /= lLength;
+        }
+
+        float nx = N.mX[i], ny = N.mY[i], nz = N.mZ[i];
+
+        T.mX[i] = sx;
+        T.mY[i] = sy;
+        T.mZ[i] = sz;
+        B.mX[i] = ny * sz - nz * sy;
+        B.mY[i] = nz * sx - nx * sz;
+        B.mZ[i] = nx * sy - ny * sx;
+    }
+}
+
+// squared distance between the unit vector n and the decoded unit vector of the quantized
+// components qu, qv. Unlike the cosine, it keeps its precision for small angles in float.
+static inline float OctahedralScore(float x, float y, float z, float qu, float qv, float pScale)
+{
+    float u = qu / pScale * 2.0f - 1.0f;
+    float v = qv / pScale * 2.0f - 1.0f;
+    float dz = 1.0f - std::fabs(u) - std::fabs(v);
+    float dx = dz < 0.0f ? std::copysign(1.0f - std::fabs(v), u) : u;
+    float dy = dz < 0.0f ? std::copysign(1.0f - std::fabs(u), v) : v;
+    float lLength = std::sqrt(dx * dx + dy * dy + dz * dz);
+    float ex = x - dx / lLength, ey = y - dy / lLength, ez = z - dz / lLength;
+    return ex * ex + ey * ey + ez * ez;
+}
+
+static void OctahedralEncodeScalar(
+                                   int pBegin,
+                                   int pEnd,
+                                   const SoaStream& N,
+                                   int pBits,
+                                   float* pU,
+                                   float* pV,
+                                   float* pError
+                                   )
+{
+    const float lScale = float((1 << pBits) - 1);
+    for( int i = pBegin; i < pEnd; i++ )
+    {
+        float x = N.mX[i], y = N.mY[i], z = N.mZ[i];
+
+        float lL1 = std::fabs(x) + std::fabs(y) + std::fabs(z);
+        if( !(lL1 >= kMinLength) )
+        {
+            pU[i] = pV[i] = 0.5f;
+            pError[i] = 0.0f;
+            continue;
+        }
+        float lLength = std::sqrt(x * x + y * y + z * z);
+        float nx = x / lLength, ny = y / lLength, nz = z / lLength;
+
+        // the lower half is folded over the diagonals
+        float px = x / lL1, py = y / lL1;
+        float ou = z < 0.0f ? std::copysign(1.0f - std::fabs(py), px) : px;
+        float ov = z < 0.0f ? std::copysign(1.0f - std::fabs(px), py) : py;
+
+        float u0 = std::floor((ou * 0.5f + 0.5f) * lScale);
+        float v0 = std::floor((ov * 0.5f + 0.5f) * lScale);
+        float u1 = std::min(u0 + 1.0f, lScale);
+        float v1 = std::min(v0 + 1.0f, lScale);
+
+        float lBestU = u0, lBestV = v0;
+        float lBest = OctahedralScore(nx, ny, nz, u0, v0, lScale);
+        float lScore = OctahedralScore(nx, ny, nz, u1, v0, lScale);
+        if( lScore < lBest ) { lBest = lScore; lBestU = u1; lBestV = v0; }
+        lScore = OctahedralScore(nx, ny, nz, u0, v1, lScale);
+        if( lScore < lBest ) { lBest = lScore; lBestU = u0; lBestV = v1; }
+        lScore = OctahedralScore(nx, ny, nz, u1, v1, lScale);
+        if( lScore < lBest ) { lBest = lScore; lBestU = u1; lBestV = v1; }
+
+        pU[i] = lBestU / lScale;
+        pV[i] = lBestV / lScale;
+        pError[i] = std::sqrt(lBest);
+    }
+}
+
+#ifdef MERGE_KERNEL_X86
+
+MERGE_TARGET("avx2,fma")
+static void NormalizeCrossAVX2(
+                               int pCount,
+                               const SoaStream& S,
+                               const SoaStream& N,
+                               const SoaStream& T,
+                               const SoaStream& B
+                               )
+{
+    const __m256 lMinLength = _mm256_set1_ps(kMinLength);
+
+    int i = 0;
+    for( ; i + 8 <= pCount; i += 8 )
+    {
+        __m256 sx = _mm256_loadu_ps(S.mX + i);
+        __m256 sy = _mm256_loadu_ps(S.mY + i);
+        __m256 sz = _mm256_loadu_ps(S.mZ + i);
+
+        __m256 lLength = _mm256_sqrt_ps(_mm256_fmadd_ps(sx, sx, _mm256_fmadd_ps(sy, sy, _mm256_mul_ps(sz, sz))));
+        __m256 lMask = _mm256_cmp_ps(lLength, lMinLength, _CMP_GE_OQ);
+        sx = _mm256_blendv_ps(sx, _mm256_div_ps(sx, lLength), lMask);
+        sy = _mm256_blendv_ps(sy, _mm256_div_ps(sy, lLength), lMask);
+        sz = _mm256_blendv_ps(sz, _mm256_div_ps(sz, lLength), lMask);
+
+        __m256 nx = _mm256_loadu_ps(N.mX + i);
+        __m256 ny = _mm256_loadu_ps(N.mY + i);
+        __m256 nz = _mm256_loadu_ps(N.mZ + i);
+
+        _mm256_storeu_ps(T.mX + i, sx);
+        _mm256_storeu_ps(T.mY + i, sy);
+        _mm256_storeu_ps(T.mZ + i, sz);
+        _mm256_storeu_ps(B.mX + i, _mm256_fmsub_ps(ny, sz, _mm256_mul_ps(nz, sy)));
+        _mm256_storeu_ps(B.mY + i, _mm256_fmsub_ps(nz, sx, _mm256_mul_ps(nx, sz)));
+        _mm256_storeu_ps(B.mZ + i, _mm256_fmsub_ps(nx, sy, _mm256_mul_ps(ny, sx)));
+    }
+
+    NormalizeCrossScalar(i, pCount, S, N, T, B);
+}
+
+MERGE_TARGET("avx512f")
+static void NormalizeCrossAVX512(
+                                 int pCount,
+                                 const SoaStream& S,
+                                 const SoaStream& N,
+                                 const SoaStream& T,
+                                 const SoaStream& B
+                                 )
+{
+    const __m512 lMinLength = _mm512_set1_ps(kMinLength);
+
+    int i = 0;
+    for( ; i + 16 <= pCount; i += 16 )
+    {
+        __m512 sx = _mm512_loadu_ps(S.mX + i);
+        __m512 sy = _mm512_loadu_ps(S.mY + i);
+        __m512 sz = _mm512_loadu_ps(S.mZ + i);
+
+        __m512 lLength = _mm512_sqrt_ps(_mm512_fmadd_ps(sx, sx, _mm512_fmadd_ps(sy, sy, _mm512_mul_ps(sz, sz))));
+        __mmask16 lMask = _mm512_cmp_ps_mask(lLength, lMinLength, _CMP_GE_OQ);
+        sx = _mm512_mask_div_ps(sx, lMask, sx, lLength);
+        sy = _mm512_mask_div_ps(sy, lMask, sy, lLength);
+        sz = _mm512_mask_div_ps(sz, lMask, sz, lLength);
+
+        __m512 nx = _mm512_loadu_ps(N.mX + i);
+        __m512 ny = _mm512_loadu_ps(N.mY + i);
+        __m512 nz = _mm512_loadu_ps(N.mZ + i);
+
+        _mm512_storeu_ps(T.mX + i, sx);
+        _mm512_storeu_ps(T.mY + i, sy);
+        _mm512_storeu_ps(T.mZ + i, sz);
+        _mm512_storeu_ps(B.mX + i, _mm512_fmsub_ps(ny, sz, _mm512_mul_ps(nz, sy)));
+        _mm512_storeu_ps(B.mY + i, _mm512_fmsub_ps(nz, sx, _mm512_mul_ps(nx, sz)));
+        _mm512_storeu_ps(B.mZ + i, _mm512_fmsub_ps(nx, sy, _mm512_mul_ps(ny, sx)));
+    }
+
+    NormalizeCrossScalar(i, pCount, S, N, T, B);
+}
+
+MERGE_TARGET("avx2,fma")
+static inline __m256 OctahedralScoreAVX2(__m256 x, __m256 y, __m256 z, __m256 qu, __m256 qv, __m256 pScale)
+{
+    const __m256 lSign = _mm256_set1_ps(-0.0f);
+    const __m256 lOne = _mm256_set1_ps(1.0f);
+    const __m256 lTwo = _mm256_set1_ps(2.0f);
+
+    __m256 u = _mm256_sub_ps(_mm256_mul_ps(_mm256_div_ps(qu, pScale), lTwo), lOne);
+    __m256 v = _mm256_sub_ps(_mm256_mul_ps(_mm256_div_ps(qv, pScale), lTwo), lOne);
+    __m256 au = _mm256_andnot_ps(lSign, u);
+    __m256 av = _mm256_andnot_ps(lSign, v);
+    __m256 dz = _mm256_sub_ps(_mm256_sub_ps(lOne, au), av);
+
+    __m256 lFolded = _mm256_cmp_ps(dz, _mm256_setzero_ps(), _CMP_LT_OQ);
+    __m256 dx = _mm256_blendv_ps(u, _mm256_or_ps(_mm256_and_ps(u, lSign), _mm256_sub_ps(lOne, av)), lFolded);
+    __m256 dy = _mm256_blendv_ps(v, _mm256_or_ps(_mm256_and_ps(v, lSign), _mm256_sub_ps(lOne, au)), lFolded);
+
+    __m256 lLength = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+    __m256 ex = _mm256_sub_ps(x, _mm256_div_ps(dx, lLength));
+    __m256 ey = _mm256_sub_ps(y, _mm256_div_ps(dy, lLength));
+    __m256 ez = _mm256_sub_ps(z, _mm256_div_ps(dz, lLength));
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey)), _mm256_mul_ps(ez, ez));
+}
+
+MERGE_TARGET("avx2,fma")
+static void OctahedralEncodeAVX2(
+                                 int pCount,
+                                 const SoaStream& N,
+                                 int pBits,
+                                 float* pU,
+                                 float* pV,
+                                 float* pError
+                                 )
+{
+    const __m256 lSign = _mm256_set1_ps(-0.0f);
+    const __m256 lOne = _mm256_set1_ps(1.0f);
+    const __m256 lHalf = _mm256_set1_ps(0.5f);
+    const __m256 lScale = _mm256_set1_ps(float((1 << pBits) - 1));
+    const __m256 lMinLength = _mm256_set1_ps(kMinLength);
+
+    int i = 0;
+    for( ; i + 8 <= pCount; i += 8 )
+    {
+        __m256 x = _mm256_loadu_ps(N.mX + i);
+        __m256 y = _mm256_loadu_ps(N.mY + i);
+        __m256 z = _mm256_loadu_ps(N.mZ + i);
+
+        __m256 lL1 = _mm256_add_ps(_mm256_add_ps(_mm256_andnot_ps(lSign, x), _mm256_andnot_ps(lSign, y)), _mm256_andnot_ps(lSign, z));
+        __m256 lValid = _mm256_cmp_ps(lL1, lMinLength, _CMP_GE_OQ);
+
+        __m256 lLength = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+        __m256 nx = _mm256_div_ps(x, lLength);
+        __m256 ny = _mm256_div_ps(y, lLength);
+        __m256 nz = _mm256_div_ps(z, lLength);
+
+        __m256 px = _mm256_div_ps(x, lL1);
+        __m256 py = _mm256_div_ps(y, lL1);
+        __m256 lFolded = _mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_LT_OQ);
+        __m256 ou = _mm256_blendv_ps(px, _mm256_or_ps(_mm256_and_ps(px, lSign), _mm256_sub_ps(lOne, _mm256_andnot_ps(lSign, py))), lFolded);
+        __m256 ov = _mm256_blendv_ps(py, _mm256_or_ps(_mm256_and_ps(py, lSign), _mm256_sub_ps(lOne, _mm256_andnot_ps(lSign, px))), lFolded);
+
+        __m256 u0 = _mm256_floor_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ou, lHalf), lHalf), lScale));
+        __m256 v0 = _mm256_floor_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ov, lHalf), lHalf), lScale));
+        __m256 u1 = _mm256_min_ps(_mm256_add_ps(u0, lOne), lScale);
+        __m256 v1 = _mm256_min_ps(_mm256_add_ps(v0, lOne), lScale);
+
+        __m256 lBestU = u0, lBestV = v0;
+        __m256 lBest = OctahedralScoreAVX2(nx, ny, nz, u0, v0, lScale);
+        __m256 lScore = OctahedralScoreAVX2(nx, ny, nz, u1, v0, lScale);
+        __m256 lBetter = _mm256_cmp_ps(lScore, lBest, _CMP_LT_OQ);
+        lBest = _mm256_blendv_ps(lBest, lScore, lBetter);
+        lBestU = _mm256_blendv_ps(lBestU, u1, lBetter);
+        lScore = OctahedralScoreAVX2(nx, ny, nz, u0, v1, lScale);
+        lBetter = _mm256_cmp_ps(lScore, lBest, _CMP_LT_OQ);
+        lBest = _mm256_blendv_ps(lBest, lScore, lBetter);
+        lBestU = _mm256_blendv_ps(lBestU, u0, lBetter);
+        lBestV = _mm256_blendv_ps(lBestV, v1, lBetter);
+        lScore = OctahedralScoreAVX2(nx, ny, nz, u1, v1, lScale);
+        lBetter = _mm256_cmp_ps(lScore, lBest, _CMP_LT_OQ);
+        lBest = _mm256_blendv_ps(lBest, lScore, lBetter);
+        lBestU = _mm256_blendv_ps(lBestU, u1, lBetter);
+        lBestV = _mm256_blendv_ps(lBestV, v1, lBetter);
+
+        _mm256_storeu_ps(pU + i, _mm256_blendv_ps(lHalf, _mm256_div_ps(lBestU, lScale), lValid));
+        _mm256_storeu_ps(pV + i, _mm256_blendv_ps(lHalf, _mm256_div_ps(lBestV, lScale), lValid));
+        _mm256_storeu_ps(pError + i, _mm256_blendv_ps(_mm256_setzero_ps(), _mm256_sqrt_ps(lBest), lValid));
+    }
+
+    OctahedralEncodeScalar(i, pCount, N, pBits, pU, pV, pError);
+}
+
+// sign operations with avx512f only, _mm512_and_ps and _mm512_or_ps need avx512dq
+MERGE_TARGET("avx512f")
+static inline __m512 AbsAVX512(__m512 a)
+{
+    return _mm512_abs_ps(a);
+}
+
+// the magnitude of pMagnitude (positive) with the sign of pSign
+MERGE_TARGET("avx512f")
+static inline __m512 CopySignAVX512(__m512 pMagnitude, __m512 pSign)
+{
+    const __m512i lSign = _mm512_set1_epi32(int(0x80000000u));
+    return _mm512_castsi512_ps(_mm512_or_epi32(_mm512_castps_si512(pMagnitude), _mm512_and_epi32(_mm512_castps_si512(pSign), lSign)));
+}
+
+MERGE_TARGET("avx512f")
+static inline __m512 OctahedralScoreAVX512(__m512 x, __m512 y, __m512 z, __m512 qu, __m512 qv, __m512 pScale)
+{
+    const __m512 lOne = _mm512_set1_ps(1.0f);
+    const __m512 lTwo = _mm512_set1_ps(2.0f);
+
+    __m512 u = _mm512_sub_ps(_mm512_mul_ps(_mm512_div_ps(qu, pScale), lTwo), lOne);
+    __m512 v = _mm512_sub_ps(_mm512_mul_ps(_mm512_div_ps(qv, pScale), lTwo), lOne);
+    __m512 au = AbsAVX512(u);
+    __m512 av = AbsAVX512(v);
+    __m512 dz = _mm512_sub_ps(_mm512_sub_ps(lOne, au), av);
+
+    __mmask16 lFolded = _mm512_cmp_ps_mask(dz, _mm512_setzero_ps(), _CMP_LT_OQ);
+    __m512 dx = _mm512_mask_blend_ps(lFolded, u, CopySignAVX512(_mm512_sub_ps(lOne, av), u));
+    __m512 dy = _mm512_mask_blend_ps(lFolded, v, CopySignAVX512(_mm512_sub_ps(lOne, au), v));
+
+    __m512 lLength = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz)));
+    __m512 ex = _mm512_sub_ps(x, _mm512_div_ps(dx, lLength));
+    __m512 ey = _mm512_sub_ps(y, _mm512_div_ps(dy, lLength));
+    __m512 ez = _mm512_sub_ps(z, _mm512_div_ps(dz, lLength));
+    return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ex, ex), _mm512_mul_ps(ey, ey)), _mm512_mul_ps(ez, ez));
+}
+
+MERGE_TARGET("avx512f")
+static void OctahedralEncodeAVX512(
+                                   int pCount,
+                                   const SoaStream& N,
+                                   int pBits,
+                                   float* pU,
+                                   float* pV,
+                                   float* pError
+                                   )
+{
+    const __m512 lOne = _mm512_set1_ps(1.0f);
+    const __m512 lHalf = _mm512_set1_ps(0.5f);
+    const __m512 lScale = _mm512_set1_ps(float((1 << pBits) - 1));
+    const __m512 lMinLength = _mm512_set1_ps(kMinLength);
+
+    int i = 0;
+    for( ; i + 16 <= pCount; i += 16 )
+    {
+        __m512 x = _mm512_loadu_ps(N.mX + i);
+        __m512 y = _mm512_loadu_ps(N.mY + i);
+        __m512 z = _mm512_loadu_ps(N.mZ + i);
+
+        __m512 lL1 = _mm512_add_ps(_mm512_add_ps(AbsAVX512(x), AbsAVX512(y)), AbsAVX512(z));
+        __mmask16 lValid = _mm512_cmp_ps_mask(lL1, lMinLength, _CMP_GE_OQ);
+
+        __m512 lLength = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, x), _mm512_mul_ps(y, y)), _mm512_mul_ps(z, z)));
+        __m512 nx = _mm512_div_ps(x, lLength);
+        __m512 ny = _mm512_div_ps(y, lLength);
+        __m512 nz = _mm512_div_ps(z, lLength);
+
+        __m512 px = _mm512_div_ps(x, lL1);
+        __m512 py = _mm512_div_ps(y, lL1);
+        __mmask16 lFolded = _mm512_cmp_ps_mask(z, _mm512_setzero_ps(), _CMP_LT_OQ);
+        __m512 ou = _mm512_mask_blend_ps(lFolded, px, CopySignAVX512(_mm512_sub_ps(lOne, AbsAVX512(py)), px));
+        __m512 ov = _mm512_mask_blend_ps(lFolded, py, CopySignAVX512(_mm512_sub_ps(lOne, AbsAVX512(px)), py));
+
+        const int kFloor = _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC;
+        __m512 u0 = _mm512_roundscale_ps(_mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(ou, lHalf), lHalf), lScale), kFloor);
+        __m512 v0 = _mm512_roundscale_ps(_mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(ov, lHalf), lHalf), lScale), kFloor);
+        __m512 u1 = _mm512_min_ps(_mm512_add_ps(u0, lOne), lScale);
+        __m512 v1 = _mm512_min_ps(_mm512_add_ps(v0, lOne), lScale);
+
+        __m512 lBestU = u0, lBestV = v0;
+        __m512 lBest = OctahedralScoreAVX512(nx, ny, nz, u0, v0, lScale);
+        __m512 lScore = OctahedralScoreAVX512(nx, ny, nz, u1, v0, lScale);
+        __mmask16 lBetter = _mm512_cmp_ps_mask(lScore, lBest, _CMP_LT_OQ);
+        lBest = _mm512_mask_blend_ps(lBetter, lBest, lScore);
+        lBestU = _mm512_mask_blend_ps(lBetter, lBestU, u1);
+        lScore = OctahedralScoreAVX512(nx, ny, nz, u0, v1, lScale);
+        lBetter = _mm512_cmp_ps_mask(lScore, lBest, _CMP_LT_OQ);
+        lBest = _mm512_mask_blend_ps(lBetter, lBest, lScore);
+        lBestU = _mm512_mask_blend_ps(lBetter, lBestU, u0);
+        lBestV = _mm512_mask_blend_ps(lBetter, lBestV, v1);
+        lScore = OctahedralScoreAVX512(nx, ny, nz, u1, v1, lScale);
+        lBetter = _mm512_cmp_ps_mask(lScore, lBest, _CMP_LT_OQ);
+        lBest = _mm512_mask_blend_ps(lBetter, lBest, lScore);
+        lBestU = _mm512_mask_blend_ps(lBetter, lBestU, u1);
+        lBestV = _mm512_mask_blend_ps(lBetter, lBestV, v1);
+
+        _mm512_storeu_ps(pU + i, _mm512_mask_blend_ps(lValid, lHalf, _mm512_div_ps(lBestU, lScale)));
+        _mm512_storeu_ps(pV + i, _mm512_mask_blend_ps(lValid, lHalf, _mm512_div_ps(lBestV, lScale)));
+        _mm512_storeu_ps(pError + i, _mm512_mask_blend_ps(lValid, _mm512_setzero_ps(), _mm512_sqrt_ps(lBest)));
+    }
+
+    OctahedralEncodeScalar(i, pCount, N, pBits, pU, pV, pError);
+}
+
+// checks the cpu and the os support (saved register state) of an instruction set
+static bool CpuSupports(EKernelIsa pIsa)
+{
+#if defined(_MSC_VER)
+    int lInfo[4];
+    __cpuid(lInfo, 0);
+    if( lInfo[0] < 7 ) return false;
+
+    __cpuid(lInfo, 1);
+    bool lOsxsave = (lInfo[2] & (1 << 27)) != 0;
+    bool lFma     = (lInfo[2] & (1 << 12)) != 0;
+    if( !lOsxsave ) return false;
+
+    unsigned long long lXcr0 = _xgetbv(0);
+    __cpuidex(lInfo, 7, 0);
+
+    if( pIsa == eKernelAVX2 )
+        return lFma && (lInfo[1] & (1 << 5)) != 0 && (lXcr0 & 0x6) == 0x6;
+    if( pIsa == eKernelAVX512 )
+        return (lInfo[1] & (1 << 16)) != 0 && (lXcr0 & 0xe6) == 0xe6;
+    return true;
+#else
+    __builtin_cpu_init();
+    if( pIsa == eKernelAVX2 )
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if( pIsa == eKernelAVX512 )
+        return __builtin_cpu_supports("avx512f");
+    return true;
+#endif
+}
+
+#endif // MERGE_KERNEL_X86
+
+EKernelIsa GetSupportedKernelIsa()
+{
+#ifdef MERGE_KERNEL_X86
+    static const EKernelIsa lSupported =
+        CpuSupports(eKernelAVX512) ? eKernelAVX512 :
+        CpuSupports(eKernelAVX2)   ? eKernelAVX2   : eKernelScalar;
+    return lSupported;
+#else
+    return eKernelScalar;
+#endif
+}
+
+static EKernelIsa gKernelIsa = GetSupportedKernelIsa();
+
+EKernelIsa GetKernelIsa()
+{
+    return gKernelIsa;
+}
+
+void SetKernelIsa(EKernelIsa pIsa)
+{
+    EKernelIsa lSupported = GetSupportedKernelIsa();
+    gKernelIsa = pIsa > lSupported ? lSupported : pIsa;
+}
+
+const char* GetKernelIsaName(EKernelIsa pIsa)
+{
+    switch( pIsa )
+    {
+    case eKernelAVX2:   return "avx2";
+    case eKernelAVX512: return "avx512";
+    default:            return "scalar";
+    }
+}
+
+void NormalizeCross(
+                    int pCount,
+                    const SoaStream& pSource,
+                    const SoaStream& pNormal,
+                    const SoaStream& pTangent,
+                    const SoaStream& pBitangent
+                    )
+{
+#ifdef MERGE_KERNEL_X86
+    if( gKernelIsa == eKernelAVX512 )
+    {
+        NormalizeCrossAVX512(pCount, pSource, pNormal, pTangent, pBitangent);
+        return;
+    }
+    if( gKernelIsa == eKernelAVX2 )
+    {
+        NormalizeCrossAVX2(pCount, pSource, pNormal, pTangent, pBitangent);
+        return;
+    }
+#endif
+    NormalizeCrossScalar(0, pCount, pSource, pNormal, pTangent, pBitangent);
+}
+
+void OctahedralEncode(
+                      int pCount,
+                      const SoaStream& pNormals,
+                      int pBits,
+                      float* pU,
+                      float* pV,
+                      float* pError
+                      )
+{
+#ifdef MERGE_KERNEL_X86
+    if( gKernelIsa == eKernelAVX512 )
+    {
+        OctahedralEncodeAVX512(pCount, pNormals, pBits, pU, pV, pError);
+        return;
+    }
+    if( gKernelIsa == eKernelAVX2 )
+    {
+        OctahedralEncodeAVX2(pCount, pNormals, pBits, pU, pV, pError);
+        return;
+    }
+#endif
+    OctahedralEncodeScalar(0, pCount, pNormals, pBits, pU, pV, pError);
+}
+
+void OctahedralDecode(
+                      double pU,
+                      double pV,
+                      double pNormal[3]
+                      )
+{
+    double u = pU * 2.0 - 1.0, v = pV * 2.0 - 1.0;
+    double z = 1.0 - std::fabs(u) - std::fabs(v);
+    double x = z < 0.0 ? std::copysign(1.0 - std::fabs(v), u) : u;
+    double y = z < 0.0 ? std::copysign(1.0 - std::fabs(u), v) : v;
+
+    double lLength = std::sqrt(x * x + y * y + z * z);
+    pNormal[0] = x / lLength;
+    pNormal[1] = y / lLength;
+    pNormal[2] = z / lLength;
+}
@@ -0,0 +1,75 @@
+// MergeKernel.h : vectorized normal to tangent/bitangent transfer.
+//
+// The kernel works on structure of arrays float buffers, for every element i:
+//
+//   T[i] = S[i] / |S[i]|      (S[i] is kept as is when |S[i]| < 1e-6, like FbxVector4::Normalize)
+//   B[i] = N[i] x T[i]
+//
+// S are the smooth normals, N the normals of the lighting mesh.
+// Computing in float, the results stay within 1e-6 per component of the
+// double precision FbxVector4 path for unit length N and any S.
+//
+// OctahedralEncode packs vectors into two quantized components: the vector is
+// projected on the octahedron |x| + |y| + |z| = 1, the lower half folded over
+// the upper one, and x, y stored as unorm values. Of the four floor/ceil
+// roundings, the one decoding closest to the unit vector is kept.
+
+#pragma once
+
+// x, y and z components of a vector stream
+struct SoaStream
+{
+    float* mX;
+    float* mY;
+    float* mZ;
+};
+
+// instruction sets the kernel is compiled for
+enum EKernelIsa
+{
+    eKernelScalar,
+    eKernelAVX2,        // 8 vectors per instruction
+    eKernelAVX512       // 16 vectors per instruction
+};
+
+// computes T and B for pCount elements with the selected instruction set.
+// The output streams must not alias the input streams.
+void NormalizeCross(
+                    int pCount,
+                    const SoaStream& pSource,
+                    const SoaStream& pNormal,
+                    const SoaStream& pTangent,
+                    const SoaStream& pBitangent
+                    );
+
+// octahedral encoding of pCount vectors of pNormals (any length, a null vector gives the
+// center of the square and no error) with pBits bits per component, 1 to 16: pU and pV
+// receive q / (2^pBits - 1), q the quantized component, and pError the distance between
+// the unit vector and its decoded value, 2 sin(angle / 2).
+void OctahedralEncode(
+                      int pCount,
+                      const SoaStream& pNormals,
+                      int pBits,
+                      float* pU,
+                      float* pV,
+                      float* pError
+                      );
+
+// the unit vector of the octahedral components pU, pV in [0, 1], as written by OctahedralEncode
+void OctahedralDecode(
+                      double pU,
+                      double pV,
+                      double pNormal[3]
+                      );
+
+// best instruction set of the cpu, detected once
+EKernelIsa GetSupportedKernelIsa();
+
+// the instruction set used by NormalizeCross and OctahedralEncode
+EKernelIsa GetKernelIsa();
+
+// forces an instruction set, clamped to the supported one. Not thread safe,
+// meant to be called before any merge (benchmarks, comparisons).
+void SetKernelIsa(EKernelIsa pIsa);
+
+const char* GetKernelIsaName(EKernelIsa pIsa);
@@ -0,0 +1,270 @@
+// MeshCache.cxx : persistent cache of the merged arrays of every mesh.
+
+#include "MeshCache.h"
+#include "ElementCompaction.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+static const char     kMagic[4] = { 'N', 'M', 'M', 'C' };
+static const uint32_t kVersion = 1;
+
+// an array of the file: its vectors, or its distinct vectors and an index
+struct ArrayHeader
+{
+    uint32_t mStride;
+    uint32_t mCompacted;
+    uint64_t mCount;
+    uint64_t mDistinctCount;    // mCompacted only
+};
+
+struct EntryHeader
+{
+    char     mMagic[4];
+    uint32_t mVersion;
+    uint32_t mArrayCount;
+    uint32_t mReserved;
+    double   mMaxAngle;
+};
+
+bool OpenMeshCache(const char* pDirectory)
+{
+#ifdef _WIN32
+    _mkdir(pDirectory);
+#else
+    mkdir(pDirectory, 0777);
+#endif
+
+    std::string lProbe = std::string(pDirectory) + "/probe." + std::to_string((unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count());
+    FILE* lFile = fopen(lProbe.c_str(), "wb");
+    if( lFile == NULL ) return false;
+    fclose(lFile);
+    remove(lProbe.c_str());
+    return true;
+}
+
+// 1 for an entry "<key>.mesh", 2 for the temporary file "<key>.mesh.<time>.<n>" of
+// StoreMeshOutputs, 0 for the other files
+static int GetCacheFileKind(const char* pName)
+{
+    const char* lExtension = strstr(pName, ".mesh");
+    if( lExtension == NULL || lExtension == pName ) return 0;
+    const char* lSuffix = lExtension + 5;
+    if( *lSuffix == 0 ) return 1;
+
+    // two dot separated numbers
+    for( int lPart = 0; lPart < 2; lPart++ )
+    {
+        if( *lSuffix++ != '.' || *lSuffix < '0' || *lSuffix > '9' ) return 0;
+        while( *lSuffix >= '0' && *lSuffix <= '9' ) lSuffix++;
+    }
+    return *lSuffix == 0 ? 2 : 0;
+}
+
+int ClearMeshCache(const char* pDirectory)
+{
+    // the names first, the directory not being changed while it is read
+    std::vector<std::string> lNames;
+#ifdef _WIN32
+    _finddata_t lData;
+    intptr_t lFind = _findfirst((std::string(pDirectory) + "/*.mesh*").c_str(), &lData);
+    if( lFind != -1 )
+    {
+        do if( GetCacheFileKind(lData.name) ) lNames.push_back(lData.name); while( _findnext(lFind, &lData) == 0 );
+        _findclose(lFind);
+    }
+#else
+    DIR* lDir = opendir(pDirectory);
+    if( lDir == NULL ) return 0;
+    while( dirent* lEntry = readdir(lDir) )
+    {
+        if( GetCacheFileKind(lEntry->d_name) ) lNames.push_back(lEntry->d_name);
+    }
+    closedir(lDir);
+#endif
+
+    // the temporary files left by an interrupted store are removed too, but not counted
+    int lCount = 0;
+    for( size_t i = 0; i < lNames.size(); i++ )
+    {
+        bool lRemoved = remove((std::string(pDirectory) + "/" + lNames[i]).c_str()) == 0;
+        lCount += lRemoved && GetCacheFileKind(lNames[i].c_str()) == 1;
+    }
+    return lCount;
+}
+
+void AddMeshGeometry(
+                     ContentHash& pHash,
+                     const MeshView& pMesh
+                     )
+{
+    int lCounts[3] = { pMesh.mControlPointCount, pMesh.mPolygonCount, pMesh.mPositionStride };
+    pHash.Add(lCounts, sizeof(lCounts));
+    if( pMesh.mPositions ) pHash.Add(pMesh.mPositions, sizeof(double) * pMesh.mPositionStride * pMesh.mControlPointCount);
+    if( pMesh.mPolygonStarts == NULL ) return;
+
+    pHash.Add(pMesh.mPolygonStarts, sizeof(int) * (pMesh.mPolygonCount + 1));
+    if( pMesh.mPolygonVertices ) pHash.Add(pMesh.mPolygonVertices, sizeof(int) * pMesh.mPolygonStarts[pMesh.mPolygonCount]);
+}
+
+void AddElementValues(
+                      ContentHash& pHash,
+                      const ElementView& pElement
+                      )
+{
+    int lModes[5] = { int(pElement.mMapping), int(pElement.mReference), pElement.mDirectCount, pElement.mStride,
+                      pElement.mReference == eRefDirect ? 0 : pElement.mIndexCount };
+    pHash.Add(lModes, sizeof(lModes));
+    if( pElement.mDirect ) pHash.Add(pElement.mDirect, sizeof(double) * pElement.mStride * pElement.mDirectCount);
+    if( pElement.mReference != eRefDirect && pElement.mIndex ) pHash.Add(pElement.mIndex, sizeof(int) * pElement.mIndexCount);
+}
+
+static std::string GetEntryPath(const char* pDirectory, const std::string& pKey)
+{
+    return std::string(pDirectory) + "/" + pKey + ".mesh";
+}
+
+bool LoadMeshOutputs(
+                     const char* pDirectory,
+                     const std::string& pKey,
+                     const std::vector<ElementOutput>& pOutputs,
+                     double& pMaxAngle
+                     )
+{
+    FILE* lFile = fopen(GetEntryPath(pDirectory, pKey).c_str(), "rb");
+    if( lFile == NULL ) return false;
+
+    EntryHeader lHeader;
+    bool lStatus = fread(&lHeader, sizeof(lHeader), 1, lFile) == 1 && memcmp(lHeader.mMagic, kMagic, sizeof(kMagic)) == 0 &&
+                   lHeader.mVersion == kVersion && lHeader.mArrayCount == pOutputs.size();
+
+    std::vector<double> lDistinct;
+    std::vector<int> lIndex;
+    for( size_t a = 0; a < pOutputs.size() && lStatus; a++ )
+    {
+        const ElementOutput& lOutput = pOutputs[a];
+        ArrayHeader lArray;
+        lStatus = fread(&lArray, sizeof(lArray), 1, lFile) == 1 && lArray.mStride == uint32_t(lOutput.mStride) &&
+                  lArray.mCount == uint64_t(lOutput.mCount) && lOutput.mCount >= 0;
+        if( !lStatus || lOutput.mCount == 0 ) continue;
+
+        size_t lStride = lArray.mStride;
+        if( !lArray.mCompacted )
+        {
+            lStatus = fread(lOutput.mDirect, sizeof(double) * lStride, lArray.mCount, lFile) == lArray.mCount;
+            continue;
+        }
+
+        lStatus = lArray.mDistinctCount > 0 && lArray.mDistinctCount <= lArray.mCount;
+        if( !lStatus ) break;
+        lDistinct.resize(size_t(lArray.mDistinctCount) * lStride);
+        lIndex.resize(size_t(lArray.mCount));
+        lStatus = fread(&lDistinct[0], sizeof(double) * lStride, lArray.mDistinctCount, lFile) == lArray.mDistinctCount &&
+                  fread(&lIndex[0], sizeof(int), lIndex.size(), lFile) == lIndex.size();
+        for( size_t i = 0; i < lIndex.size() && lStatus; i++ )
+        {
+            lStatus = lIndex[i] >= 0 && uint64_t(lIndex[i]) < lArray.mDistinctCount;
+            if( lStatus ) memcpy(lOutput.mDirect + i * lStride, &lDistinct[size_t(lIndex[i]) * lStride], sizeof(double) * lStride);
+        }
+    }
+
+    // nothing may follow the last array
+    char lByte;
+    lStatus = lStatus && fread(&lByte, 1, 1, lFile) == 0;
+    fclose(lFile);
+
+    if( lStatus ) pMaxAngle = lHeader.mMaxAngle;
+    return lStatus;
+}
+
+unsigned long long StoreMeshOutputs(
+                        const char* pDirectory,
+                        const std::string& pKey,
+                        const std::vector<ElementOutput>& pOutputs,
+                        double pMaxAngle,
+                        WorkStealingPool* pPool
+                        )
+{
+    // the processes sharing the directory write their own temporary file
+    static std::atomic<unsigned> sPartNumber(0);
+    std::string lPath = GetEntryPath(pDirectory, pKey);
+    std::string lPartName = lPath + "." + std::to_string((unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count()) +
+                            "." + std::to_string(sPartNumber++);
+    FILE* lFile = fopen(lPartName.c_str(), "wb");
+    if( lFile == NULL ) return 0;
+
+    EntryHeader lHeader;
+    memcpy(lHeader.mMagic, kMagic, sizeof(kMagic));
+    lHeader.mVersion = kVersion;
+    lHeader.mArrayCount = uint32_t(pOutputs.size());
+    lHeader.mReserved = 0;
+    lHeader.mMaxAngle = pMaxAngle;
+    bool lStatus = fwrite(&lHeader, sizeof(lHeader), 1, lFile) == 1;
+    unsigned long long lSize = sizeof(lHeader);
+
+    std::vector<int> lIndex, lFirst;
+    for( size_t a = 0; a < pOutputs.size() && lStatus; a++ )
+    {
+        const ElementOutput& lOutput = pOutputs[a];
+        size_t lStride = size_t(lOutput.mStride);
+        size_t lCount = size_t(std::max(lOutput.mCount, 0));
+
+        // the distinct vectors are kept when they keep every value bit for bit (-0 and 0
+        // are the same vector of CompactElement) and make the array smaller
+        int lDistinctCount = CompactElement(lOutput.mDirect, int(lCount), int(lStride), int(lStride), 0.0, pPool, lIndex, lFirst);
+        bool lCompacted = lCount > 0 && size_t(lDistinctCount) * lStride * sizeof(double) + lCount * sizeof(int) < lCount * lStride * sizeof(double);
+        for( size_t i = 0; i < lCount && lCompacted; i++ )
+        {
+            lCompacted = memcmp(lOutput.mDirect + i * lStride, lOutput.mDirect + size_t(lFirst[lIndex[i]]) * lStride, sizeof(double) * lStride) == 0;
+        }
+
+        ArrayHeader lArray;
+        lArray.mStride = uint32_t(lStride);
+        lArray.mCompacted = lCompacted ? 1 : 0;
+        lArray.mCount = lCount;
+        lArray.mDistinctCount = lCompacted ? uint64_t(lDistinctCount) : 0;
+        lStatus = fwrite(&lArray, sizeof(lArray), 1, lFile) == 1;
+        lSize += sizeof(lArray);
+        if( !lStatus || lCount == 0 ) continue;
+
+        if( !lCompacted )
+        {
+            lStatus = fwrite(lOutput.mDirect, sizeof(double) * lStride, lCount, lFile) == lCount;
+            lSize += (unsigned long long)lCount * lStride * sizeof(double);
+            continue;
+        }
+        for( int d = 0; d < lDistinctCount && lStatus; d++ )
+            lStatus = fwrite(lOutput.mDirect + size_t(lFirst[d]) * lStride, sizeof(double) * lStride, 1, lFile) == 1;
+        lStatus = lStatus && fwrite(&lIndex[0], sizeof(int), lCount, lFile) == lCount;
+        lSize += (unsigned long long)lDistinctCount * lStride * sizeof(double) + (unsigned long long)lCount * sizeof(int);
+    }
+
+    // rename replaces an entry stored meanwhile by another process, except on Windows
+    lStatus = fclose(lFile) == 0 && lStatus;
+    if( lStatus )
+    {
+#ifdef _WIN32
+        remove(lPath.c_str());
+#endif
+        lStatus = rename(lPartName.c_str(), lPath.c_str()) == 0;
+    }
+    if( !lStatus )
+    {
+        remove(lPartName.c_str());
+        return 0;
+    }
+    return lSize;
+}
@@ -0,0 +1,63 @@
+// MeshCache.h : persistent cache of the merged arrays of every mesh.
+//
+// A scene often changes a few of its meshes between two runs. The output arrays
+// of a mesh (tangents, binormals, encoded or packed smooth normals) only depend on
+// its geometry, the smooth normals read by its elements and the settings, so they
+// are stored in a directory under a fingerprint of these, and the meshes whose
+// fingerprint is found read them back instead of being merged. An entry is one
+// file: the arrays with their distinct vectors and an index when that is smaller
+// (ElementCompaction.h with a 0 tolerance, the values kept bit for bit), written
+// next to its name and renamed once complete, so several processes may share the
+// directory.
+
+#pragma once
+
+#include "MergeCore.h"
+#include "ResultCache.h"
+
+#include <string>
+#include <vector>
+
+class WorkStealingPool;
+
+// creates the directory pDirectory of a mesh cache if missing. Returns false if
+// files can't be written in it.
+bool OpenMeshCache(const char* pDirectory);
+
+// removes the entries of the mesh cache pDirectory and returns their number. The
+// temporary files of the stores which did not complete are removed too.
+int ClearMeshCache(const char* pDirectory);
+
+// adds the positions and the polygons of pMesh to pHash, not its normals
+void AddMeshGeometry(
+                     ContentHash& pHash,
+                     const MeshView& pMesh
+                     );
+
+// adds the mapping, the reference mode and the arrays of pElement to pHash
+void AddElementValues(
+                      ContentHash& pHash,
+                      const ElementView& pElement
+                      );
+
+// reads the arrays stored under pKey in pDirectory into pOutputs, and the largest
+// packing angle of the mesh in pMaxAngle. Returns false, leaving pOutputs in an
+// unknown state, if there is no entry or it does not have the count and the stride
+// of every output.
+bool LoadMeshOutputs(
+                     const char* pDirectory,
+                     const std::string& pKey,
+                     const std::vector<ElementOutput>& pOutputs,
+                     double& pMaxAngle
+                     );
+
+// stores pOutputs and pMaxAngle under pKey in pDirectory, opened by OpenMeshCache. pPool
+// looks for the distinct vectors in parallel, NULL on the calling thread.
+// Returns the size of the entry, 0 if it can't be written.
+unsigned long long StoreMeshOutputs(
+                        const char* pDirectory,
+                        const std::string& pKey,
+                        const std::vector<ElementOutput>& pOutputs,
+                        double pMaxAngle,
+                        WorkStealingPool* pPool
+                        );
@@ -0,0 +1,375 @@
+// NormalSidecar.cxx : memory mapped file of the smooth normals of a scene.
+
+#include "NormalSidecar.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char     kMagic[8] = { 'N', 'M', 'S', 'M', 'O', 'O', 'T', 'H' };
+static const uint32_t kVersion = 1;
+static const int      kStride = 3;
+
+struct FileHeader
+{
+    char     mMagic[8];
+    uint32_t mVersion;
+    uint32_t mSectionCount;
+    uint64_t mFileSize;
+};
+
+// a mesh node, followed in the file by the other ones, sorted by path
+struct SectionHeader
+{
+    uint64_t mPathOffset;
+    uint64_t mDirectOffset;
+    uint64_t mIndexOffset;          // eRefIndexToDirect only
+    uint32_t mPathLength;
+    int32_t  mMapping;
+    int32_t  mReference;
+    int32_t  mControlPointCount;
+    int32_t  mPolygonCount;
+    int32_t  mPolygonVertexCount;
+    int32_t  mDirectCount;
+    int32_t  mIndexCount;
+};
+
+static uint64_t Align8(uint64_t pOffset)
+{
+    return (pOffset + 7) & ~uint64_t(7);
+}
+
+// number of elements of a normal element with pMapping
+static int GetNormalCount(int pMapping, int pControlPointCount, int pPolygonCount, int pPolygonVertexCount)
+{
+    switch( pMapping )
+    {
+    case eMapByControlPoint:  return pControlPointCount;
+    case eMapByPolygonVertex: return pPolygonVertexCount;
+    case eMapByPolygon:       return pPolygonCount;
+    default:                  return 1;
+    }
+}
+
+static bool WritePadding(FILE* pFile, uint64_t pOffset)
+{
+    static const char kZeros[8] = { 0 };
+    size_t lPadding = size_t(Align8(pOffset) - pOffset);
+    return lPadding == 0 || fwrite(kZeros, 1, lPadding, pFile) == lPadding;
+}
+
+bool WriteNormalSidecar(
+                        const char* pFilename,
+                        const std::vector<NormalSidecarMesh>& pMeshes,
+                        std::string& pError
+                        )
+{
+    // the sections in order of path
+    std::vector<int> lOrder(pMeshes.size());
+    for( size_t i = 0; i < lOrder.size(); i++ ) lOrder[i] = int(i);
+    std::sort(lOrder.begin(), lOrder.end(), [&](int pA, int pB) { return pMeshes[pA].mPath < pMeshes[pB].mPath; });
+    for( size_t i = 0; i < lOrder.size(); i++ )
+    {
+        const NormalSidecarMesh& lMesh = pMeshes[lOrder[i]];
+        if( i > 0 && lMesh.mPath == pMeshes[lOrder[i - 1]].mPath )
+        {
+            pError = "two nodes have the path " + lMesh.mPath;
+            return false;
+        }
+        const ElementView& lNormals = lMesh.mNormals;
+        int lCount = GetNormalCount(lNormals.mMapping, lMesh.mControlPointCount, lMesh.mPolygonCount, lMesh.mPolygonVertexCount);
+        if( lNormals.mStride < kStride || lNormals.mDirect == NULL || !IsElementValid(lNormals, lCount) )
+        {
+            pError = "the normals of " + lMesh.mPath + " don't match their mesh";
+            return false;
+        }
+    }
+
+    // the paths, then the arrays, the nodes of an instanced mesh pointing at the same ones
+    std::vector<SectionHeader> lSections(pMeshes.size());
+    uint64_t lOffset = sizeof(FileHeader) + sizeof(SectionHeader) * lSections.size();
+    for( size_t i = 0; i < lOrder.size(); i++ )
+    {
+        const NormalSidecarMesh& lMesh = pMeshes[lOrder[i]];
+        SectionHeader& lSection = lSections[i];
+        memset(&lSection, 0, sizeof(lSection));
+        lSection.mPathOffset         = lOffset;
+        lSection.mPathLength         = uint32_t(lMesh.mPath.size());
+        lSection.mMapping            = int32_t(lMesh.mNormals.mMapping);
+        lSection.mReference          = int32_t(lMesh.mNormals.mReference);
+        lSection.mControlPointCount  = lMesh.mControlPointCount;
+        lSection.mPolygonCount       = lMesh.mPolygonCount;
+        lSection.mPolygonVertexCount = lMesh.mPolygonVertexCount;
+        lSection.mDirectCount        = lMesh.mNormals.mDirectCount;
+        lSection.mIndexCount         = lMesh.mNormals.mReference == eRefIndexToDirect ? lMesh.mNormals.mIndexCount : 0;
+        lOffset += lMesh.mPath.size();
+    }
+    lOffset = Align8(lOffset);
+
+    typedef std::pair<const double*, const int*> ArrayKey;
+    std::map<ArrayKey, int> lShared;    // first section of every pair of arrays
+    std::vector<int> lWritten;          // sections whose arrays are written, in file order
+    for( size_t i = 0; i < lOrder.size(); i++ )
+    {
+        const ElementView& lNormals = pMeshes[lOrder[i]].mNormals;
+        SectionHeader& lSection = lSections[i];
+        ArrayKey lKey(lNormals.mDirect, lSection.mIndexCount > 0 ? lNormals.mIndex : NULL);
+        std::map<ArrayKey, int>::const_iterator lFound = lShared.find(lKey);
+        if( lFound != lShared.end() && lSections[lFound->second].mDirectCount == lSection.mDirectCount &&
+            lSections[lFound->second].mIndexCount == lSection.mIndexCount )
+        {
+            lSection.mDirectOffset = lSections[lFound->second].mDirectOffset;
+            lSection.mIndexOffset  = lSections[lFound->second].mIndexOffset;
+            continue;
+        }
+        lShared[lKey] = int(i);
+        lWritten.push_back(int(i));
+
+        lSection.mDirectOffset = lOffset;
+        lOffset += sizeof(double) * kStride * uint64_t(lSection.mDirectCount);
+        lSection.mIndexOffset = lSection.mIndexCount > 0 ? lOffset : 0;
+        lOffset = Align8(lOffset + sizeof(int32_t) * uint64_t(lSection.mIndexCount));
+    }
+
+    FileHeader lHeader;
+    memcpy(lHeader.mMagic, kMagic, sizeof(kMagic));
+    lHeader.mVersion      = kVersion;
+    lHeader.mSectionCount = uint32_t(lSections.size());
+    lHeader.mFileSize     = lOffset;
+
+    std::string lPartName = std::string(pFilename) + "." +
+                            std::to_string((unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count());
+    FILE* lFile = fopen(lPartName.c_str(), "wb");
+    if( lFile == NULL )
+    {
+        pError = std::string("cannot write ") + pFilename;
+        return false;
+    }
+
+    bool lStatus = fwrite(&lHeader, sizeof(lHeader), 1, lFile) == 1 &&
+                   (lSections.empty() || fwrite(&lSections[0], sizeof(SectionHeader), lSections.size(), lFile) == lSections.size());
+    uint64_t lWrittenBytes = sizeof(FileHeader) + sizeof(SectionHeader) * lSections.size();
+    for( size_t i = 0; i < lOrder.size() && lStatus; i++ )
+    {
+        const std::string& lPath = pMeshes[lOrder[i]].mPath;
+        lStatus = lPath.empty() || fwrite(lPath.data(), 1, lPath.size(), lFile) == lPath.size();
+        lWrittenBytes += lPath.size();
+    }
+    lStatus = lStatus && WritePadding(lFile, lWrittenBytes);
+
+    // the direct vectors without their W, in blocks
+    std::vector<double> lBlock;
+    for( size_t w = 0; w < lWritten.size() && lStatus; w++ )
+    {
+        const SectionHeader& lSection = lSections[lWritten[w]];
+        const ElementView& lNormals = pMeshes[lOrder[lWritten[w]]].mNormals;
+        const int kBlockSize = 16 * 1024;
+        for( int lBegin = 0; lBegin < lSection.mDirectCount && lStatus; lBegin += kBlockSize )
+        {
+            int lEnd = std::min(lBegin + kBlockSize, int(lSection.mDirectCount));
+            lBlock.resize(size_t(lEnd - lBegin) * kStride);
+            for( int i = lBegin; i < lEnd; i++ )
+                memcpy(&lBlock[size_t(i - lBegin) * kStride], lNormals.mDirect + size_t(i) * lNormals.mStride, sizeof(double) * kStride);
+            lStatus = fwrite(&lBlock[0], sizeof(double) * kStride, lEnd - lBegin, lFile) == size_t(lEnd - lBegin);
+        }
+        uint64_t lEnd = lSection.mDirectOffset + sizeof(double) * kStride * uint64_t(lSection.mDirectCount);
+        if( lSection.mIndexCount > 0 )
+        {
+            lStatus = lStatus && fwrite(lNormals.mIndex, sizeof(int32_t), lSection.mIndexCount, lFile) == size_t(lSection.mIndexCount);
+            lEnd += sizeof(int32_t) * uint64_t(lSection.mIndexCount);
+        }
+        lStatus = lStatus && WritePadding(lFile, lEnd);
+    }
+
+    lStatus = fclose(lFile) == 0 && lStatus;
+    if( lStatus )
+    {
+        remove(pFilename);
+        lStatus = rename(lPartName.c_str(), pFilename) == 0;
+    }
+    if( !lStatus )
+    {
+        remove(lPartName.c_str());
+        pError = std::string("cannot write ") + pFilename;
+    }
+    return lStatus;
+}
+
+bool IsNormalSidecar(const char* pFilename)
+{
+    FILE* lFile = fopen(pFilename, "rb");
+    if( lFile == NULL ) return false;
+
+    char lMagic[sizeof(kMagic)];
+    bool lSidecar = fread(lMagic, sizeof(lMagic), 1, lFile) == 1 && memcmp(lMagic, kMagic, sizeof(kMagic)) == 0;
+    fclose(lFile);
+    return lSidecar;
+}
+
+NormalSidecarFile::NormalSidecarFile()
+    : mData(NULL)
+    , mSize(0)
+    , mMapping(NULL)
+{
+}
+
+NormalSidecarFile::~NormalSidecarFile()
+{
+    Close();
+}
+
+bool NormalSidecarFile::Open(const char* pFilename)
+{
+    Close();
+    if( !Map(pFilename) ) return false;
+    if( Parse() ) return true;
+
+    Close();
+    return false;
+}
+
+void NormalSidecarFile::Close()
+{
+    mPaths.clear();
+    mMeshes.clear();
+    mPolygonVertexCounts.clear();
+    if( mData == NULL ) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(mData);
+    CloseHandle(mMapping);
+#else
+    munmap(const_cast<unsigned char*>(mData), mSize);
+#endif
+    mData = NULL;
+    mSize = 0;
+    mMapping = NULL;
+}
+
+int NormalSidecarFile::FindMesh(const std::string& pPath) const
+{
+    std::vector<std::string>::const_iterator lFound = std::lower_bound(mPaths.begin(), mPaths.end(), pPath);
+    return lFound != mPaths.end() && *lFound == pPath ? int(lFound - mPaths.begin()) : -1;
+}
+
+bool NormalSidecarFile::Map(const char* pFilename)
+{
+    mError = std::string("cannot map ") + pFilename;
+#ifdef _WIN32
+    HANDLE lFile = CreateFileA(pFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if( lFile == INVALID_HANDLE_VALUE ) return false;
+
+    LARGE_INTEGER lSize;
+    HANDLE lMapping = NULL;
+    if( GetFileSizeEx(lFile, &lSize) && lSize.QuadPart > 0 )
+        lMapping = CreateFileMappingA(lFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(lFile);
+    if( lMapping == NULL ) return false;
+
+    void* lData = MapViewOfFile(lMapping, FILE_MAP_READ, 0, 0, 0);
+    if( lData == NULL )
+    {
+        CloseHandle(lMapping);
+        return false;
+    }
+    mMapping = lMapping;
+    mSize = size_t(lSize.QuadPart);
+#else
+    int lFile = open(pFilename, O_RDONLY);
+    if( lFile < 0 ) return false;
+
+    struct stat lStat;
+    void* lData = MAP_FAILED;
+    if( fstat(lFile, &lStat) == 0 && lStat.st_size > 0 )
+        lData = mmap(NULL, size_t(lStat.st_size), PROT_READ, MAP_PRIVATE, lFile, 0);
+    close(lFile);
+    if( lData == MAP_FAILED ) return false;
+    mSize = size_t(lStat.st_size);
+#endif
+    mData = static_cast<const unsigned char*>(lData);
+    mError.clear();
+    return true;
+}
+
+// true if pCount items of pItemSize bytes at pOffset are inside a file of pSize bytes
+static bool IsInside(uint64_t pOffset, int64_t pCount, uint64_t pItemSize, uint64_t pSize)
+{
+    return pCount >= 0 && pOffset <= pSize && uint64_t(pCount) <= (pSize - pOffset) / pItemSize;
+}
+
+bool NormalSidecarFile::Parse()
+{
+    FileHeader lHeader;
+    if( mSize < sizeof(lHeader) || memcmp(mData, kMagic, sizeof(kMagic)) != 0 )
+    {
+        mError = "not a smooth normal sidecar";
+        return false;
+    }
+    memcpy(&lHeader, mData, sizeof(lHeader));
+    if( lHeader.mVersion != kVersion )
+    {
+        char lMessage[64];
+        snprintf(lMessage, sizeof(lMessage), "sidecar version %u is not %u", lHeader.mVersion, kVersion);
+        mError = lMessage;
+        return false;
+    }
+
+    mError = "damaged sidecar";
+    if( lHeader.mFileSize != mSize || !IsInside(sizeof(lHeader), lHeader.mSectionCount, sizeof(SectionHeader), mSize) )
+        return false;
+
+    // the mapping is page aligned, so are the arrays at 8 byte offsets
+    const SectionHeader* lSections = reinterpret_cast<const SectionHeader*>(mData + sizeof(lHeader));
+    mPaths.resize(lHeader.mSectionCount);
+    mMeshes.resize(lHeader.mSectionCount);
+    mPolygonVertexCounts.resize(lHeader.mSectionCount);
+    for( uint32_t i = 0; i < lHeader.mSectionCount; i++ )
+    {
+        const SectionHeader& lSection = lSections[i];
+        bool lIndexed = lSection.mReference == eRefIndexToDirect;
+        if( !IsInside(lSection.mPathOffset, lSection.mPathLength, 1, mSize) ||
+            lSection.mMapping < eMapByControlPoint || lSection.mMapping > eMapAllSame ||
+            (lSection.mReference != eRefDirect && !lIndexed) ||
+            lSection.mControlPointCount < 0 || lSection.mPolygonCount < 0 || lSection.mPolygonVertexCount < 0 ||
+            lSection.mDirectOffset % 8 != 0 || !IsInside(lSection.mDirectOffset, lSection.mDirectCount, sizeof(double) * kStride, mSize) ||
+            (lIndexed && (lSection.mIndexOffset % 4 != 0 || !IsInside(lSection.mIndexOffset, lSection.mIndexCount, sizeof(int32_t), mSize))) )
+            return false;
+
+        mPaths[i].assign(reinterpret_cast<const char*>(mData + lSection.mPathOffset), lSection.mPathLength);
+        if( i > 0 && !(mPaths[i - 1] < mPaths[i]) ) return false;
+
+        MeshView& lView = mMeshes[i];
+        lView = MeshView();
+        lView.mPositionStride       = kStride;
+        lView.mControlPointCount    = lSection.mControlPointCount;
+        lView.mPolygonCount         = lSection.mPolygonCount;
+        lView.mNormals.mMapping     = EElementMapping(lSection.mMapping);
+        lView.mNormals.mReference   = EElementReference(lSection.mReference);
+        lView.mNormals.mDirect      = reinterpret_cast<const double*>(mData + lSection.mDirectOffset);
+        lView.mNormals.mDirectCount = lSection.mDirectCount;
+        lView.mNormals.mStride      = kStride;
+        lView.mNormals.mIndex       = lIndexed ? reinterpret_cast<const int*>(mData + lSection.mIndexOffset) : NULL;
+        lView.mNormals.mIndexCount  = lIndexed ? lSection.mIndexCount : 0;
+        mPolygonVertexCounts[i] = lSection.mPolygonVertexCount;
+    }
+    mError.clear();
+    return true;
+}
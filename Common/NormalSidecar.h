@@ -0,0 +1,81 @@
+// NormalSidecar.h : memory mapped file of the smooth normals of a scene.
+//
+// Several lighting files often share one smooth file, which is then imported
+// once per merge. A sidecar holds only what the merge reads from it: for every
+// mesh node, addressed by its path in the scene, the counts of its mesh and its
+// normal element (mapping, reference, direct vectors without W, index). It is
+// written once from the smooth scene, then mapped read-only by the merges, the
+// normals being read in place from the mapped pages. The file is little endian,
+// versioned, its sections sorted by path and its arrays 8 byte aligned; the
+// nodes of an instanced mesh share their arrays. There are no positions, so a
+// sidecar is merged with the index correspondence only.
+
+#pragma once
+
+#include "MergeCore.h"
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// a mesh node to write in a sidecar
+struct NormalSidecarMesh
+{
+    std::string mPath;              // names of the nodes from the root, separated by '/'
+    int         mControlPointCount;
+    int         mPolygonCount;
+    int         mPolygonVertexCount;
+    ElementView mNormals;           // nodes with the same arrays share them in the file
+};
+
+// writes pMeshes to pFilename, through a temporary file renamed once complete.
+// Returns false, with the reason in pError, if a path is given twice, a normal
+// element is not valid for its mesh or the file can't be written.
+bool WriteNormalSidecar(
+                        const char* pFilename,
+                        const std::vector<NormalSidecarMesh>& pMeshes,
+                        std::string& pError
+                        );
+
+// true if pFilename starts like a sidecar, of any version
+bool IsNormalSidecar(const char* pFilename);
+
+class NormalSidecarFile
+{
+public:
+    NormalSidecarFile();
+    ~NormalSidecarFile();
+
+    // maps pFilename and checks its sections, false if it is not a sidecar of this
+    // version or it is damaged (GetError). The views are valid until Close().
+    bool Open(const char* pFilename);
+    void Close();
+
+    const char* GetError() const { return mError.c_str(); }
+    size_t GetFileSize() const { return mSize; }
+
+    int GetMeshCount() const { return int(mMeshes.size()); }
+    const std::string& GetPath(int pIndex) const { return mPaths[pIndex]; }
+
+    // counts and normals of a mesh, read in the mapping: no positions nor polygons
+    const MeshView& GetMesh(int pIndex) const { return mMeshes[pIndex]; }
+    int GetPolygonVertexCount(int pIndex) const { return mPolygonVertexCounts[pIndex]; }
+
+    // the mesh of the node at pPath, -1 if there is none
+    int FindMesh(const std::string& pPath) const;
+
+private:
+    NormalSidecarFile(const NormalSidecarFile&);
+    NormalSidecarFile& operator=(const NormalSidecarFile&);
+
+    bool Map(const char* pFilename);
+    bool Parse();
+
+    const unsigned char*     mData;
+    size_t                   mSize;
+    void*                    mMapping;      // handle of the mapping on Windows
+    std::string              mError;
+    std::vector<std::string> mPaths;        // sorted
+    std::vector<MeshView>    mMeshes;
+    std::vector<int>         mPolygonVertexCounts;
+};
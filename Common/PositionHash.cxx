@@ -0,0 +1,235 @@
+// PositionHash.cxx : spatial hash of points for the weld tolerance lookups.
+
+#include "PositionHash.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <stddef.h>
+
+// cells are limited to 2^30 per axis around the origin, so that the
+// cell coordinates of any finite position stay in range
+static const double kMaxCells = 1073741824.0;
+
+// cells of at least 2 tolerances: a lookup visits 1 or 2 cells per axis
+static const double kCellScale = 2.0;
+
+// shifts the grid so that round coordinates do not fall on cell borders
+static const double kCellOffset = 0.3183098861837907;
+
+PositionHash::PositionHash(
+                           const double* pPositions,
+                           int pStride,
+                           const std::vector<int>& pPoints,
+                           double pTolerance,
+                           WorkStealingPool* pPool
+                           )
+    : mTolerance(pTolerance > 0.0 ? pTolerance : 0.0)
+{
+    const int lCount = int(pPoints.size());
+    const int kGrain = 64 * 1024;
+
+    // bounding box of the points, 6 values per chunk
+    int lChunkCount = (lCount + kGrain - 1) / kGrain;
+    std::vector<double> lChunkBounds(6 * size_t(lChunkCount > 0 ? lChunkCount : 1), 0.0);
+    ForRange(pPool, lCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        double* lBounds = &lChunkBounds[6 * size_t(pBegin / kGrain)];
+        const double* p = pPositions + size_t(pPoints[pBegin]) * pStride;
+        for( int c = 0; c < 3; c++ ) lBounds[c] = lBounds[3 + c] = p[c];
+
+        for( int i = pBegin + 1; i < pEnd; i++ )
+        {
+            p = pPositions + size_t(pPoints[i]) * pStride;
+            for( int c = 0; c < 3; c++ )
+            {
+                lBounds[c] = std::min(lBounds[c], p[c]);
+                lBounds[3 + c] = std::max(lBounds[3 + c], p[c]);
+            }
+        }
+    });
+
+    double lExtent = 0.0, lSize = 0.0;
+    for( int c = 0; c < 3; c++ )
+    {
+        double lMin = lChunkBounds[c], lMax = lChunkBounds[3 + c];
+        for( int k = 1; k < lChunkCount; k++ )
+        {
+            lMin = std::min(lMin, lChunkBounds[6 * size_t(k) + c]);
+            lMax = std::max(lMax, lChunkBounds[6 * size_t(k) + 3 + c]);
+        }
+        lExtent = std::max(lExtent, std::max(std::fabs(lMin), std::fabs(lMax)));
+        lSize = std::max(lSize, lMax - lMin);
+    }
+
+    // about one point per cell for points spread on a surface, so that the
+    // neighbouring points share the blocks of cells; never smaller than the
+    // tolerance nor small enough for the cell coordinates to overflow
+    double lSpacing = lCount > 0 ? lSize / std::sqrt(double(lCount)) : 0.0;
+    mCellSize = std::max(std::max(kCellScale * mTolerance, lSpacing), lExtent / kMaxCells);
+    if( !(mCellSize > 0.0) ) mCellSize = 1.0;
+
+    // about two buckets per point, at least a block of cells
+    unsigned lBucketCount = 512;
+    while( lBucketCount < unsigned(lCount) * 2u && lBucketCount < (1u << 30) ) lBucketCount <<= 1;
+    mBucketMask = lBucketCount - 1;
+
+    // count the points of every bucket
+    std::vector<int> lBuckets(lCount);
+    std::unique_ptr<std::atomic<int>[]> lCounts(new std::atomic<int>[lBucketCount]);
+    ForRange(pPool, int(lBucketCount), kGrain, [&](int pBegin, int pEnd)
+    {
+        for( int b = pBegin; b < pEnd; b++ ) lCounts[b].store(0, std::memory_order_relaxed);
+    });
+    ForRange(pPool, lCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            long long lCell[3];
+            GetCell(pPositions + size_t(pPoints[i]) * pStride, lCell);
+            lBuckets[i] = GetBucket(lCell[0], lCell[1], lCell[2]);
+            lCounts[lBuckets[i]].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    mBucketStarts.resize(size_t(lBucketCount) + 1);
+    int lStart = 0;
+    for( unsigned b = 0; b < lBucketCount; b++ )
+    {
+        mBucketStarts[b] = lStart;
+        lStart += lCounts[b].load(std::memory_order_relaxed);
+        lCounts[b].store(0, std::memory_order_relaxed);
+    }
+    mBucketStarts[lBucketCount] = lStart;
+
+    // scatter the points, then sort every bucket so that the result
+    // does not depend on the order the threads ran in
+    mEntries.resize(lCount);
+    ForRange(pPool, lCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            int b = lBuckets[i];
+            const double* p = pPositions + size_t(pPoints[i]) * pStride;
+
+            Entry& lEntry = mEntries[mBucketStarts[b] + lCounts[b].fetch_add(1, std::memory_order_relaxed)];
+            lEntry.mX = p[0];
+            lEntry.mY = p[1];
+            lEntry.mZ = p[2];
+            lEntry.mPoint = pPoints[i];
+        }
+    });
+    ForRange(pPool, int(lBucketCount), kGrain, [&](int pBegin, int pEnd)
+    {
+        for( int b = pBegin; b < pEnd; b++ )
+        {
+            if( mBucketStarts[b + 1] - mBucketStarts[b] > 1 )
+                std::sort(mEntries.begin() + mBucketStarts[b], mEntries.begin() + mBucketStarts[b + 1],
+                          [](const Entry& pA, const Entry& pB) { return pA.mPoint < pB.mPoint; });
+        }
+    });
+}
+
+void PositionHash::GetCell(const double* pPosition, long long pCell[3]) const
+{
+    for( int c = 0; c < 3; c++ )
+    {
+        pCell[c] = GetCellCoordinate(pPosition[c]);
+    }
+}
+
+long long PositionHash::GetCellCoordinate(double pValue) const
+{
+    double lCell = std::floor(pValue / mCellSize + kCellOffset);
+    return (long long)std::max(-kMaxCells - 2.0, std::min(kMaxCells + 2.0, lCell));
+}
+
+// The cells are grouped in blocks of 8x8x8 cells. The blocks are hashed, the
+// cells of a block get consecutive buckets, so that the lookups of neighbouring
+// positions read neighbouring memory. The windows of the blocks overlap, the
+// few extra points they put in a bucket are rejected by the distance test.
+int PositionHash::GetBucket(long long pX, long long pY, long long pZ) const
+{
+    // large odd multipliers, then a final mix of the high bits
+    unsigned long long h = (unsigned long long)(pX >> 3) * 0x9E3779B97F4A7C15ull ^
+                           (unsigned long long)(pY >> 3) * 0xC2B2AE3D27D4EB4Full ^
+                           (unsigned long long)(pZ >> 3) * 0x165667B19E3779F9ull;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+
+    unsigned lCell = unsigned(pX & 7) | unsigned(pY & 7) << 3 | unsigned(pZ & 7) << 6;
+    return int((unsigned(h) * 512u + lCell) & mBucketMask);
+}
+
+int PositionHash::FindClosest(const double* pPosition) const
+{
+    // the cells overlapped by the box of the tolerance around pPosition
+    long long lMin[3], lMax[3];
+    for( int c = 0; c < 3; c++ )
+    {
+        lMin[c] = GetCellCoordinate(pPosition[c] - mTolerance);
+        lMax[c] = GetCellCoordinate(pPosition[c] + mTolerance);
+    }
+
+    const double lMaxDistance2 = mTolerance * mTolerance;
+    double lBestDistance2 = lMaxDistance2;
+    int lBest = -1;
+
+    for( long long x = lMin[0]; x <= lMax[0]; x++ )
+    for( long long y = lMin[1]; y <= lMax[1]; y++ )
+    for( long long z = lMin[2]; z <= lMax[2]; z++ )
+    {
+        int b = GetBucket(x, y, z);
+        for( int e = mBucketStarts[b]; e < mBucketStarts[b + 1]; e++ )
+        {
+            const Entry& lEntry = mEntries[e];
+            double dx = lEntry.mX - pPosition[0], dy = lEntry.mY - pPosition[1], dz = lEntry.mZ - pPosition[2];
+            double lDistance2 = dx * dx + dy * dy + dz * dz;
+            if( lDistance2 > lMaxDistance2 ) continue;
+
+            if( lBest < 0 || lDistance2 < lBestDistance2 || (lDistance2 == lBestDistance2 && lEntry.mPoint < lBest) )
+            {
+                lBest = lEntry.mPoint;
+                lBestDistance2 = lDistance2;
+            }
+        }
+    }
+    return lBest;
+}
+
+int PositionHash::FindLowest(const double* pPosition) const
+{
+    long long lMin[3], lMax[3];
+    for( int c = 0; c < 3; c++ )
+    {
+        lMin[c] = GetCellCoordinate(pPosition[c] - mTolerance);
+        lMax[c] = GetCellCoordinate(pPosition[c] + mTolerance);
+    }
+
+    const double lMaxDistance2 = mTolerance * mTolerance;
+    int lLowest = -1;
+
+    for( long long x = lMin[0]; x <= lMax[0]; x++ )
+    for( long long y = lMin[1]; y <= lMax[1]; y++ )
+    for( long long z = lMin[2]; z <= lMax[2]; z++ )
+    {
+        // the points of a bucket are in increasing order, the first one in range is its lowest
+        int b = GetBucket(x, y, z);
+        for( int e = mBucketStarts[b]; e < mBucketStarts[b + 1]; e++ )
+        {
+            const Entry& lEntry = mEntries[e];
+            if( lLowest >= 0 && lEntry.mPoint >= lLowest ) break;
+
+            double dx = lEntry.mX - pPosition[0], dy = lEntry.mY - pPosition[1], dz = lEntry.mZ - pPosition[2];
+            if( dx * dx + dy * dy + dz * dz > lMaxDistance2 ) continue;
+
+            lLowest = lEntry.mPoint;
+            break;
+        }
+    }
+    return lLowest;
+}
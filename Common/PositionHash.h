@@ -0,0 +1,51 @@
+// PositionHash.h : spatial hash of points for the weld tolerance lookups.
+//
+// The points are put in a uniform grid of cells of about the point spacing and
+// at least twice the tolerance, so the points within the tolerance of a position
+// are in at most 8 cells. Blocks of cells are hashed into a bucket array stored
+// as one sorted list, built in parallel; a lookup costs O(1) expected.
+
+#pragma once
+
+#include <vector>
+
+class WorkStealingPool;
+
+class PositionHash
+{
+public:
+    // hashes the points pPoints[i] of the strided pPositions array, the positions are copied.
+    // pPool runs the build in parallel, NULL builds on the calling thread.
+    PositionHash(
+                 const double* pPositions,
+                 int pStride,
+                 const std::vector<int>& pPoints,
+                 double pTolerance,
+                 WorkStealingPool* pPool
+                 );
+
+    // the hashed point closest to pPosition within the tolerance,
+    // the lowest one on ties, -1 if there is none
+    int FindClosest(const double* pPosition) const;
+
+    // the lowest hashed point within the tolerance of pPosition, -1 if there is none
+    int FindLowest(const double* pPosition) const;
+
+private:
+    void      GetCell(const double* pPosition, long long pCell[3]) const;
+    long long GetCellCoordinate(double pValue) const;
+    int       GetBucket(long long pX, long long pY, long long pZ) const;
+
+    // a copy of the position, so that a lookup reads a single array
+    struct Entry
+    {
+        double mX, mY, mZ;
+        int    mPoint;
+    };
+
+    double             mTolerance;
+    double             mCellSize;
+    unsigned           mBucketMask;
+    std::vector<int>   mBucketStarts;   // mBucketMask + 2 entries
+    std::vector<Entry> mEntries;        // points of every bucket, in increasing order
+};
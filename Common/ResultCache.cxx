@@ -0,0 +1,448 @@
+// ResultCache.cxx : content addressed cache of the merged files.
+
+#include "ResultCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+static const char* kIndexHeader = "NormalMergerCache";
+static const int   kIndexVersion = 1;
+static const int   kKeyLength = 32;
+
+static const uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t kPrime3 = 0x165667B19E3779F9ull;
+static const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+static uint64_t RotateLeft(uint64_t pValue, int pBits)
+{
+    return (pValue << pBits) | (pValue >> (64 - pBits));
+}
+
+static uint64_t MixLane(uint64_t pLane, uint64_t pWord)
+{
+    return RotateLeft(pLane + pWord * kPrime2, 31) * kPrime1;
+}
+
+static uint64_t Avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+ContentHash::ContentHash()
+    : mSize(0)
+    , mTailSize(0)
+{
+    mLanes[0] = kPrime1 + kPrime2;
+    mLanes[1] = kPrime2;
+    mLanes[2] = 0;
+    mLanes[3] = 0 - kPrime1;
+}
+
+void ContentHash::Add(const void* pData, size_t pSize)
+{
+    const unsigned char* lData = (const unsigned char*)pData;
+    mSize += pSize;
+    if( mTailSize > 0 )
+    {
+        size_t lCount = std::min(pSize, sizeof(mTail) - mTailSize);
+        memcpy(mTail + mTailSize, lData, lCount);
+        mTailSize += lCount;
+        lData += lCount;
+        pSize -= lCount;
+        if( mTailSize < sizeof(mTail) ) return;
+        AddBlock(mTail);
+        mTailSize = 0;
+    }
+    for( ; pSize >= sizeof(mTail); lData += sizeof(mTail), pSize -= sizeof(mTail) ) AddBlock(lData);
+    memcpy(mTail, lData, pSize);
+    mTailSize = pSize;
+}
+
+// the lanes are folded in both orders for the two halves of the digest
+std::string ContentHash::GetDigest() const
+{
+    uint64_t lHalves[2];
+    for( int k = 0; k < 2; k++ )
+    {
+        const uint64_t* l = mLanes;
+        uint64_t h = k == 0 ? RotateLeft(l[0], 1) + RotateLeft(l[1], 7) + RotateLeft(l[2], 12) + RotateLeft(l[3], 18)
+                            : RotateLeft(l[3], 1) + RotateLeft(l[2], 7) + RotateLeft(l[1], 12) + RotateLeft(l[0], 18) + kPrime5;
+        for( int i = 0; i < 4; i++ ) h = (h ^ MixLane(0, l[k == 0 ? i : 3 - i])) * kPrime1 + kPrime4;
+        h += mSize;
+        for( size_t i = 0; i < mTailSize; i++ ) h = RotateLeft(h ^ (mTail[i] * kPrime5), 11) * kPrime1;
+        lHalves[k] = Avalanche(h);
+    }
+
+    char lText[kKeyLength + 1];
+    snprintf(lText, sizeof(lText), "%016llx%016llx", (unsigned long long)lHalves[0], (unsigned long long)lHalves[1]);
+    return lText;
+}
+
+void ContentHash::AddBlock(const unsigned char* pBlock)
+{
+    uint64_t lWords[4];
+    memcpy(lWords, pBlock, sizeof(lWords));
+    for( int i = 0; i < 4; i++ ) mLanes[i] = MixLane(mLanes[i], lWords[i]);
+}
+
+bool HashFile(
+              const char* pFilename,
+              std::string& pDigest
+              )
+{
+    FILE* lFile = fopen(pFilename, "rb");
+    if( lFile == NULL ) return false;
+
+    ContentHash lHash;
+    std::vector<unsigned char> lBuffer(1 << 20);
+    size_t lRead;
+    while( (lRead = fread(&lBuffer[0], 1, lBuffer.size(), lFile)) > 0 ) lHash.Add(&lBuffer[0], lRead);
+    bool lStatus = ferror(lFile) == 0;
+    fclose(lFile);
+
+    if( lStatus ) pDigest = lHash.GetDigest();
+    return lStatus;
+}
+
+std::string HashText(const std::string& pText)
+{
+    ContentHash lHash;
+    lHash.Add(pText.data(), pText.size());
+    return lHash.GetDigest();
+}
+
+// copies pSource to pCopy through a temporary file renamed once complete, pBytes
+// receives the size of the copy. pSourceFailed is set when pSource can't be read,
+// the other failures being those of pCopy.
+static bool CopyWhole(
+                      const std::string& pSource,
+                      const std::string& pCopy,
+                      unsigned long long& pBytes,
+                      bool& pSourceFailed
+                      )
+{
+    FILE* lSource = fopen(pSource.c_str(), "rb");
+    pSourceFailed = lSource == NULL;
+    if( lSource == NULL ) return false;
+
+    std::string lPartName = pCopy + ".part";
+    FILE* lCopy = fopen(lPartName.c_str(), "wb");
+    if( lCopy == NULL )
+    {
+        fclose(lSource);
+        return false;
+    }
+
+    pBytes = 0;
+    bool lStatus = true;
+    std::vector<unsigned char> lBuffer(1 << 20);
+    size_t lRead;
+    while( lStatus && (lRead = fread(&lBuffer[0], 1, lBuffer.size(), lSource)) > 0 )
+    {
+        lStatus = fwrite(&lBuffer[0], 1, lRead, lCopy) == lRead;
+        pBytes += lRead;
+    }
+    pSourceFailed = ferror(lSource) != 0;
+    lStatus = !pSourceFailed && lStatus;
+    fclose(lSource);
+    lStatus = fclose(lCopy) == 0 && lStatus;
+
+    if( lStatus )
+    {
+        remove(pCopy.c_str());
+        lStatus = rename(lPartName.c_str(), pCopy.c_str()) == 0;
+    }
+    if( !lStatus ) remove(lPartName.c_str());
+    return lStatus;
+}
+
+static bool IsKey(const std::string& pKey)
+{
+    if( pKey.size() != size_t(kKeyLength) ) return false;
+    for( size_t i = 0; i < pKey.size(); i++ )
+    {
+        if( !((pKey[i] >= '0' && pKey[i] <= '9') || (pKey[i] >= 'a' && pKey[i] <= 'f')) ) return false;
+    }
+    return true;
+}
+
+ResultCache::ResultCache()
+    : mMaxBytes(0)
+    , mBytes(0)
+    , mClock(0)
+    , mPartNumber(0)
+    , mChanged(false)
+{
+}
+
+ResultCache::~ResultCache()
+{
+    Flush();
+}
+
+bool ResultCache::Flush()
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    if( mDirectory.empty() || !mChanged ) return true;
+    return WriteIndex();
+}
+
+bool ResultCache::Open(
+                       const char* pDirectory,
+                       unsigned long long pMaxBytes,
+                       std::string& pError
+                       )
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    mDirectory = pDirectory;
+    mMaxBytes = pMaxBytes;
+    mStats = CacheStats();
+
+#ifdef _WIN32
+    _mkdir(pDirectory);
+#else
+    mkdir(pDirectory, 0777);
+#endif
+
+    // the size may have been lowered since the last run
+    bool lStatus = ReadIndex(pError);
+    if( lStatus ) Evict();
+    if( lStatus && !WriteIndex() )
+    {
+        pError = std::string("cannot write the cache index in ") + pDirectory;
+        lStatus = false;
+    }
+    if( !lStatus )
+    {
+        mDirectory.clear();
+        mEntries.clear();
+    }
+    return lStatus;
+}
+
+std::string ResultCache::GetEntryPath(const std::string& pKey) const
+{
+    return mDirectory + "/" + pKey + ".out";
+}
+
+bool ResultCache::ReadIndex(std::string& pError)
+{
+    mEntries.clear();
+    mBytes = 0;
+    mClock = 0;
+
+    std::string lPath = mDirectory + "/index";
+    FILE* lFile = fopen(lPath.c_str(), "r");
+    if( lFile == NULL ) return true;
+
+    char lHeader[32];
+    int lVersion = 0;
+    bool lStatus = fscanf(lFile, "%31s %d %llu", lHeader, &lVersion, &mClock) == 3 &&
+                   strcmp(lHeader, kIndexHeader) == 0 && lVersion == kIndexVersion;
+
+    char lKey[64];
+    Entry lEntry;
+    while( lStatus && fscanf(lFile, "%63s %llu %llu", lKey, &lEntry.mBytes, &lEntry.mLastUse) == 3 )
+    {
+        lStatus = IsKey(lKey);
+        if( !lStatus ) break;
+
+        std::map<std::string, Entry>::iterator lFound = mEntries.find(lKey);
+        if( lFound != mEntries.end() ) mBytes -= lFound->second.mBytes;
+        mEntries[lKey] = lEntry;
+        mBytes += lEntry.mBytes;
+        if( lEntry.mLastUse > mClock ) mClock = lEntry.mLastUse;
+    }
+    lStatus = lStatus && feof(lFile);
+    fclose(lFile);
+
+    if( !lStatus ) pError = "damaged cache index " + lPath;
+    return lStatus;
+}
+
+bool ResultCache::WriteIndex()
+{
+    std::string lPath = mDirectory + "/index";
+    std::string lPartName = lPath + ".part";
+    FILE* lFile = fopen(lPartName.c_str(), "w");
+    if( lFile == NULL ) return false;
+
+    bool lStatus = fprintf(lFile, "%s %d %llu\n", kIndexHeader, kIndexVersion, mClock) > 0;
+    for( std::map<std::string, Entry>::const_iterator i = mEntries.begin(); i != mEntries.end() && lStatus; ++i )
+        lStatus = fprintf(lFile, "%s %llu %llu\n", i->first.c_str(), i->second.mBytes, i->second.mLastUse) > 0;
+    lStatus = fclose(lFile) == 0 && lStatus;
+
+    if( lStatus )
+    {
+        remove(lPath.c_str());
+        lStatus = rename(lPartName.c_str(), lPath.c_str()) == 0;
+    }
+    if( !lStatus ) remove(lPartName.c_str());
+    mChanged = !lStatus;
+    return lStatus;
+}
+
+void ResultCache::Evict()
+{
+    while( mBytes > mMaxBytes && !mEntries.empty() )
+    {
+        std::map<std::string, Entry>::iterator lOldest = mEntries.begin();
+        for( std::map<std::string, Entry>::iterator i = mEntries.begin(); i != mEntries.end(); ++i )
+        {
+            if( i->second.mLastUse < lOldest->second.mLastUse ) lOldest = i;
+        }
+
+        remove(GetEntryPath(lOldest->first).c_str());
+        mBytes -= lOldest->second.mBytes;
+        mEntries.erase(lOldest);
+        mStats.mEvictions++;
+    }
+}
+
+bool ResultCache::Fetch(
+                        const std::string& pKey,
+                        const char* pOutput
+                        )
+{
+    std::string lPath;
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        std::map<std::string, Entry>::iterator lFound = mEntries.find(pKey);
+        if( mDirectory.empty() || lFound == mEntries.end() )
+        {
+            mStats.mMisses++;
+            return false;
+        }
+
+        // the use is written to the index with the next store or Flush()
+        lFound->second.mLastUse = ++mClock;
+        mChanged = true;
+        lPath = GetEntryPath(pKey);
+    }
+
+    // an entry evicted meanwhile may fail to copy, and is a miss; so is an output that
+    // can't be written, the entry being kept
+    unsigned long long lBytes = 0;
+    bool lEntryFailed;
+    bool lCopied = CopyWhole(lPath, pOutput, lBytes, lEntryFailed);
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    std::map<std::string, Entry>::iterator lFound = mEntries.find(pKey);
+    if( lFound != mEntries.end() && (lEntryFailed || (lCopied && lFound->second.mBytes != lBytes)) )
+    {
+        // the file of the entry is missing or was changed, forget it
+        remove(lPath.c_str());
+        mBytes -= lFound->second.mBytes;
+        mEntries.erase(lFound);
+        WriteIndex();
+        if( lCopied ) remove(pOutput);
+        lCopied = false;
+    }
+    if( !lCopied )
+    {
+        mStats.mMisses++;
+        return false;
+    }
+
+    mStats.mHits++;
+    mStats.mHitBytes += double(lBytes);
+    return true;
+}
+
+bool ResultCache::Store(
+                        const std::string& pKey,
+                        const char* pOutput
+                        )
+{
+    std::string lPartName;
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        if( mDirectory.empty() || !IsKey(pKey) ) return false;
+        lPartName = mDirectory + "/" + pKey + "." + std::to_string(++mPartNumber);
+    }
+
+    // copied outside of the lock, then renamed to its entry
+    unsigned long long lBytes = 0;
+    bool lOutputFailed;
+    if( !CopyWhole(pOutput, lPartName, lBytes, lOutputFailed) ) return false;
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    if( lBytes > mMaxBytes )
+    {
+        remove(lPartName.c_str());
+        return false;
+    }
+
+    std::string lPath = GetEntryPath(pKey);
+    std::map<std::string, Entry>::iterator lFound = mEntries.find(pKey);
+    if( lFound != mEntries.end() )
+    {
+        mBytes -= lFound->second.mBytes;
+        mEntries.erase(lFound);
+    }
+    remove(lPath.c_str());
+    if( rename(lPartName.c_str(), lPath.c_str()) != 0 )
+    {
+        remove(lPartName.c_str());
+        WriteIndex();
+        return false;
+    }
+
+    Entry lEntry;
+    lEntry.mBytes = lBytes;
+    lEntry.mLastUse = ++mClock;
+    mEntries[pKey] = lEntry;
+    mBytes += lBytes;
+    mStats.mStores++;
+    mStats.mStoredBytes += double(lBytes);
+
+    Evict();
+    return WriteIndex();
+}
+
+void ResultCache::Clear()
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    if( mDirectory.empty() ) return;
+
+    for( std::map<std::string, Entry>::const_iterator i = mEntries.begin(); i != mEntries.end(); ++i )
+        remove(GetEntryPath(i->first).c_str());
+    mEntries.clear();
+    mBytes = 0;
+    mChanged = false;
+    remove((mDirectory + "/index").c_str());
+}
+
+CacheStats ResultCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    return mStats;
+}
+
+int ResultCache::GetEntryCount() const
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    return int(mEntries.size());
+}
+
+unsigned long long ResultCache::GetBytes() const
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    return mBytes;
+}
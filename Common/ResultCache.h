@@ -0,0 +1,130 @@
+// ResultCache.h : content addressed cache of the merged files.
+//
+// Most pairs of a nightly batch have not changed since the last run. A job is
+// keyed by a hash of the bytes of its input files and of the text of its settings
+// (tool and SDK versions, merge kernel, options), and its output is kept in the
+// cache directory under that key. A job whose key is found gets a copy of the
+// stored output without loading any scene. The cache holds at most a given number
+// of bytes, the least recently used outputs are removed first. The index of the
+// entries is a text file of the directory, rewritten when it changes; one process
+// uses a directory at a time, its threads may share the cache.
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// what a cache did since it was opened
+struct CacheStats
+{
+    int    mHits;
+    int    mMisses;
+    int    mStores;
+    int    mEvictions;
+    double mHitBytes;           // copied from the cache
+    double mStoredBytes;        // copied to the cache
+
+    CacheStats() : mHits(0), mMisses(0), mStores(0), mEvictions(0), mHitBytes(0.0), mStoredBytes(0.0) {}
+};
+
+// 128 bit hash of a stream of bytes and of its length: four 64 bit lanes over the
+// 32 byte blocks, like xxHash64, the state being folded twice for the two halves
+class ContentHash
+{
+public:
+    ContentHash();
+
+    void Add(const void* pData, size_t pSize);
+
+    // 32 hex digits
+    std::string GetDigest() const;
+
+private:
+    void AddBlock(const unsigned char* pBlock);
+
+    uint64_t      mLanes[4];
+    uint64_t      mSize;
+    unsigned char mTail[32];
+    size_t        mTailSize;
+};
+
+// 128 bit hash of the bytes of pFilename and of its size, as 32 hex digits.
+// Returns false if the file can't be read.
+bool HashFile(
+              const char* pFilename,
+              std::string& pDigest
+              );
+
+// same for the characters of pText
+std::string HashText(const std::string& pText);
+
+class ResultCache
+{
+public:
+    ResultCache();
+    ~ResultCache();
+
+    // uses the directory pDirectory, created if missing, holding at most pMaxBytes of
+    // outputs. Returns false, with the reason in pError, if it can't be created or its
+    // index read.
+    bool Open(
+              const char* pDirectory,
+              unsigned long long pMaxBytes,
+              std::string& pError
+              );
+
+    bool IsOpen() const { return !mDirectory.empty(); }
+
+    // copies the output stored under pKey to pOutput, false if there is none or the
+    // copy fails. The entry becomes the most recently used one.
+    bool Fetch(
+               const std::string& pKey,
+               const char* pOutput
+               );
+
+    // stores a copy of pOutput under pKey, then removes the least recently used entries
+    // until the cache fits its size. An output larger than the cache is not stored.
+    bool Store(
+               const std::string& pKey,
+               const char* pOutput
+               );
+
+    // writes the index if the fetches changed the order of the entries, done by the
+    // destructor too
+    bool Flush();
+
+    // removes all the entries and the index
+    void Clear();
+
+    CacheStats GetStats() const;
+    int GetEntryCount() const;
+    unsigned long long GetBytes() const;
+
+private:
+    ResultCache(const ResultCache&);
+    ResultCache& operator=(const ResultCache&);
+
+    struct Entry
+    {
+        unsigned long long mBytes;
+        unsigned long long mLastUse;    // value of mClock at the last store or fetch
+    };
+
+    std::string GetEntryPath(const std::string& pKey) const;
+    bool ReadIndex(std::string& pError);
+    bool WriteIndex();
+    void Evict();
+
+    std::string                  mDirectory;
+    unsigned long long           mMaxBytes;
+    unsigned long long           mBytes;
+    unsigned long long           mClock;
+    unsigned long long           mPartNumber;   // names the copies in progress
+    bool                         mChanged;      // the index on disk is older than mEntries
+    std::map<std::string, Entry> mEntries;
+    CacheStats                   mStats;
+    mutable std::mutex           mMutex;
+};
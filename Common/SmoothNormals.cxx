@@ -0,0 +1,168 @@
+// SmoothNormals.cxx : smooth normals computed from the lighting mesh itself.
+
+#include "SmoothNormals.h"
+#include "PositionHash.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <functional>
+#include <stddef.h>
+
+// Newell normal of the polygon, twice its area long for a planar polygon
+static void GetPolygonNormal(const MeshView& pMesh, int pStart, int pSize, double pNormal[3])
+{
+    pNormal[0] = pNormal[1] = pNormal[2] = 0.0;
+    for( int k = 0; k < pSize; k++ )
+    {
+        const double* a = pMesh.mPositions + size_t(pMesh.mPolygonVertices[pStart + k]) * pMesh.mPositionStride;
+        const double* b = pMesh.mPositions + size_t(pMesh.mPolygonVertices[pStart + (k + 1) % pSize]) * pMesh.mPositionStride;
+        pNormal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+        pNormal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+        pNormal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+    }
+}
+
+// angle of the polygon at its corner k, between the edges to the previous and the next corner
+static double GetCornerAngle(const MeshView& pMesh, int pStart, int pSize, int k)
+{
+    const double* lPrevious = pMesh.mPositions + size_t(pMesh.mPolygonVertices[pStart + (k + pSize - 1) % pSize]) * pMesh.mPositionStride;
+    const double* lCorner   = pMesh.mPositions + size_t(pMesh.mPolygonVertices[pStart + k]) * pMesh.mPositionStride;
+    const double* lNext     = pMesh.mPositions + size_t(pMesh.mPolygonVertices[pStart + (k + 1) % pSize]) * pMesh.mPositionStride;
+
+    double u[3], v[3];
+    for( int c = 0; c < 3; c++ )
+    {
+        u[c] = lPrevious[c] - lCorner[c];
+        v[c] = lNext[c] - lCorner[c];
+    }
+    double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+    return std::atan2(std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]), u[0] * v[0] + u[1] * v[1] + u[2] * v[2]);
+}
+
+void ComputeSmoothNormals(
+                          const MeshView& pMesh,
+                          ESmoothWeighting pWeighting,
+                          double pTolerance,
+                          WorkStealingPool* pPool,
+                          std::vector<double>& pNormals
+                          )
+{
+    const int kGrain = 16 * 1024;
+    int lControlPointCount = pMesh.mControlPointCount;
+    int lPolygonVertexCount = pMesh.mPolygonStarts[pMesh.mPolygonCount];
+
+    // the polygons with a corner out of range are left out
+    std::vector<char> lValid(pMesh.mPolygonCount, 1);
+    std::vector<char> lUsed(lControlPointCount, 0);
+    for( int p = 0; p < pMesh.mPolygonCount; p++ )
+    {
+        for( int i = pMesh.mPolygonStarts[p]; i < pMesh.mPolygonStarts[p + 1]; i++ )
+        {
+            int lControlPoint = pMesh.mPolygonVertices[i];
+            if( lControlPoint < 0 || lControlPoint >= lControlPointCount ) lValid[p] = 0;
+        }
+        for( int i = pMesh.mPolygonStarts[p]; i < pMesh.mPolygonStarts[p + 1] && lValid[p]; i++ ) lUsed[pMesh.mPolygonVertices[i]] = 1;
+    }
+
+    std::vector<int> lPoints;
+    for( int i = 0; i < lControlPointCount; i++ )
+    {
+        if( lUsed[i] ) lPoints.push_back(i);
+    }
+
+    // lWeld[c] is the welded point of the control point c, -1 if c is not used.
+    // A point is within the tolerance of itself, so lWeld[c] <= c.
+    std::vector<int> lWeld(lControlPointCount, -1);
+    {
+        PositionHash lHash(pMesh.mPositions, pMesh.mPositionStride, lPoints, pTolerance, pPool);
+        ForRange(pPool, int(lPoints.size()), kGrain, [&](int pBegin, int pEnd)
+        {
+            for( int i = pBegin; i < pEnd; i++ )
+                lWeld[lPoints[i]] = lHash.FindLowest(pMesh.mPositions + size_t(lPoints[i]) * pMesh.mPositionStride);
+        });
+    }
+
+    // a chain of points closer than the tolerance ends at its lowest point
+    for( int i = 0; i < lControlPointCount; i++ )
+    {
+        if( lWeld[i] >= 0 ) lWeld[i] = lWeld[lWeld[i]];
+    }
+
+    // the weighted polygon normal at every polygon-vertex
+    std::vector<double> lCorners(size_t(lPolygonVertexCount) * 3, 0.0);
+    ForRange(pPool, pMesh.mPolygonCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        for( int p = pBegin; p < pEnd; p++ )
+        {
+            int lStart = pMesh.mPolygonStarts[p];
+            int lSize = pMesh.mPolygonStarts[p + 1] - lStart;
+            if( lSize < 3 || !lValid[p] ) continue;
+
+            double lNormal[3];
+            GetPolygonNormal(pMesh, lStart, lSize, lNormal);
+
+            double lScale = 1.0;
+            if( pWeighting == eWeightAngle )
+            {
+                double lLength = std::sqrt(lNormal[0] * lNormal[0] + lNormal[1] * lNormal[1] + lNormal[2] * lNormal[2]);
+                if( lLength == 0.0 ) continue;
+                lScale = 1.0 / lLength;
+            }
+
+            for( int k = 0; k < lSize; k++ )
+            {
+                double lWeight = pWeighting == eWeightAngle ? lScale * GetCornerAngle(pMesh, lStart, lSize, k) : 1.0;
+                double* lCorner = &lCorners[size_t(lStart + k) * 3];
+                for( int c = 0; c < 3; c++ ) lCorner[c] = lWeight * lNormal[c];
+            }
+        }
+    });
+
+    // counting sort of the polygon-vertices by welded point, in increasing order in a group
+    std::vector<int> lGroupStarts(size_t(lControlPointCount) + 1, 0);
+    for( int i = 0; i < lPolygonVertexCount; i++ )
+    {
+        int lControlPoint = pMesh.mPolygonVertices[i];
+        if( lControlPoint >= 0 && lControlPoint < lControlPointCount && lWeld[lControlPoint] >= 0 ) lGroupStarts[lWeld[lControlPoint] + 1]++;
+    }
+    for( int i = 0; i < lControlPointCount; i++ ) lGroupStarts[i + 1] += lGroupStarts[i];
+
+    std::vector<int> lGroups(lGroupStarts[lControlPointCount]);
+    std::vector<int> lFill(lGroupStarts.begin(), lGroupStarts.end() - 1);
+    for( int i = 0; i < lPolygonVertexCount; i++ )
+    {
+        int lControlPoint = pMesh.mPolygonVertices[i];
+        if( lControlPoint >= 0 && lControlPoint < lControlPointCount && lWeld[lControlPoint] >= 0 ) lGroups[lFill[lWeld[lControlPoint]]++] = i;
+    }
+    std::vector<int>().swap(lFill);
+
+    // the sum of every group, in polygon-vertex order, then the welded points take the sum of their group
+    pNormals.assign(size_t(lControlPointCount) * 4, 0.0);
+    ForRange(pPool, lControlPointCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            double* lNormal = &pNormals[size_t(i) * 4];
+            lNormal[3] = 1.0;
+            if( lWeld[i] != i ) continue;
+
+            double lSum[3] = { 0.0, 0.0, 0.0 };
+            for( int g = lGroupStarts[i]; g < lGroupStarts[i + 1]; g++ )
+            {
+                const double* lCorner = &lCorners[size_t(lGroups[g]) * 3];
+                for( int c = 0; c < 3; c++ ) lSum[c] += lCorner[c];
+            }
+
+            double lLength = std::sqrt(lSum[0] * lSum[0] + lSum[1] * lSum[1] + lSum[2] * lSum[2]);
+            for( int c = 0; c < 3 && lLength > 0.0; c++ ) lNormal[c] = lSum[c] / lLength;
+        }
+    });
+    ForRange(pPool, lControlPointCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            if( lWeld[i] >= 0 && lWeld[i] != i )
+                for( int c = 0; c < 3; c++ ) pNormals[size_t(i) * 4 + c] = pNormals[size_t(lWeld[i]) * 4 + c];
+        }
+    });
+}
@@ -0,0 +1,37 @@
+// SmoothNormals.h : smooth normals computed from the lighting mesh itself.
+//
+// Used when no smooth mesh is given. The control points closer than the weld
+// tolerance are welded (the seams of the UVs and of the hard edges split them),
+// and every welded point gets the sum of the normals of the polygons around it,
+// weighted by the polygon area or by the angle of the polygon at the point.
+// The corners are weighted per polygon, then gathered per welded point through a
+// counting sort, so that the passes run in parallel without locks and the result
+// does not depend on the number of threads.
+
+#pragma once
+
+#include "MergeCore.h"
+
+#include <vector>
+
+class WorkStealingPool;
+
+// weight of a polygon in the normal of its corners
+enum ESmoothWeighting
+{
+    eWeightArea,    // polygon area, big polygons dominate
+    eWeightAngle    // angle at the corner, independent of the tessellation
+};
+
+// pNormals receives the smooth normal of every control point of pMesh, 4 doubles
+// per control point (unit length, W = 1). A control point joins the lowest used
+// control point within pTolerance. Control points used by no polygon, and points
+// whose polygons are all degenerate, get a null vector. pPool runs the passes in
+// parallel, NULL runs them on the calling thread.
+void ComputeSmoothNormals(
+                          const MeshView& pMesh,
+                          ESmoothWeighting pWeighting,
+                          double pTolerance,
+                          WorkStealingPool* pPool,
+                          std::vector<double>& pNormals
+                          );
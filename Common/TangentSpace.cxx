@@ -0,0 +1,356 @@
+// TangentSpace.cxx : tangent basis of the lighting mesh and tangent space smooth normals.
+
+#include "TangentSpace.h"
+#include "PositionHash.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stddef.h>
+
+static double Dot(const double* a, const double* b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// pVector without its component along the unit pNormal, normalized; false if nothing is left
+static bool ProjectNormalize(const double* pNormal, const double* pVector, double pResult[3])
+{
+    double d = Dot(pNormal, pVector);
+    for( int c = 0; c < 3; c++ ) pResult[c] = pVector[c] - d * pNormal[c];
+
+    double lLength = std::sqrt(Dot(pResult, pResult));
+    if( !(lLength > 0.0) ) return false;
+    for( int c = 0; c < 3; c++ ) pResult[c] /= lLength;
+    return true;
+}
+
+// unit normal of a polygon-vertex, a null vector if it has no length
+static void GetUnitNormal(const MeshView& pMesh, int pPolygon, int pPolygonVertex, double pNormal[3])
+{
+    const double* n = GetElementValue(pMesh.mNormals, pPolygon, pPolygonVertex, pMesh.mPolygonVertices[pPolygonVertex]);
+    double lLength = std::sqrt(Dot(n, n));
+    for( int c = 0; c < 3; c++ ) pNormal[c] = lLength > 0.0 ? n[c] / lLength : 0.0;
+}
+
+// twice the signed area of a triangle in UV space
+static double GetUVArea(const double* a, const double* b, const double* c)
+{
+    return (b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]);
+}
+
+// adds the angle weighted tangent of the triangle pCorners (polygon-vertices) to their sums
+static void AddTriangle(
+                        const MeshView& pMesh,
+                        const ElementView& pUVs,
+                        int pPolygon,
+                        const int pCorners[3],
+                        double pSign,
+                        double* pSums
+                        )
+{
+    const double* p[3];
+    const double* t[3];
+    for( int k = 0; k < 3; k++ )
+    {
+        int lControlPoint = pMesh.mPolygonVertices[pCorners[k]];
+        p[k] = pMesh.mPositions + size_t(lControlPoint) * pMesh.mPositionStride;
+        t[k] = GetElementValue(pUVs, pPolygon, pCorners[k], lControlPoint);
+    }
+
+    // degenerate in UV space: no tangent, like MikkTSpace
+    if( GetUVArea(t[0], t[1], t[2]) == 0.0 ) return;
+
+    // direction of increasing U: the V derivatives cancel
+    double t1 = t[1][1] - t[0][1], t2 = t[2][1] - t[0][1];
+    double lTangent[3];
+    for( int c = 0; c < 3; c++ ) lTangent[c] = pSign * (t2 * (p[1][c] - p[0][c]) - t1 * (p[2][c] - p[0][c]));
+
+    for( int k = 0; k < 3; k++ )
+    {
+        double n[3], lProjected[3];
+        GetUnitNormal(pMesh, pPolygon, pCorners[k], n);
+        if( !ProjectNormalize(n, lTangent, lProjected) ) continue;
+
+        // angle of the corner between its edges projected on the plane of the normal
+        double lEdge1[3], lEdge2[3], e1[3], e2[3];
+        for( int c = 0; c < 3; c++ )
+        {
+            lEdge1[c] = p[(k + 1) % 3][c] - p[k][c];
+            lEdge2[c] = p[(k + 2) % 3][c] - p[k][c];
+        }
+        if( !ProjectNormalize(n, lEdge1, e1) || !ProjectNormalize(n, lEdge2, e2) ) continue;
+        double lAngle = std::acos(std::max(-1.0, std::min(1.0, Dot(e1, e2))));
+
+        double* lSum = pSums + size_t(pCorners[k]) * 4;
+        for( int c = 0; c < 3; c++ ) lSum[c] += lAngle * lProjected[c];
+    }
+}
+
+// the triangles of a polygon: quads split along the shorter UV diagonal (the shorter
+// position diagonal on ties), the others fanned. Returns the triangle count.
+static int TriangulatePolygon(
+                              const MeshView& pMesh,
+                              const ElementView& pUVs,
+                              int pPolygon,
+                              std::vector<int>& pTriangles
+                              )
+{
+    int lStart = pMesh.mPolygonStarts[pPolygon];
+    int lSize = pMesh.mPolygonStarts[pPolygon + 1] - lStart;
+    pTriangles.clear();
+    if( lSize < 3 ) return 0;
+
+    bool lDiagonal02 = true;
+    if( lSize == 4 )
+    {
+        const double* t[4];
+        const double* p[4];
+        for( int k = 0; k < 4; k++ )
+        {
+            int lControlPoint = pMesh.mPolygonVertices[lStart + k];
+            t[k] = GetElementValue(pUVs, pPolygon, lStart + k, lControlPoint);
+            p[k] = pMesh.mPositions + size_t(lControlPoint) * pMesh.mPositionStride;
+        }
+        double lUV02 = (t[2][0] - t[0][0]) * (t[2][0] - t[0][0]) + (t[2][1] - t[0][1]) * (t[2][1] - t[0][1]);
+        double lUV13 = (t[3][0] - t[1][0]) * (t[3][0] - t[1][0]) + (t[3][1] - t[1][1]) * (t[3][1] - t[1][1]);
+        if( lUV02 != lUV13 )
+        {
+            lDiagonal02 = lUV02 < lUV13;
+        }
+        else
+        {
+            double lPosition02 = 0.0, lPosition13 = 0.0;
+            for( int c = 0; c < 3; c++ )
+            {
+                lPosition02 += (p[2][c] - p[0][c]) * (p[2][c] - p[0][c]);
+                lPosition13 += (p[3][c] - p[1][c]) * (p[3][c] - p[1][c]);
+            }
+            lDiagonal02 = !(lPosition13 < lPosition02);
+        }
+    }
+
+    if( lSize == 4 && !lDiagonal02 )
+    {
+        int lTriangles[6] = { 0, 1, 3, 1, 2, 3 };
+        for( int i = 0; i < 6; i++ ) pTriangles.push_back(lStart + lTriangles[i]);
+    }
+    else
+    {
+        for( int k = 1; k + 1 < lSize; k++ )
+        {
+            pTriangles.push_back(lStart);
+            pTriangles.push_back(lStart + k);
+            pTriangles.push_back(lStart + k + 1);
+        }
+    }
+    return int(pTriangles.size() / 3);
+}
+
+void ComputeTangentFrames(
+                          const MeshView& pMesh,
+                          const ElementView& pUVs,
+                          WorkStealingPool* pPool,
+                          std::vector<double>& pFrames
+                          )
+{
+    const int kGrain = 16 * 1024;
+    int lControlPointCount = pMesh.mControlPointCount;
+    int lPolygonVertexCount = pMesh.mPolygonStarts[pMesh.mPolygonCount];
+
+    // pass 1, per face range: the sum of the corner tangents of every polygon-vertex and
+    // the UV orientation of its polygon. A polygon-vertex belongs to one polygon, so the
+    // ranges write disjoint sums.
+    pFrames.assign(size_t(lPolygonVertexCount) * 4, 0.0);
+    std::vector<int> lPolygons(lPolygonVertexCount);
+    ForRange(pPool, pMesh.mPolygonCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        std::vector<int> lTriangles;
+        for( int p = pBegin; p < pEnd; p++ )
+        {
+            int lTriangleCount = TriangulatePolygon(pMesh, pUVs, p, lTriangles);
+
+            double lArea = 0.0;
+            for( int i = 0; i < lTriangleCount; i++ )
+            {
+                const double* t[3];
+                for( int k = 0; k < 3; k++ )
+                {
+                    int lPolygonVertex = lTriangles[3 * i + k];
+                    t[k] = GetElementValue(pUVs, p, lPolygonVertex, pMesh.mPolygonVertices[lPolygonVertex]);
+                }
+                lArea += GetUVArea(t[0], t[1], t[2]);
+            }
+            double lSign = lArea > 0.0 ? 1.0 : -1.0;
+
+            for( int i = pMesh.mPolygonStarts[p]; i < pMesh.mPolygonStarts[p + 1]; i++ )
+            {
+                lPolygons[i] = p;
+                pFrames[size_t(i) * 4 + 3] = lSign;
+            }
+            for( int i = 0; i < lTriangleCount; i++ )
+                AddTriangle(pMesh, pUVs, p, &lTriangles[3 * i], lSign, &pFrames[0]);
+
+            // the corners only in degenerate triangles (the middle of collinear
+            // corners) take the tangent of the whole polygon, as in MikkTSpace
+            double lPolygonSum[3] = { 0.0, 0.0, 0.0 };
+            for( int i = pMesh.mPolygonStarts[p]; i < pMesh.mPolygonStarts[p + 1]; i++ )
+            {
+                for( int c = 0; c < 3; c++ ) lPolygonSum[c] += pFrames[size_t(i) * 4 + c];
+            }
+            for( int i = pMesh.mPolygonStarts[p]; i < pMesh.mPolygonStarts[p + 1]; i++ )
+            {
+                double* lCorner = &pFrames[size_t(i) * 4];
+                if( lCorner[0] == 0.0 && lCorner[1] == 0.0 && lCorner[2] == 0.0 )
+                    for( int c = 0; c < 3; c++ ) lCorner[c] = lPolygonSum[c];
+            }
+        }
+    });
+
+    // the control points at the same position are gathered by the lowest one
+    std::vector<char> lUsed(lControlPointCount, 0);
+    for( int i = 0; i < lPolygonVertexCount; i++ ) lUsed[pMesh.mPolygonVertices[i]] = 1;
+
+    std::vector<int> lPoints;
+    for( int i = 0; i < lControlPointCount; i++ )
+    {
+        if( lUsed[i] ) lPoints.push_back(i);
+    }
+
+    std::vector<int> lWeld(lControlPointCount, -1);
+    {
+        PositionHash lHash(pMesh.mPositions, pMesh.mPositionStride, lPoints, 0.0, pPool);
+        ForRange(pPool, int(lPoints.size()), kGrain, [&](int pBegin, int pEnd)
+        {
+            for( int i = pBegin; i < pEnd; i++ )
+                lWeld[lPoints[i]] = lHash.FindLowest(pMesh.mPositions + size_t(lPoints[i]) * pMesh.mPositionStride);
+        });
+    }
+
+    // counting sort of the polygon-vertices by position, in increasing order in a group
+    std::vector<int> lGroupStarts(size_t(lControlPointCount) + 1, 0);
+    for( int i = 0; i < lPolygonVertexCount; i++ ) lGroupStarts[lWeld[pMesh.mPolygonVertices[i]] + 1]++;
+    for( int i = 0; i < lControlPointCount; i++ ) lGroupStarts[i + 1] += lGroupStarts[i];
+
+    std::vector<int> lGroups(lPolygonVertexCount);
+    {
+        std::vector<int> lFill(lGroupStarts.begin(), lGroupStarts.end() - 1);
+        for( int i = 0; i < lPolygonVertexCount; i++ ) lGroups[lFill[lWeld[pMesh.mPolygonVertices[i]]]++] = i;
+    }
+
+    // orders the polygon-vertices of a position by normal, UV and orientation
+    auto lLess = [&](int a, int b)
+    {
+        const double* na = GetElementValue(pMesh.mNormals, lPolygons[a], a, pMesh.mPolygonVertices[a]);
+        const double* nb = GetElementValue(pMesh.mNormals, lPolygons[b], b, pMesh.mPolygonVertices[b]);
+        for( int c = 0; c < 3; c++ )
+        {
+            if( na[c] != nb[c] ) return na[c] < nb[c];
+        }
+        const double* ta = GetElementValue(pUVs, lPolygons[a], a, pMesh.mPolygonVertices[a]);
+        const double* tb = GetElementValue(pUVs, lPolygons[b], b, pMesh.mPolygonVertices[b]);
+        for( int c = 0; c < 2; c++ )
+        {
+            if( ta[c] != tb[c] ) return ta[c] < tb[c];
+        }
+        return pFrames[size_t(a) * 4 + 3] < pFrames[size_t(b) * 4 + 3];
+    };
+
+    // pass 2, per position: the polygon-vertices of a vertex share the sum of their tangents
+    ForRange(pPool, lControlPointCount, kGrain, [&](int pBegin, int pEnd)
+    {
+        std::vector<int> lVertices;
+        for( int i = pBegin; i < pEnd; i++ )
+        {
+            if( lGroupStarts[i] == lGroupStarts[i + 1] ) continue;
+
+            // stable, so that the sums are in polygon-vertex order
+            lVertices.assign(lGroups.begin() + lGroupStarts[i], lGroups.begin() + lGroupStarts[i + 1]);
+            std::stable_sort(lVertices.begin(), lVertices.end(), lLess);
+
+            for( size_t lFirst = 0, lLast; lFirst < lVertices.size(); lFirst = lLast )
+            {
+                double lSum[3] = { 0.0, 0.0, 0.0 };
+                for( lLast = lFirst; lLast < lVertices.size() && !lLess(lVertices[lFirst], lVertices[lLast]); lLast++ )
+                {
+                    const double* lCorner = &pFrames[size_t(lVertices[lLast]) * 4];
+                    for( int c = 0; c < 3; c++ ) lSum[c] += lCorner[c];
+                }
+
+                double n[3], lTangent[3];
+                GetUnitNormal(pMesh, lPolygons[lVertices[lFirst]], lVertices[lFirst], n);
+                const double kAxisX[3] = { 1.0, 0.0, 0.0 };
+                const double kAxisZ[3] = { 0.0, 0.0, 1.0 };
+                if( !ProjectNormalize(n, lSum, lTangent) && !ProjectNormalize(n, kAxisX, lTangent) )
+                    ProjectNormalize(n, kAxisZ, lTangent);
+
+                for( size_t v = lFirst; v < lLast; v++ )
+                {
+                    double* lFrame = &pFrames[size_t(lVertices[v]) * 4];
+                    for( int c = 0; c < 3; c++ ) lFrame[c] = lTangent[c];
+                }
+            }
+        }
+    });
+}
+
+void EncodeTangentSpace(
+                        const MeshView& pMesh,
+                        const ElementView& pSource,
+                        const std::vector<double>& pFrames,
+                        ETangentEncoding pEncoding,
+                        const ElementOutput& pTangents,
+                        const ElementOutput& pBinormals,
+                        double pBinormalW,
+                        const ElementOutput& pEncoded,
+                        int pBegin,
+                        int pEnd
+                        )
+{
+    for( int p = pBegin; p < pEnd; p++ )
+    {
+        for( int i = pMesh.mPolygonStarts[p]; i < pMesh.mPolygonStarts[p + 1]; i++ )
+        {
+            const double* t = &pFrames[size_t(i) * 4];
+            double lSign = t[3];
+
+            double n[3];
+            GetUnitNormal(pMesh, p, i, n);
+            double b[3] = { lSign * (n[1] * t[2] - n[2] * t[1]), lSign * (n[2] * t[0] - n[0] * t[2]), lSign * (n[0] * t[1] - n[1] * t[0]) };
+
+            double* lTangent = pTangents.mDirect + size_t(i) * pTangents.mStride;
+            double* lBinormal = pBinormals.mDirect + size_t(i) * pBinormals.mStride;
+            for( int c = 0; c < 3; c++ )
+            {
+                lTangent[c] = t[c];
+                lBinormal[c] = b[c];
+            }
+            if( pTangents.mStride > 3 )  lTangent[3] = lSign;
+            if( pBinormals.mStride > 3 ) lBinormal[3] = pBinormalW;
+
+            // a null smooth normal keeps the lighting normal
+            const double* s = GetElementValue(pSource, p, i, pMesh.mPolygonVertices[i]);
+            double lLength = std::sqrt(Dot(s, s));
+            double lEncoded[3] = { 0.0, 0.0, 1.0 };
+            if( lLength > 0.0 )
+            {
+                lEncoded[0] = Dot(s, t) / lLength;
+                lEncoded[1] = Dot(s, b) / lLength;
+                lEncoded[2] = Dot(s, n) / lLength;
+            }
+
+            double* lOutput = pEncoded.mDirect + size_t(i) * pEncoded.mStride;
+            if( pEncoding == eEncodeXY )
+            {
+                lOutput[0] = lEncoded[0];
+                lOutput[1] = lEncoded[1];
+            }
+            else
+            {
+                for( int c = 0; c < 3; c++ ) lOutput[c] = lEncoded[c] * 0.5 + 0.5;
+                lOutput[3] = 1.0;
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+// TangentSpace.h : tangent basis of the lighting mesh and tangent space smooth normals.
+//
+// Raw smooth normals in the tangent channel break skinned and normal mapped
+// meshes. Instead, the mesh gets a real tangent basis and the smooth normal is
+// stored in that basis, in a UV set or a vertex color layer.
+//
+// The basis follows MikkTSpace: every triangle (quads split along their shorter
+// UV diagonal, other polygons fanned) gives the tangent of its UV derivatives,
+// which is projected on the plane of the normal of each corner, normalized and
+// weighted by the angle of the corner; corners only in degenerate triangles take
+// the tangent of their polygon. The corners of the same vertex (same
+// position, normal, UV and UV orientation) are summed. The bitangent is
+// sign * (normal x tangent), the sign being the UV orientation of the polygon.
+// The corners are computed per face range and the vertices gathered per
+// position, both in parallel.
+
+#pragma once
+
+#include "MergeCore.h"
+
+#include <vector>
+
+class WorkStealingPool;
+
+// how the tangent space smooth normal is stored
+enum ETangentEncoding
+{
+    eEncodeXY,      // x and y of the unit vector, 2 values, z = sqrt(1 - x^2 - y^2) is rebuilt by the shader
+    eEncodeColor    // xyz * 0.5 + 0.5 and an alpha of 1, 4 values
+};
+
+// tangent basis of every polygon-vertex of pMesh in pFrames, 4 doubles: the unit tangent,
+// orthogonal to the normal, then the bitangent sign (1 or -1). The polygon-vertices must
+// be valid control points, the normals of pMesh and pUVs (stride 2 or more) must be
+// valid (IsElementValid). Vertices without UV derivatives get the X axis, or the Z axis,
+// projected on the plane of their normal.
+// pPool runs the passes in parallel, NULL runs them on the calling thread.
+void ComputeTangentFrames(
+                          const MeshView& pMesh,
+                          const ElementView& pUVs,
+                          WorkStealingPool* pPool,
+                          std::vector<double>& pFrames
+                          );
+
+// writes, for every polygon-vertex of the polygons [pBegin, pEnd) of pMesh:
+//   tangent  = the tangent of pFrames, W set to the bitangent sign
+//   binormal = sign * (normal x tangent), W set to pBinormalW
+//   encoded  = normalize(source normal) in the (tangent, binormal, normal) basis
+// pSource must use the mapping of the normals of pMesh, both must be valid. The
+// outputs have one value per polygon-vertex. Disjoint ranges can run in parallel.
+void EncodeTangentSpace(
+                        const MeshView& pMesh,
+                        const ElementView& pSource,
+                        const std::vector<double>& pFrames,
+                        ETangentEncoding pEncoding,
+                        const ElementOutput& pTangents,
+                        const ElementOutput& pBinormals,
+                        double pBinormalW,
+                        const ElementOutput& pEncoded,
+                        int pBegin,
+                        int pEnd
+                        );
@@ -0,0 +1,173 @@
+// ThreadPool.cxx : work stealing thread pool used by the merge.
+
+#include "ThreadPool.h"
+
+// the pool the current thread is working for, used to run nested batches inline
+static thread_local WorkStealingPool* gCurrentPool = nullptr;
+
+thread_local int gJobTag = -1;
+
+WorkStealingPool::WorkStealingPool(int pThreadCount)
+    : mTask(nullptr)
+    , mGeneration(0)
+    , mJobTag(-1)
+    , mPending(0)
+    , mActiveThreads(0)
+    , mQuit(false)
+{
+    if( pThreadCount <= 0 ) pThreadCount = int(std::thread::hardware_concurrency());
+    if( pThreadCount <= 0 ) pThreadCount = 1;
+
+    for( int i = 0; i < pThreadCount; i++ )
+    {
+        mQueues.push_back(new TaskQueue);
+    }
+
+    // thread 0 is the thread calling Run()
+    for( int i = 1; i < pThreadCount; i++ )
+    {
+        mThreads.push_back(std::thread(&WorkStealingPool::WorkerMain, this, i));
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        mQuit = true;
+    }
+    mWakeUp.notify_all();
+
+    for( size_t i = 0; i < mThreads.size(); i++ )
+    {
+        mThreads[i].join();
+    }
+    for( size_t i = 0; i < mQueues.size(); i++ )
+    {
+        delete mQueues[i];
+    }
+}
+
+void WorkStealingPool::Run(int pTaskCount, const std::function<void(int)>& pTask)
+{
+    if( pTaskCount <= 0 ) return;
+
+    if( pTaskCount == 1 || mQueues.size() == 1 || gCurrentPool == this )
+    {
+        for( int i = 0; i < pTaskCount; i++ ) pTask(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+
+        // deal the tasks round robin so every thread starts with one of the first ones
+        int lQueueCount = int(mQueues.size());
+        for( int i = 0; i < pTaskCount; i++ )
+        {
+            TaskQueue* lQueue = mQueues[i % lQueueCount];
+            std::lock_guard<std::mutex> lQueueLock(lQueue->mMutex);
+            lQueue->mTasks.push_back(i);
+        }
+
+        mPending = pTaskCount;
+        mTask = &pTask;
+        mGeneration++;
+        mJobTag = gJobTag;
+    }
+    mWakeUp.notify_all();
+
+    gCurrentPool = this;
+    Drain(0);
+    gCurrentPool = nullptr;
+
+    // wait for the tasks stolen by the other threads, and for the threads
+    // to be done with pTask before it goes out of scope
+    std::unique_lock<std::mutex> lLock(mMutex);
+    mDone.wait(lLock, [this]{ return mPending == 0 && mActiveThreads == 0; });
+    mTask = nullptr;
+}
+
+void WorkStealingPool::ParallelFor(int pBegin, int pEnd, int pGrain, const std::function<void(int, int)>& pBody)
+{
+    if( pEnd <= pBegin ) return;
+    if( pGrain < 1 ) pGrain = 1;
+
+    int lChunkCount = (pEnd - pBegin + pGrain - 1) / pGrain;
+    Run(lChunkCount, [&](int pChunk)
+    {
+        int lBegin = pBegin + pChunk * pGrain;
+        int lEnd = pEnd - lBegin > pGrain ? lBegin + pGrain : pEnd;
+        pBody(lBegin, lEnd);
+    });
+}
+
+void WorkStealingPool::WorkerMain(int pThreadIndex)
+{
+    gCurrentPool = this;
+
+    unsigned lSeenGeneration = 0;
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lLock(mMutex);
+            mWakeUp.wait(lLock, [&]{ return mQuit || (mTask != nullptr && mGeneration != lSeenGeneration); });
+            if( mQuit ) return;
+
+            lSeenGeneration = mGeneration;
+            mActiveThreads++;
+            gJobTag = mJobTag;
+        }
+
+        Drain(pThreadIndex);
+
+        {
+            std::lock_guard<std::mutex> lLock(mMutex);
+            mActiveThreads--;
+        }
+        mDone.notify_all();
+    }
+}
+
+// own queue first (front), then the other queues (back)
+bool WorkStealingPool::PopTask(int pThreadIndex, int& pTask)
+{
+    int lQueueCount = int(mQueues.size());
+    for( int i = 0; i < lQueueCount; i++ )
+    {
+        TaskQueue* lQueue = mQueues[(pThreadIndex + i) % lQueueCount];
+        std::lock_guard<std::mutex> lLock(lQueue->mMutex);
+        if( lQueue->mTasks.empty() ) continue;
+
+        if( i == 0 )
+        {
+            pTask = lQueue->mTasks.front();
+            lQueue->mTasks.pop_front();
+        }
+        else
+        {
+            pTask = lQueue->mTasks.back();
+            lQueue->mTasks.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::Drain(int pThreadIndex)
+{
+    // mTask does not change while this thread is counted in the batch
+    const std::function<void(int)>& lTask = *mTask;
+
+    int lTaskIndex;
+    while( PopTask(pThreadIndex, lTaskIndex) )
+    {
+        lTask(lTaskIndex);
+
+        if( --mPending == 0 )
+        {
+            std::lock_guard<std::mutex> lLock(mMutex);
+            mDone.notify_all();
+        }
+    }
+}
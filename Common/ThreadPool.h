@@ -0,0 +1,69 @@
+// ThreadPool.h : work stealing thread pool used by the merge.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// job number shown in front of the messages of the calling thread, -1 when no job runs.
+// The tasks of a pool run with the job of the thread calling Run().
+extern thread_local int gJobTag;
+
+// Runs batches of independent tasks on a fixed set of threads.
+// Every thread owns a task queue, takes its tasks from the front and, once it
+// is empty, steals from the back of the queues of the other threads, so that
+// one long task never leaves the other threads idle.
+// The calling thread takes part in the work. A pool runs one batch at a time;
+// Run() and ParallelFor() called from inside a task execute inline.
+class WorkStealingPool
+{
+public:
+    // pThreadCount includes the calling thread, 0 uses all the cores
+    explicit WorkStealingPool(int pThreadCount);
+    ~WorkStealingPool();
+
+    int GetThreadCount() const { return int(mQueues.size()); }
+
+    // calls pTask(i) for every i in [0, pTaskCount) and waits for all of them.
+    // Tasks are dealt to the threads in order, put the longest ones first.
+    void Run(int pTaskCount, const std::function<void(int)>& pTask);
+
+    // calls pBody(lBegin, lEnd) on chunks of at most pGrain items of [pBegin, pEnd)
+    void ParallelFor(int pBegin, int pEnd, int pGrain, const std::function<void(int, int)>& pBody);
+
+private:
+    struct TaskQueue
+    {
+        std::mutex      mMutex;
+        std::deque<int> mTasks;
+    };
+
+    void WorkerMain(int pThreadIndex);
+    bool PopTask(int pThreadIndex, int& pTask);
+    void Drain(int pThreadIndex);
+
+    std::vector<TaskQueue*>          mQueues;
+    std::vector<std::thread>         mThreads;
+
+    std::mutex                       mMutex;
+    std::condition_variable          mWakeUp;
+    std::condition_variable          mDone;
+    const std::function<void(int)>*  mTask;
+    unsigned                         mGeneration;
+    int                              mJobTag;       // of the thread running the batch
+    std::atomic<int>                 mPending;
+    int                              mActiveThreads;
+    bool                             mQuit;
+};
+
+// runs pBody on chunks of [0, pCount), in parallel when a pool is given
+inline void ForRange(WorkStealingPool* pPool, int pCount, int pGrain, const std::function<void(int, int)>& pBody)
+{
+    if( pPool ) pPool->ParallelFor(0, pCount, pGrain, pBody);
+    else if( pCount > 0 ) pBody(0, pCount);
+}
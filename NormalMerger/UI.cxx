@@ -594,12 +594,6 @@ void ExecuteImportExport(
         return;
     }
 
-	if (strlen(gszInputFile2) == 0)
-	{
-		UI_Printf("Error: No import file name 2 selected.");
-		return;
-	}
-
     if(strlen(gszOutputFile) == 0)
     {
         UI_Printf("Error: No export file name selected.");
@@ -618,8 +612,8 @@ void ExecuteImportExport(
         return;
     }
 
-	// check if the file to import still exist
-	if (FbxFileUtils::Exist(gszInputFile2) == false)
+	// check if the file to import still exist, without file 2 the smooth normals are generated
+	if (strlen(gszInputFile2) != 0 && FbxFileUtils::Exist(gszInputFile2) == false)
 	{
 		UI_Printf("Error: Import file 2 not found.");
 		return;
@@ -631,7 +625,7 @@ void ExecuteImportExport(
 	// Ĺܵ뵼
     // OK now we have valid files names
     // call the ImportExport function from ImportExport.cxx
-    ImportExport(gszInputFile, gszInputFile2, gszOutputFile, gWriteFileFormat);
+    ImportExport(gszInputFile, strlen(gszInputFile2) != 0 ? gszInputFile2 : NULL, gszOutputFile, gWriteFileFormat);
 
     // reset to default cursor
     SetCursor(oldCursor);
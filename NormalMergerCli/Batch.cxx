@@ -0,0 +1,656 @@
+// Batch.cxx : manifest reading and the worker pool running the merge jobs.
+
+#include "Batch.h"
+#include "BoundedQueue.h"
+
+#include <atomic>
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+bool gQuiet = false;
+
+// serializes the output of the workers
+static std::mutex gPrintMutex;
+
+// used to show messages from the ImportExport.cxx file
+void UI_Printf(
+               const char* pMsg,
+               ...
+               )
+{
+    if( gQuiet ) return;
+
+    char msg[2048];
+    va_list Arguments;
+    va_start( Arguments, pMsg );
+    vsnprintf( msg, sizeof(msg), pMsg, Arguments );
+    va_end( Arguments );
+
+    std::lock_guard<std::mutex> lLock(gPrintMutex);
+    if( gJobTag >= 0 ) printf("[%d] %s\n", gJobTag, msg);
+    else               printf("%s\n", msg);
+}
+
+void SplitFields(
+                        const std::string& pLine,
+                        std::vector<std::string>& pFields
+                        )
+{
+    size_t i = 0;
+    while( i < pLine.size() )
+    {
+        while( i < pLine.size() && isspace((unsigned char)pLine[i]) ) i++;
+        if( i >= pLine.size() ) break;
+
+        std::string lField;
+        if( pLine[i] == '"' )
+        {
+            size_t lEnd = pLine.find('"', i + 1);
+            if( lEnd == std::string::npos ) lEnd = pLine.size();
+            lField = pLine.substr(i + 1, lEnd - i - 1);
+            i = lEnd + 1;
+        }
+        else
+        {
+            size_t lStart = i;
+            while( i < pLine.size() && !isspace((unsigned char)pLine[i]) ) i++;
+            lField = pLine.substr(lStart, i - lStart);
+        }
+        pFields.push_back(lField);
+    }
+}
+
+int ParseMergeArgument(
+                       const std::vector<std::string>& pArgs,
+                       size_t& pIndex,
+                       BatchOptions& pOptions
+                       )
+{
+    const std::string& lArg = pArgs[pIndex];
+    bool lHasValue = pIndex + 1 < pArgs.size();
+
+    if( lArg == "-ascii" )                      pOptions.mAscii = true;
+    else if( lArg == "-format" && lHasValue )   pOptions.mWriteFileFormat = atoi(pArgs[++pIndex].c_str());
+    else if( lArg == "-mesh-threads" && lHasValue ) pOptions.mMergeOptions.mMeshThreads = atoi(pArgs[++pIndex].c_str());
+    else if( lArg == "-match" && lHasValue )
+    {
+        std::string lMode = pArgs[++pIndex];
+        if( lMode == "index" )         pOptions.mMergeOptions.mCorrespondence = eCorrespondIndex;
+        else if( lMode == "position" ) pOptions.mMergeOptions.mCorrespondence = eCorrespondPosition;
+        else if( lMode == "closest" )  pOptions.mMergeOptions.mCorrespondence = eCorrespondClosestPoint;
+        else return -1;
+    }
+    else if( lArg == "-weld" && lHasValue )     pOptions.mMergeOptions.mWeldTolerance = atof(pArgs[++pIndex].c_str());
+    else if( lArg == "-smooth" && lHasValue )
+    {
+        std::string lWeighting = pArgs[++pIndex];
+        if( lWeighting == "area" )       pOptions.mMergeOptions.mSmoothWeighting = eWeightArea;
+        else if( lWeighting == "angle" ) pOptions.mMergeOptions.mSmoothWeighting = eWeightAngle;
+        else return -1;
+    }
+    else if( lArg == "-output" && lHasValue )
+    {
+        std::string lChannel = pArgs[++pIndex];
+        if( lChannel == "tangent" )    pOptions.mMergeOptions.mOutput = eOutputTangent;
+        else if( lChannel == "uv" )    pOptions.mMergeOptions.mOutput = eOutputUV;
+        else if( lChannel == "color" ) pOptions.mMergeOptions.mOutput = eOutputColor;
+        else return -1;
+    }
+    else if( lArg == "-pack" && lHasValue )
+    {
+        std::string lPacking = pArgs[++pIndex];
+        if( lPacking == "tangent" )    pOptions.mMergeOptions.mPackBits = 0;
+        else if( lPacking == "oct8" )  pOptions.mMergeOptions.mPackBits = 8;
+        else if( lPacking == "oct16" ) pOptions.mMergeOptions.mPackBits = 16;
+        else return -1;
+    }
+    else if( (lArg == "-import1" || lArg == "-import2") && lHasValue )
+    {
+        std::string lName = pArgs[++pIndex];
+        EImportProfile& lProfile = lArg == "-import1" ? pOptions.mMergeOptions.mImportProfile : pOptions.mMergeOptions.mImportProfile2;
+        if( lName == "full" )          lProfile = eImportFull;
+        else if( lName == "static" )   lProfile = eImportStatic;
+        else if( lName == "geometry" ) lProfile = eImportGeometry;
+        else return -1;
+    }
+    else if( lArg == "-reader2" && lHasValue )
+    {
+        std::string lReader = pArgs[++pIndex];
+        if( lReader == "sdk" )         pOptions.mMergeOptions.mNativeReader2 = false;
+        else if( lReader == "native" ) pOptions.mMergeOptions.mNativeReader2 = true;
+        else return -1;
+    }
+    else if( lArg == "-writer" && lHasValue )
+    {
+        std::string lWriter = pArgs[++pIndex];
+        if( lWriter == "sdk" )        pOptions.mMergeOptions.mWriter = eWriterSdk;
+        else if( lWriter == "patch" ) pOptions.mMergeOptions.mWriter = eWriterPatch;
+        else if( lWriter == "glb" )   pOptions.mMergeOptions.mWriter = eWriterGltf;
+        else return -1;
+    }
+    else if( lArg == "-quantize" && lHasValue )
+    {
+        std::string lQuantization = pArgs[++pIndex];
+        if( lQuantization == "float" )      pOptions.mMergeOptions.mQuantization = eGltfFloat;
+        else if( lQuantization == "int16" ) pOptions.mMergeOptions.mQuantization = eGltfInt16;
+        else if( lQuantization == "int8" )  pOptions.mMergeOptions.mQuantization = eGltfInt8;
+        else return -1;
+    }
+    else if( lArg == "-compact" && lHasValue )  pOptions.mMergeOptions.mCompactTolerance = atof(pArgs[++pIndex].c_str());
+    else if( lArg == "-channels" && lHasValue )
+    {
+        if( !ParseMergeChannels(pArgs[++pIndex].c_str(), pOptions.mChannels) )
+            return -1;
+    }
+    else return 0;
+    return 1;
+}
+
+bool CheckJobArguments(
+                       const BatchOptions& pOptions,
+                       bool pManifest,
+                       MergeJob& pJob,
+                       std::string& pError
+                       )
+{
+    // the packed normals go to a UV set or a vertex color layer
+    if( pOptions.mMergeOptions.mPackBits > 0 && pOptions.mMergeOptions.mOutput == eOutputTangent )
+    {
+        pError = std::string("-pack ") + (pOptions.mMergeOptions.mPackBits == 8 ? "oct8" : "oct16") + " needs -output uv or color";
+        return false;
+    }
+
+    if( !pOptions.mChannels.empty() && !AreMergeSourcesValid(pOptions.mChannels, pError) )
+    {
+        pError = "-channels: " + pError;
+        return false;
+    }
+
+    // a reduced import of input 1 is only written back by the patch writer; -format is
+    // checked against the native writer once a manager exists, before the import
+    std::vector<MergeSource> lSources = pOptions.mChannels;
+    if( lSources.empty() )
+    {
+        lSources.resize(1);
+        lSources[0].mOutput = pOptions.mMergeOptions.mOutput;
+    }
+    if( !IsImportProfileWritable(pOptions.mMergeOptions, lSources, !pOptions.mAscii, pError) )
+    {
+        pError = "-import1: " + pError;
+        return false;
+    }
+
+    // without -channels, -s is the single input 2
+    int lSourceCount = int(pOptions.mChannels.size());
+    if( lSourceCount == 0 && pJob.mSources.size() == 1 )
+    {
+        pJob.mInput2 = pJob.mSources[0];
+        pJob.mSources.clear();
+    }
+    if( (lSourceCount == 0 && !pJob.mSources.empty()) || (lSourceCount > 0 && !pManifest && int(pJob.mSources.size()) != lSourceCount) )
+    {
+        pError = "expected one -s per channel";
+        return false;
+    }
+    return true;
+}
+
+// read the input/input2/output triples of a manifest file, or the input/sources/output lines
+bool ReadManifest(
+                  const char* pFilename,
+                  int pSourceCount,
+                  std::vector<MergeJob>& pJobs
+                  )
+{
+    FILE* lFile = fopen(pFilename, "r");
+    if( lFile == NULL )
+    {
+        fprintf(stderr, "Error: cannot open manifest %s\n", pFilename);
+        return false;
+    }
+
+    bool lStatus = true;
+    int lLineNumber = 0;
+    char lBuffer[4096];
+    while( fgets(lBuffer, sizeof(lBuffer), lFile) )
+    {
+        lLineNumber++;
+
+        std::vector<std::string> lFields;
+        SplitFields(lBuffer, lFields);
+        if( lFields.empty() || lFields[0][0] == '#' ) continue;
+
+        // without input2 the smooth normals are generated
+        if( pSourceCount == 0 && lFields.size() != 2 && lFields.size() != 3 )
+        {
+            fprintf(stderr, "Error: %s(%d): expected <input> [<input2>] <output>\n", pFilename, lLineNumber);
+            lStatus = false;
+            continue;
+        }
+        if( pSourceCount > 0 && lFields.size() != size_t(pSourceCount) + 2 )
+        {
+            fprintf(stderr, "Error: %s(%d): expected <input>, %d sources and <output>\n", pFilename, lLineNumber, pSourceCount);
+            lStatus = false;
+            continue;
+        }
+
+        MergeJob lJob;
+        lJob.mInput     = lFields[0];
+        lJob.mInput2    = pSourceCount == 0 && lFields.size() == 3 ? lFields[1] : std::string();
+        lJob.mOutput    = lFields.back();
+        for( int i = 0; i < pSourceCount; i++ )
+            lJob.mSources.push_back(lFields[1 + i] == "-" ? std::string() : lFields[1 + i]);
+        lJob.mSeconds   = 0.0;
+        lJob.mSucceeded = false;
+        lJob.mCached    = false;
+        pJobs.push_back(lJob);
+    }
+
+    fclose(lFile);
+    return lStatus;
+}
+
+int GetWriteFileFormat(
+                              FbxManager* pSdkManager,
+                              const BatchOptions& pOptions
+                              )
+{
+    if( pOptions.mWriteFileFormat >= 0 ) return pOptions.mWriteFileFormat;
+
+    FbxIOPluginRegistry* lRegistry = pSdkManager->GetIOPluginRegistry();
+    return pOptions.mAscii ? lRegistry->FindWriterIDByDescription("FBX ascii (*.fbx)")
+                           : lRegistry->GetNativeWriterFormat();
+}
+
+// key of the job in the result cache: its settings and the bytes of its inputs, a
+// generated source being "-". Empty if an input can't be read.
+static std::string GetJobKey(
+                             const MergeJob& pJob,
+                             const std::vector<MergeSource>& pSources,
+                             const BatchOptions& pOptions,
+                             int pWriteFileFormat
+                             )
+{
+    std::vector<std::string> lFiles(1, pJob.mInput);
+    if( pSources.empty() ) lFiles.push_back(pJob.mInput2);
+    for( size_t i = 0; i < pSources.size(); i++ ) lFiles.push_back(pSources[i].mFileName);
+
+    std::string lText = GetMergeSettingsText(pOptions.mMergeOptions, pSources, pWriteFileFormat);
+    for( size_t i = 0; i < lFiles.size(); i++ )
+    {
+        std::string lDigest = "-";
+        if( !lFiles[i].empty() && !HashFile(lFiles[i].c_str(), lDigest) ) return std::string();
+        lText += "\n" + lDigest;
+    }
+    return HashText(lText);
+}
+
+struct BatchState
+{
+    std::vector<MergeJob>* mJobs;
+    const BatchOptions*    mOptions;
+    std::atomic<size_t>    mNextJob;
+    std::atomic<int>       mFailures;
+};
+
+// gives the channels of the job its sources, in order, and looks for its output in the
+// result cache. Returns false if an input is missing; pKey is empty without a cache.
+static bool BeginJob(
+                     MergeJob& pJob,
+                     const BatchOptions& pOptions,
+                     int pWriteFileFormat,
+                     std::vector<MergeSource>& pSources,
+                     std::string& pKey
+                     )
+{
+    pSources = pOptions.mChannels;
+    bool lExist = FbxFileUtils::Exist(pJob.mInput.c_str()) && (pJob.mInput2.empty() || FbxFileUtils::Exist(pJob.mInput2.c_str()));
+    for( size_t i = 0; i < pSources.size() && i < pJob.mSources.size(); i++ )
+    {
+        pSources[i].mFileName = pJob.mSources[i];
+        lExist = lExist && (pJob.mSources[i].empty() || FbxFileUtils::Exist(pJob.mSources[i].c_str()));
+    }
+
+    // an unchanged job is a copy of its last output, without loading any scene
+    ResultCache* lCache = pOptions.mCache;
+    pKey.clear();
+    if( lCache && lExist ) pKey = GetJobKey(pJob, pSources, pOptions, pWriteFileFormat);
+    pJob.mCached = !pKey.empty() && lCache->Fetch(pKey, pJob.mOutput.c_str());
+    return lExist;
+}
+
+// stores the output of a merged job in the result cache and sets its time
+static void EndJob(
+                   const BatchOptions& pOptions,
+                   MergeJob& pJob,
+                   const std::string& pKey,
+                   std::chrono::steady_clock::time_point pStart
+                   )
+{
+    if( pJob.mSucceeded && !pJob.mCached && !pKey.empty() ) pOptions.mCache->Store(pKey, pJob.mOutput.c_str());
+    pJob.mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - pStart).count();
+}
+
+void RunJob(
+            const MergeContext& pContext,
+            MergeJob& pJob,
+            const BatchOptions& pOptions,
+            int pWriteFileFormat
+            )
+{
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    std::vector<MergeSource> lSources;
+    std::string lKey;
+    bool lExist = BeginJob(pJob, pOptions, pWriteFileFormat, lSources, lKey);
+
+    if( pJob.mCached )
+        pJob.mSucceeded = true;
+    else if( lSources.empty() )
+        pJob.mSucceeded = lExist && ImportExport(pContext, pOptions.mMergeOptions, pJob.mInput.c_str(), pJob.mInput2.c_str(),
+                                                 pJob.mOutput.c_str(), pWriteFileFormat, &pJob.mTimings);
+    else
+        pJob.mSucceeded = lExist && ImportExport(pContext, pOptions.mMergeOptions, pJob.mInput.c_str(), lSources,
+                                                 pJob.mOutput.c_str(), pWriteFileFormat, &pJob.mTimings);
+
+    EndJob(pOptions, pJob, lKey, lStart);
+}
+
+void PrintJobResult(
+                    const MergeJob& pJob
+                    )
+{
+    std::lock_guard<std::mutex> lLock(gPrintMutex);
+    printf("[%s] %8.3f s  %s%s\n", pJob.mSucceeded ? " ok " : "FAIL", pJob.mSeconds, pJob.mOutput.c_str(), pJob.mCached ? " (cached)" : "");
+    fflush(stdout);
+}
+
+// body of a worker thread: pulls jobs until the manifest is exhausted
+static void RunWorker(
+                      BatchState* pState
+                      )
+{
+    // the manager is created once per worker and stays warm between jobs
+    MergeContext lContext;
+    InitializeMergeContext(lContext);
+
+    int lWriteFileFormat = GetWriteFileFormat(lContext.mSdkManager, *pState->mOptions);
+
+    for(;;)
+    {
+        size_t lIndex = pState->mNextJob++;
+        if( lIndex >= pState->mJobs->size() ) break;
+
+        MergeJob& lJob = (*pState->mJobs)[lIndex];
+        gJobTag = int(lIndex);
+        RunJob(lContext, lJob, *pState->mOptions, lWriteFileFormat);
+        gJobTag = -1;
+
+        if( !lJob.mSucceeded ) pState->mFailures++;
+        PrintJobResult(lJob);
+    }
+
+    DestroyMergeContext(lContext);
+}
+
+// a job between the stages of the pipeline
+struct PipelineJob
+{
+    size_t                   mIndex;
+    std::vector<MergeSource> mSources;      // the single source of the merge options once imported
+    std::string              mKey;
+    MergeContext*            mContext;      // of the phases of the job, NULL if it is not merged
+    LoadedMerge              mMerge;
+    std::chrono::steady_clock::time_point mStart;
+
+    PipelineJob() : mIndex(0), mContext(NULL) {}
+};
+
+typedef BoundedQueue<std::unique_ptr<PipelineJob> > PipelineQueue;
+
+struct PipelineState
+{
+    BatchState*                  mBatch;
+    PipelineQueue*               mMergeQueue;       // imported jobs
+    PipelineQueue*               mExportQueue;      // merged jobs
+    BoundedQueue<MergeContext*>* mFreeContexts;
+    int                          mWriteFileFormat;
+    std::atomic<int>             mLoaded;           // jobs holding a context
+    std::atomic<int>             mMaxLoaded;
+    StageTimes                   mStages[3];        // import, merge, export
+};
+
+// seconds since the previous call
+static double Lap(std::chrono::steady_clock::time_point& pTime)
+{
+    std::chrono::steady_clock::time_point lNow = std::chrono::steady_clock::now();
+    double lSeconds = std::chrono::duration<double>(lNow - pTime).count();
+    pTime = lNow;
+    return lSeconds;
+}
+
+// the merge stage: merges the imported jobs in order and passes them to the export
+static void RunMergeStage(
+                          PipelineState* pState
+                          )
+{
+    StageTimes& lTimes = pState->mStages[1];
+    const MergeOptions& lOptions = pState->mBatch->mOptions->mMergeOptions;
+    std::chrono::steady_clock::time_point lTime = std::chrono::steady_clock::now();
+
+    std::unique_ptr<PipelineJob> lJob;
+    while( pState->mMergeQueue->Pop(lJob) )
+    {
+        lTimes.mWait += Lap(lTime);
+        if( lJob->mContext )
+        {
+            gJobTag = int(lJob->mIndex);
+            MergeLoadedScenes(lOptions, lJob->mSources, lJob->mMerge);
+            gJobTag = -1;
+            lTimes.mWork += Lap(lTime);
+            lTimes.mJobs++;
+        }
+        pState->mExportQueue->Push(std::move(lJob));
+        lTimes.mWait += Lap(lTime);
+    }
+    pState->mExportQueue->Close();
+}
+
+// the export stage: writes the merged jobs, gives their context back to the import and
+// prints their result
+static void RunExportStage(
+                           PipelineState* pState
+                           )
+{
+    StageTimes& lTimes = pState->mStages[2];
+    const MergeOptions& lOptions = pState->mBatch->mOptions->mMergeOptions;
+    std::chrono::steady_clock::time_point lTime = std::chrono::steady_clock::now();
+
+    std::unique_ptr<PipelineJob> lJob;
+    while( pState->mExportQueue->Pop(lJob) )
+    {
+        lTimes.mWait += Lap(lTime);
+        MergeJob& lMergeJob = (*pState->mBatch->mJobs)[lJob->mIndex];
+        if( lJob->mContext )
+        {
+            gJobTag = int(lJob->mIndex);
+            lMergeJob.mSucceeded = ExportMergedScene(*lJob->mContext, lOptions, lJob->mSources, lMergeJob.mInput.c_str(),
+                                                     lMergeJob.mOutput.c_str(), pState->mWriteFileFormat, lJob->mMerge);
+            lMergeJob.mTimings = lJob->mMerge.mTimings;
+            gJobTag = -1;
+            pState->mFreeContexts->Push(lJob->mContext);
+            pState->mLoaded--;
+            lTimes.mJobs++;
+        }
+        EndJob(*pState->mBatch->mOptions, lMergeJob, lJob->mKey, lJob->mStart);
+        if( !lMergeJob.mSucceeded ) pState->mBatch->mFailures++;
+        PrintJobResult(lMergeJob);
+        lJob.reset();
+        lTimes.mWork += Lap(lTime);
+    }
+}
+
+// the import stage runs on the calling thread, the merge and the export on their own.
+// A job keeps the context it was imported with until it is exported, the contexts
+// coming back to the import once free.
+static void RunPipeline(
+                        BatchState* pState,
+                        BatchStats* pStats
+                        )
+{
+    const BatchOptions& lOptions = *pState->mOptions;
+    size_t lDepth = size_t(lOptions.mPipelineDepth);
+
+    // one job in each stage and a full queue between them; -inflight caps it further
+    int lContextCount = 2 * int(lDepth) + 3;
+    if( lOptions.mMaxInFlight > 0 && lOptions.mMaxInFlight < lContextCount ) lContextCount = lOptions.mMaxInFlight;
+
+    PipelineQueue lMergeQueue(lDepth);
+    PipelineQueue lExportQueue(lDepth);
+    BoundedQueue<MergeContext*> lFreeContexts(lContextCount);
+    std::vector<std::unique_ptr<MergeContext> > lContexts;
+
+    PipelineState lState;
+    lState.mBatch        = pState;
+    lState.mMergeQueue   = &lMergeQueue;
+    lState.mExportQueue  = &lExportQueue;
+    lState.mFreeContexts = &lFreeContexts;
+    lState.mLoaded       = 0;
+    lState.mMaxLoaded    = 0;
+
+    // the first context resolves the writer format
+    lContexts.push_back(std::unique_ptr<MergeContext>(new MergeContext));
+    InitializeMergeContext(*lContexts.back());
+    lFreeContexts.Push(lContexts.back().get());
+    lState.mWriteFileFormat = GetWriteFileFormat(lContexts.back()->mSdkManager, lOptions);
+
+    std::thread lMergeThread(RunMergeStage, &lState);
+    std::thread lExportThread(RunExportStage, &lState);
+
+    StageTimes& lTimes = lState.mStages[0];
+    std::chrono::steady_clock::time_point lTime = std::chrono::steady_clock::now();
+    for( size_t lIndex = 0; lIndex < pState->mJobs->size(); lIndex++ )
+    {
+        MergeJob& lMergeJob = (*pState->mJobs)[lIndex];
+        std::unique_ptr<PipelineJob> lJob(new PipelineJob);
+        lJob->mIndex = lIndex;
+        lJob->mStart = std::chrono::steady_clock::now();
+        gJobTag = int(lIndex);
+
+        bool lExist = BeginJob(lMergeJob, lOptions, lState.mWriteFileFormat, lJob->mSources, lJob->mKey);
+        lMergeJob.mSucceeded = lMergeJob.mCached;
+        if( lExist && !lMergeJob.mCached )
+        {
+            // a free context, a new one while there are less than lContextCount, or the next one given back
+            MergeContext* lContext = NULL;
+            if( !lFreeContexts.TryPop(lContext) )
+            {
+                if( int(lContexts.size()) < lContextCount )
+                {
+                    lContexts.push_back(std::unique_ptr<MergeContext>(new MergeContext));
+                    InitializeMergeContext(*lContexts.back());
+                    lContext = lContexts.back().get();
+                }
+                else
+                {
+                    lTimes.mWork += Lap(lTime);
+                    lFreeContexts.Pop(lContext);
+                    lTimes.mWait += Lap(lTime);
+                }
+            }
+
+            int lLoaded = ++lState.mLoaded;
+            if( lLoaded > lState.mMaxLoaded ) lState.mMaxLoaded = lLoaded;
+
+            // the single source of the merge options, as ImportExport gives it
+            std::vector<MergeSource> lSources = lJob->mSources;
+            if( lSources.empty() )
+            {
+                lSources.resize(1);
+                lSources[0].mFileName = lMergeJob.mInput2;
+                lSources[0].mOutput   = lOptions.mMergeOptions.mOutput;
+                lSources[0].mPackBits = lOptions.mMergeOptions.mPackBits;
+            }
+            if( ImportMergeScenes(*lContext, lOptions.mMergeOptions, lMergeJob.mInput.c_str(), lSources, lState.mWriteFileFormat, lJob->mMerge) )
+            {
+                lJob->mSources = lSources;
+                lJob->mContext = lContext;
+            }
+            else
+            {
+                lMergeJob.mTimings = lJob->mMerge.mTimings;
+                lFreeContexts.Push(lContext);
+                lState.mLoaded--;
+            }
+            lTimes.mJobs++;
+        }
+        gJobTag = -1;
+
+        lTimes.mWork += Lap(lTime);
+        lMergeQueue.Push(std::move(lJob));
+        lTimes.mWait += Lap(lTime);
+    }
+    lMergeQueue.Close();
+
+    lMergeThread.join();
+    lExportThread.join();
+
+    for( size_t i = 0; i < lContexts.size(); i++ ) DestroyMergeContext(*lContexts[i]);
+
+    if( pStats )
+    {
+        for( int i = 0; i < 3; i++ ) pStats->mStages[i] = lState.mStages[i];
+        pStats->mContextCount = int(lContexts.size());
+        pStats->mMaxLoaded    = lState.mMaxLoaded;
+    }
+}
+
+int RunBatch(
+             std::vector<MergeJob>& pJobs,
+             const BatchOptions& pOptions,
+             BatchStats* pStats
+             )
+{
+    BatchState lState;
+    lState.mJobs     = &pJobs;
+    lState.mOptions  = &pOptions;
+    lState.mNextJob  = 0;
+    lState.mFailures = 0;
+
+    if( pOptions.mPipelineDepth > 0 )
+    {
+        RunPipeline(&lState, pStats);
+        return lState.mFailures;
+    }
+
+    // a worker holds one job at a time, so the number of workers
+    // is also the bound on the scenes loaded at the same time
+    int lWorkerCount = pOptions.mThreadCount;
+    if( pOptions.mMaxInFlight > 0 && pOptions.mMaxInFlight < lWorkerCount ) lWorkerCount = pOptions.mMaxInFlight;
+    if( lWorkerCount > int(pJobs.size()) ) lWorkerCount = int(pJobs.size());
+    if( lWorkerCount < 1 ) lWorkerCount = 1;
+
+    if( lWorkerCount == 1 )
+    {
+        RunWorker(&lState);
+    }
+    else
+    {
+        std::vector<std::thread> lThreads;
+        for( int i = 0; i < lWorkerCount; i++ )
+        {
+            lThreads.push_back(std::thread(RunWorker, &lState));
+        }
+        for( int i = 0; i < lWorkerCount; i++ )
+        {
+            lThreads[i].join();
+        }
+    }
+
+    return lState.mFailures;
+}
@@ -0,0 +1,126 @@
+// Batch.h : manifest reading and the worker pool running the merge jobs.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// FBXSDK calls are done in ImportExport.cxx
+#include "../Common/ImportExport.h"
+#include "../Common/ResultCache.h"
+#include "../Common/ThreadPool.h"
+
+// one (lighting mesh, smooth mesh) pair to merge, mInput2 is empty to generate the smooth normals.
+// With BatchOptions::mChannels, mSources replaces mInput2: one file per channel, empty to generate.
+struct MergeJob
+{
+    std::string  mInput;
+    std::string  mInput2;
+    std::vector<std::string> mSources;
+    std::string  mOutput;
+    double       mSeconds;
+    MergeTimings mTimings;      // phases of mSeconds
+    bool         mSucceeded;
+    bool         mCached;       // the output was copied from the result cache
+};
+
+struct BatchOptions
+{
+    int  mThreadCount;          // worker threads, each one owns a FbxManager
+    int  mMaxInFlight;          // max jobs (two scenes each) loaded at the same time
+    int  mPipelineDepth;        // 0 runs every job on a worker; otherwise the import, the merge and
+                                // the export run on their own thread, connected by queues of this
+                                // many jobs, and at most 2 * mPipelineDepth + 3 jobs are loaded
+    bool mAscii;                // write ASCII FBX
+    int  mWriteFileFormat;      // writer format number, -1 to use mAscii / the native writer
+
+    MergeOptions mMergeOptions;
+    std::vector<MergeSource> mChannels;     // channels of the sources of every job, empty for the single
+                                            // source in mMergeOptions.mOutput and mPackBits
+    ResultCache* mCache;        // outputs of the unchanged jobs, NULL to merge every job
+};
+
+// seconds a stage of the pipeline spends on its jobs and waiting on its queues
+struct StageTimes
+{
+    double mWork;
+    double mWait;               // for a job to come, room in the next queue, or a free context
+    int    mJobs;               // jobs the stage loaded, merged or exported
+
+    StageTimes() : mWork(0.0), mWait(0.0), mJobs(0) {}
+};
+
+// what RunBatch measured of a pipeline (BatchOptions::mPipelineDepth)
+struct BatchStats
+{
+    StageTimes mStages[3];      // import, merge, export
+    int        mContextCount;   // managers created
+    int        mMaxLoaded;      // max jobs loaded at the same time
+
+    BatchStats() : mContextCount(0), mMaxLoaded(0) {}
+};
+
+// when set, UI_Printf only prints the per-file results
+extern bool gQuiet;
+
+// split a manifest line in blank separated, optionally quoted, fields
+void SplitFields(
+                 const std::string& pLine,
+                 std::vector<std::string>& pFields
+                 );
+
+// reads the merge option pArgs[pIndex], and its value, into pOptions: -ascii, -format,
+// -mesh-threads, -match, -weld, -smooth, -output, -pack, -import1, -import2, -reader2,
+// -writer, -quantize, -compact and -channels. pIndex is left on the last argument read.
+// Returns 1 if it was read, 0 if it is not one of them, -1 if its value is not valid.
+int ParseMergeArgument(
+                       const std::vector<std::string>& pArgs,
+                       size_t& pIndex,
+                       BatchOptions& pOptions
+                       );
+
+// checks the merge options of pOptions, and that pJob has a source per channel unless
+// pManifest, the jobs being read from a manifest; without channels, its single source
+// becomes mInput2. Returns false with the reason in pError.
+bool CheckJobArguments(
+                       const BatchOptions& pOptions,
+                       bool pManifest,
+                       MergeJob& pJob,
+                       std::string& pError
+                       );
+
+// pSourceCount is the number of channels, the lines being <input> <source>... <output>,
+// a source "-" being generated; 0 reads <input> [<input2>] <output>
+bool ReadManifest(
+                  const char* pFilename,
+                  int pSourceCount,
+                  std::vector<MergeJob>& pJobs
+                  );
+
+// the writer format number for the options, resolved with the registry of pSdkManager
+int GetWriteFileFormat(
+                       FbxManager* pSdkManager,
+                       const BatchOptions& pOptions
+                       );
+
+// runs pJob with pContext: copies its output from the result cache, or merges it.
+// Sets mSucceeded, mCached, mTimings and mSeconds.
+void RunJob(
+            const MergeContext& pContext,
+            MergeJob& pJob,
+            const BatchOptions& pOptions,
+            int pWriteFileFormat
+            );
+
+// prints "[ ok ] <seconds> s  <output>", or FAIL
+void PrintJobResult(
+                    const MergeJob& pJob
+                    );
+
+// runs all the jobs and returns the number of failures. pStats, if not NULL, receives
+// the times of the stages of a pipeline.
+int RunBatch(
+             std::vector<MergeJob>& pJobs,
+             const BatchOptions& pOptions,
+             BatchStats* pStats = NULL
+             );
@@ -0,0 +1,76 @@
+// BoundedQueue.h : queue of a bounded number of items between threads.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// FIFO of at most a given number of items, Push waiting while it is full
+template<class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t pCapacity) : mCapacity(pCapacity), mClosed(false) {}
+
+    // waits until there is room for pItem
+    void Push(T pItem)
+    {
+        std::unique_lock<std::mutex> lLock(mMutex);
+        mNotFull.wait(lLock, [this]() { return mItems.size() < mCapacity; });
+        mItems.push_back(std::move(pItem));
+        mNotEmpty.notify_one();
+    }
+
+    // waits at most pMilliseconds for room for pItem, false with pItem kept if the queue stayed full
+    bool TryPush(T& pItem, int pMilliseconds)
+    {
+        std::unique_lock<std::mutex> lLock(mMutex);
+        if( !mNotFull.wait_for(lLock, std::chrono::milliseconds(pMilliseconds), [this]() { return mItems.size() < mCapacity; }) )
+            return false;
+        mItems.push_back(std::move(pItem));
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    // waits for an item, false once the queue is closed and empty
+    bool Pop(T& pItem)
+    {
+        std::unique_lock<std::mutex> lLock(mMutex);
+        mNotEmpty.wait(lLock, [this]() { return !mItems.empty() || mClosed; });
+        if( mItems.empty() ) return false;
+        pItem = std::move(mItems.front());
+        mItems.pop_front();
+        mNotFull.notify_one();
+        return true;
+    }
+
+    // false without waiting if the queue is empty
+    bool TryPop(T& pItem)
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        if( mItems.empty() ) return false;
+        pItem = std::move(mItems.front());
+        mItems.pop_front();
+        mNotFull.notify_one();
+        return true;
+    }
+
+    // no more items will be pushed
+    void Close()
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        mClosed = true;
+        mNotEmpty.notify_all();
+    }
+
+private:
+    std::mutex              mMutex;
+    std::condition_variable mNotFull;
+    std::condition_variable mNotEmpty;
+    std::deque<T>           mItems;
+    size_t                  mCapacity;
+    bool                    mClosed;
+};
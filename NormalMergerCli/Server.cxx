@@ -0,0 +1,374 @@
+// Server.cxx : merge server listening on a Unix domain socket, and its client.
+
+#include "Server.h"
+#include "BoundedQueue.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+int RunServer(
+              const char* pSocketPath,
+              const BatchOptions& pOptions
+              )
+{
+    (void)pSocketPath;
+    (void)pOptions;
+    printf("-serve: Unix domain sockets are not supported on this platform\n");
+    return 1;
+}
+
+int RunClient(
+              const char* pSocketPath,
+              const std::vector<std::string>& pArgs
+              )
+{
+    (void)pSocketPath;
+    (void)pArgs;
+    printf("-connect: Unix domain sockets are not supported on this platform\n");
+    return 1;
+}
+
+#else
+
+// longest request line, the arguments of a job
+static const size_t kMaxRequestSize = 65536;
+
+// seconds a worker waits for the request of a connection
+static const int kRequestTimeout = 10;
+
+// set by SIGINT and SIGTERM, or by a shutdown request
+static volatile sig_atomic_t gStopSignal = 0;
+static std::atomic<bool> gStopRequest(false);
+
+static void OnStopSignal(int)
+{
+    gStopSignal = 1;
+}
+
+struct ServerState
+{
+    const BatchOptions* mOptions;
+    BoundedQueue<int>*  mConnections;   // accepted, not yet read
+    std::atomic<int>    mNextJob;
+    std::atomic<int>    mFailures;
+};
+
+// reads the first line of pSocket, without its '\n'. False if the socket is closed
+// or times out before, or the line is longer than kMaxRequestSize.
+static bool ReadLine(
+                     int pSocket,
+                     std::string& pLine
+                     )
+{
+    pLine.clear();
+    char lBuffer[4096];
+    for(;;)
+    {
+        ssize_t lCount = recv(pSocket, lBuffer, sizeof(lBuffer), 0);
+        if( lCount < 0 && errno == EINTR ) continue;
+        if( lCount <= 0 ) return false;
+
+        pLine.append(lBuffer, size_t(lCount));
+        size_t lEnd = pLine.find('\n');
+        if( lEnd != std::string::npos )
+        {
+            pLine.resize(lEnd);
+            return true;
+        }
+        if( pLine.size() > kMaxRequestSize ) return false;
+    }
+}
+
+static bool WriteText(
+                      int pSocket,
+                      const std::string& pText
+                      )
+{
+    size_t lSent = 0;
+    while( lSent < pText.size() )
+    {
+        ssize_t lCount = send(pSocket, pText.data() + lSent, pText.size() - lSent, 0);
+        if( lCount < 0 && errno == EINTR ) continue;
+        if( lCount <= 0 ) return false;
+        lSent += size_t(lCount);
+    }
+    return true;
+}
+
+static bool GetSocketAddress(
+                             const char* pSocketPath,
+                             sockaddr_un& pAddress
+                             )
+{
+    memset(&pAddress, 0, sizeof(pAddress));
+    pAddress.sun_family = AF_UNIX;
+    if( strlen(pSocketPath) >= sizeof(pAddress.sun_path) ) return false;
+    strcpy(pAddress.sun_path, pSocketPath);
+    return true;
+}
+
+// runs the request pRequest with the manager of the worker and returns the reply line
+static std::string RunRequest(
+                              const MergeContext& pContext,
+                              ServerState* pState,
+                              const std::string& pRequest
+                              )
+{
+    std::vector<std::string> lFields;
+    SplitFields(pRequest, lFields);
+    if( lFields.size() == 1 && lFields[0] == "shutdown" )
+    {
+        gStopRequest = true;
+        return "ok";
+    }
+    if( lFields.empty() || lFields[0] != "merge" ) return "error expected merge or shutdown";
+
+    // the options of the server, then those of the request
+    BatchOptions lOptions = *pState->mOptions;
+    MergeJob lJob;
+    lJob.mSeconds   = 0.0;
+    lJob.mSucceeded = false;
+    lJob.mCached    = false;
+    for( size_t i = 1; i < lFields.size(); i++ )
+    {
+        int lParsed = ParseMergeArgument(lFields, i, lOptions);
+        if( lParsed < 0 ) return "error invalid value " + lFields[i];
+        if( lParsed > 0 ) continue;
+
+        bool lHasValue = i + 1 < lFields.size();
+        if( lFields[i] == "-i" && lHasValue )      lJob.mInput = lFields[++i];
+        else if( lFields[i] == "-s" && lHasValue ) lJob.mSources.push_back(lFields[++i] == "-" ? std::string() : lFields[i]);
+        else if( lFields[i] == "-o" && lHasValue ) lJob.mOutput = lFields[++i];
+        else return "error unexpected argument " + lFields[i];
+    }
+    if( lJob.mInput.empty() || lJob.mOutput.empty() ) return "error expected -i <input> and -o <output>";
+
+    std::string lError;
+    if( !CheckJobArguments(lOptions, false, lJob, lError) ) return "error " + lError;
+
+    gJobTag = pState->mNextJob++;
+    RunJob(pContext, lJob, lOptions, GetWriteFileFormat(pContext.mSdkManager, lOptions));
+    gJobTag = -1;
+
+    if( !lJob.mSucceeded ) pState->mFailures++;
+    PrintJobResult(lJob);
+
+    char lReply[256];
+    snprintf(lReply, sizeof(lReply), "%s %.6f %.6f %.6f %.6f %.6f%s", lJob.mSucceeded ? "ok" : "fail", lJob.mSeconds,
+             lJob.mTimings.mImport, lJob.mTimings.mImport2, lJob.mTimings.mMerge, lJob.mTimings.mExport, lJob.mCached ? " cached" : "");
+    return lReply;
+}
+
+// true if the peer of pSocket runs as the effective user of the server
+static bool IsSameUser(int pSocket)
+{
+#ifdef SO_PEERCRED
+    ucred lCredentials;
+    socklen_t lSize = sizeof(lCredentials);
+    return getsockopt(pSocket, SOL_SOCKET, SO_PEERCRED, &lCredentials, &lSize) == 0 && lCredentials.uid == geteuid();
+#else
+    uid_t lUser;
+    gid_t lGroup;
+    return getpeereid(pSocket, &lUser, &lGroup) == 0 && lUser == geteuid();
+#endif
+}
+
+// body of a worker thread: answers the connections until the server stops
+static void RunServerWorker(
+                            ServerState* pState
+                            )
+{
+    // the manager is created once per worker and stays warm between requests
+    MergeContext lContext;
+    InitializeMergeContext(lContext);
+
+    int lConnection;
+    while( pState->mConnections->Pop(lConnection) )
+    {
+        // a client which does not send its request does not hold the worker
+        timeval lTimeout;
+        lTimeout.tv_sec  = kRequestTimeout;
+        lTimeout.tv_usec = 0;
+        setsockopt(lConnection, SOL_SOCKET, SO_RCVTIMEO, &lTimeout, sizeof(lTimeout));
+
+        // the jobs read and write files as the server: other users are refused
+        std::string lRequest;
+        std::string lReply;
+        if( !IsSameUser(lConnection) )                lReply = "error the client runs as another user";
+        else if( ReadLine(lConnection, lRequest) )    lReply = RunRequest(lContext, pState, lRequest);
+        else                                          lReply = "error no request line";
+        WriteText(lConnection, lReply + "\n");
+        close(lConnection);
+    }
+
+    DestroyMergeContext(lContext);
+}
+
+int RunServer(
+              const char* pSocketPath,
+              const BatchOptions& pOptions
+              )
+{
+    sockaddr_un lAddress;
+    if( !GetSocketAddress(pSocketPath, lAddress) )
+    {
+        printf("-serve: the socket path %s is too long\n", pSocketPath);
+        return 1;
+    }
+
+    // the socket file left by a server which did not stop is replaced, not that of a running one
+    int lProbe = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool lRunning = lProbe >= 0 && connect(lProbe, (const sockaddr*)&lAddress, sizeof(lAddress)) == 0;
+    if( lProbe >= 0 ) close(lProbe);
+    if( lRunning )
+    {
+        printf("-serve: a server already listens on %s\n", pSocketPath);
+        return 1;
+    }
+    unlink(pSocketPath);
+
+    // the socket file is created 0600; the mask is per process, no other thread runs yet
+    int lListen = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t lMask = umask(0177);
+    bool lBound = lListen >= 0 && bind(lListen, (const sockaddr*)&lAddress, sizeof(lAddress)) == 0;
+    umask(lMask);
+    if( !lBound || listen(lListen, 64) != 0 )
+    {
+        printf("-serve: cannot listen on %s: %s\n", pSocketPath, strerror(errno));
+        if( lListen >= 0 ) close(lListen);
+        return 1;
+    }
+
+    // a client gone before its reply must not stop the server
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction lAction;
+    memset(&lAction, 0, sizeof(lAction));
+    lAction.sa_handler = OnStopSignal;
+    sigaction(SIGINT, &lAction, NULL);
+    sigaction(SIGTERM, &lAction, NULL);
+
+    // a worker holds one job at a time, as in RunBatch
+    int lWorkerCount = pOptions.mThreadCount;
+    if( pOptions.mMaxInFlight > 0 && pOptions.mMaxInFlight < lWorkerCount ) lWorkerCount = pOptions.mMaxInFlight;
+    if( lWorkerCount < 1 ) lWorkerCount = 1;
+
+    // once the workers are busy and the queue is full, the clients wait in the backlog
+    BoundedQueue<int> lConnections(size_t(lWorkerCount) * 2);
+    ServerState lState;
+    lState.mOptions     = &pOptions;
+    lState.mConnections = &lConnections;
+    lState.mNextJob     = 0;
+    lState.mFailures    = 0;
+
+    std::vector<std::thread> lThreads;
+    for( int i = 0; i < lWorkerCount; i++ )
+    {
+        lThreads.push_back(std::thread(RunServerWorker, &lState));
+    }
+    printf("listening on %s, %d workers\n", pSocketPath, lWorkerCount);
+    fflush(stdout);
+
+    // polled so that a signal or a shutdown request stops the loop; while the queue is
+    // full, the connection accepted last waits for room and the others stay in the backlog
+    int lConnection = -1;
+    while( !gStopSignal && !gStopRequest )
+    {
+        if( lConnection >= 0 )
+        {
+            if( lConnections.TryPush(lConnection, 200) ) lConnection = -1;
+            continue;
+        }
+
+        pollfd lPoll;
+        lPoll.fd      = lListen;
+        lPoll.events  = POLLIN;
+        lPoll.revents = 0;
+        if( poll(&lPoll, 1, 200) <= 0 ) continue;
+
+        lConnection = accept(lListen, NULL, NULL);
+    }
+
+    // the accepted connections are still answered, the workers make room for the last one
+    close(lListen);
+    unlink(pSocketPath);
+    if( lConnection >= 0 ) lConnections.Push(lConnection);
+    lConnections.Close();
+    for( int i = 0; i < lWorkerCount; i++ )
+    {
+        lThreads[i].join();
+    }
+
+    printf("served %d jobs (%d failed)\n", int(lState.mNextJob), int(lState.mFailures));
+    return 0;
+}
+
+int RunClient(
+              const char* pSocketPath,
+              const std::vector<std::string>& pArgs
+              )
+{
+    // the server has its own working directory: the paths of the job are sent absolute
+    char lDirectory[4096];
+    if( getcwd(lDirectory, sizeof(lDirectory)) == NULL ) lDirectory[0] = 0;
+
+    std::string lRequest = "merge";
+    if( pArgs.size() == 1 && pArgs[0] == "-shutdown" ) lRequest = "shutdown";
+    for( size_t i = 0; i < pArgs.size() && lRequest != "shutdown"; i++ )
+    {
+        bool lPath = i > 0 && (pArgs[i - 1] == "-i" || pArgs[i - 1] == "-s" || pArgs[i - 1] == "-o");
+        std::string lArg = pArgs[i];
+        if( lPath && !lArg.empty() && lArg != "-" && lArg[0] != '/' ) lArg = std::string(lDirectory) + "/" + lArg;
+        if( lArg.find('"') != std::string::npos || lArg.find('\n') != std::string::npos )
+        {
+            printf("-connect: %s can't be sent, it holds a double quote or a new line\n", pArgs[i].c_str());
+            return 1;
+        }
+        lRequest += " \"" + lArg + "\"";
+    }
+
+    sockaddr_un lAddress;
+    if( !GetSocketAddress(pSocketPath, lAddress) )
+    {
+        printf("-connect: the socket path %s is too long\n", pSocketPath);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int lSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if( lSocket < 0 || connect(lSocket, (const sockaddr*)&lAddress, sizeof(lAddress)) != 0 )
+    {
+        printf("-connect: no server on %s: %s\n", pSocketPath, strerror(errno));
+        if( lSocket >= 0 ) close(lSocket);
+        return 1;
+    }
+
+    std::string lReply;
+    bool lAnswered = WriteText(lSocket, lRequest + "\n") && ReadLine(lSocket, lReply);
+    close(lSocket);
+    if( !lAnswered )
+    {
+        printf("-connect: the server closed the connection\n");
+        return 1;
+    }
+
+    printf("%s\n", lReply.c_str());
+    if( lReply.compare(0, 3, "ok ") == 0 || lReply == "ok" ) return 0;
+    return lReply.compare(0, 5, "fail ") == 0 ? 2 : 1;
+}
+
+#endif
@@ -0,0 +1,44 @@
+// Server.h : merge server listening on a Unix domain socket, and its client.
+//
+// Every run of NormalMergerCli creates a FbxManager and its IO plugin registry
+// before its first merge. With -serve the managers are created once, one per
+// worker kept warm between the jobs, and the jobs come from local clients, one
+// request per connection:
+//
+//   merge <arguments>\n      the arguments of a single job of the command line: -i, -s,
+//                            -o and the merge options (ParseMergeArgument), separated by
+//                            blanks, double quoted if they hold blanks. The options the
+//                            server was started with are the defaults of every job.
+//   shutdown\n               stops the server once the running jobs are done
+//
+// and one reply line:
+//
+//   ok|fail <seconds> <import> <import2> <merge> <export> [cached]\n
+//   error <message>\n        the request is not valid, nothing was run
+//
+// The paths are opened by the server: the client sends them absolute. The socket is
+// only open to the user of the server (mode 0600), and a client running as another
+// user gets an error.
+
+#pragma once
+
+#include "Batch.h"
+
+#include <string>
+#include <vector>
+
+// serves the merge requests on pSocketPath with pOptions.mThreadCount workers (at most
+// pOptions.mMaxInFlight) until a shutdown request, SIGINT or SIGTERM. Returns 0, or 1
+// if the socket can't be created or another server listens on it.
+int RunServer(
+              const char* pSocketPath,
+              const BatchOptions& pOptions
+              );
+
+// sends the job of pArgs, or "shutdown" if pArgs is -shutdown, to the server on pSocketPath
+// and prints its reply. Returns 0 if the job succeeded, 2 if it failed, 1 if the server
+// can't be reached or refused the request.
+int RunClient(
+              const char* pSocketPath,
+              const std::vector<std::string>& pArgs
+              );
@@ -0,0 +1,326 @@
+// main.cxx : Defines the entry point for the headless batch merger.
+//
+// usage:
+//   NormalMergerCli [options] <manifest>
+//   NormalMergerCli [options] -i <lighting.fbx> [-s <outline.fbx>] -o <output.fbx>
+//   NormalMergerCli [options] -channels <c,...> -i <lighting.fbx> -s <source>... -o <output.fbx>
+//   NormalMergerCli [-import2 <p>] -sidecar <outline.fbx> -o <outline.nms>
+//   NormalMergerCli [options] -serve <socket>
+//   NormalMergerCli -connect <socket> [options] -i <lighting.fbx> [-s <outline.fbx>]... -o <output.fbx>
+//   NormalMergerCli -connect <socket> -shutdown
+//
+// Without a smooth file, the smooth normals are computed from the lighting mesh
+// by welding its coincident control points (-weld) and averaging the polygon normals.
+// A smooth file may be a sidecar written by -sidecar (NormalSidecar.h): it is mapped
+// instead of imported, its meshes pair by node path and by index (-match index).
+// -serve keeps -j workers and their managers alive and merges the jobs sent by
+// -connect on a Unix domain socket (Server.h), the options of the server being the
+// defaults of the jobs; the client prints the reply: ok|fail <seconds> <import>
+// <import2> <merge> <export> [cached], or error <message>.
+//
+// options:
+//   -ascii          write ASCII FBX instead of the native binary writer
+//   -format <n>     write with the writer format number <n> of the IO plugin registry
+//   -j <n>          number of worker threads, each with its own FbxManager (default: all cores)
+//   -inflight <n>   max number of jobs loaded at the same time (default: one per worker)
+//   -pipeline <n>   instead of -j, one thread imports, one merges and one exports, the jobs
+//                   waiting between them in queues of <n> jobs: the next file imports while
+//                   one merges and the previous one exports. At most 2 * <n> + 3 jobs are loaded
+//   -mesh-threads <n>  threads merging the meshes of one scene (default: 1, 0 for all cores)
+//   -match <mode>   index: element i gets the smooth normal i (default)
+//                   position: control points are matched by position, for re-ordered vertices
+//                   closest: normals sampled on the closest point of the smooth surface, for
+//                   other topologies (LODs, cages); meshes pair by node name
+//   -weld <d>       max distance of the control points matched or welded by position (default: 1e-4)
+//   -smooth <w>     weighting of the generated smooth normals: area (default) or angle
+//   -output <c>     tangent: raw smooth normals in the tangent layer (default)
+//                   uv: a MikkTSpace tangent basis in the tangent layer and the smooth normals
+//                   in that basis, x and y in the UV set "SmoothNormal"
+//                   color: same, xyz * 0.5 + 0.5 in the vertex color layer "SmoothNormal"
+//   -pack <p>       with -output uv or color: tangent, the tangent space encoding above (default)
+//                   oct8, oct16: the smooth normals packed in 2 octahedral components of 8 or
+//                   16 bits, in the mapping of the normals, the tangent layer is left as it is
+//   -import1 <p>    what is read of the lighting file, which is written back:
+//                   full (default), static (no animation, gobos, characters, constraints,
+//                   audio) or geometry (also no materials, textures, skins, shapes, tangents,
+//                   vertex colors, smoothing); static and geometry need -writer patch, which
+//                   keeps the rest of the lighting file, tangent outputs and binary FBX
+//   -import2 <p>    same for the smooth file, geometry by default: only its normals are read
+//   -reader2 <r>    sdk: the smooth file is imported by the FBX SDK (default)
+//                   native: a binary FBX 7.x smooth file is memory mapped and only its meshes and
+//                   normals are read, meshes pair by node name; other files and -match closest
+//                   fall back to the SDK
+//   -writer <w>     sdk: the merged scene is exported by the FBX SDK (default)
+//                   patch: the binary lighting file is copied with only its tangent layers
+//                   replaced, in its own FBX version; -output uv and color, -ascii, -format
+//                   and other files fall back to the SDK
+//                   glb: the meshes are written to a binary glTF file, one interleaved vertex
+//                   buffer per mesh, the smooth normals in the attribute _SMOOTH_NORMAL
+//   -quantize <q>   with -writer glb: float (default), int16 or int8: the normals, tangents,
+//                   UVs and smooth normals are stored as normalized integers when they fit
+//   -compact <d>    stores every distinct generated tangent and binormal once, with an index
+//                   array, the vectors within <d> (0 for equal ones) being the same; off by default
+//   -channels <c,...>  merges several smooth sources in one pass, one per channel, in order:
+//                   tangent, uv or color, uv and color optionally followed by :oct8 or :oct16
+//                   (instead of -output and -pack). Every job gives one source per channel,
+//                   - to generate it; the lighting file is imported and exported once and
+//                   the sources are imported at the same time. One source may write the
+//                   tangent layer: tangent, or an unpacked uv or color.
+//   -cache <dir>    keeps the outputs in <dir>, keyed by the bytes of the inputs and the settings;
+//                   a job whose key is found gets a copy of its last output without loading any scene
+//   -cache-size <n> size of the cache in MB, the least recently used outputs are removed (default: 10240)
+//   -mesh-cache <dir>  keeps the merged arrays of every mesh in <dir>, keyed by its geometry and
+//                   its smooth normals; the meshes found there are read back instead of merged
+//   -sidecar <f>    writes the normals of the smooth file <f> to the sidecar -o and exits
+//   -serve <socket> serves the jobs of the clients on <socket> until SIGINT, SIGTERM or -shutdown
+//   -connect <socket>  sends the job of the other arguments to the server on <socket>
+//   -q              only print the per-file results and the summary
+//
+// The manifest has one job per line: <input> [<input2>] <output>, or with -channels
+// <input> <source>... <output>.
+// Fields are separated by blanks and may be double quoted, blank lines and
+// lines starting with '#' are ignored.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Batch.h"
+#include "Server.h"
+#include "../Common/MergeKernel.h"
+#include "../Common/MeshCache.h"
+
+static void PrintUsage()
+{
+    printf("usage: NormalMergerCli [options] <manifest>\n");
+    printf("       NormalMergerCli [options] -i <input> [-s <input2>] -o <output>\n");
+    printf("       NormalMergerCli [options] -channels <c,...> -i <input> -s <source>... -o <output>\n");
+    printf("       NormalMergerCli [-import2 full|static|geometry] -sidecar <input2> -o <sidecar>\n");
+    printf("       NormalMergerCli [options] -serve <socket>\n");
+    printf("       NormalMergerCli -connect <socket> [options] -i <input> [-s <input2>] -o <output> | -shutdown\n");
+    printf("options: [-ascii | -format <n>] [-j <n> | -pipeline <n>] [-inflight <n>] [-mesh-threads <n>]\n");
+    printf("         [-match index|position|closest] [-weld <distance>] [-smooth area|angle]\n");
+    printf("         [-output tangent|uv|color] [-pack tangent|oct8|oct16]\n");
+    printf("         [-import1 full|static|geometry] [-import2 full|static|geometry]\n");
+    printf("         [-reader2 sdk|native] [-writer sdk|patch|glb]\n");
+    printf("         [-quantize float|int16|int8] [-compact <tolerance>]\n");
+    printf("         [-cache <dir>] [-cache-size <MB>] [-mesh-cache <dir>] [-q]\n");
+    printf("channels: tangent, uv, color, uv:oct8, uv:oct16, color:oct8, color:oct16\n");
+}
+
+int main(
+         int argc,
+         char** argv
+         )
+{
+    std::vector<MergeJob> lJobs;
+    const char* lManifest = NULL;
+    MergeJob lSingleJob;
+    lSingleJob.mSeconds   = 0.0;
+    lSingleJob.mSucceeded = false;
+    lSingleJob.mCached    = false;
+    const char* lCacheDirectory = NULL;
+    double lCacheMegaBytes = 10240.0;
+    const char* lSidecarSource = NULL;
+
+    BatchOptions lOptions;
+    lOptions.mThreadCount     = int(std::thread::hardware_concurrency());
+    lOptions.mMaxInFlight     = 0;
+    lOptions.mPipelineDepth   = 0;
+    lOptions.mAscii           = false;
+    lOptions.mWriteFileFormat = -1;
+    lOptions.mCache           = NULL;
+
+    std::vector<std::string> lArgs(argv + 1, argv + argc);
+
+    // a client sends its job to a server, which reads the arguments
+    for( size_t i = 0; i + 1 < lArgs.size(); i++ )
+    {
+        if( lArgs[i] != "-connect" ) continue;
+        std::string lSocket = lArgs[i + 1];
+        lArgs.erase(lArgs.begin() + i, lArgs.begin() + i + 2);
+        return RunClient(lSocket.c_str(), lArgs);
+    }
+
+    const char* lServerSocket = NULL;
+    for( size_t i = 0; i < lArgs.size(); i++ )
+    {
+        const std::string& lArg = lArgs[i];
+        bool lHasValue = i + 1 < lArgs.size();
+
+        int lParsed = ParseMergeArgument(lArgs, i, lOptions);
+        if( lParsed < 0 )
+        {
+            PrintUsage();
+            return 1;
+        }
+        if( lParsed > 0 ) continue;
+
+        if( lArg == "-q" )                          gQuiet = true;
+        else if( lArg == "-j" && lHasValue )        lOptions.mThreadCount = atoi(lArgs[++i].c_str());
+        else if( lArg == "-inflight" && lHasValue ) lOptions.mMaxInFlight = atoi(lArgs[++i].c_str());
+        else if( lArg == "-pipeline" && lHasValue ) lOptions.mPipelineDepth = atoi(lArgs[++i].c_str());
+        else if( lArg == "-cache" && lHasValue )    lCacheDirectory = lArgs[++i].c_str();
+        else if( lArg == "-cache-size" && lHasValue ) lCacheMegaBytes = atof(lArgs[++i].c_str());
+        else if( lArg == "-mesh-cache" && lHasValue ) lOptions.mMergeOptions.mMeshCacheDirectory = lArgs[++i];
+        else if( lArg == "-i" && lHasValue )        lSingleJob.mInput  = lArgs[++i];
+        else if( lArg == "-s" && lHasValue )        lSingleJob.mSources.push_back(lArgs[++i] == "-" ? std::string() : lArgs[i]);
+        else if( lArg == "-o" && lHasValue )        lSingleJob.mOutput = lArgs[++i];
+        else if( lArg == "-sidecar" && lHasValue )  lSidecarSource = lArgs[++i].c_str();
+        else if( lArg == "-serve" && lHasValue )    lServerSocket = lArgs[++i].c_str();
+        else if( lArg[0] != '-' && !lManifest )     lManifest = lArgs[i].c_str();
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if( lSidecarSource )
+    {
+        if( lSingleJob.mOutput.empty() )
+        {
+            PrintUsage();
+            return 1;
+        }
+        MergeContext lContext;
+        InitializeMergeContext(lContext);
+        bool lWritten = WriteSmoothSidecar(lContext, lOptions.mMergeOptions, lSidecarSource, lSingleJob.mOutput.c_str());
+        DestroyMergeContext(lContext);
+        return lWritten ? 0 : 1;
+    }
+
+    std::string lError;
+    if( !CheckJobArguments(lOptions, lManifest != NULL || lServerSocket != NULL, lSingleJob, lError) )
+    {
+        printf("%s\n", lError.c_str());
+        return 1;
+    }
+
+    // a server gets its jobs from its clients, the options being their defaults
+    if( lServerSocket )
+    {
+        if( lManifest || !lSingleJob.mInput.empty() || !lSingleJob.mOutput.empty() )
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+    else if( lManifest )
+    {
+        if( !ReadManifest(lManifest, int(lOptions.mChannels.size()), lJobs) ) return 1;
+    }
+    else if( !lSingleJob.mInput.empty() && !lSingleJob.mOutput.empty() )
+    {
+        lJobs.push_back(lSingleJob);
+    }
+    else
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    ResultCache lCache;
+    unsigned long long lCacheBytes = (unsigned long long)(lCacheMegaBytes * 1024.0 * 1024.0);
+    if( lCacheDirectory )
+    {
+        if( lCacheMegaBytes <= 0.0 || !lCache.Open(lCacheDirectory, lCacheBytes, lError) )
+        {
+            printf("-cache: %s\n", lError.empty() ? "the size must be positive" : lError.c_str());
+            return 1;
+        }
+        lOptions.mCache = &lCache;
+    }
+
+    const std::string& lMeshCache = lOptions.mMergeOptions.mMeshCacheDirectory;
+    if( !lMeshCache.empty() && !OpenMeshCache(lMeshCache.c_str()) )
+    {
+        printf("-mesh-cache: cannot write in %s\n", lMeshCache.c_str());
+        return 1;
+    }
+
+    if( lServerSocket )
+    {
+        int lStatus = RunServer(lServerSocket, lOptions);
+        if( lCacheDirectory ) lCache.Flush();
+        return lStatus;
+    }
+
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    BatchStats lBatchStats;
+    int lFailures = RunBatch(lJobs, lOptions, &lBatchStats);
+    if( lCacheDirectory ) lCache.Flush();
+    double lWallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+
+    int lCount = int(lJobs.size());
+    double lInputBytes = 0.0;
+    double lJobSeconds = 0.0;
+    MergeTimings lPhases;
+    for( int i = 0; i < lCount; i++ )
+    {
+        lJobSeconds += lJobs[i].mSeconds;
+        lPhases.mImport  += lJobs[i].mTimings.mImport;
+        lPhases.mImport2 += lJobs[i].mTimings.mImport2;
+        lPhases.mMerge   += lJobs[i].mTimings.mMerge;
+        lPhases.mExport  += lJobs[i].mTimings.mExport;
+        if( !lJobs[i].mSucceeded ) continue;
+
+        lInputBytes += double(FbxFileUtils::Size(lJobs[i].mInput.c_str()));
+        if( !lJobs[i].mInput2.empty() ) lInputBytes += double(FbxFileUtils::Size(lJobs[i].mInput2.c_str()));
+        for( size_t s = 0; s < lJobs[i].mSources.size(); s++ )
+        {
+            if( !lJobs[i].mSources[s].empty() ) lInputBytes += double(FbxFileUtils::Size(lJobs[i].mSources[s].c_str()));
+        }
+    }
+
+    printf("\n");
+    printf("files            : %d (%d failed)\n", lCount, lFailures);
+    printf("merge kernel     : %s\n", GetKernelIsaName(GetKernelIsa()));
+    printf("wall time        : %.3f s (includes the sdk init of the workers)\n", lWallSeconds);
+    printf("sum of job times : %.3f s\n", lJobSeconds);
+    printf("  import input 1 : %.3f s (%s)\n", lPhases.mImport, GetImportProfileName(lOptions.mMergeOptions.mImportProfile));
+    printf("  import input 2 : %.3f s (%s)\n", lPhases.mImport2,
+        lOptions.mMergeOptions.mNativeReader2 ? "native" : GetImportProfileName(lOptions.mMergeOptions.mImportProfile2));
+    if( lOptions.mChannels.empty() )
+        printf("  merge          : %.3f s\n", lPhases.mMerge);
+    else
+    {
+        std::string lChannels;
+        for( size_t c = 0; c < lOptions.mChannels.size(); c++ )
+            lChannels += (c > 0 ? "," : "") + GetMergeChannelName(lOptions.mChannels[c]);
+        printf("  merge          : %.3f s (%s)\n", lPhases.mMerge, lChannels.c_str());
+    }
+    printf("  export         : %.3f s (%s)\n", lPhases.mExport, GetOutputWriterName(lOptions.mMergeOptions.mWriter));
+    if( lOptions.mPipelineDepth > 0 )
+    {
+        // a stage waiting most of the time is not the bottleneck
+        const char* lNames[3] = { "import", "merge", "export" };
+        printf("pipeline         : queues of %d, %d managers, %d jobs loaded at most\n", lOptions.mPipelineDepth,
+            lBatchStats.mContextCount, lBatchStats.mMaxLoaded);
+        for( int s = 0; s < 3; s++ )
+        {
+            const StageTimes& lStage = lBatchStats.mStages[s];
+            printf("  %-6s stage   : %.3f s working, %.3f s waiting, %d jobs\n", lNames[s], lStage.mWork, lStage.mWait, lStage.mJobs);
+        }
+    }
+    if( lCacheDirectory )
+    {
+        CacheStats lStats = lCache.GetStats();
+        printf("cache            : %d hits, %d misses, %d stored, %d evicted, %.2f MB copied out\n",
+            lStats.mHits, lStats.mMisses, lStats.mStores, lStats.mEvictions, lStats.mHitBytes / (1024.0 * 1024.0));
+        printf("cache size       : %d entries, %.2f of %.2f MB\n", lCache.GetEntryCount(),
+            double(lCache.GetBytes()) / (1024.0 * 1024.0), lCacheMegaBytes);
+    }
+    if( lCount > 0 && lWallSeconds > 0.0 )
+    {
+        printf("average per file : %.3f s\n", lJobSeconds / lCount);
+        printf("throughput       : %.2f files/s, %.2f MB/s read\n",
+            lCount / lWallSeconds, lInputBytes / (1024.0 * 1024.0) / lWallSeconds);
+    }
+
+    return lFailures == 0 ? 0 : 2;
+}
@@ -0,0 +1,202 @@
+// BinaryFbxPatchTest.cxx : the patch writer splices new tangent and binormal layers
+// into a copy of a synthetic binary FBX file.
+
+#include "Test.h"
+
+#include "BinaryFbx.h"
+#include "BinaryFbxPatch.h"
+#include "BinaryFbxRecord.h"
+#include "SyntheticFbx.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// new layer values of the mesh pMesh of a file: xyzw by element of the mapping of its
+// normals, indexed through pIndex if it is not empty
+static void BuildPatchValues(const MeshView& pMesh, int pSeed, bool pIndexed, std::vector<double>& pValues, std::vector<int>& pIndex)
+{
+    int lCount = GetElementCount(pMesh, pMesh.mNormals.mMapping);
+    int lDirectCount = pIndexed ? lCount / 2 + 1 : lCount;
+    pValues.resize(size_t(lDirectCount) * 4);
+    for( int i = 0; i < lDirectCount; i++ )
+    {
+        pValues[4 * size_t(i)]     = 0.25 * i + pSeed;
+        pValues[4 * size_t(i) + 1] = -0.5 * i;
+        pValues[4 * size_t(i) + 2] = 1.0 / (i + 1);
+        pValues[4 * size_t(i) + 3] = (i + pSeed) % 2 == 0 ? 1.0 : -1.0;
+    }
+    pIndex.clear();
+    for( int i = 0; i < lCount && pIndexed; i++ ) pIndex.push_back(i / 2);
+}
+
+static ElementView GetPatchView(EElementMapping pMapping, const std::vector<double>& pValues, const std::vector<int>& pIndex)
+{
+    ElementView lView;
+    lView.mMapping     = pMapping;
+    lView.mReference   = pIndex.empty() ? eRefDirect : eRefIndexToDirect;
+    lView.mDirect      = pValues.empty() ? NULL : &pValues[0];
+    lView.mDirectCount = int(pValues.size() / 4);
+    lView.mStride      = 4;
+    lView.mIndex       = pIndex.empty() ? NULL : &pIndex[0];
+    lView.mIndexCount  = int(pIndex.size());
+    return lView;
+}
+
+// the double or int array of the child pName of pRecord
+template <class T>
+static bool ReadChildArray(const RecordReader& pReader, const Record& pRecord, const char* pName, std::vector<T>& pValues)
+{
+    Record lChild;
+    Property lProperty;
+    bool lDamaged = false;
+    if( !pReader.FindChild(pRecord, pName, lChild, lDamaged) || !pReader.GetProperty(lChild, 0, lProperty) ||
+        lProperty.mType != (sizeof(T) == sizeof(double) ? 'd' : 'i') )
+        return false;
+    pValues.resize(lProperty.mCount);
+    return pValues.empty() || ReadArrayValues(lProperty, sizeof(T), &pValues[0]);
+}
+
+// checks the layer pRecordName of the geometry of pMesh in pFile: pValues and pIndex,
+// listed in Layer 0; or no such layer if pValues is empty
+static bool IsPatchedLayer(
+                           const BinaryFbxFile& pFile,
+                           const BinaryFbxMesh& pMesh,
+                           const char* pRecordName,
+                           const char* pArrayName,
+                           const std::vector<double>& pValues,
+                           const std::vector<int>& pIndex
+                           )
+{
+    RecordReader lReader(pFile.GetData(), pFile.GetVersion());
+    Record lGeometry, lLayer, lChild;
+    bool lDamaged = false;
+    if( !lReader.ReadRecord(pMesh.mRecord, pFile.GetFileSize(), lGeometry, lDamaged) ) return false;
+    if( !lReader.FindLayerElement(lGeometry, pRecordName, lLayer, lDamaged) ) return pValues.empty();
+
+    std::string lName = pArrayName;
+    std::vector<double> lValues, lW;
+    std::vector<int> lIndex;
+    if( !ReadChildArray(lReader, lLayer, lName.c_str(), lValues) || !ReadChildArray(lReader, lLayer, (lName + "W").c_str(), lW) ||
+        (!pIndex.empty() && !ReadChildArray(lReader, lLayer, (lName + "Index").c_str(), lIndex)) ||
+        lValues.size() != pValues.size() / 4 * 3 || lW.size() != pValues.size() / 4 || lIndex != pIndex )
+        return false;
+    for( size_t i = 0; i < lW.size(); i++ )
+    {
+        if( lValues[3 * i] != pValues[4 * i] || lValues[3 * i + 1] != pValues[4 * i + 1] || lValues[3 * i + 2] != pValues[4 * i + 2] ||
+            lW[i] != pValues[4 * i + 3] )
+            return false;
+    }
+
+    // Layer 0 lists the layer
+    for( size_t lOffset = lGeometry.mChildren; lReader.ReadRecord(lOffset, lGeometry.mEnd, lChild, lDamaged); lOffset = lChild.mEnd )
+    {
+        int64_t lIndexValue = -1;
+        if( !lChild.IsNamed("Layer") || !lReader.GetInteger(lChild, 0, lIndexValue) || lIndexValue != 0 ) continue;
+
+        Record lEntry, lField;
+        for( size_t lEntryOffset = lChild.mChildren; lReader.ReadRecord(lEntryOffset, lChild.mEnd, lEntry, lDamaged); lEntryOffset = lEntry.mEnd )
+        {
+            std::string lType;
+            if( lReader.FindChild(lEntry, "Type", lField, lDamaged) && lReader.GetString(lField, 0, lType) && lType == pRecordName )
+                return true;
+        }
+    }
+    return false;
+}
+
+void TestBinaryFbxPatch(const char* pDirectory)
+{
+    const int kMeshCount = 3;
+    const int kPatchedCount = 2;
+    std::string lPath = GetTestPath(pDirectory, "binaryfbxpatchtest.fbx");
+    std::string lPatched = GetTestPath(pDirectory, "binaryfbxpatchtest_patched.fbx");
+    std::string lPatched2 = GetTestPath(pDirectory, "binaryfbxpatchtest_patched2.fbx");
+    WorkStealingPool lPool(4);
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        std::vector<const SyntheticMesh*> lMeshes(kMeshCount, &lMesh);
+        std::vector<std::string> lNames;
+        for( int i = 0; i < kMeshCount; i++ ) lNames.push_back("Lighting" + std::to_string(i));
+
+        for( int lVersion = 7400; lVersion <= 7500; lVersion += 100 )
+#ifdef NORMALMERGER_ZLIB
+        for( int lCompress = 0; lCompress <= 1; lCompress++ )
+#else
+        for( int lCompress = 0; lCompress <= 0; lCompress++ )
+#endif
+        {
+            SetTestCase(lDescs[d]);
+            BinaryFbxFile lFile;
+            if( !CHECK(WriteSyntheticFbx(lPath.c_str(), lVersion, lCompress != 0, lMeshes, lNames)) ||
+                !CHECK(lFile.Open(lPath.c_str(), &lPool)) )
+                continue;
+
+            // Lighting0 gets direct layers, Lighting1 indexed binormals, Lighting2 nothing
+            std::vector<double> lValues[kPatchedCount][2];
+            std::vector<int> lIndex[kPatchedCount][2];
+            std::vector<BinaryFbxTangents> lLayers;
+            for( int i = 0; i < kPatchedCount; i++ )
+            {
+                BinaryFbxTangents lMeshLayers;
+                lMeshLayers.mMesh = lFile.FindMesh(lNames[i].c_str());
+                if( !CHECK(lMeshLayers.mMesh >= 0) ) break;
+
+                const MeshView& lView = lFile.GetMesh(lMeshLayers.mMesh).mView;
+                BuildPatchValues(lView, 2 * i, false, lValues[i][0], lIndex[i][0]);
+                BuildPatchValues(lView, 2 * i + 1, i == 1, lValues[i][1], lIndex[i][1]);
+                lMeshLayers.mTangentName  = "UVChannel_1";
+                lMeshLayers.mBinormalName = "UVChannel_1";
+                lMeshLayers.mTangents     = GetPatchView(lView.mNormals.mMapping, lValues[i][0], lIndex[i][0]);
+                lMeshLayers.mBinormals    = GetPatchView(lView.mNormals.mMapping, lValues[i][1], lIndex[i][1]);
+                lLayers.push_back(lMeshLayers);
+            }
+            std::string lError;
+            if( !CHECK(int(lLayers.size()) == kPatchedCount) || !CHECK(WritePatchedFbx(lFile, lLayers, lPatched.c_str(), &lPool, lError)) )
+                continue;
+
+            // the patched file reads back the meshes and the layers, and ends with its footer
+            std::vector<unsigned char> lOriginalData, lPatchedData, lPatchedData2;
+            BinaryFbxFile lPatchedFile;
+            if( !CHECK(lPatchedFile.Open(lPatched.c_str(), &lPool)) ) continue;
+            CHECK(lPatchedFile.GetMeshCount() == kMeshCount);
+            std::vector<double> lNone;
+            std::vector<int> lNoIndex;
+            for( int i = 0; i < kMeshCount; i++ )
+            {
+                int lIndexInFile = lPatchedFile.FindMesh(lNames[i].c_str());
+                if( !CHECK(lIndexInFile >= 0) ) continue;
+                const BinaryFbxMesh& lPatchedMesh = lPatchedFile.GetMesh(lIndexInFile);
+                CHECK(IsSameMesh(lMesh, lPatchedMesh));
+                CHECK(IsPatchedLayer(lPatchedFile, lPatchedMesh, "LayerElementTangent", "Tangents",
+                                     i < kPatchedCount ? lValues[i][0] : lNone, i < kPatchedCount ? lIndex[i][0] : lNoIndex));
+                CHECK(IsPatchedLayer(lPatchedFile, lPatchedMesh, "LayerElementBinormal", "Binormals",
+                                     i < kPatchedCount ? lValues[i][1] : lNone, i < kPatchedCount ? lIndex[i][1] : lNoIndex));
+            }
+            CHECK(ReadTestFile(lPatched, lPatchedData) && lPatchedData.size() >= kFbxFooterEnd &&
+                  (lPatchedData.size() - kFbxFooterEnd) % 16 == 0 &&
+                  memcmp(&lPatchedData[lPatchedData.size() - sizeof(kFbxFooterMagic)], kFbxFooterMagic, sizeof(kFbxFooterMagic)) == 0);
+
+            // the layers replaced by the same ones give the same file, no layer the original file
+            CHECK(WritePatchedFbx(lPatchedFile, std::vector<BinaryFbxTangents>(), lPatched2.c_str(), NULL, lError) &&
+                  ReadTestFile(lPatched2, lPatchedData2) && lPatchedData2 == lPatchedData);
+            for( size_t i = 0; i < lLayers.size(); i++ )
+                lLayers[i].mMesh = lPatchedFile.FindMesh(lNames[i].c_str());
+            CHECK(WritePatchedFbx(lPatchedFile, lLayers, lPatched2.c_str(), NULL, lError) &&
+                  ReadTestFile(lPatched2, lPatchedData2) && lPatchedData2 == lPatchedData);
+            CHECK(WritePatchedFbx(lFile, std::vector<BinaryFbxTangents>(), lPatched2.c_str(), NULL, lError) &&
+                  ReadTestFile(lPatched2, lPatchedData2) && ReadTestFile(lPath, lOriginalData) && lPatchedData2 == lOriginalData);
+            if( !lError.empty() ) printf("%s\n", lError.c_str());
+        }
+    }
+    remove(lPatched2.c_str());
+    remove(lPatched.c_str());
+    remove(lPath.c_str());
+}
@@ -0,0 +1,144 @@
+// BinaryFbxTest.cxx : the native reader gives back the meshes of a synthetic binary
+// FBX file, refuses a cut file and survives flipped bytes.
+
+#include "Test.h"
+
+#include "BinaryFbx.h"
+#include "SyntheticFbx.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+bool IsSameMesh(
+                const SyntheticMesh& pMesh,
+                const BinaryFbxMesh& pRead
+                )
+{
+    const MeshView& lView = pMesh.mView;
+    const MeshView& lRead = pRead.mView;
+    if( lRead.mControlPointCount != lView.mControlPointCount || lRead.mPolygonCount != lView.mPolygonCount )
+        return false;
+    for( int i = 0; i < lView.mControlPointCount; i++ )
+    for( int c = 0; c < 3; c++ )
+    {
+        if( lRead.mPositions[size_t(i) * lRead.mPositionStride + c] != lView.mPositions[size_t(i) * lView.mPositionStride + c] )
+            return false;
+    }
+    for( int p = 0; p <= lView.mPolygonCount; p++ )
+    {
+        if( lRead.mPolygonStarts[p] != lView.mPolygonStarts[p] ) return false;
+    }
+    for( int i = 0; i < lView.mPolygonStarts[lView.mPolygonCount]; i++ )
+    {
+        if( lRead.mPolygonVertices[i] != lView.mPolygonVertices[i] ) return false;
+    }
+
+    const ElementView& lSource = pMesh.mSource;
+    const ElementView& lNormals = lRead.mNormals;
+    if( lNormals.mMapping != lSource.mMapping || lNormals.mReference != lSource.mReference ||
+        lNormals.mDirectCount != lSource.mDirectCount || lNormals.mIndexCount != lSource.mIndexCount )
+        return false;
+    for( int i = 0; i < lSource.mDirectCount; i++ )
+    for( int c = 0; c < 3; c++ )
+    {
+        if( lNormals.mDirect[size_t(i) * lNormals.mStride + c] != lSource.mDirect[size_t(i) * lSource.mStride + c] ) return false;
+    }
+    for( int i = 0; i < lSource.mIndexCount; i++ )
+    {
+        if( lNormals.mIndex[i] != lSource.mIndex[i] ) return false;
+    }
+    return true;
+}
+
+void TestBinaryFbx(const char* pDirectory)
+{
+    const int kMeshCount = 3;
+    std::string lPath = GetTestPath(pDirectory, "binaryfbxtest.fbx");
+    std::string lCopy = GetTestPath(pDirectory, "binaryfbxtest_damaged.fbx");
+    WorkStealingPool lPool(4);
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        std::vector<const SyntheticMesh*> lMeshes(kMeshCount, &lMesh);
+        std::vector<std::string> lNames;
+        for( int i = 0; i < kMeshCount; i++ ) lNames.push_back("Smooth" + std::to_string(i));
+
+        // 32 and 64 bit record offsets, raw and compressed arrays
+        for( int lVersion = 7400; lVersion <= 7500; lVersion += 100 )
+#ifdef NORMALMERGER_ZLIB
+        for( int lCompress = 0; lCompress <= 1; lCompress++ )
+#else
+        for( int lCompress = 0; lCompress <= 0; lCompress++ )
+#endif
+        {
+            SetTestCase(lDescs[d]);
+            if( !CHECK(WriteSyntheticFbx(lPath.c_str(), lVersion, lCompress != 0, lMeshes, lNames)) ) continue;
+
+            // inflated on the pool, then on the calling thread
+            for( int k = 0; k < 2; k++ )
+            {
+                BinaryFbxFile lFile;
+                if( !CHECK(lFile.Open(lPath.c_str(), k == 0 ? &lPool : NULL)) ) continue;
+                CHECK(lFile.GetVersion() == lVersion);
+                CHECK(lFile.GetMeshCount() == kMeshCount);
+                for( int i = 0; i < kMeshCount; i++ )
+                {
+                    int lIndex = lFile.FindMesh(lNames[i].c_str());
+                    if( !CHECK(lIndex >= 0) ) continue;
+                    CHECK(lFile.GetMesh(lIndex).mName == lNames[i]);
+                    CHECK(IsSameMesh(lMesh, lFile.GetMesh(lIndex)));
+                }
+                CHECK(lFile.FindMesh("Smooth") < 0);
+            }
+
+            // the damaged copies of the small meshes are enough
+            if( lDescs[d].mElementCount > 1000 ) continue;
+
+            // cut before the footer, the null record and the last record
+            std::vector<unsigned char> lData;
+            CHECK(ReadTestFile(lPath, lData) && lData.size() > 200);
+            size_t lSize = lData.size();
+            std::vector<size_t> lFlips;
+            for( int k = 0; k <= 8 && lSize > 200; k++ )
+            {
+                size_t lCut = k == 0 ? 30 : 27 + (lSize - 200 - 27) * k / 8;
+                BinaryFbxFile lFile;
+                CHECK(CopyTestFile(lPath, lCopy, lCut, lFlips) && !lFile.Open(lCopy.c_str()));
+            }
+
+            // 16 flipped bytes must not crash the reader
+            unsigned lRandom = 12345;
+            for( int k = 0; k < 16 && lSize > 27; k++ )
+            {
+                lFlips.clear();
+                for( int f = 0; f < 16; f++ )
+                {
+                    lRandom = lRandom * 1664525u + 1013904223u;
+                    lFlips.push_back(27 + size_t(lRandom >> 8) % (lSize - 27));
+                }
+                BinaryFbxFile lFile;
+                CHECK(CopyTestFile(lPath, lCopy, lSize, lFlips));
+                lFile.Open(lCopy.c_str(), &lPool);
+            }
+        }
+    }
+
+    // a polygon-vertex past the control points leaves its mesh out
+    SyntheticMesh lMesh;
+    BuildSyntheticMesh(lDescs[0], lMesh);
+    lMesh.mPolygonVertices[1] = lMesh.mView.mControlPointCount;
+    std::vector<const SyntheticMesh*> lMeshes(1, &lMesh);
+    std::vector<std::string> lNames(1, "Smooth");
+    BinaryFbxFile lFile;
+    SetTestCase(lDescs[0]);
+    CHECK(WriteSyntheticFbx(lPath.c_str(), 7500, false, lMeshes, lNames) && lFile.Open(lPath.c_str()) && lFile.GetMeshCount() == 0);
+
+    remove(lCopy.c_str());
+    remove(lPath.c_str());
+}
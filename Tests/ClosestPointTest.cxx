@@ -0,0 +1,95 @@
+// ClosestPointTest.cxx : the closest point sampling gives back the smooth normals at
+// the control points and their mean at the triangle centers.
+
+#include "Test.h"
+
+#include "Bvh.h"
+#include "Correspondence.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+void TestClosestPoint(const char*)
+{
+    WorkStealingPool lPool(4);
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(eMapByControlPoint, lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SetTestCase(lDescs[d]);
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        const MeshView& lView = lMesh.mView;
+
+        std::vector<double> lCorners, lCornerValues;
+        TriangulateMesh(lView, lMesh.mSource, lCorners, lCornerValues);
+        int lTriangleCount = int(lCorners.size() / 9);
+
+        // the used control points, then the triangle centers
+        std::vector<char> lUsed(lView.mControlPointCount, 0);
+        for( int i = 0; i < lView.mPolygonStarts[lView.mPolygonCount]; i++ ) lUsed[lView.mPolygonVertices[i]] = 1;
+
+        std::vector<double> lQueries, lExpected;
+        for( int i = 0; i < lView.mControlPointCount; i++ )
+        {
+            if( !lUsed[i] ) continue;
+            const double* lValue = lMesh.mSource.mDirect + size_t(i) * lMesh.mSource.mStride;
+            lQueries.insert(lQueries.end(), lView.mPositions + size_t(i) * lView.mPositionStride, lView.mPositions + size_t(i) * lView.mPositionStride + 3);
+            lExpected.insert(lExpected.end(), lValue, lValue + 3);
+        }
+        for( int t = 0; t < lTriangleCount; t++ )
+        {
+            // the closest point of slivers (fans over collinear points of the mixed
+            // polygons) is ill conditioned, their centers are left out
+            const double* a = &lCorners[size_t(t) * 9];
+            double ab[3], ac[3], bc[3];
+            for( int c = 0; c < 3; c++ )
+            {
+                ab[c] = a[3 + c] - a[c];
+                ac[c] = a[6 + c] - a[c];
+                bc[c] = a[6 + c] - a[3 + c];
+            }
+            double n[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+            double lLongest2 = std::max(std::max(ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2], ac[0] * ac[0] + ac[1] * ac[1] + ac[2] * ac[2]),
+                                        bc[0] * bc[0] + bc[1] * bc[1] + bc[2] * bc[2]);
+            if( std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) < 0.1 * lLongest2 ) continue;
+
+            for( int c = 0; c < 3; c++ )
+            {
+                lQueries.push_back((a[c] + a[3 + c] + a[6 + c]) / 3.0);
+                lExpected.push_back((lCornerValues[size_t(t) * 9 + c] + lCornerValues[size_t(t) * 9 + 3 + c] + lCornerValues[size_t(t) * 9 + 6 + c]) / 3.0);
+            }
+        }
+        int lQueryCount = int(lQueries.size() / 3);
+
+        // a mesh of points only, sampled by control point
+        int lNoPolygon = 0;
+        MeshView lTarget = lView;
+        lTarget.mPositions         = &lQueries[0];
+        lTarget.mPositionStride    = 3;
+        lTarget.mControlPointCount = lQueryCount;
+        lTarget.mPolygonVertices   = NULL;
+        lTarget.mPolygonStarts     = &lNoPolygon;
+        lTarget.mPolygonCount      = 0;
+
+        std::vector<double> lValues, lSerialValues;
+        TriangleBvh lBvh(lCorners, &lPool);
+        TriangleBvh lSerialBvh(lCorners, NULL);
+        CHECK(lBvh.GetTriangleCount() == lTriangleCount);
+        CHECK(SampleSurface(lBvh, lCornerValues, lTarget, eMapByControlPoint, &lPool, lValues));
+        CHECK(SampleSurface(lSerialBvh, lCornerValues, lTarget, eMapByControlPoint, NULL, lSerialValues));
+        CHECK(lSerialValues == lValues);
+        if( !CHECK(lValues.size() == size_t(lQueryCount) * 4) ) continue;
+
+        double lMaxError = 0.0;
+        for( int i = 0; i < lQueryCount; i++ )
+        {
+            for( int c = 0; c < 3; c++ )
+                lMaxError = std::max(lMaxError, std::fabs(lValues[size_t(i) * 4 + c] - lExpected[size_t(i) * 3 + c]));
+        }
+        CHECK(lMaxError <= 1e-6);
+    }
+}
@@ -0,0 +1,62 @@
+// CorrespondenceTest.cxx : the position matching finds back shuffled control points.
+
+#include "Test.h"
+
+#include "Correspondence.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+void TestCorrespondence(const char*)
+{
+    WorkStealingPool lPool(4);
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(eMapByControlPoint, lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SetTestCase(lDescs[d]);
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        const MeshView& lView = lMesh.mView;
+        int lCount = lView.mControlPointCount;
+
+        // lShuffle[c] is the new place of the control point c
+        std::vector<int> lShuffle(lCount);
+        for( int i = 0; i < lCount; i++ ) lShuffle[i] = i;
+        unsigned lSeed = 12345u;
+        for( int i = lCount - 1; i > 0; i-- )
+        {
+            lSeed = lSeed * 1664525u + 1013904223u;
+            std::swap(lShuffle[i], lShuffle[lSeed % unsigned(i + 1)]);
+        }
+
+        std::vector<double> lPositions(size_t(lCount) * 4);
+        for( int i = 0; i < lCount; i++ )
+            memcpy(&lPositions[size_t(lShuffle[i]) * 4], lView.mPositions + size_t(i) * lView.mPositionStride, 4 * sizeof(double));
+
+        int lPolygonVertexCount = lView.mPolygonStarts[lView.mPolygonCount];
+        std::vector<int> lPolygonVertices(lPolygonVertexCount);
+        for( int i = 0; i < lPolygonVertexCount; i++ ) lPolygonVertices[i] = lShuffle[lView.mPolygonVertices[i]];
+
+        MeshView lShuffled = lView;
+        lShuffled.mPositions       = &lPositions[0];
+        lShuffled.mPositionStride  = 4;
+        lShuffled.mPolygonVertices = &lPolygonVertices[0];
+
+        std::vector<int> lMatches, lSerialMatches;
+        CHECK(MatchControlPoints(lView, lShuffled, 1e-4, &lPool, lMatches) == 0);
+        CHECK(MatchControlPoints(lView, lShuffled, 1e-4, NULL, lSerialMatches) == 0);
+        CHECK(lSerialMatches == lMatches);
+        if( !CHECK(int(lMatches.size()) == lCount) ) continue;
+
+        // control points used by no polygon are not matched
+        std::vector<char> lUsed(lCount, 0);
+        for( int i = 0; i < lPolygonVertexCount; i++ ) lUsed[lView.mPolygonVertices[i]] = 1;
+        int lWrong = 0;
+        for( int i = 0; i < lCount; i++ ) lWrong += lMatches[i] == (lUsed[i] ? lShuffle[i] : -1) ? 0 : 1;
+        CHECK(lWrong == 0);
+    }
+}
@@ -0,0 +1,97 @@
+// ElementCompactionTest.cxx : the compaction of the merged tangents and binormals,
+// against its definition, with a 0 and a 1e-3 tolerance.
+
+#include "Test.h"
+
+#include "ElementCompaction.h"
+#include "MergeCore.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+// checks a compaction of the pCount vectors of pValues against its definition
+static bool IsCompactionValid(
+                              const std::vector<double>& pValues,
+                              int pCount,
+                              double pTolerance,
+                              const std::vector<int>& pIndex,
+                              const std::vector<int>& pFirst
+                              )
+{
+    if( int(pIndex.size()) != pCount || pFirst.size() > pIndex.size() ) return false;
+
+    // numbered in order of first use
+    int lNext = 0;
+    for( int i = 0; i < pCount; i++ )
+    {
+        int u = pIndex[i];
+        if( u < 0 || u > lNext || u >= int(pFirst.size()) ) return false;
+        if( u == lNext )
+        {
+            if( pFirst[u] != i ) return false;
+            lNext++;
+        }
+
+        const double* a = &pValues[size_t(i) * 4];
+        const double* b = &pValues[size_t(pFirst[u]) * 4];
+        for( int c = 0; c < 4; c++ )
+        {
+            if( pTolerance > 0.0 ? !(std::fabs(a[c] - b[c]) <= pTolerance * (1.0 + 1e-9)) : a[c] != b[c] ) return false;
+        }
+    }
+    if( lNext != int(pFirst.size()) ) return false;
+    if( pTolerance > 0.0 ) return true;
+
+    // as many distinct vectors as a sort finds
+    std::vector<int> lOrder(pCount);
+    for( int i = 0; i < pCount; i++ ) lOrder[i] = i;
+    std::function<bool(int, int)> lLess = [&](int pA, int pB)
+    {
+        const double* a = &pValues[size_t(pA) * 4];
+        const double* b = &pValues[size_t(pB) * 4];
+        for( int c = 0; c < 4; c++ )
+        {
+            if( a[c] != b[c] ) return a[c] < b[c];
+        }
+        return false;
+    };
+    std::sort(lOrder.begin(), lOrder.end(), lLess);
+    int lDistinct = pCount > 0 ? 1 : 0;
+    for( int i = 1; i < pCount; i++ ) lDistinct += lLess(lOrder[i - 1], lOrder[i]) ? 1 : 0;
+    return lDistinct == int(pFirst.size());
+}
+
+void TestElementCompaction(const char*)
+{
+    WorkStealingPool lPool(4);
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SetTestCase(lDescs[d]);
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        int lCount = GetElementCount(lMesh.mView, lMesh.mSource.mMapping);
+        std::vector<double> lVectors[2];
+        lVectors[0].resize(size_t(lCount) * 4);
+        lVectors[1].resize(size_t(lCount) * 4);
+        ElementOutput lTangentOutput  = { &lVectors[0][0], lCount, 4 };
+        ElementOutput lBinormalOutput = { &lVectors[1][0], lCount, 4 };
+        MergeNormals(lMesh.mView, lMesh.mSource, lTangentOutput, lBinormalOutput, 0.0, 0, lCount);
+
+        const double lTolerances[2] = { 0.0, 1e-3 };
+        for( int t = 0; t < 2; t++ )
+        for( int v = 0; v < 2; v++ )
+        {
+            std::vector<int> lIndex, lFirst, lSerialIndex, lSerialFirst;
+            CompactElement(&lVectors[v][0], lCount, 4, 4, lTolerances[t], &lPool, lIndex, lFirst);
+            CompactElement(&lVectors[v][0], lCount, 4, 4, lTolerances[t], NULL, lSerialIndex, lSerialFirst);
+            CHECK(lSerialIndex == lIndex && lSerialFirst == lFirst);
+            CHECK(IsCompactionValid(lVectors[v], lCount, lTolerances[t], lIndex, lFirst));
+        }
+    }
+}
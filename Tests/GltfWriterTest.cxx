@@ -0,0 +1,484 @@
+// GltfWriterTest.cxx : the GLB writer, read back by a small JSON and accessor reader,
+// in float, 16 and 8 bit storage.
+
+#include "Test.h"
+
+#include "GltfWriter.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+// a value of the JSON chunk of a GLB file
+struct JsonValue
+{
+    enum EType { eNull, eBool, eNumber, eString, eArray, eObject };
+
+    EType                    mType;
+    double                   mNumber;
+    std::string              mString;
+    std::vector<JsonValue>   mItems;
+    std::vector<std::string> mKeys;         // of the items of an object
+
+    JsonValue() : mType(eNull), mNumber(0.0) {}
+
+    const JsonValue* Find(const char* pKey) const
+    {
+        for( size_t i = 0; i < mKeys.size(); i++ )
+        {
+            if( mKeys[i] == pKey ) return &mItems[i];
+        }
+        return NULL;
+    }
+
+    double GetNumber(const char* pKey, double pDefault) const
+    {
+        const JsonValue* lValue = Find(pKey);
+        return lValue && lValue->mType == eNumber ? lValue->mNumber : pDefault;
+    }
+};
+
+static void SkipBlanks(const char*& p, const char* pEnd)
+{
+    while( p < pEnd && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') ) p++;
+}
+
+static bool ParseJsonString(const char*& p, const char* pEnd, std::string& pString)
+{
+    if( p >= pEnd || *p != '"' ) return false;
+    for( p++; p < pEnd && *p != '"'; p++ )
+    {
+        if( *p != '\\' )
+        {
+            pString += *p;
+            continue;
+        }
+        if( ++p >= pEnd ) return false;
+        if( *p == 'u' )
+        {
+            if( pEnd - p < 5 ) return false;
+            pString += char(strtol(std::string(p + 1, p + 5).c_str(), NULL, 16));
+            p += 4;
+        }
+        else
+        {
+            pString += *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+        }
+    }
+    return p++ < pEnd;
+}
+
+static bool ParseJson(const char*& p, const char* pEnd, JsonValue& pValue)
+{
+    SkipBlanks(p, pEnd);
+    if( p >= pEnd ) return false;
+    if( *p == '"' )
+    {
+        pValue.mType = JsonValue::eString;
+        return ParseJsonString(p, pEnd, pValue.mString);
+    }
+    if( *p == '[' || *p == '{' )
+    {
+        bool lObject = *p++ == '{';
+        pValue.mType = lObject ? JsonValue::eObject : JsonValue::eArray;
+        SkipBlanks(p, pEnd);
+        if( p < pEnd && *p == (lObject ? '}' : ']') ) return ++p <= pEnd;
+        while( p < pEnd )
+        {
+            if( lObject )
+            {
+                pValue.mKeys.push_back(std::string());
+                SkipBlanks(p, pEnd);
+                if( !ParseJsonString(p, pEnd, pValue.mKeys.back()) ) return false;
+                SkipBlanks(p, pEnd);
+                if( p >= pEnd || *p++ != ':' ) return false;
+            }
+            pValue.mItems.push_back(JsonValue());
+            if( !ParseJson(p, pEnd, pValue.mItems.back()) ) return false;
+            SkipBlanks(p, pEnd);
+            if( p < pEnd && *p == ',' )
+            {
+                p++;
+                continue;
+            }
+            return p < pEnd && *p++ == (lObject ? '}' : ']');
+        }
+        return false;
+    }
+    const char* kLiterals[3] = { "true", "false", "null" };
+    for( int i = 0; i < 3; i++ )
+    {
+        size_t lLength = strlen(kLiterals[i]);
+        if( size_t(pEnd - p) >= lLength && strncmp(p, kLiterals[i], lLength) == 0 )
+        {
+            pValue.mType = i < 2 ? JsonValue::eBool : JsonValue::eNull;
+            pValue.mNumber = i == 0 ? 1.0 : 0.0;
+            p += lLength;
+            return true;
+        }
+    }
+    std::string lNumber;
+    while( p < pEnd && strchr("+-0123456789.eE", *p) ) lNumber += *p++;
+    pValue.mType = JsonValue::eNumber;
+    pValue.mNumber = atof(lNumber.c_str());
+    return !lNumber.empty();
+}
+
+// reads the accessors of a GLB file, with the bounds of their buffer views checked
+class GlbReader
+{
+public:
+    GlbReader(const std::vector<unsigned char>& pData) : mData(pData), mBinary(0), mBinaryBytes(0) {}
+
+    bool Parse()
+    {
+        uint32_t lHeader[5], lBinaryHeader[2];
+        if( mData.size() < sizeof(lHeader) ) return false;
+        memcpy(lHeader, &mData[0], sizeof(lHeader));
+        if( lHeader[0] != 0x46546c67u || lHeader[1] != 2u || lHeader[2] != mData.size() || lHeader[3] % 4 != 0 ||
+            lHeader[4] != 0x4e4f534au || sizeof(lHeader) + size_t(lHeader[3]) > mData.size() )
+            return false;
+
+        const char* p = (const char*)&mData[sizeof(lHeader)];
+        const char* lEnd = p + lHeader[3];
+        if( !ParseJson(p, lEnd, mJson) || mJson.mType != JsonValue::eObject ) return false;
+
+        mBinary = sizeof(lHeader) + lHeader[3] + sizeof(lBinaryHeader);
+        if( mBinary > mData.size() ) return mBinary == mData.size() + sizeof(lBinaryHeader);
+        memcpy(lBinaryHeader, &mData[mBinary - sizeof(lBinaryHeader)], sizeof(lBinaryHeader));
+        mBinaryBytes = lBinaryHeader[0];
+        const JsonValue* lBuffers = mJson.Find("buffers");
+        return lBinaryHeader[1] == 0x004e4942u && mBinary + mBinaryBytes == mData.size() && lBuffers && lBuffers->mItems.size() == 1 &&
+               lBuffers->mItems[0].GetNumber("byteLength", -1.0) == double(mBinaryBytes);
+    }
+
+    const JsonValue& GetJson() const { return mJson; }
+
+    // the accessor pIndex, false if it does not fit its buffer view or is not aligned
+    bool GetAccessor(int pIndex, const JsonValue*& pAccessor, size_t& pOffset, size_t& pStride) const
+    {
+        const JsonValue* lAccessors = mJson.Find("accessors");
+        const JsonValue* lViews = mJson.Find("bufferViews");
+        if( !lAccessors || !lViews || pIndex < 0 || pIndex >= int(lAccessors->mItems.size()) ) return false;
+        pAccessor = &lAccessors->mItems[pIndex];
+
+        int lViewIndex = int(pAccessor->GetNumber("bufferView", -1.0));
+        if( lViewIndex < 0 || lViewIndex >= int(lViews->mItems.size()) ) return false;
+        const JsonValue& lView = lViews->mItems[lViewIndex];
+
+        int lType = int(pAccessor->GetNumber("componentType", 0.0));
+        size_t lComponentSize = lType == 5126 || lType == 5125 ? 4 : lType == 5122 || lType == 5123 ? 2 : 1;
+        const JsonValue* lTypeName = pAccessor->Find("type");
+        int lComponents = !lTypeName ? 0 : lTypeName->mString == "SCALAR" ? 1 : lTypeName->mString == "VEC2" ? 2 :
+                          lTypeName->mString == "VEC3" ? 3 : lTypeName->mString == "VEC4" ? 4 : 0;
+        size_t lCount = size_t(pAccessor->GetNumber("count", 0.0));
+        size_t lViewOffset = size_t(lView.GetNumber("byteOffset", 0.0));
+        size_t lViewBytes = size_t(lView.GetNumber("byteLength", 0.0));
+        size_t lAccessorOffset = size_t(pAccessor->GetNumber("byteOffset", 0.0));
+        pStride = size_t(lView.GetNumber("byteStride", double(lComponentSize * lComponents)));
+        pOffset = mBinary + lViewOffset + lAccessorOffset;
+        return lComponents > 0 && lCount > 0 && lViewOffset + lViewBytes <= mBinaryBytes && lAccessorOffset % lComponentSize == 0 &&
+               (lView.Find("byteStride") == NULL || (pStride % 4 == 0 && lAccessorOffset % 4 == 0)) &&
+               lAccessorOffset + (lCount - 1) * pStride + lComponentSize * lComponents <= lViewBytes;
+    }
+
+    // component pComponent of element pElement of an accessor, decoded
+    double Read(const JsonValue& pAccessor, size_t pOffset, size_t pStride, size_t pElement, int pComponent) const
+    {
+        int lType = int(pAccessor.GetNumber("componentType", 0.0));
+        const JsonValue* lNormalized = pAccessor.Find("normalized");
+        bool lNormal = lNormalized && lNormalized->mNumber != 0.0;
+        const unsigned char* lValue = &mData[pOffset + pElement * pStride];
+        switch( lType )
+        {
+        case 5120: { int8_t   v; memcpy(&v, lValue + pComponent, 1);     return lNormal ? std::max(v / 127.0, -1.0) : v; }
+        case 5121: { uint8_t  v; memcpy(&v, lValue + pComponent, 1);     return lNormal ? v / 255.0 : v; }
+        case 5122: { int16_t  v; memcpy(&v, lValue + 2 * pComponent, 2); return lNormal ? std::max(v / 32767.0, -1.0) : v; }
+        case 5123: { uint16_t v; memcpy(&v, lValue + 2 * pComponent, 2); return lNormal ? v / 65535.0 : v; }
+        case 5125: { uint32_t v; memcpy(&v, lValue + 4 * pComponent, 4); return v; }
+        default:   { float    v; memcpy(&v, lValue + 4 * pComponent, 4); return v; }
+        }
+    }
+
+private:
+    const std::vector<unsigned char>& mData;
+    JsonValue                         mJson;
+    size_t                            mBinary;          // offset of the binary chunk
+    size_t                            mBinaryBytes;
+};
+
+// checks the GLB file pData of GltfScene pScene, holding the mesh of GetTestScene
+static bool IsGlbValid(const std::vector<unsigned char>& pData, const GltfScene& pScene, EGltfQuantization pQuantization, int& pVertexCount)
+{
+    GlbReader lReader(pData);
+    if( !lReader.Parse() ) return false;
+    const JsonValue& lJson = lReader.GetJson();
+    const JsonValue* lNodes = lJson.Find("nodes");
+    const JsonValue* lMeshes = lJson.Find("meshes");
+    const JsonValue* lMaterials = lJson.Find("materials");
+    if( !lNodes || lNodes->mItems.size() != pScene.mNodes.size() || !lMeshes || lMeshes->mItems.size() != 1 ||
+        !lMaterials || lMaterials->mItems.size() != pScene.mMaterials.size() )
+        return false;
+
+    // the nodes share the mesh, the identity is left out
+    for( size_t n = 0; n < pScene.mNodes.size(); n++ )
+    {
+        const JsonValue& lNode = lNodes->mItems[n];
+        const JsonValue* lMatrix = lNode.Find("matrix");
+        if( lNode.GetNumber("mesh", -1.0) != 0.0 || (n == 0) != (lMatrix == NULL) ) return false;
+        for( int i = 0; lMatrix && i < 16; i++ )
+        {
+            if( lMatrix->mItems.size() != 16 || lMatrix->mItems[i].mNumber != pScene.mNodes[n].mMatrix[i] ) return false;
+        }
+    }
+
+    // the primitives follow the mesh materials, the polygons without one first
+    const GltfMesh& lMesh = pScene.mMeshes[0];
+    const MeshView& lView = lMesh.mView;
+    const JsonValue* lPrimitives = lMeshes->mItems[0].Find("primitives");
+    int lSlotCount = int(lMesh.mMaterials.size()) + 1;
+    if( !lPrimitives || int(lPrimitives->mItems.size()) != lSlotCount ) return false;
+
+    bool lQuantized = false;
+    std::set<std::vector<int> > lKeys;
+    for( int s = 0; s < lSlotCount; s++ )
+    {
+        const JsonValue& lPrimitive = lPrimitives->mItems[s];
+        const JsonValue* lAttributes = lPrimitive.Find("attributes");
+        if( lPrimitive.GetNumber("material", -1.0) != (s > 0 ? lMesh.mMaterials[s - 1] : -1) || !lAttributes ||
+            lAttributes->mItems.size() != lMesh.mAttributes.size() + 1 )
+            return false;
+
+        const JsonValue* lIndexAccessor;
+        size_t lIndexOffset, lIndexStride;
+        if( !lReader.GetAccessor(int(lPrimitive.GetNumber("indices", -1.0)), lIndexAccessor, lIndexOffset, lIndexStride) ) return false;
+
+        // POSITION, then the attributes of the mesh
+        std::vector<const JsonValue*> lAccessors(lMesh.mAttributes.size() + 1);
+        std::vector<size_t> lOffsets(lAccessors.size()), lStrides(lAccessors.size());
+        for( size_t a = 0; a < lAccessors.size(); a++ )
+        {
+            const char* lName = a == 0 ? "POSITION" : lMesh.mAttributes[a - 1].mName.c_str();
+            const JsonValue* lIndex = lAttributes->Find(lName);
+            if( !lIndex || !lReader.GetAccessor(int(lIndex->mNumber), lAccessors[a], lOffsets[a], lStrides[a]) ) return false;
+
+            int lType = int(lAccessors[a]->GetNumber("componentType", 0.0));
+            if( a > 0 && lName[0] != '_' && lType != 5126 ) lQuantized = true;
+            // the UVs are in [0, 1], they must be quantized
+            if( a > 0 && lMesh.mAttributes[a - 1].mName == "TEXCOORD_0" &&
+                lType != (pQuantization == eGltfInt16 ? 5123 : pQuantization == eGltfInt8 ? 5121 : 5126) )
+                return false;
+            // KHR_mesh_quantization: NORMAL and TANGENT signed, COLOR_n unsigned
+            std::string lSemantic = lName;
+            if( (lSemantic == "NORMAL" || lSemantic == "TANGENT") && lType != 5126 && lType != 5120 && lType != 5122 ) return false;
+            if( lSemantic.compare(0, 6, "COLOR_") == 0 && lType != 5126 && lType != 5121 && lType != 5123 ) return false;
+        }
+        pVertexCount = int(lAccessors[0]->GetNumber("count", 0.0));
+
+        // every corner of the fanned polygons of the material, in order
+        size_t lCorner = 0;
+        size_t lIndexCount = size_t(lIndexAccessor->GetNumber("count", 0.0));
+        for( int p = 0; p < lView.mPolygonCount; p++ )
+        {
+            int lMaterial = lMesh.mPolygonMaterials[p];
+            int lSlot = lMaterial >= 0 && lMaterial < lSlotCount - 1 ? lMaterial + 1 : 0;
+            int lStart = lView.mPolygonStarts[p], lEnd = lView.mPolygonStarts[p + 1];
+            for( int i = lStart; i < lEnd; i++ )
+            {
+                std::vector<int> lKey(1, lView.mPolygonVertices[i]);
+                for( size_t a = 0; a < lMesh.mAttributes.size(); a++ )
+                {
+                    const ElementView& lElement = lMesh.mAttributes[a].mView;
+                    lKey.push_back(int((GetElementValue(lElement, p, i, lKey[0]) - lElement.mDirect) / lElement.mStride));
+                }
+                if( s == 0 ) lKeys.insert(lKey);
+            }
+            if( lSlot != s ) continue;
+
+            for( int i = lStart + 1; i + 1 < lEnd; i++ )
+            {
+                int lCorners[3] = { lStart, i, i + 1 };
+                for( int c = 0; c < 3; c++, lCorner++ )
+                {
+                    if( lCorner >= lIndexCount ) return false;
+                    double lVertex = lReader.Read(*lIndexAccessor, lIndexOffset, lIndexStride, lCorner, 0);
+                    if( lVertex < 0 || lVertex >= pVertexCount ) return false;
+
+                    int lControlPoint = lView.mPolygonVertices[lCorners[c]];
+                    for( int k = 0; k < 3; k++ )
+                    {
+                        if( lReader.Read(*lAccessors[0], lOffsets[0], lStrides[0], size_t(lVertex), k) !=
+                            double(float(lView.mPositions[size_t(lControlPoint) * lView.mPositionStride + k])) )
+                            return false;
+                    }
+                    for( size_t a = 0; a < lMesh.mAttributes.size(); a++ )
+                    {
+                        const GltfAttribute& lAttribute = lMesh.mAttributes[a];
+                        const double* lValue = GetElementValue(lAttribute.mView, p, lCorners[c], lControlPoint);
+                        int lType = int(lAccessors[a + 1]->GetNumber("componentType", 0.0));
+                        double lTolerance = lType == 5120 || lType == 5121 ? 0.5 / 127.0 : lType == 5122 || lType == 5123 ? 0.5 / 32767.0 : 1e-6;
+                        for( int k = 0; k < lAttribute.mComponents; k++ )
+                        {
+                            double lExpected = lValue[k] * lAttribute.mScale[k] + lAttribute.mOffset[k];
+                            double lRead = lReader.Read(*lAccessors[a + 1], lOffsets[a + 1], lStrides[a + 1], size_t(lVertex), k);
+                            if( std::fabs(lRead - lExpected) > lTolerance * std::max(1.0, std::fabs(lExpected)) + 1e-9 ) return false;
+                        }
+                    }
+                }
+            }
+        }
+        if( lCorner != lIndexCount ) return false;
+    }
+
+    // one vertex per distinct key, the extension declared for the quantized standard attributes
+    const JsonValue* lRequired = lJson.Find("extensionsRequired");
+    bool lDeclared = lRequired && lRequired->mItems.size() == 1 && lRequired->mItems[0].mString == "KHR_mesh_quantization";
+    return pVertexCount == int(lKeys.size()) && lQuantized == lDeclared && lQuantized == (pQuantization != eGltfFloat);
+}
+
+// component type of the attribute pName of the first primitive of the GLB file pData, 0 if it has none
+static int GetAttributeType(const std::vector<unsigned char>& pData, const char* pName)
+{
+    GlbReader lReader(pData);
+    const JsonValue* lMeshes = lReader.Parse() ? lReader.GetJson().Find("meshes") : NULL;
+    const JsonValue* lPrimitives = lMeshes && !lMeshes->mItems.empty() ? lMeshes->mItems[0].Find("primitives") : NULL;
+    const JsonValue* lAttributes = lPrimitives && !lPrimitives->mItems.empty() ? lPrimitives->mItems[0].Find("attributes") : NULL;
+    const JsonValue* lIndex = lAttributes ? lAttributes->Find(pName) : NULL;
+    const JsonValue* lAccessor;
+    size_t lOffset, lStride;
+    if( !lIndex || !lReader.GetAccessor(int(lIndex->mNumber), lAccessor, lOffset, lStride) ) return 0;
+    return int(lAccessor->GetNumber("componentType", 0.0));
+}
+
+// pMesh under two nodes, with UVs, its smooth normals and three materials, the
+// polygons of the third one having none; the UVs are filled in pUVValues
+static void GetTestScene(const SyntheticMesh& pMesh, std::vector<double>& pUVValues, std::vector<int>& pPolygonMaterials, GltfScene& pScene)
+{
+    const MeshView& lView = pMesh.mView;
+
+    // the UVs are the positions in the XZ extent of the mesh
+    double lMin[2] = { HUGE_VAL, HUGE_VAL }, lMax[2] = { -HUGE_VAL, -HUGE_VAL };
+    for( int i = 0; i < lView.mControlPointCount; i++ )
+    {
+        for( int c = 0; c < 2; c++ )
+        {
+            double v = lView.mPositions[size_t(i) * lView.mPositionStride + 2 * c];
+            lMin[c] = std::min(lMin[c], v);
+            lMax[c] = std::max(lMax[c], v);
+        }
+    }
+    pUVValues.resize(size_t(lView.mControlPointCount) * 2);
+    for( int i = 0; i < lView.mControlPointCount; i++ )
+    {
+        for( int c = 0; c < 2; c++ )
+            pUVValues[size_t(i) * 2 + c] = (lView.mPositions[size_t(i) * lView.mPositionStride + 2 * c] - lMin[c]) / std::max(lMax[c] - lMin[c], 1e-30);
+    }
+    ElementView lUVs = { eMapByControlPoint, eRefDirect, &pUVValues[0], lView.mControlPointCount, 2, NULL, 0 };
+
+    pPolygonMaterials.resize(lView.mPolygonCount);
+    for( int p = 0; p < lView.mPolygonCount; p++ ) pPolygonMaterials[p] = p % 3;
+
+    pScene.mMaterials.push_back("Skin");
+    pScene.mMaterials.push_back("Cloth");
+
+    GltfMesh lMesh;
+    lMesh.mName = "Lighting";
+    lMesh.mView = lView;
+    lMesh.mAttributes.push_back(GetGltfAttribute("NORMAL", lView.mNormals, 3, true));
+    lMesh.mAttributes.push_back(GetGltfAttribute("TEXCOORD_0", lUVs, 2, true));
+    lMesh.mAttributes.back().mScale[1]  = -1.0;
+    lMesh.mAttributes.back().mOffset[1] = 1.0;
+    lMesh.mAttributes.push_back(GetGltfAttribute("_SMOOTH_NORMAL", pMesh.mSource, 3, true));
+    lMesh.mPolygonMaterials = &pPolygonMaterials[0];
+    lMesh.mMaterials.push_back(1);
+    lMesh.mMaterials.push_back(0);
+    pScene.mMeshes.push_back(lMesh);
+
+    GltfNode lNode = { "Lighting", 0, { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } };
+    pScene.mNodes.push_back(lNode);
+    lNode.mName = "Lighting \"copy\"";
+    lNode.mMatrix[0] = lNode.mMatrix[10] = -1.0;
+    lNode.mMatrix[12] = 2.5;
+    pScene.mNodes.push_back(lNode);
+}
+
+void TestGltfWriter(const char* pDirectory)
+{
+    std::string lPath = GetTestPath(pDirectory, "gltfwritertest.glb");
+    std::string lSerialPath = GetTestPath(pDirectory, "gltfwritertest_serial.glb");
+    WorkStealingPool lPool(4);
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        std::vector<double> lUVValues;
+        std::vector<int> lPolygonMaterials;
+        GltfScene lScene;
+        GetTestScene(lMesh, lUVValues, lPolygonMaterials, lScene);
+
+        for( int q = eGltfFloat; q <= eGltfInt8; q++ )
+        {
+            SetTestCase(lDescs[d]);
+            std::string lError;
+            GltfStats lStats = { 0, 0, 0 };
+            std::vector<unsigned char> lData, lSerialData;
+            int lVertexCount = 0;
+            if( !CHECK(WriteGlb(lScene, EGltfQuantization(q), lPath.c_str(), &lPool, lError, &lStats)) ) printf("%s\n", lError.c_str());
+            CHECK(ReadTestFile(lPath, lData) && lData.size() == lStats.mFileBytes);
+            CHECK(IsGlbValid(lData, lScene, EGltfQuantization(q), lVertexCount) && lVertexCount == lStats.mVertexCount);
+
+            // the meshes built on the calling thread give the same file
+            CHECK(WriteGlb(lScene, EGltfQuantization(q), lSerialPath.c_str(), NULL, lError) && ReadTestFile(lSerialPath, lSerialData) &&
+                  lSerialData == lData);
+        }
+    }
+
+    // a flat +Y surface, and tangents with xyz >= 0 and W = +1, are in [0, 1]: NORMAL and
+    // TANGENT are still signed; COLOR_0 in [-1, 0] can't be unsigned and stays float
+    SyntheticMesh lFlat;
+    BuildSyntheticMesh(lDescs[0], lFlat);
+    int lCount = lFlat.mView.mControlPointCount;
+    std::vector<double> lFlatNormals(size_t(lCount) * 4, 0.0), lFlatTangents(size_t(lCount) * 4, 0.0), lColors(size_t(lCount) * 4, -0.5);
+    for( int i = 0; i < lCount; i++ )
+    {
+        lFlatNormals[size_t(i) * 4 + 1]  = 1.0;
+        lFlatTangents[size_t(i) * 4]     = 1.0;
+        lFlatTangents[size_t(i) * 4 + 3] = 1.0;
+    }
+    ElementView lNormalView  = { eMapByControlPoint, eRefDirect, &lFlatNormals[0], lCount, 4, NULL, 0 };
+    ElementView lTangentView = { eMapByControlPoint, eRefDirect, &lFlatTangents[0], lCount, 4, NULL, 0 };
+    ElementView lColorView   = { eMapByControlPoint, eRefDirect, &lColors[0], lCount, 4, NULL, 0 };
+
+    std::vector<double> lUVValues;
+    std::vector<int> lPolygonMaterials;
+    GltfScene lScene;
+    GetTestScene(lFlat, lUVValues, lPolygonMaterials, lScene);
+    lScene.mMeshes[0].mAttributes[0].mView = lNormalView;
+    lScene.mMeshes[0].mAttributes.push_back(GetGltfAttribute("TANGENT", lTangentView, 4, true));
+    lScene.mMeshes[0].mAttributes.push_back(GetGltfAttribute("COLOR_0", lColorView, 4, true));
+    for( int q = eGltfInt16; q <= eGltfInt8; q++ )
+    {
+        SetTestCase(lDescs[0]);
+        std::string lError;
+        std::vector<unsigned char> lData;
+        int lVertexCount = 0;
+        int lSignedType = q == eGltfInt16 ? 5122 : 5120;
+        CHECK(WriteGlb(lScene, EGltfQuantization(q), lPath.c_str(), &lPool, lError) && ReadTestFile(lPath, lData));
+        CHECK(IsGlbValid(lData, lScene, EGltfQuantization(q), lVertexCount));
+        CHECK(GetAttributeType(lData, "NORMAL") == lSignedType);
+        CHECK(GetAttributeType(lData, "TANGENT") == lSignedType);
+        CHECK(GetAttributeType(lData, "COLOR_0") == 5126);
+    }
+    remove(lSerialPath.c_str());
+    remove(lPath.c_str());
+}
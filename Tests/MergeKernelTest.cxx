@@ -0,0 +1,85 @@
+// MergeKernelTest.cxx : the merge of every instruction set against the double
+// precision formulas and against the scalar kernel.
+
+#include "Test.h"
+
+#include "MergeCore.h"
+#include "MergeKernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// documented in MergeKernel.h
+static const double kTolerance = 1e-6;
+
+// largest difference between the outputs and the double precision formulas
+static double GetMaxError(const SyntheticMesh& pMesh, int pCount, const std::vector<double>& pTangents, const std::vector<double>& pBinormals)
+{
+    const ElementView& lSource = pMesh.mSource;
+    const ElementView& lNormals = pMesh.mView.mNormals;
+
+    double lMaxError = 0.0;
+    for( int i = 0; i < pCount; i++ )
+    {
+        const double* s = lSource.mDirect + size_t(lSource.mIndex ? lSource.mIndex[i] : i) * 4;
+        const double* n = lNormals.mDirect + size_t(lNormals.mIndex ? lNormals.mIndex[i] : i) * 4;
+
+        double lLength = std::sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+        double t[3] = { s[0] / lLength, s[1] / lLength, s[2] / lLength };
+        double b[3] = { n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2], n[0] * t[1] - n[1] * t[0] };
+
+        for( int c = 0; c < 3; c++ )
+        {
+            lMaxError = std::max(lMaxError, std::fabs(pTangents[size_t(i) * 4 + c] - t[c]));
+            lMaxError = std::max(lMaxError, std::fabs(pBinormals[size_t(i) * 4 + c] - b[c]));
+        }
+    }
+    return lMaxError;
+}
+
+static double GetMaxDifference(const std::vector<double>& pA, const std::vector<double>& pB)
+{
+    double lMaxDifference = 0.0;
+    for( size_t i = 0; i < pA.size(); i++ ) lMaxDifference = std::max(lMaxDifference, std::fabs(pA[i] - pB[i]));
+    return lMaxDifference;
+}
+
+void TestMergeKernel(const char*)
+{
+    EKernelIsa lSupported = GetSupportedKernelIsa();
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        int lCount = GetElementCount(lMesh.mView, lMesh.mSource.mMapping);
+
+        std::vector<double> lScalar[2];
+        for( int i = eKernelScalar; i <= lSupported; i++ )
+        {
+            SetTestCase(lDescs[d]);
+            SetKernelIsa(EKernelIsa(i));
+
+            // in uneven ranges, so that the vector loops end on partial blocks
+            std::vector<double> lTangents(size_t(lCount) * 4), lBinormals(size_t(lCount) * 4);
+            ElementOutput lTangentOutput  = { &lTangents[0],  lCount, 4 };
+            ElementOutput lBinormalOutput = { &lBinormals[0], lCount, 4 };
+            for( int lBegin = 0; lBegin < lCount; lBegin += 1237 )
+                MergeNormals(lMesh.mView, lMesh.mSource, lTangentOutput, lBinormalOutput, 0.0, lBegin, std::min(lBegin + 1237, lCount));
+
+            CHECK(GetMaxError(lMesh, lCount, lTangents, lBinormals) <= kTolerance);
+            if( i == eKernelScalar )
+            {
+                lScalar[0].swap(lTangents);
+                lScalar[1].swap(lBinormals);
+                continue;
+            }
+            CHECK(GetMaxDifference(lTangents, lScalar[0]) <= 2.0 * kTolerance);
+            CHECK(GetMaxDifference(lBinormals, lScalar[1]) <= 2.0 * kTolerance);
+        }
+    }
+    SetKernelIsa(lSupported);
+}
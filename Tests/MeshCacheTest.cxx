@@ -0,0 +1,102 @@
+// MeshCacheTest.cxx : the merged tangents and binormals of every mesh stored in a
+// mesh cache and read back, and the entries it must refuse.
+
+#include "Test.h"
+
+#include "MeshCache.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+// fingerprint of the geometry of pMesh and of pSource
+static std::string GetMeshKey(const MeshView& pMesh, const ElementView& pSource)
+{
+    ContentHash lHash;
+    AddMeshGeometry(lHash, pMesh);
+    AddElementValues(lHash, pSource);
+    return lHash.GetDigest();
+}
+
+void TestMeshCache(const char* pDirectory)
+{
+    std::string lDirectory = GetTestPath(pDirectory, "meshcachetest");
+    WorkStealingPool lPool(4);
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SetTestCase(lDescs[d]);
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        int lCount = GetElementCount(lMesh.mView, lMesh.mSource.mMapping);
+        std::vector<double> lVectors[2], lLoaded[2];
+        std::vector<ElementOutput> lOutputs(2), lLoadOutputs(2);
+        for( int v = 0; v < 2; v++ )
+        {
+            lVectors[v].resize(size_t(lCount) * 4);
+            lLoaded[v].assign(size_t(lCount) * 4, 0.0);
+            ElementOutput lOutput = { &lVectors[v][0], lCount, 4 };
+            ElementOutput lLoadOutput = { &lLoaded[v][0], lCount, 4 };
+            lOutputs[v] = lOutput;
+            lLoadOutputs[v] = lLoadOutput;
+        }
+        MergeNormals(lMesh.mView, lMesh.mSource, lOutputs[0], lOutputs[1], 0.0, 0, lCount);
+
+        // the arrays read back have the bits of the merged ones
+        std::string lKey = GetMeshKey(lMesh.mView, lMesh.mSource);
+        if( !CHECK(OpenMeshCache(lDirectory.c_str())) ) continue;
+        CHECK(lKey == GetMeshKey(lMesh.mView, lMesh.mSource));
+        unsigned long long lEntryBytes = StoreMeshOutputs(lDirectory.c_str(), lKey, lOutputs, 1.5, &lPool);
+        double lMaxAngle = 0.0;
+        CHECK(lEntryBytes > 0 && LoadMeshOutputs(lDirectory.c_str(), lKey, lLoadOutputs, lMaxAngle));
+        for( int v = 0; v < 2; v++ )
+            CHECK(memcmp(&lLoaded[v][0], &lVectors[v][0], sizeof(double) * lVectors[v].size()) == 0);
+        CHECK(lMaxAngle == 1.5);
+
+        // one position, then one smooth normal, changed by one bit
+        std::vector<double> lPositions(lMesh.mPositions), lSmooth(lMesh.mSmoothNormals);
+        MeshView lChangedMesh = lMesh.mView;
+        ElementView lSource = lMesh.mSource;
+        lPositions[lPositions.size() / 2] = nextafter(lPositions[lPositions.size() / 2], 1e300);
+        lChangedMesh.mPositions = &lPositions[0];
+        CHECK(GetMeshKey(lChangedMesh, lMesh.mSource) != lKey);
+        lSmooth[lSmooth.size() / 2] = nextafter(lSmooth[lSmooth.size() / 2], 1e300);
+        lSource.mDirect = &lSmooth[0];
+        CHECK(GetMeshKey(lMesh.mView, lSource) != lKey);
+
+        // another stride, a missing byte, an extra byte
+        std::vector<ElementOutput> lStrided(lLoadOutputs);
+        lStrided[1].mStride = 3;
+        CHECK(!LoadMeshOutputs(lDirectory.c_str(), lKey, lStrided, lMaxAngle));
+        std::string lPath = lDirectory + "/" + lKey + ".mesh";
+        std::vector<unsigned char> lEntry;
+        std::vector<size_t> lFlips;
+        CHECK(ReadTestFile(lPath, lEntry) && lEntry.size() == lEntryBytes);
+        CHECK(CopyTestFile(lPath, lPath + ".copy", lEntry.size() - 1, lFlips) && rename((lPath + ".copy").c_str(), lPath.c_str()) == 0 &&
+              !LoadMeshOutputs(lDirectory.c_str(), lKey, lLoadOutputs, lMaxAngle));
+        lEntry.push_back(0);
+        FILE* lFile = fopen(lPath.c_str(), "wb");
+        CHECK(lFile && fwrite(&lEntry[0], 1, lEntry.size(), lFile) == lEntry.size());
+        if( lFile ) fclose(lFile);
+        CHECK(!LoadMeshOutputs(lDirectory.c_str(), lKey, lLoadOutputs, lMaxAngle));
+
+        // the temporary file of an interrupted store goes with the entry, other files stay
+        std::string lPart = lPath + ".123.4", lOther = lPath + ".bak";
+        CHECK(CopyTestFile(lPath, lPart, 0, lFlips) && CopyTestFile(lPath, lOther, 0, lFlips));
+        CHECK(ClearMeshCache(lDirectory.c_str()) == 1);
+        CHECK(remove(lPart.c_str()) != 0 && remove(lOther.c_str()) == 0);
+    }
+    rmdir(lDirectory.c_str());
+}
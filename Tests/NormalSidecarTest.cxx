@@ -0,0 +1,123 @@
+// NormalSidecarTest.cxx : the smooth normals of every mesh written to a sidecar under
+// three node paths, mapped back, and the files it must refuse.
+
+#include "Test.h"
+
+#include "NormalSidecar.h"
+#include "SyntheticFbx.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// checks that the mesh pIndex of pFile has the counts and the smooth normals of pMesh
+static bool IsSameSidecarMesh(const SyntheticMesh& pMesh, const NormalSidecarFile& pFile, int pIndex)
+{
+    const MeshView& lView = pMesh.mView;
+    const MeshView& lRead = pFile.GetMesh(pIndex);
+    const ElementView& lSource = pMesh.mSource;
+    const ElementView& lNormals = lRead.mNormals;
+    if( lRead.mControlPointCount != lView.mControlPointCount || lRead.mPolygonCount != lView.mPolygonCount ||
+        pFile.GetPolygonVertexCount(pIndex) != lView.mPolygonStarts[lView.mPolygonCount] ||
+        lNormals.mMapping != lSource.mMapping || lNormals.mReference != lSource.mReference ||
+        lNormals.mDirectCount != lSource.mDirectCount || lNormals.mStride != 3 ||
+        lNormals.mIndexCount != (lSource.mReference == eRefDirect ? 0 : lSource.mIndexCount) )
+        return false;
+    for( int i = 0; i < lSource.mDirectCount; i++ )
+    {
+        if( memcmp(lNormals.mDirect + size_t(i) * 3, lSource.mDirect + size_t(i) * lSource.mStride, sizeof(double) * 3) != 0 )
+            return false;
+    }
+    return lNormals.mIndexCount == 0 || memcmp(lNormals.mIndex, lSource.mIndex, sizeof(int) * lNormals.mIndexCount) == 0;
+}
+
+void TestNormalSidecar(const char* pDirectory)
+{
+    const int kMeshCount = 3;
+    const char* kPaths[kMeshCount] = { "Root/Smooth0", "Root/Group/Smooth1", "Root/Group/Smooth2" };
+    std::string lPath = GetTestPath(pDirectory, "normalsidecartest.nms");
+    std::string lCopy = GetTestPath(pDirectory, "normalsidecartest_damaged.nms");
+    std::string lFbxPath = GetTestPath(pDirectory, "normalsidecartest.fbx");
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SetTestCase(lDescs[d]);
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+
+        // the first mesh has its own copy of the arrays, the two others share theirs
+        std::vector<double> lValues(lMesh.mSmoothNormals);
+        std::vector<NormalSidecarMesh> lMeshes(kMeshCount);
+        for( int i = 0; i < kMeshCount; i++ )
+        {
+            lMeshes[i].mPath               = kPaths[i];
+            lMeshes[i].mControlPointCount  = lMesh.mView.mControlPointCount;
+            lMeshes[i].mPolygonCount       = lMesh.mView.mPolygonCount;
+            lMeshes[i].mPolygonVertexCount = lMesh.mView.mPolygonStarts[lMesh.mView.mPolygonCount];
+            lMeshes[i].mNormals            = lMesh.mSource;
+        }
+        lMeshes[0].mNormals.mDirect = &lValues[0];
+
+        std::string lError;
+        NormalSidecarFile lFile;
+        if( !CHECK(WriteNormalSidecar(lPath.c_str(), lMeshes, lError) && IsNormalSidecar(lPath.c_str())) ||
+            !CHECK(lFile.Open(lPath.c_str()) && lFile.GetMeshCount() == kMeshCount) )
+            continue;
+        for( int i = 0; i < kMeshCount; i++ )
+        {
+            int lIndex = lFile.FindMesh(kPaths[i]);
+            CHECK(lIndex >= 0 && lFile.GetPath(lIndex) == kPaths[i] && IsSameSidecarMesh(lMesh, lFile, lIndex));
+        }
+        CHECK(lFile.FindMesh("Root/Smooth") < 0 && lFile.FindMesh("Smooth0") < 0);
+        if( CHECK(lFile.FindMesh(kPaths[0]) >= 0 && lFile.FindMesh(kPaths[1]) >= 0 && lFile.FindMesh(kPaths[2]) >= 0) )
+        {
+            CHECK(lFile.GetMesh(lFile.FindMesh(kPaths[1])).mNormals.mDirect == lFile.GetMesh(lFile.FindMesh(kPaths[2])).mNormals.mDirect);
+            CHECK(lFile.GetMesh(lFile.FindMesh(kPaths[0])).mNormals.mDirect != lFile.GetMesh(lFile.FindMesh(kPaths[1])).mNormals.mDirect);
+        }
+        size_t lSize = lFile.GetFileSize();
+        lFile.Close();
+
+        // a path can't be given twice, a binary FBX file is not a sidecar
+        std::vector<NormalSidecarMesh> lTwice(lMeshes);
+        lTwice[2].mPath = kPaths[1];
+        CHECK(!WriteNormalSidecar(lCopy.c_str(), lTwice, lError));
+        std::vector<const SyntheticMesh*> lFbxMeshes(1, &lMesh);
+        std::vector<std::string> lNames(1, "Smooth0");
+        CHECK(WriteSyntheticFbx(lFbxPath.c_str(), 7500, false, lFbxMeshes, lNames) && !IsNormalSidecar(lFbxPath.c_str()));
+
+        // a cut file, then 16 flipped bytes: the normals of an opened file are read to the end
+        std::vector<size_t> lFlips;
+        for( int k = 0; k <= 8; k++ )
+        {
+            size_t lCut = k == 0 ? 8 : (lSize - 1) * k / 8;
+            CHECK(CopyTestFile(lPath, lCopy, lCut, lFlips) && !lFile.Open(lCopy.c_str()));
+        }
+        unsigned lRandom = 12345;
+        double lSum = 0.0;
+        for( int k = 0; k < 16; k++ )
+        {
+            lFlips.clear();
+            for( int f = 0; f < 16; f++ )
+            {
+                lRandom = lRandom * 1664525u + 1013904223u;
+                lFlips.push_back(8 + size_t(lRandom >> 8) % (lSize - 8));
+            }
+            CHECK(CopyTestFile(lPath, lCopy, lSize, lFlips));
+            if( !lFile.Open(lCopy.c_str()) ) continue;
+            for( int m = 0; m < lFile.GetMeshCount(); m++ )
+            {
+                const ElementView& lNormals = lFile.GetMesh(m).mNormals;
+                for( int i = 0; i < lNormals.mDirectCount; i++ ) lSum += lNormals.mDirect[size_t(i) * 3];
+                for( int i = 0; i < lNormals.mIndexCount; i++ ) lSum += lNormals.mIndex[i];
+            }
+            lFile.Close();
+        }
+        CHECK(lSum == lSum);
+    }
+    remove(lFbxPath.c_str());
+    remove(lCopy.c_str());
+    remove(lPath.c_str());
+}
@@ -0,0 +1,68 @@
+// PackNormalsTest.cxx : the octahedral packing of every instruction set, decoded in double.
+
+#include "Test.h"
+
+#include "MergeCore.h"
+#include "MergeKernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// largest angle, in degrees, between a packed normal and its smooth normal: 8 bits
+// stay under a degree, every bit halves the step of the grid
+static double GetPackBound(int pBits)
+{
+    return 0.6 * 256.0 / double(1 << pBits);
+}
+
+void TestPackNormals(const char*)
+{
+    EKernelIsa lSupported = GetSupportedKernelIsa();
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        int lCount = GetElementCount(lMesh.mView, lMesh.mSource.mMapping);
+
+        for( int lIsa = eKernelScalar; lIsa <= lSupported; lIsa++ )
+        for( int lBits = 8; lBits <= 16; lBits += 8 )
+        {
+            SetTestCase(lDescs[d]);
+            SetKernelIsa(EKernelIsa(lIsa));
+            std::vector<double> lPacked(size_t(lCount) * 2);
+            ElementOutput lPackedOutput = { &lPacked[0], lCount, 2 };
+            double lMaxAngle = PackNormals(lMesh.mView, lMesh.mSource, lBits, lPackedOutput, 0, lCount);
+
+            // decoded in double, and on the grid of the bit count (up to the float rounding)
+            const double lScale = double((1 << lBits) - 1);
+            bool lOnGrid = true;
+            double lMaxChord = 0.0;
+            for( int i = 0; i < lCount; i++ )
+            {
+                int lIndex = lMesh.mSource.mReference == eRefDirect ? i : lMesh.mSource.mIndex[i];
+                const double* s = lMesh.mSource.mDirect + size_t(lIndex) * lMesh.mSource.mStride;
+                const double* lValue = &lPacked[size_t(i) * 2];
+                double lLength = std::sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+
+                double n[3];
+                OctahedralDecode(lValue[0], lValue[1], n);
+                double lChord = 0.0;
+                for( int c = 0; c < 3; c++ ) lChord += (s[c] / lLength - n[c]) * (s[c] / lLength - n[c]);
+                lMaxChord = std::max(lMaxChord, std::sqrt(lChord));
+
+                for( int c = 0; c < 2; c++ )
+                    lOnGrid = lOnGrid && std::fabs(lValue[c] * lScale - std::floor(lValue[c] * lScale + 0.5)) < 1e-2;
+            }
+            double lDecodedAngle = 2.0 * std::asin(std::min(1.0, 0.5 * lMaxChord)) * 180.0 / 3.14159265358979323846;
+
+            CHECK(lOnGrid);
+            CHECK(lDecodedAngle <= GetPackBound(lBits));
+            CHECK(std::fabs(lDecodedAngle - lMaxAngle) <= 1e-3 * GetPackBound(lBits) + 1e-4);
+        }
+    }
+    SetKernelIsa(lSupported);
+}
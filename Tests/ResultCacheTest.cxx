@@ -0,0 +1,83 @@
+// ResultCacheTest.cxx : the digest of a binary FBX file and the entries of a result
+// cache sized for two copies and a half.
+
+#include "Test.h"
+
+#include "ResultCache.h"
+#include "SyntheticFbx.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+void TestResultCache(const char* pDirectory)
+{
+    std::string lPath = GetTestPath(pDirectory, "resultcachetest.fbx");
+    std::string lCopy = GetTestPath(pDirectory, "resultcachetest_copy.fbx");
+    std::string lCacheDirectory = GetTestPath(pDirectory, "resultcachetest");
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(eMapByPolygonVertex, lDescs);
+
+    CHECK(HashText("") != HashText(std::string(1, '\0')));
+    CHECK(HashText("a") == HashText("a"));
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SetTestCase(lDescs[d]);
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        std::vector<const SyntheticMesh*> lMeshes(1, &lMesh);
+        std::vector<std::string> lNames(1, "Lighting");
+
+        std::vector<unsigned char> lData, lFetched;
+        std::string lDigest, lDigest2;
+        if( !CHECK(WriteSyntheticFbx(lPath.c_str(), 7500, false, lMeshes, lNames) && ReadTestFile(lPath, lData) && lData.size() > 1) )
+            continue;
+        CHECK(HashFile(lPath.c_str(), lDigest) && HashFile(lPath.c_str(), lDigest2) && lDigest2 == lDigest);
+
+        // one flipped byte in the middle, then one byte less
+        std::vector<size_t> lFlips(1, lData.size() / 2);
+        CHECK(CopyTestFile(lPath, lCopy, lData.size(), lFlips) && HashFile(lCopy.c_str(), lDigest2) && lDigest2 != lDigest);
+        lFlips.clear();
+        CHECK(CopyTestFile(lPath, lCopy, lData.size() - 1, lFlips) && HashFile(lCopy.c_str(), lDigest2) && lDigest2 != lDigest);
+
+        // room for two entries: the third store evicts the least recently used one
+        const std::string lKeys[3] = { HashText(lDigest + "1"), HashText(lDigest + "2"), HashText(lDigest + "3") };
+        unsigned long long lMaxBytes = lData.size() * 5 / 2;
+        std::string lError;
+        {
+            ResultCache lCache;
+            CHECK(lCache.Open(lCacheDirectory.c_str(), lMaxBytes, lError));
+            lCache.Clear();
+            CHECK(lCache.Open(lCacheDirectory.c_str(), lMaxBytes, lError) && lCache.GetEntryCount() == 0);
+            CHECK(lCache.Store(lKeys[0], lPath.c_str()) && lCache.Store(lKeys[1], lPath.c_str()));
+            CHECK(lCache.Fetch(lKeys[0], lCopy.c_str()) && ReadTestFile(lCopy, lFetched) && lFetched == lData);
+
+            // an output that can't be written is a miss which keeps the entry
+            CHECK(!lCache.Fetch(lKeys[0], (lCacheDirectory + "/missing/copy.fbx").c_str()) && lCache.GetEntryCount() == 2);
+
+            CHECK(lCache.Store(lKeys[2], lPath.c_str()) && lCache.GetEntryCount() == 2);
+            CHECK(!lCache.Fetch(lKeys[1], lCopy.c_str()) && lCache.Fetch(lKeys[2], lCopy.c_str()));
+            CacheStats lStats = lCache.GetStats();
+            CHECK(lStats.mStores == 3 && lStats.mEvictions == 1 && lStats.mHits == 2 && lStats.mMisses == 2);
+        }
+        {
+            // the index keeps the entries and their order: a smaller cache keeps the last fetched
+            ResultCache lCache;
+            CHECK(lCache.Open(lCacheDirectory.c_str(), lData.size() * 3 / 2, lError) && lCache.GetEntryCount() == 1);
+            CHECK(lCache.Fetch(lKeys[2], lCopy.c_str()) && !lCache.Fetch(lKeys[0], lCopy.c_str()));
+            CHECK(ReadTestFile(lCopy, lFetched) && lFetched == lData);
+            lCache.Clear();
+        }
+    }
+    remove(lCopy.c_str());
+    remove(lPath.c_str());
+    rmdir(lCacheDirectory.c_str());
+}
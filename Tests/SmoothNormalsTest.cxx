@@ -0,0 +1,117 @@
+// SmoothNormalsTest.cxx : the smooth normals of a mesh split into one control point
+// per polygon-vertex, against a serial sum over the control points of the mesh.
+
+#include "Test.h"
+
+#include "SmoothNormals.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// serial sum of the weighted polygon normals at every control point of pMesh, normalized
+static void GetReferenceSmoothNormals(const MeshView& pMesh, ESmoothWeighting pWeighting, std::vector<double>& pNormals)
+{
+    pNormals.assign(size_t(pMesh.mControlPointCount) * 3, 0.0);
+    for( int p = 0; p < pMesh.mPolygonCount; p++ )
+    {
+        int lStart = pMesh.mPolygonStarts[p];
+        int lSize = pMesh.mPolygonStarts[p + 1] - lStart;
+        const double* lCorner[8];
+        for( int k = 0; k < lSize; k++ ) lCorner[k] = pMesh.mPositions + size_t(pMesh.mPolygonVertices[lStart + k]) * pMesh.mPositionStride;
+
+        // the sum of the cross products of the fan is the area vector of the polygon
+        double n[3] = { 0.0, 0.0, 0.0 };
+        for( int k = 1; k + 1 < lSize; k++ )
+        {
+            double u[3], v[3];
+            for( int c = 0; c < 3; c++ )
+            {
+                u[c] = lCorner[k][c] - lCorner[0][c];
+                v[c] = lCorner[k + 1][c] - lCorner[0][c];
+            }
+            n[0] += u[1] * v[2] - u[2] * v[1];
+            n[1] += u[2] * v[0] - u[0] * v[2];
+            n[2] += u[0] * v[1] - u[1] * v[0];
+        }
+        double lLength = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        for( int k = 0; k < lSize; k++ )
+        {
+            double lWeight = 1.0;
+            if( pWeighting == eWeightAngle )
+            {
+                double u[3], v[3];
+                for( int c = 0; c < 3; c++ )
+                {
+                    u[c] = lCorner[(k + lSize - 1) % lSize][c] - lCorner[k][c];
+                    v[c] = lCorner[(k + 1) % lSize][c] - lCorner[k][c];
+                }
+                double lCos = (u[0] * v[0] + u[1] * v[1] + u[2] * v[2]) /
+                              std::sqrt((u[0] * u[0] + u[1] * u[1] + u[2] * u[2]) * (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]));
+                lWeight = std::acos(std::max(-1.0, std::min(1.0, lCos))) / lLength;
+            }
+            double* lNormal = &pNormals[size_t(pMesh.mPolygonVertices[lStart + k]) * 3];
+            for( int c = 0; c < 3; c++ ) lNormal[c] += lWeight * n[c];
+        }
+    }
+
+    for( int i = 0; i < pMesh.mControlPointCount; i++ )
+    {
+        double* n = &pNormals[size_t(i) * 3];
+        double lLength = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for( int c = 0; c < 3 && lLength > 0.0; c++ ) n[c] /= lLength;
+    }
+}
+
+void TestSmoothNormals(const char*)
+{
+    WorkStealingPool lPool(4);
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(eMapByPolygonVertex, lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SetTestCase(lDescs[d]);
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        const MeshView& lView = lMesh.mView;
+        int lPolygonVertexCount = lView.mPolygonStarts[lView.mPolygonCount];
+
+        // the welding must join the split control points back
+        std::vector<double> lPositions(size_t(lPolygonVertexCount) * 4);
+        std::vector<int> lPolygonVertices(lPolygonVertexCount);
+        for( int i = 0; i < lPolygonVertexCount; i++ )
+        {
+            memcpy(&lPositions[size_t(i) * 4], lView.mPositions + size_t(lView.mPolygonVertices[i]) * lView.mPositionStride, 4 * sizeof(double));
+            lPolygonVertices[i] = i;
+        }
+
+        MeshView lSplit = lView;
+        lSplit.mPositions         = &lPositions[0];
+        lSplit.mPositionStride    = 4;
+        lSplit.mControlPointCount = lPolygonVertexCount;
+        lSplit.mPolygonVertices   = &lPolygonVertices[0];
+
+        for( int w = eWeightArea; w <= eWeightAngle; w++ )
+        {
+            std::vector<double> lNormals, lSerialNormals, lExpected;
+            ComputeSmoothNormals(lSplit, ESmoothWeighting(w), 1e-4, &lPool, lNormals);
+            ComputeSmoothNormals(lSplit, ESmoothWeighting(w), 1e-4, NULL, lSerialNormals);
+            GetReferenceSmoothNormals(lView, ESmoothWeighting(w), lExpected);
+            CHECK(lSerialNormals == lNormals);
+            if( !CHECK(lNormals.size() == size_t(lPolygonVertexCount) * 4) ) continue;
+
+            double lMaxError = 0.0;
+            for( int i = 0; i < lPolygonVertexCount; i++ )
+            {
+                const double* lExpectedNormal = &lExpected[size_t(lView.mPolygonVertices[i]) * 3];
+                for( int c = 0; c < 3; c++ )
+                    lMaxError = std::max(lMaxError, std::fabs(lNormals[size_t(i) * 4 + c] - lExpectedNormal[c]));
+            }
+            CHECK(lMaxError <= 1e-6);
+        }
+    }
+}
@@ -0,0 +1,111 @@
+// TangentSpaceTest.cxx : the tangent basis of UVs mirrored at a half column, and
+// both encodings of the smooth normals in it.
+
+#include "Test.h"
+
+#include "TangentSpace.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+void TestTangentSpace(const char*)
+{
+    WorkStealingPool lPool(4);
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(lDescs);
+
+    for( size_t d = 0; d < lDescs.size(); d++ )
+    {
+        SetTestCase(lDescs[d]);
+        SyntheticMesh lMesh;
+        BuildSyntheticMesh(lDescs[d], lMesh);
+        const MeshView& lView = lMesh.mView;
+        int lVertexCount = lView.mPolygonStarts[lView.mPolygonCount];
+
+        // U mirrored at a half column, so that no control point is on the mirror line
+        double lMirror = 0.0;
+        for( int i = 0; i < lView.mControlPointCount; i++ ) lMirror = std::max(lMirror, lView.mPositions[size_t(i) * lView.mPositionStride]);
+        lMirror = std::floor(lMirror * 0.5) + 0.5;
+
+        std::vector<double> lUVValues(size_t(lView.mControlPointCount) * 2);
+        for( int i = 0; i < lView.mControlPointCount; i++ )
+        {
+            lUVValues[size_t(i) * 2]     = std::fabs(lView.mPositions[size_t(i) * lView.mPositionStride] - lMirror);
+            lUVValues[size_t(i) * 2 + 1] = lView.mPositions[size_t(i) * lView.mPositionStride + 2];
+        }
+        ElementView lUVs = { eMapByControlPoint, eRefDirect, &lUVValues[0], lView.mControlPointCount, 2, NULL, 0 };
+
+        std::vector<double> lFrames, lSerialFrames, lTangents(size_t(lVertexCount) * 4), lBinormals(size_t(lVertexCount) * 4);
+        std::vector<double> lEncoded(size_t(lVertexCount) * 2), lColors(size_t(lVertexCount) * 4);
+        ElementOutput lTangentOutput  = { &lTangents[0], lVertexCount, 4 };
+        ElementOutput lBinormalOutput = { &lBinormals[0], lVertexCount, 4 };
+        ElementOutput lEncodedOutput  = { &lEncoded[0], lVertexCount, 2 };
+        ElementOutput lColorOutput    = { &lColors[0], lVertexCount, 4 };
+
+        ComputeTangentFrames(lView, lUVs, &lPool, lFrames);
+        ComputeTangentFrames(lView, lUVs, NULL, lSerialFrames);
+        CHECK(lSerialFrames == lFrames);
+
+        std::function<void(int, int)> lEncode = [&](int pBegin, int pEnd)
+        {
+            EncodeTangentSpace(lView, lMesh.mSource, lFrames, eEncodeXY, lTangentOutput, lBinormalOutput, 0.0, lEncodedOutput, pBegin, pEnd);
+        };
+        lPool.ParallelFor(0, lView.mPolygonCount, 1000, lEncode);
+        EncodeTangentSpace(lView, lMesh.mSource, lFrames, eEncodeColor, lTangentOutput, lBinormalOutput, 0.0, lColorOutput, 0, lView.mPolygonCount);
+
+        bool lSigned = true;
+        double lMaxError = 0.0;
+        for( int p = 0; p < lView.mPolygonCount; p++ )
+        {
+            // orientation and extent of the polygon in UV space
+            int lStart = lView.mPolygonStarts[p], lSize = lView.mPolygonStarts[p + 1] - lStart;
+            double lArea = 0.0, lMinX = 1e300, lMaxX = -1e300;
+            for( int k = 0; k < lSize; k++ )
+            {
+                const double* a = &lUVValues[size_t(lView.mPolygonVertices[lStart + k]) * 2];
+                const double* b = &lUVValues[size_t(lView.mPolygonVertices[lStart + (k + 1) % lSize]) * 2];
+                lArea += a[0] * b[1] - b[0] * a[1];
+                double x = lView.mPositions[size_t(lView.mPolygonVertices[lStart + k]) * lView.mPositionStride];
+                lMinX = std::min(lMinX, x);
+                lMaxX = std::max(lMaxX, x);
+            }
+            bool lMirrored = lMinX < lMirror && lMaxX > lMirror;
+
+            for( int i = lStart; i < lStart + lSize; i++ )
+            {
+                const double* t = &lTangents[size_t(i) * 4];
+                const double* b = &lBinormals[size_t(i) * 4];
+                const double* n = GetElementValue(lView.mNormals, p, i, lView.mPolygonVertices[i]);
+                const double* s = GetElementValue(lMesh.mSource, p, i, lView.mPolygonVertices[i]);
+                double lNormalLength = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                double lSmoothLength = std::sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+
+                // unit, orthogonal to the normal, along U with the sign of the UV orientation
+                lMaxError = std::max(lMaxError, std::fabs(std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]) - 1.0));
+                lMaxError = std::max(lMaxError, std::fabs((t[0] * n[0] + t[1] * n[1] + t[2] * n[2]) / lNormalLength));
+                if( !lMirrored )
+                {
+                    double lSide = lMinX > lMirror ? 1.0 : -1.0;
+                    lSigned = lSigned && t[0] * lSide > 0.0 && t[3] == (lArea > 0.0 ? 1.0 : -1.0);
+                }
+
+                // both encodings give the smooth normal back in the (t, b, n) basis
+                const double* e = &lEncoded[size_t(i) * 2];
+                const double* lColor = &lColors[size_t(i) * 4];
+                double z = std::sqrt(std::max(0.0, 1.0 - e[0] * e[0] - e[1] * e[1]));
+                for( int c = 0; c < 3; c++ )
+                {
+                    double lExpected = s[c] / lSmoothLength;
+                    double lDecoded = e[0] * t[c] + e[1] * b[c] + z * n[c] / lNormalLength;
+                    double lColorDecoded = (lColor[0] * 2.0 - 1.0) * t[c] + (lColor[1] * 2.0 - 1.0) * b[c] + (lColor[2] * 2.0 - 1.0) * n[c] / lNormalLength;
+                    lMaxError = std::max(lMaxError, std::max(std::fabs(lDecoded - lExpected), std::fabs(lColorDecoded - lExpected)));
+                }
+            }
+        }
+        CHECK(lSigned);
+        CHECK(lMaxError <= 1e-6);
+    }
+}
@@ -0,0 +1,84 @@
+// Test.h : checks of the FBX independent core, run by NormalMergerTests.
+//
+// Every feature has one test function, run by name:
+//
+//   NormalMergerTests <test> [directory]
+//
+// with its files written in directory (.) and removed at the end. The exit code
+// is 0 if every check passed. CMake registers every test with ctest.
+
+#pragma once
+
+#include "SyntheticMesh.h"
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct BinaryFbxMesh;
+
+// prints the failed condition with the case of SetTestCase, returns pCondition
+bool Check(
+           bool pCondition,
+           const char* pText,
+           const char* pFile,
+           int pLine
+           );
+
+#define CHECK(pCondition) Check((pCondition), #pCondition, __FILE__, __LINE__)
+
+// the case printed with the failed checks
+void SetTestCase(const std::string& pCase);
+void SetTestCase(const SyntheticMeshDesc& pDesc);
+
+// every topology, mapping and reference, at a size below and above the grain of
+// the threads and the blocks of the vector kernels
+void GetTestMeshes(std::vector<SyntheticMeshDesc>& pDescs);
+
+// one control point or polygon-vertex mesh per topology and size, for the features
+// which only look at the positions or the bytes of a file
+void GetTestMeshes(
+                   EElementMapping pMapping,
+                   std::vector<SyntheticMeshDesc>& pDescs
+                   );
+
+// pName in pDirectory
+std::string GetTestPath(
+                        const char* pDirectory,
+                        const char* pName
+                        );
+
+// the bytes of a file
+bool ReadTestFile(
+                  const std::string& pFile,
+                  std::vector<unsigned char>& pData
+                  );
+
+// copies the first pSize bytes of pFile, flipping the bytes at pFlips
+bool CopyTestFile(
+                  const std::string& pFile,
+                  const std::string& pCopy,
+                  size_t pSize,
+                  const std::vector<size_t>& pFlips
+                  );
+
+// checks that pRead holds the positions, polygons and smooth normals of pMesh
+bool IsSameMesh(
+                const SyntheticMesh& pMesh,
+                const BinaryFbxMesh& pRead
+                );
+
+// the tests, pDirectory is where their files go
+void TestMergeKernel(const char* pDirectory);
+void TestCorrespondence(const char* pDirectory);
+void TestClosestPoint(const char* pDirectory);
+void TestSmoothNormals(const char* pDirectory);
+void TestTangentSpace(const char* pDirectory);
+void TestPackNormals(const char* pDirectory);
+void TestBinaryFbx(const char* pDirectory);
+void TestBinaryFbxPatch(const char* pDirectory);
+void TestGltfWriter(const char* pDirectory);
+void TestElementCompaction(const char* pDirectory);
+void TestResultCache(const char* pDirectory);
+void TestMeshCache(const char* pDirectory);
+void TestNormalSidecar(const char* pDirectory);
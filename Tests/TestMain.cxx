@@ -0,0 +1,157 @@
+// TestMain.cxx : runs one test of the core by name.
+
+#include "Test.h"
+
+#include <cstdio>
+#include <cstring>
+
+struct TestEntry
+{
+    const char* mName;
+    void      (*mFunction)(const char* pDirectory);
+};
+
+static const TestEntry kTests[] =
+{
+    { "MergeKernel",       TestMergeKernel },
+    { "Correspondence",    TestCorrespondence },
+    { "ClosestPoint",      TestClosestPoint },
+    { "SmoothNormals",     TestSmoothNormals },
+    { "TangentSpace",      TestTangentSpace },
+    { "PackNormals",       TestPackNormals },
+    { "BinaryFbx",         TestBinaryFbx },
+    { "BinaryFbxPatch",    TestBinaryFbxPatch },
+    { "GltfWriter",        TestGltfWriter },
+    { "ElementCompaction", TestElementCompaction },
+    { "ResultCache",       TestResultCache },
+    { "MeshCache",         TestMeshCache },
+    { "NormalSidecar",     TestNormalSidecar }
+};
+
+static const int kTestCount = int(sizeof(kTests) / sizeof(kTests[0]));
+
+static int         gFailures = 0;
+static std::string gCase;
+
+bool Check(
+           bool pCondition,
+           const char* pText,
+           const char* pFile,
+           int pLine
+           )
+{
+    if( pCondition ) return true;
+
+    // the first failures of a case are enough to find it back
+    if( gFailures++ < 20 ) printf("%s:%d: %s failed (%s)\n", pFile, pLine, pText, gCase.c_str());
+    return false;
+}
+
+void SetTestCase(const std::string& pCase)
+{
+    gCase = pCase;
+}
+
+void SetTestCase(const SyntheticMeshDesc& pDesc)
+{
+    gCase = std::string(GetTopologyName(pDesc.mTopology)) + " " + GetMappingName(pDesc.mMapping) + " " +
+            GetReferenceName(pDesc.mReference) + " " + std::to_string(pDesc.mElementCount);
+}
+
+void GetTestMeshes(std::vector<SyntheticMeshDesc>& pDescs)
+{
+    const int kSizes[2] = { 1000, 40000 };
+    pDescs.clear();
+    for( int t = eTopologyTriangles; t <= eTopologyMixed; t++ )
+    for( int m = eMapByControlPoint; m <= eMapByPolygonVertex; m++ )
+    for( int r = eRefDirect; r <= eRefIndexToDirect; r++ )
+    for( int s = 0; s < 2; s++ )
+    {
+        SyntheticMeshDesc lDesc;
+        lDesc.mTopology     = ESyntheticTopology(t);
+        lDesc.mMapping      = EElementMapping(m);
+        lDesc.mReference    = EElementReference(r);
+        lDesc.mElementCount = kSizes[s];
+        pDescs.push_back(lDesc);
+    }
+}
+
+void GetTestMeshes(
+                   EElementMapping pMapping,
+                   std::vector<SyntheticMeshDesc>& pDescs
+                   )
+{
+    std::vector<SyntheticMeshDesc> lDescs;
+    GetTestMeshes(lDescs);
+    pDescs.clear();
+    for( size_t i = 0; i < lDescs.size(); i++ )
+    {
+        if( lDescs[i].mMapping == pMapping && lDescs[i].mReference == eRefDirect ) pDescs.push_back(lDescs[i]);
+    }
+}
+
+std::string GetTestPath(
+                        const char* pDirectory,
+                        const char* pName
+                        )
+{
+    return std::string(pDirectory) + "/" + pName;
+}
+
+bool ReadTestFile(
+                  const std::string& pFile,
+                  std::vector<unsigned char>& pData
+                  )
+{
+    FILE* lFile = fopen(pFile.c_str(), "rb");
+    if( lFile == NULL ) return false;
+    fseek(lFile, 0, SEEK_END);
+    pData.resize(size_t(ftell(lFile)));
+    fseek(lFile, 0, SEEK_SET);
+    bool lRead = pData.empty() || fread(&pData[0], 1, pData.size(), lFile) == pData.size();
+    fclose(lFile);
+    return lRead;
+}
+
+bool CopyTestFile(
+                  const std::string& pFile,
+                  const std::string& pCopy,
+                  size_t pSize,
+                  const std::vector<size_t>& pFlips
+                  )
+{
+    std::vector<unsigned char> lData;
+    if( !ReadTestFile(pFile, lData) || lData.size() < pSize ) return false;
+    lData.resize(pSize);
+    for( size_t i = 0; i < pFlips.size() && pSize > 0; i++ ) lData[pFlips[i] % pSize] ^= 0xff;
+
+    FILE* lFile = fopen(pCopy.c_str(), "wb");
+    if( lFile == NULL ) return false;
+    bool lWritten = lData.empty() || fwrite(&lData[0], 1, lData.size(), lFile) == lData.size();
+    return fclose(lFile) == 0 && lWritten;
+}
+
+int main(int argc, char** argv)
+{
+    const TestEntry* lTest = NULL;
+    for( int i = 0; i < kTestCount && argc >= 2; i++ )
+    {
+        if( strcmp(argv[1], kTests[i].mName) == 0 ) lTest = &kTests[i];
+    }
+    if( lTest == NULL || argc > 3 )
+    {
+        printf("usage: NormalMergerTests <test> [directory]\ntests:");
+        for( int i = 0; i < kTestCount; i++ ) printf(" %s", kTests[i].mName);
+        printf("\n");
+        return 1;
+    }
+
+    lTest->mFunction(argc == 3 ? argv[2] : ".");
+    if( gFailures > 0 )
+    {
+        printf("%s: %d checks failed\n", lTest->mName, gFailures);
+        return 1;
+    }
+    printf("%s: passed\n", lTest->mName);
+    return 0;
+}